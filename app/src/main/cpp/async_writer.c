@@ -0,0 +1,534 @@
+/* fallocate */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define WRITER_URING
+#endif
+#endif
+
+#include "async_writer.h"
+
+#define WRITER_ALIGN    4096
+
+typedef struct writer_patch {
+    struct writer_patch *next;
+    int64_t offset;
+    size_t  len;
+    unsigned char data[];
+} writer_patch;
+
+#if defined(WRITER_URING)
+typedef struct {
+    int     fd;
+    void   *sq_ring;
+    size_t  sq_size;
+    void   *cq_ring;
+    size_t  cq_size;
+    struct io_uring_sqe *sqes;
+    size_t  sqes_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+} uring;
+#endif
+
+struct async_writer {
+    int     fd;
+    int     seekable;
+    int64_t start;              /* position of fd when opened */
+    int64_t offset;             /* of the next chunk, writer thread only */
+    int64_t queued;             /* end of what was queued, producer only */
+    int     reserved;           /* preallocated past queued, truncate when done */
+    writer_patch *patches;      /* oldest first */
+    writer_patch **patches_end;
+
+    unsigned char *chunk[WRITER_CHUNKS];
+    size_t  len[WRITER_CHUNKS];
+    unsigned head;              /* chunks queued, advanced by the producer */
+    unsigned tail;              /* chunks written, advanced by the writer thread */
+    size_t  fill;               /* bytes in chunk[head % WRITER_CHUNKS] */
+    sem_t   ready;              /* one per queued chunk, and one to stop */
+    sem_t   space;              /* free chunks besides the one being filled */
+
+    int     error;              /* errno of the first failed write */
+    int     abort;
+    int64_t written;
+
+    pthread_t thread;
+    int     running;
+    int     finished;
+
+#if defined(WRITER_URING)
+    uring   ring;
+    int     use_ring;
+    int64_t chunk_offset[WRITER_CHUNKS];
+    int     done[WRITER_CHUNKS];
+#endif
+};
+
+static unsigned load_index(const unsigned *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void store_index(unsigned *p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static int load_flag(const int *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void set_error(async_writer *w, int err) {
+    int expected = 0;
+    __atomic_compare_exchange_n(&w->error, &expected, err, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void wait_sem(sem_t *sem) {
+    while (sem_wait(sem) < 0 && errno == EINTR) {
+    }
+}
+
+static int write_all(async_writer *w, const unsigned char *buf, size_t len, int64_t offset) {
+    while (len > 0) {
+        ssize_t n = w->seekable ? pwrite(w->fd, buf, len, (off_t)offset) : write(w->fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Chunk slot written out (or dropped after an error). */
+static void write_slot(async_writer *w, int slot) {
+    size_t const len = w->len[slot];
+
+    if (!load_flag(&w->abort) && !load_flag(&w->error)) {
+        if (write_all(w, w->chunk[slot], len, w->offset) < 0) {
+            set_error(w, errno);
+        } else {
+            __atomic_add_fetch(&w->written, (int64_t)len, __ATOMIC_RELAXED);
+        }
+    }
+    w->offset += (int64_t)len;
+}
+
+static void *writer_main(void *arg) {
+    async_writer *w = (async_writer *)arg;
+
+    for (;;) {
+        wait_sem(&w->ready);
+        unsigned const t = w->tail;
+        if (t == load_index(&w->head)) {
+            break;
+        }
+        write_slot(w, (int)(t % WRITER_CHUNKS));
+        store_index(&w->tail, t + 1);
+        sem_post(&w->space);
+    }
+    return NULL;
+}
+
+#if defined(WRITER_URING)
+
+static int uring_setup(uring *u, unsigned entries) {
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    memset(u, 0, sizeof(*u));
+    u->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (u->fd < 0) {
+        return -1;
+    }
+    u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sq_ring = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                      IORING_OFF_SQ_RING);
+    u->cq_ring = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                      IORING_OFF_CQ_RING);
+    u->sqes = (struct io_uring_sqe *)mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sq_ring == MAP_FAILED || u->cq_ring == MAP_FAILED || (void *)u->sqes == MAP_FAILED) {
+        if (u->sq_ring != MAP_FAILED) {
+            munmap(u->sq_ring, u->sq_size);
+        }
+        if (u->cq_ring != MAP_FAILED) {
+            munmap(u->cq_ring, u->cq_size);
+        }
+        if ((void *)u->sqes != MAP_FAILED) {
+            munmap(u->sqes, u->sqes_size);
+        }
+        close(u->fd);
+        memset(u, 0, sizeof(*u));
+        return -1;
+    }
+    u->sq_tail = (unsigned *)((char *)u->sq_ring + p.sq_off.tail);
+    u->sq_mask = (unsigned *)((char *)u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)((char *)u->sq_ring + p.sq_off.array);
+    u->cq_head = (unsigned *)((char *)u->cq_ring + p.cq_off.head);
+    u->cq_tail = (unsigned *)((char *)u->cq_ring + p.cq_off.tail);
+    u->cq_mask = (unsigned *)((char *)u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)((char *)u->cq_ring + p.cq_off.cqes);
+    return 0;
+}
+
+static void uring_teardown(uring *u) {
+    munmap(u->sqes, u->sqes_size);
+    munmap(u->cq_ring, u->cq_size);
+    munmap(u->sq_ring, u->sq_size);
+    close(u->fd);
+}
+
+static int uring_submit_write(async_writer *w, int slot) {
+    uring *u = &w->ring;
+    unsigned const tail = *u->sq_tail;
+    unsigned const index = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = w->fd;
+    sqe->addr = (uint64_t)(uintptr_t)w->chunk[slot];
+    sqe->len = (uint32_t)w->len[slot];
+    sqe->off = (uint64_t)w->chunk_offset[slot];
+    sqe->user_data = (uint64_t)slot;
+    u->sq_array[index] = index;
+    store_index(u->sq_tail, tail + 1);
+
+    while (syscall(__NR_io_uring_enter, u->fd, 1, 0, 0, NULL, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Waits for at least one write; returns how many completed. */
+static int uring_reap(async_writer *w) {
+    uring *u = &w->ring;
+    int reaped = 0;
+
+    while (syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+        if (errno != EINTR) {
+            break;
+        }
+    }
+    unsigned head = *u->cq_head;
+    while (head != load_index(u->cq_tail)) {
+        const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        int const slot = (int)cqe->user_data;
+        int const res = cqe->res;
+        size_t const len = w->len[slot];
+
+        if (res == -EINVAL || res == -EOPNOTSUPP) {
+            w->use_ring = 0;    /* kernel without IORING_OP_WRITE */
+        }
+        /* failed or short: the rest with pwrite, which reports the error if there is one */
+        size_t const done = res > 0 ? (size_t)res : 0;
+        if (done == len || write_all(w, w->chunk[slot] + done, len - done,
+                                     w->chunk_offset[slot] + (int64_t)done) == 0) {
+            __atomic_add_fetch(&w->written, (int64_t)len, __ATOMIC_RELAXED);
+        } else {
+            set_error(w, errno);
+        }
+        w->done[slot] = 1;
+        head++;
+        reaped++;
+    }
+    store_index(u->cq_head, head);
+    return reaped;
+}
+
+static void *uring_main(void *arg) {
+    async_writer *w = (async_writer *)arg;
+    unsigned next = w->tail;    /* next chunk to take */
+    int inflight = 0;
+    int stopping = 0;
+
+    for (;;) {
+        while (!stopping && inflight < WRITER_CHUNKS) {
+            if (inflight == 0) {
+                wait_sem(&w->ready);
+            } else if (sem_trywait(&w->ready) < 0) {
+                break;
+            }
+            if (next == load_index(&w->head)) {
+                stopping = 1;
+                break;
+            }
+            int const slot = (int)(next % WRITER_CHUNKS);
+            w->chunk_offset[slot] = w->offset;
+            if (load_flag(&w->abort) || load_flag(&w->error)) {
+                w->offset += (int64_t)w->len[slot];
+                w->done[slot] = 1;
+            } else if (!w->use_ring || uring_submit_write(w, slot) < 0) {
+                write_slot(w, slot);
+                w->done[slot] = 1;
+            } else {
+                w->offset += (int64_t)w->len[slot];
+                inflight++;
+            }
+            next++;
+        }
+        if (inflight > 0) {
+            inflight -= uring_reap(w);
+        }
+        /* chunks go back in order, the producer fills them in order */
+        unsigned t = w->tail;
+        while (t != next && w->done[t % WRITER_CHUNKS]) {
+            w->done[t % WRITER_CHUNKS] = 0;
+            store_index(&w->tail, ++t);
+            sem_post(&w->space);
+        }
+        if (stopping && inflight == 0 && t == next) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+#endif
+
+static void free_writer(async_writer *w) {
+    for (int i = 0; i < WRITER_CHUNKS; ++i) {
+        free(w->chunk[i]);
+    }
+    while (w->patches != NULL) {
+        writer_patch *next = w->patches->next;
+        free(w->patches);
+        w->patches = next;
+    }
+    sem_destroy(&w->ready);
+    sem_destroy(&w->space);
+    free(w);
+}
+
+async_writer *async_writer_open(int fd) {
+    async_writer *w = (async_writer *)calloc(1, sizeof(*w));
+    void *(*thread_main)(void *) = writer_main;
+
+    if (w == NULL) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    w->fd = fd;
+    w->patches_end = &w->patches;
+    sem_init(&w->ready, 0, 0);
+    sem_init(&w->space, 0, WRITER_CHUNKS - 1);
+    off_t const position = lseek(fd, 0, SEEK_CUR);
+    w->seekable = position >= 0;
+    w->start = w->seekable ? (int64_t)position : 0;
+    w->offset = w->start;
+    w->queued = w->offset;
+    for (int i = 0; i < WRITER_CHUNKS; ++i) {
+        void *buf = NULL;
+        if (posix_memalign(&buf, WRITER_ALIGN, WRITER_CHUNK) != 0) {
+            free_writer(w);
+            close(fd);
+            errno = ENOMEM;
+            return NULL;
+        }
+        w->chunk[i] = (unsigned char *)buf;
+    }
+
+#if defined(WRITER_URING)
+    if (w->seekable && uring_setup(&w->ring, WRITER_CHUNKS) == 0) {
+        w->use_ring = 1;
+        thread_main = uring_main;
+    }
+#endif
+    int const err = pthread_create(&w->thread, NULL, thread_main, w);
+    if (err != 0) {
+#if defined(WRITER_URING)
+        if (thread_main == uring_main) {
+            uring_teardown(&w->ring);
+        }
+#endif
+        free_writer(w);
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    w->running = 1;
+    return w;
+}
+
+/* Hands the chunk being filled to the writer thread and takes the next one. */
+static void queue_chunk(async_writer *w) {
+    w->len[w->head % WRITER_CHUNKS] = w->fill;
+    store_index(&w->head, w->head + 1);
+    sem_post(&w->ready);
+    w->fill = 0;
+}
+
+int async_writer_write(async_writer *w, const void *data, size_t len) {
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    if (w->finished || !w->running) {
+        errno = EBADF;
+        return -1;
+    }
+    while (len > 0) {
+        int const err = load_flag(&w->error);
+        if (err != 0) {
+            errno = err;
+            return -1;
+        }
+        size_t n = WRITER_CHUNK - w->fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(w->chunk[w->head % WRITER_CHUNKS] + w->fill, bytes, n);
+        w->fill += n;
+        w->queued += (int64_t)n;
+        bytes += n;
+        len -= n;
+        if (w->fill == WRITER_CHUNK) {
+            queue_chunk(w);
+            wait_sem(&w->space);
+        }
+    }
+    return 0;
+}
+
+int async_writer_reserve(async_writer *w, int64_t len) {
+    if (w->finished || len <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!w->seekable) {
+        errno = ESPIPE;
+        return -1;
+    }
+    /* KEEP_SIZE leaves the file size to the writes; where only mode 0 is
+     * taken, the size is set ahead and finish cuts it back */
+    int result = fallocate(w->fd, FALLOC_FL_KEEP_SIZE, (off_t)w->queued, (off_t)len);
+    if (result < 0 && errno == EOPNOTSUPP) {
+        result = fallocate(w->fd, 0, (off_t)w->queued, (off_t)len);
+    }
+    if (result < 0) {
+        return -1;
+    }
+    w->reserved = 1;
+    return 0;
+}
+
+int async_writer_patch(async_writer *w, int64_t offset, const void *data, size_t len) {
+    if (w->finished || offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!w->seekable) {
+        errno = ESPIPE;
+        return -1;
+    }
+    writer_patch *patch = (writer_patch *)malloc(sizeof(*patch) + len);
+    if (patch == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    patch->next = NULL;
+    patch->offset = offset;
+    patch->len = len;
+    memcpy(patch->data, data, len);
+    *w->patches_end = patch;
+    w->patches_end = &patch->next;
+    return 0;
+}
+
+/* Cuts a file that a mode-0 fallocate made longer back to the bytes the
+ * thread wrote, which after an abort is less than was queued. Called after
+ * the join; chunks are dropped only from the first error or abort on. */
+static int cut_reserved(async_writer *w) {
+    if (!w->reserved) {
+        return 0;
+    }
+    return ftruncate(w->fd, (off_t)(w->start + w->written));
+}
+
+/* Lets the writer thread run out of queued chunks and exit. */
+static void stop_thread(async_writer *w) {
+    if (!w->running) {
+        return;
+    }
+    sem_post(&w->ready);
+    pthread_join(w->thread, NULL);
+    w->running = 0;
+#if defined(WRITER_URING)
+    if (w->ring.sq_ring != NULL) {
+        uring_teardown(&w->ring);
+        w->ring.sq_ring = NULL;
+        w->use_ring = 0;
+    }
+#endif
+}
+
+int64_t async_writer_finish(async_writer *w, int sync) {
+    if (w->finished) {
+        errno = EBADF;
+        return -1;
+    }
+    w->finished = 1;
+    if (w->running && w->fill > 0) {
+        queue_chunk(w);
+    }
+    stop_thread(w);
+
+    int err = load_flag(&w->error);
+    for (const writer_patch *patch = w->patches; err == 0 && patch != NULL; patch = patch->next) {
+        if (write_all(w, patch->data, patch->len, patch->offset) < 0) {
+            err = errno;
+        }
+    }
+    if (cut_reserved(w) < 0 && err == 0) {
+        err = errno;
+    }
+    if (err == 0 && sync && fsync(w->fd) < 0 && errno != EINVAL) {
+        err = errno;
+    }
+    if (close(w->fd) < 0 && err == 0 && errno != EINTR) {
+        err = errno;
+    }
+    w->fd = -1;
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return w->written;
+}
+
+void async_writer_close(async_writer *w) {
+    if (w == NULL) {
+        return;
+    }
+    if (!w->finished) {
+        __atomic_store_n(&w->abort, 1, __ATOMIC_RELEASE);
+        stop_thread(w);
+        (void)cut_reserved(w);
+        close(w->fd);
+    }
+    free_writer(w);
+}
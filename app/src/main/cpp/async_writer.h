@@ -0,0 +1,64 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Output stage for the encoder: owns the target fd and writes it on a
+ * thread of its own, so a stall of the storage does not stop encoding.
+ *
+ * async_writer_write copies into WRITER_CHUNK buffers of a single
+ * producer / single consumer ring and only waits when all of them are
+ * queued. The writer thread writes whole chunks at chunk-aligned
+ * offsets. On Linux hosts it keeps several in flight with io_uring; on
+ * Android, where apps may not use io_uring, it uses pwrite, and write on
+ * fds that cannot seek.
+ */
+
+#define WRITER_CHUNK    (256 * 1024)
+#define WRITER_CHUNKS   8
+
+typedef struct async_writer async_writer;
+
+/* Takes fd, also on failure (closes it then). NULL with errno. */
+async_writer *async_writer_open(int fd);
+
+/*
+ * Queues len bytes. -1 with errno if an earlier write failed; the bytes
+ * are dropped then, and async_writer_finish reports the same error.
+ */
+int async_writer_write(async_writer *w, const void *data, size_t len);
+
+/*
+ * Allocates len bytes of the file past what was queued so far, so the
+ * filesystem can give the file one contiguous run of clusters instead of
+ * growing it chunk by chunk. Only a hint: -1 with errno if the fd or the
+ * filesystem cannot preallocate. async_writer_finish, or
+ * async_writer_close without it, cuts the file back to what was written.
+ */
+int async_writer_reserve(async_writer *w, int64_t len);
+
+/*
+ * Has len bytes written at offset after everything queued, for headers
+ * that are known only at the end (ID3 TLEN, the LAME Info frame) and were
+ * written as placeholders. async_writer_finish applies them in order.
+ * -1 with errno, ESPIPE on fds that cannot seek.
+ */
+int async_writer_patch(async_writer *w, int64_t offset, const void *data, size_t len);
+
+/*
+ * Writes out what is queued, fsyncs the fd if sync is set and closes it.
+ * Returns the bytes written, or -1 with errno of the first error. w is
+ * still to be freed with async_writer_close.
+ */
+int64_t async_writer_finish(async_writer *w, int sync);
+
+/*
+ * If not finished: stops the thread without waiting for queued bytes,
+ * cuts a reserved file back to the bytes written and closes the fd. Frees
+ * w. The partial file stays; the caller deletes it if it is not wanted.
+ */
+void async_writer_close(async_writer *w);
+
+#endif
@@ -0,0 +1,264 @@
+/*
+ * Shared pieces of the host benchmarks: the test corpus and opening an
+ * encoder the way lamejni does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "bench.h"
+
+double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Deterministic noise, so the synthetic corpus is identical on every run. */
+static uint32_t rng_state;
+
+static float noise(void) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (float)((int32_t)rng_state) * (1.0f / 2147483648.0f);
+}
+
+/* ----------------------------------------------------------------------
+ * synthetic corpus
+ * ---------------------------------------------------------------------- */
+
+/* Voiced syllables: a glottal pulse train through two moving formants,
+ * with short pauses and unvoiced fricatives in between. */
+static float gen_speech(double t, int rate, float *state) {
+    double const syl = fmod(t, 0.25);
+    double const f0 = 110.0 + 30.0 * sin(2.0 * M_PI * 0.7 * t);
+    double const f1 = 500.0 + 300.0 * sin(2.0 * M_PI * 3.1 * t);
+    double const f2 = 1500.0 + 700.0 * sin(2.0 * M_PI * 2.3 * t + 1.0);
+    float v;
+
+    if (fmod(t, 2.0) > 1.7) {
+        return 0.0005f * noise();                   /* pause */
+    }
+    if (syl > 0.2) {
+        return 0.08f * noise();                     /* fricative */
+    }
+    state[0] += (float)(f0 / rate);
+    if (state[0] >= 1.0f) {
+        state[0] -= 1.0f;
+    }
+    v = state[0] < 0.1f ? 1.0f : 0.0f;
+    v = (float)(v * (0.6 * sin(2.0 * M_PI * f1 * t) + 0.3 * sin(2.0 * M_PI * f2 * t)));
+    return v * (float)sin(M_PI * syl / 0.2) * 0.7f;
+}
+
+/* Sustained chords with harmonics, a bass line and a little noise. */
+static float gen_music(double t, int rate, float *state) {
+    static const double chords[4][3] = {
+        {261.63, 329.63, 392.00}, {220.00, 261.63, 329.63},
+        {174.61, 220.00, 261.63}, {196.00, 246.94, 293.66}
+    };
+    int const c = (int)(t / 2.0) & 3;
+    double v = 0.0;
+
+    (void)rate;
+    (void)state;
+    for (int n = 0; n < 3; ++n) {
+        for (int h = 1; h <= 6; ++h) {
+            v += sin(2.0 * M_PI * chords[c][n] * h * t) / (h * h);
+        }
+    }
+    v += 0.8 * sin(2.0 * M_PI * chords[c][0] * 0.25 * t);
+    return (float)(0.18 * v) + 0.01f * noise();
+}
+
+/* Mostly digital silence with a short tone burst every three seconds. */
+static float gen_silence(double t, int rate, float *state) {
+    double const p = fmod(t, 3.0);
+
+    (void)rate;
+    (void)state;
+    if (p < 0.3) {
+        return (float)(0.4 * sin(2.0 * M_PI * 440.0 * t) * sin(M_PI * p / 0.3));
+    }
+    return 0.0f;
+}
+
+/* Drum machine: noise snares, decaying kick sweeps and hi-hat clicks. */
+static float gen_transient(double t, int rate, float *state) {
+    double const beat = fmod(t, 0.5);
+    double const hat = fmod(t, 0.125);
+    double v = 0.0;
+
+    (void)rate;
+    (void)state;
+    if (fmod(t, 1.0) < 0.5) {
+        v += 0.9 * sin(2.0 * M_PI * (50.0 + 100.0 * exp(-beat * 30.0)) * beat) * exp(-beat * 12.0);
+    } else {
+        v += 0.7 * noise() * exp(-beat * 25.0);
+    }
+    v += 0.25 * noise() * exp(-hat * 300.0);
+    return (float)v;
+}
+
+typedef float (*generator)(double t, int rate, float *state);
+
+static const struct {
+    const char *name;
+    generator gen;
+} synthetic[] = {
+    {"speech", gen_speech},
+    {"music", gen_music},
+    {"silence", gen_silence},
+    {"transient", gen_transient},
+};
+
+static void clip_set_float(bench_clip *clip) {
+    long const n = clip->frames * clip->channels;
+    clip->f32 = (float *)malloc(sizeof(float) * (size_t)(n > 0 ? n : 1));
+    if (clip->f32 == NULL) {
+        return;
+    }
+    for (long i = 0; i < n; ++i) {
+        clip->f32[i] = clip->s16[i] * (1.0f / 32768.0f);
+    }
+}
+
+int bench_make_synthetic(bench_clip *clip, int which, int rate, double seconds) {
+    float state[4] = {0};
+
+    memset(clip, 0, sizeof(*clip));
+    snprintf(clip->name, sizeof(clip->name), "%s", synthetic[which].name);
+    clip->sample_rate = rate;
+    clip->channels = 1;
+    clip->frames = (long)(seconds * rate);
+    clip->s16 = (short *)malloc(sizeof(short) * (size_t)clip->frames);
+    if (clip->s16 == NULL) {
+        return -1;
+    }
+    rng_state = 0x1234567u + (uint32_t)which;
+    for (long i = 0; i < clip->frames; ++i) {
+        float v = synthetic[which].gen((double)i / rate, rate, state);
+        v = v > 1.0f ? 1.0f : (v < -1.0f ? -1.0f : v);
+        clip->s16[i] = (short)lrintf(v * 32767.0f);
+    }
+    clip_set_float(clip);
+    return clip->f32 != NULL ? 0 : -1;
+}
+
+/* ----------------------------------------------------------------------
+ * file corpus: RIFF WAVE, 16-bit PCM or 32-bit float, any channel count
+ * ---------------------------------------------------------------------- */
+
+static unsigned rd16(const unsigned char *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned long rd32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+int bench_load_wav(bench_clip *clip, const char *path) {
+    FILE *f = fopen(path, "rb");
+    unsigned char hdr[12], ck[8], fmt[16];
+    int format = 0, bits = 0, have_fmt = 0;
+    const char *base;
+
+    memset(clip, 0, sizeof(*clip));
+    if (f == NULL) {
+        return -1;
+    }
+    if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+        fclose(f);
+        return -1;
+    }
+    while (fread(ck, 1, 8, f) == 8) {
+        unsigned long const len = rd32(ck + 4);
+        if (!memcmp(ck, "fmt ", 4) && len >= 16) {
+            if (fread(fmt, 1, 16, f) != 16) {
+                break;
+            }
+            format = rd16(fmt);
+            clip->channels = rd16(fmt + 2);
+            clip->sample_rate = (int)rd32(fmt + 4);
+            bits = rd16(fmt + 14);
+            have_fmt = 1;
+            fseek(f, (long)(len - 16 + (len & 1)), SEEK_CUR);
+        } else if (!memcmp(ck, "data", 4) && have_fmt) {
+            int const bytes = bits / 8;
+            long n;
+            unsigned char *raw;
+
+            if (clip->channels <= 0 || !((format == 1 && bits == 16) || (format == 3 && bits == 32))) {
+                break;
+            }
+            clip->frames = (long)(len / (unsigned long)(bytes * clip->channels));
+            n = clip->frames * clip->channels;
+            raw = (unsigned char *)malloc((size_t)(n * bytes));
+            clip->s16 = (short *)malloc(sizeof(short) * (size_t)n);
+            if (raw == NULL || clip->s16 == NULL || fread(raw, (size_t)bytes, (size_t)n, f) != (size_t)n) {
+                free(raw);
+                break;
+            }
+            for (long i = 0; i < n; ++i) {
+                if (format == 1) {
+                    clip->s16[i] = (short)rd16(raw + 2 * i);
+                } else {
+                    union { uint32_t u; float f; } v;
+                    float x;
+                    v.u = (uint32_t)rd32(raw + 4 * i);
+                    x = v.f > 1.0f ? 1.0f : (v.f < -1.0f ? -1.0f : v.f);
+                    /* what MediaCodecMp3Converter.encodeFloatsAsShorts does */
+                    clip->s16[i] = (short)(int)(x * 32767.0f);
+                }
+            }
+            free(raw);
+            fclose(f);
+            base = strrchr(path, '/');
+            snprintf(clip->name, sizeof(clip->name), "file:%s", base ? base + 1 : path);
+            clip_set_float(clip);
+            return clip->f32 != NULL ? 0 : -1;
+        } else {
+            fseek(f, (long)(len + (len & 1)), SEEK_CUR);
+        }
+    }
+    fclose(f);
+    free(clip->s16);
+    clip->s16 = NULL;
+    return -1;
+}
+
+int bench_synthetic_count(void) {
+    return (int)(sizeof(synthetic) / sizeof(synthetic[0]));
+}
+
+void bench_clip_free(bench_clip *clip) {
+    free(clip->s16);
+    free(clip->f32);
+    clip->s16 = NULL;
+    clip->f32 = NULL;
+}
+
+/* ----------------------------------------------------------------------
+ * encoding, the lamejni way
+ * ---------------------------------------------------------------------- */
+
+lame_t bench_open_encoder(const lame_api *api, int sample_rate) {
+    lame_t gfp = api->init();
+    if (gfp == NULL) {
+        return NULL;
+    }
+    api->set_num_channels(gfp, 1);
+    api->set_in_samplerate(gfp, sample_rate);
+    api->set_out_samplerate(gfp, sample_rate);
+    api->set_brate(gfp, BENCH_BITRATE);
+    api->set_quality(gfp, BENCH_QUALITY);
+    api->set_mode(gfp, MONO);
+    api->set_VBR(gfp, vbr_off);
+    if (api->init_params(gfp) < 0) {
+        api->close(gfp);
+        return NULL;
+    }
+    return gfp;
+}
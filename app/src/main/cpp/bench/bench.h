@@ -0,0 +1,34 @@
+#ifndef LAME_BENCH_H
+#define LAME_BENCH_H
+
+#include "lame_api.h"
+
+/* What MediaCodecMp3Converter opens the encoder with. */
+#define BENCH_BITRATE 128
+#define BENCH_QUALITY 6
+
+typedef struct {
+    char name[96];
+    int sample_rate;
+    int channels;
+    long frames;
+    short *s16;         /* interleaved */
+    float *f32;         /* interleaved, same samples scaled to [-1, 1) */
+} bench_clip;
+
+double bench_now(void);
+
+/* Deterministic synthetic clips: speech, music, silence-heavy and
+ * transient-heavy, in that order. Mono, at any sample rate. */
+int bench_synthetic_count(void);
+int bench_make_synthetic(bench_clip *clip, int which, int rate, double seconds);
+
+/* RIFF WAVE, 16-bit PCM or 32-bit float, any channel count. */
+int bench_load_wav(bench_clip *clip, const char *path);
+
+void bench_clip_free(bench_clip *clip);
+
+/* Mono CBR encoder with the app's settings, in rate = out rate. */
+lame_t bench_open_encoder(const lame_api *api, int sample_rate);
+
+#endif
@@ -0,0 +1,226 @@
+/*
+ * Kernel fixtures recorded from real encodes, shared by lame_kbench and
+ * lame_simd_check.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fixtures.h"
+
+#define KB_MAGIC 0x46424b4cu    /* "LKBF" */
+#define KB_VERSION 1
+#define KB_STORED_SIZE offsetof(kb_frame, xrpow)
+
+/* Everything the kernels need that a frame does not carry itself. */
+static void derive_frame(kb_frame *f) {
+    f->npairs = 0;
+    for (int gr = 0; gr < 2; ++gr) {
+        gr_info *const gi = &f->gi[gr];
+        FLOAT max = 0;
+
+        gi->xr = f->xr[gr];
+        gi->sfb_partition_table = NULL;
+        for (int i = 0; i < 576; ++i) {
+            f->xrpow[gr][i] = (FLOAT)pow(fabs(f->xr[gr][i]), 0.75);
+            if (max < f->xrpow[gr][i]) {
+                max = f->xrpow[gr][i];
+            }
+        }
+        gi->xrpow_max = max;
+    }
+
+    /* A putbits2 stream shaped like the big_values region: one write per
+     * pair of quantized values, long enough for both plus sign bits. */
+    for (int i = 0; i + 1 < f->gi[0].big_values && f->npairs < KB_MAX_PAIRS; i += 2) {
+        int const x = abs(f->gi[0].l3_enc[i]), y = abs(f->gi[0].l3_enc[i + 1]);
+        int bits = 1;
+        while ((1 << bits) <= (x | y)) {
+            ++bits;
+        }
+        bits = 2 * bits + (x != 0) + (y != 0);
+        f->put_bits[f->npairs] = bits;
+        f->put_val[f->npairs] = ((x << (bits / 2)) | y) & ((1 << bits) - 1);
+        ++f->npairs;
+    }
+}
+
+/* xmin 20 dB below the band energy, a typical masking distance. */
+static void set_xmin(kb_frame *f, int gr) {
+    gr_info const *const gi = &f->gi[gr];
+    int j = 0;
+
+    for (int sfb = 0; sfb < gi->psymax && sfb < SFBMAX; ++sfb) {
+        FLOAT en = 0;
+        for (int l = 0; l < gi->width[sfb] && j < 576; ++l, ++j) {
+            en += f->xr[gr][j] * f->xr[gr][j];
+        }
+        f->xmin[gr][sfb] = 0.01f * en + 1e-20f;
+    }
+}
+
+static int record_clip(kb_fixtures *fx, const kb_variant *v, const bench_clip *clip, int want) {
+    lame_t gfp = bench_open_encoder(&v->k->api, clip->sample_rate);
+    lame_internal_flags *gfc;
+    short mono[1152];
+    long pos;
+    int got = 0, stride;
+    unsigned char *mp3buf = (unsigned char *)malloc(LAME_MAXMP3BUFFER);
+
+    if (gfp == NULL || mp3buf == NULL) {
+        free(mp3buf);
+        return -1;
+    }
+    gfc = v->k->internal_flags(gfp);
+    stride = (int)(clip->frames / 1152 / (want > 0 ? want : 1));
+    stride = stride > 0 ? stride : 1;
+    for (pos = 0; pos + 1152 <= clip->frames && got < want; pos += 1152) {
+        int const n = (int)(pos / 1152);
+
+        for (int i = 0; i < 1152; ++i) {
+            int sum = 0;
+            for (int ch = 0; ch < clip->channels; ++ch) {
+                sum += clip->s16[(pos + i) * clip->channels + ch];
+            }
+            mono[i] = (short)(sum / clip->channels);
+        }
+        if (v->k->api.encode_buffer(gfp, mono, NULL, 1152, mp3buf, LAME_MAXMP3BUFFER) < 0) {
+            break;
+        }
+        if (n >= 4 && n % stride == 0) {
+            kb_frame *const f = &fx->frame[fx->count];
+            memset(f, 0, sizeof(*f));
+            memcpy(f->mfbuf, gfc->sv_enc.mfbuf[0], sizeof(f->mfbuf));
+            memcpy(f->fftenergy, gfc->scratch->fftenergy, sizeof(f->fftenergy));
+            for (int gr = 0; gr < 2; ++gr) {
+                f->gi[gr] = gfc->l3_side.tt[gr][0];
+                memcpy(f->xr[gr], gfc->l3_side.xr[gr][0], sizeof(f->xr[gr]));
+                set_xmin(f, gr);
+            }
+            derive_frame(f);
+            ++fx->count;
+            ++got;
+        }
+    }
+    v->k->api.close(gfp);
+    free(mp3buf);
+    return got;
+}
+
+int kb_record(kb_fixtures *fx, const kb_variant *v, char *const *wav, int nwav, int want) {
+    int const nclips = nwav > 0 ? nwav : bench_synthetic_count();
+
+    fx->count = 0;
+    fx->frame = (kb_frame *)calloc((size_t)(nclips * want), sizeof(*fx->frame));
+    if (fx->frame == NULL) {
+        return -1;
+    }
+    for (int c = 0; c < nclips; ++c) {
+        bench_clip clip;
+        int const ok = nwav > 0 ? bench_load_wav(&clip, wav[c])
+                                : bench_make_synthetic(&clip, c, 44100, 30.0);
+        if (ok < 0) {
+            fprintf(stderr, "fixtures: cannot read %s (16-bit PCM or float WAV)\n",
+                    nwav > 0 ? wav[c] : "corpus");
+            return -1;
+        }
+        if (clip.sample_rate != 44100) {
+            fprintf(stderr, "fixtures: %s: fixtures are recorded at 44100 Hz\n", clip.name);
+            bench_clip_free(&clip);
+            return -1;
+        }
+        record_clip(fx, v, &clip, want);
+        bench_clip_free(&clip);
+    }
+    return fx->count > 0 ? 0 : -1;
+}
+
+int kb_save(const kb_fixtures *fx, const char *path) {
+    FILE *f = fopen(path, "wb");
+    unsigned hdr[4] = {KB_MAGIC, KB_VERSION, (unsigned)KB_STORED_SIZE, (unsigned)fx->count};
+    int ok;
+
+    if (f == NULL) {
+        return -1;
+    }
+    ok = fwrite(hdr, sizeof(hdr), 1, f) == 1;
+    for (int i = 0; ok && i < fx->count; ++i) {
+        ok = fwrite(&fx->frame[i], KB_STORED_SIZE, 1, f) == 1;
+    }
+    return fclose(f) == 0 && ok ? 0 : -1;
+}
+
+int kb_load(kb_fixtures *fx, const char *path) {
+    FILE *f = fopen(path, "rb");
+    unsigned hdr[4];
+
+    if (f == NULL) {
+        return -1;
+    }
+    if (fread(hdr, sizeof(hdr), 1, f) != 1 || hdr[0] != KB_MAGIC || hdr[1] != KB_VERSION
+        || hdr[2] != (unsigned)KB_STORED_SIZE) {
+        fprintf(stderr, "fixtures: %s was recorded by a different build\n", path);
+        fclose(f);
+        return -1;
+    }
+    fx->frame = (kb_frame *)calloc(hdr[3] > 0 ? hdr[3] : 1, sizeof(*fx->frame));
+    if (fx->frame == NULL) {
+        fclose(f);
+        return -1;
+    }
+    for (fx->count = 0; fx->count < (int)hdr[3]; ++fx->count) {
+        if (fread(&fx->frame[fx->count], KB_STORED_SIZE, 1, f) != 1) {
+            break;
+        }
+        derive_frame(&fx->frame[fx->count]);
+    }
+    fclose(f);
+    return fx->count > 0 ? 0 : -1;
+}
+
+void kb_free(kb_fixtures *fx) {
+    free(fx->frame);
+    fx->frame = NULL;
+    fx->count = 0;
+}
+
+int kb_open_variant(kb_variant *v, const lame_kernels *k) {
+    const lame_api *const api = &k->api;
+
+    memset(v, 0, sizeof(*v));
+    v->k = k;
+    v->gfp = bench_open_encoder(api, 44100);
+    v->gfp_resample = api->init();
+    if (v->gfp == NULL || v->gfp_resample == NULL) {
+        return -1;
+    }
+    api->set_num_channels(v->gfp_resample, 1);
+    api->set_in_samplerate(v->gfp_resample, 48000);
+    api->set_out_samplerate(v->gfp_resample, 44100);
+    api->set_brate(v->gfp_resample, BENCH_BITRATE);
+    api->set_quality(v->gfp_resample, BENCH_QUALITY);
+    api->set_mode(v->gfp_resample, MONO);
+    if (api->init_params(v->gfp_resample) < 0) {
+        return -1;
+    }
+    v->gfc = k->internal_flags(v->gfp);
+    v->gfc_resample = k->internal_flags(v->gfp_resample);
+    /* putbits2 must never run into a frame header here */
+    v->gfc->sv_enc.header[v->gfc->sv_enc.w_ptr].write_timing = 0x7fffffff;
+    return 0;
+}
+
+void kb_close_variant(kb_variant *v) {
+    if (v->gfp != NULL) {
+        v->k->api.close(v->gfp);
+    }
+    if (v->gfp_resample != NULL) {
+        v->k->api.close(v->gfp_resample);
+    }
+}
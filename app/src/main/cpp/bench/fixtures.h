@@ -0,0 +1,53 @@
+#ifndef LAME_BENCH_FIXTURES_H
+#define LAME_BENCH_FIXTURES_H
+
+#include "bench.h"
+#include "lame_kernels.h"
+
+#define KB_MAX_VARIANTS 3
+#define KB_MAX_PAIRS 288
+
+/* One frame recorded from a real encode (mono, two granules): the sample
+ * window, the granule spectra and quantizer state, the long block FFT
+ * energies, plus what the kernels need derived from those. */
+typedef struct {
+    sample_t mfbuf[MFSIZE];
+    FLOAT xr[2][576];
+    gr_info gi[2];
+    FLOAT fftenergy[HBLKSIZE];
+    FLOAT xmin[2][SFBMAX];
+
+    /* derived on load, not stored */
+    FLOAT xrpow[2][576];
+    int npairs;
+    int put_val[KB_MAX_PAIRS];
+    int put_bits[KB_MAX_PAIRS];
+} kb_frame;
+
+typedef struct {
+    kb_frame *frame;
+    int count;
+} kb_fixtures;
+
+/* One kernel table with the encoders its kernels run on: the app's
+ * settings at 44.1 kHz, and 48 -> 44.1 kHz for the resampler. */
+typedef struct {
+    const lame_kernels *k;
+    lame_t gfp;
+    lame_t gfp_resample;
+    lame_internal_flags *gfc;
+    lame_internal_flags *gfc_resample;
+} kb_variant;
+
+int kb_open_variant(kb_variant *v, const lame_kernels *k);
+void kb_close_variant(kb_variant *v);
+
+/* Records `want` frames per clip by encoding with v: the WAV files given,
+ * or the synthetic corpus if there are none. Prints its own errors. */
+int kb_record(kb_fixtures *fx, const kb_variant *v, char *const *wav, int nwav, int want);
+
+int kb_save(const kb_fixtures *fx, const char *path);
+int kb_load(kb_fixtures *fx, const char *path);
+void kb_free(kb_fixtures *fx);
+
+#endif
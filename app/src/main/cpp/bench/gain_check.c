@@ -0,0 +1,342 @@
+/*
+ * gain_check: is mp3_gain lossless, and does it leave the stream valid?
+ *
+ * Encodes a few streams with libmp3lame (mono CBR as the converter writes
+ * them, joint stereo with frame CRCs, MPEG-2 VBR), each with its LAME Info
+ * frame patched in as LamePcmEncoder does, and applies +n and then -n
+ * steps, and the other way round. After the first edit every granule's
+ * global_gain must have moved by n, every frame CRC must check and the
+ * LAME tag's music and tag CRCs must hold; after the second the file must
+ * be byte for byte the one encoded. The CRCs are recomputed here, not
+ * with the encoder's functions that mp3_stream.c uses.
+ *
+ * Prints one line per case; the exit status is 1 if any fails.
+ *
+ *   gain_check
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "lame.h"
+#include "mp3_stream.h"
+
+#define CHECK_SECONDS 3
+
+typedef struct {
+    const char *name;
+    int channels;
+    int sample_rate;
+    int protect;        /* frame CRCs */
+    int vbr;
+} gain_case;
+
+typedef struct {
+    long offset;
+    long size;
+    int version;        /* 1 or 2 (2.5 counts as 2) */
+    int mono;
+    int protect;
+} frame_info;
+
+static int temp_file(void) {
+    char path[] = "/tmp/gain_checkXXXXXX";
+    int const fd = mkstemp(path);
+
+    if (fd >= 0) {
+        unlink(path);
+    }
+    return fd;
+}
+
+static int write_all(int fd, const unsigned char *data, long size) {
+    return write(fd, data, (size_t)size) == (ssize_t)size ? 0 : -1;
+}
+
+/* The stream LamePcmEncoder would write for c: frames, then the Info frame
+ * over the placeholder at the start. Returns the file size, -1 on error. */
+static long encode(int fd, const gain_case *c) {
+    int const frames = c->sample_rate * CHECK_SECONDS;
+    int const chunk = 1152 * 8;
+    short *pcm = (short *)malloc(sizeof(short) * (size_t)chunk * 2);
+    unsigned char *mp3 = (unsigned char *)malloc((size_t)chunk * 2 + 7200);
+    unsigned char tag[2880];
+    unsigned seed = 1;
+    long total = 0;
+    size_t tag_size;
+    int n, ok = pcm != NULL && mp3 != NULL;
+    lame_t gfp = lame_init();
+
+    if (gfp == NULL) {
+        ok = 0;
+    } else {
+        lame_set_num_channels(gfp, c->channels);
+        lame_set_in_samplerate(gfp, c->sample_rate);
+        lame_set_out_samplerate(gfp, c->sample_rate);
+        lame_set_mode(gfp, c->channels == 1 ? MONO : JOINT_STEREO);
+        lame_set_error_protection(gfp, c->protect);
+        if (c->vbr) {
+            lame_set_VBR(gfp, vbr_default);
+            lame_set_VBR_quality(gfp, 4);
+        } else {
+            lame_set_brate(gfp, 128);
+        }
+        lame_set_quality(gfp, 6);
+        ok = ok && lame_init_params(gfp) >= 0;
+    }
+    for (int done = 0; ok && done < frames; done += chunk) {
+        int const len = frames - done < chunk ? frames - done : chunk;
+
+        /* a swept tone in noise, with quiet stretches */
+        for (int i = 0; i < len; ++i) {
+            double const t = (double)(done + i) / c->sample_rate;
+            double const level = fmod(t, 1.0) < 0.8 ? 8000.0 : 40.0;
+            for (int ch = 0; ch < c->channels; ++ch) {
+                seed = seed * 1103515245u + 12345u;
+                pcm[i * c->channels + ch] = (short)(level * sin(2 * M_PI * (200 + 900 * t) * t
+                                                                + ch)
+                                                    + (int)(seed >> 20) % 1500 - 750);
+            }
+        }
+        n = c->channels == 1
+            ? lame_encode_buffer(gfp, pcm, NULL, len, mp3, chunk * 2 + 7200)
+            : lame_encode_buffer_interleaved(gfp, pcm, len, mp3, chunk * 2 + 7200);
+        ok = n >= 0 && write_all(fd, mp3, n) == 0;
+        total += n;
+    }
+    if (ok) {
+        n = lame_encode_flush(gfp, mp3, chunk * 2 + 7200);
+        ok = n >= 0 && write_all(fd, mp3, n) == 0;
+        total += n;
+    }
+    if (ok) {
+        tag_size = lame_get_lametag_frame(gfp, tag, sizeof(tag));
+        ok = tag_size > 0 && tag_size <= sizeof(tag)
+             && pwrite(fd, tag, tag_size, 0) == (ssize_t)tag_size;
+    }
+    if (gfp != NULL) {
+        lame_close(gfp);
+    }
+    free(pcm);
+    free(mp3);
+    return ok ? total : -1;
+}
+
+/* ----------------------------------------------------------------------
+ * the checks, on the file in memory
+ * ---------------------------------------------------------------------- */
+
+static int read_file(int fd, unsigned char *buf, long size) {
+    return pread(fd, buf, (size_t)size, 0) == (ssize_t)size ? 0 : -1;
+}
+
+/* Layer III frames back to back from offset 0; the count, or -1 if the
+ * file is not made of whole frames. */
+static int frames_of(const unsigned char *d, long size, frame_info *out, int max) {
+    static const int kbps[2][16] = {
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}
+    };
+    static const int rates[4][3] = {
+        {11025, 12000, 8000}, {0, 0, 0}, {22050, 24000, 16000}, {44100, 48000, 32000}
+    };
+    long pos = 0;
+    int n = 0;
+
+    while (pos < size) {
+        const unsigned char *h = d + pos;
+        int vbits, rate, br;
+
+        if (n == max || pos + 4 > size || h[0] != 0xFF || (h[1] & 0xE6) != 0xE2) {
+            return -1;
+        }
+        vbits = (h[1] >> 3) & 3;
+        br = kbps[vbits != 3][h[2] >> 4];
+        rate = rates[vbits][(h[2] >> 2) & 3];
+        if (br == 0 || rate == 0) {
+            return -1;
+        }
+        out[n].offset = pos;
+        out[n].version = vbits == 3 ? 1 : 2;
+        out[n].size = (vbits == 3 ? 144000L : 72000L) * br / rate + ((h[2] >> 1) & 1);
+        out[n].mono = (h[3] >> 6) == 3;
+        out[n].protect = !(h[1] & 1);
+        pos += out[n++].size;
+    }
+    return pos == size ? n : -1;
+}
+
+static int side_bytes(const frame_info *f) {
+    return f->version == 1 ? (f->mono ? 17 : 32) : (f->mono ? 9 : 17);
+}
+
+/* ISO 11172-3 CRC-16 over the header's last two bytes and the side info */
+static int frame_crc_ok(const unsigned char *frame, const frame_info *f) {
+    unsigned crc = 0xFFFF;
+    int const n = side_bytes(f);
+
+    for (int i = 0; i < 2 + n; ++i) {
+        unsigned const byte = frame[i < 2 ? 2 + i : 4 + i];
+        for (int b = 7; b >= 0; --b) {
+            unsigned const top = ((crc >> 15) ^ (byte >> b)) & 1;
+            crc = (crc << 1) & 0xFFFF;
+            if (top) {
+                crc ^= 0x8005;
+            }
+        }
+    }
+    return crc == (((unsigned)frame[4] << 8) | frame[5]);
+}
+
+/* The CRC-16 of the LAME tag (reflected 0x8005, from 0) */
+static unsigned lame_crc(unsigned crc, const unsigned char *data, long size) {
+    for (long i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; ++b) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+static int global_gain(const unsigned char *frame, const frame_info *f, int k) {
+    const unsigned char *side = frame + (f->protect ? 6 : 4);
+    int const first = f->version == 1 ? (f->mono ? 18 : 20) + 21 : (f->mono ? 9 : 10) + 21;
+    int const bit = first + k * (f->version == 1 ? 59 : 63);
+    unsigned const window = ((unsigned)side[bit >> 3] << 8) | side[(bit >> 3) + 1];
+
+    return (int)((window >> (8 - (bit & 7))) & 0xFF);
+}
+
+static int granules(const frame_info *f) {
+    return (f->version == 1 ? 2 : 1) * (f->mono ? 1 : 2);
+}
+
+/* Frame CRCs, the LAME tag and, against the original, the gains; prints
+ * what fails. */
+static int check_stream(const char *name, const unsigned char *orig, const unsigned char *d,
+                        const frame_info *frames, int nframes, long size, int steps) {
+    const unsigned char *const info = d;
+    const unsigned char *tag = NULL;
+    int ok = 1;
+
+    for (int i = 1; i < nframes; ++i) {
+        const frame_info *f = &frames[i];
+        if (f->protect && !frame_crc_ok(d + f->offset, f)) {
+            printf("%s: %+d: frame %d CRC does not check\n", name, steps, i);
+            return 0;
+        }
+        for (int k = 0; k < granules(f); ++k) {
+            if (global_gain(d + f->offset, f, k) != global_gain(orig + f->offset, f, k) + steps) {
+                printf("%s: %+d: frame %d granule %d global_gain %d, was %d\n", name, steps, i, k,
+                       global_gain(d + f->offset, f, k), global_gain(orig + f->offset, f, k));
+                return 0;
+            }
+        }
+    }
+    for (long p = 4; p + 4 <= frames[0].size; ++p) {
+        if (!memcmp(info + p, "Info", 4) || !memcmp(info + p, "Xing", 4)) {
+            tag = info + p;
+            break;
+        }
+    }
+    if (tag == NULL) {
+        printf("%s: %+d: no Info frame\n", name, steps);
+        return 0;
+    }
+    /* "Info", flags, frames, bytes, TOC, VBR scale: LAME writes all four */
+    tag += 4 + 4 + 4 + 4 + 100 + 4;
+    if (lame_crc(0, info, tag + 34 - info) != (((unsigned)tag[34] << 8) | tag[35])) {
+        printf("%s: %+d: LAME tag CRC does not check\n", name, steps);
+        ok = 0;
+    }
+    if (lame_crc(0, d + frames[0].size, size - frames[0].size)
+        != (((unsigned)tag[32] << 8) | tag[33])) {
+        printf("%s: %+d: music CRC does not check\n", name, steps);
+        ok = 0;
+    }
+    return ok;
+}
+
+static int run_case(const gain_case *c, int steps) {
+    char name[96];
+    unsigned char *orig = NULL, *d = NULL;
+    frame_info *frames = NULL;
+    int nframes, max_frames, ok = 0;
+    long size, edited;
+    int const fd = temp_file();
+
+    snprintf(name, sizeof(name), "%s, %+d %+d", c->name, steps, -steps);
+    if (fd < 0 || (size = encode(fd, c)) <= 0) {
+        printf("%s: encode failed\n", name);
+        goto done;
+    }
+    max_frames = (int)(size / 48) + 1;
+    orig = (unsigned char *)malloc((size_t)size);
+    d = (unsigned char *)malloc((size_t)size);
+    frames = (frame_info *)malloc(sizeof(*frames) * (size_t)max_frames);
+    if (orig == NULL || d == NULL || frames == NULL || read_file(fd, orig, size) < 0) {
+        printf("%s: out of memory\n", name);
+        goto done;
+    }
+    nframes = frames_of(orig, size, frames, max_frames);
+    if (nframes < 2 || !check_stream(name, orig, orig, frames, nframes, size, 0)) {
+        printf("%s: encoded stream does not check\n", name);
+        goto done;
+    }
+
+    edited = mp3_gain(fd, steps);
+    if (edited != nframes - 1) {
+        printf("%s: %+d edited %ld of %d frames\n", name, steps, edited, nframes - 1);
+        goto done;
+    }
+    if (read_file(fd, d, size) < 0 || frames_of(d, size, frames, max_frames) != nframes
+        || !check_stream(name, orig, d, frames, nframes, size, steps)) {
+        goto done;
+    }
+
+    edited = mp3_gain(fd, -steps);
+    if (edited != nframes - 1 || read_file(fd, d, size) < 0) {
+        printf("%s: %+d failed\n", name, -steps);
+        goto done;
+    }
+    if (memcmp(d, orig, (size_t)size) != 0) {
+        long i = 0;
+        while (d[i] == orig[i]) {
+            ++i;
+        }
+        printf("%s: not the original, first difference at byte %ld\n", name, i);
+        goto done;
+    }
+    ok = 1;
+
+done:
+    printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+    free(orig);
+    free(d);
+    free(frames);
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+int main(void) {
+    static const gain_case cases[] = {
+        {"mono 44.1 kHz CBR", 1, 44100, 0, 0},
+        {"joint stereo 48 kHz CBR, frame CRCs", 2, 48000, 1, 0},
+        {"mono 22.05 kHz VBR, frame CRCs", 1, 22050, 1, 1},
+        {"joint stereo 24 kHz VBR", 2, 24000, 0, 1},
+    };
+    static const int steps[] = {1, -4, 12};
+    int ok = 1;
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); ++s) {
+            ok &= run_case(&cases[i], steps[s]);
+        }
+    }
+    return ok ? 0 : 1;
+}
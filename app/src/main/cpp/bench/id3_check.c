@@ -0,0 +1,185 @@
+/*
+ * id3_check: does the tag the converter writes survive its own patching?
+ *
+ * MediaCodecMp3Converter writes the tag with id3_write, a blank TLEN as
+ * the last text frame, and once the length is known overwrites the last
+ * TLEN_FRAME_SIZE bytes of the tag with the real frame, or with zeros if
+ * the length stays unknown. This does the same on a temporary file, with
+ * and without a cover streamed from another file, and checks that the
+ * cover bytes are untouched, that TLEN reads back, and that id3_read still
+ * finds the title and the picture where they are.
+ *
+ * Prints one line per case; the exit status is 1 if any fails.
+ *
+ *   id3_check
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "id3_reader.h"
+#include "id3_writer.h"
+
+#define TLEN_DIGITS     10
+#define TLEN_FRAME_SIZE (10 + 1 + 2 + 2 * TLEN_DIGITS)
+#define COVER_BYTES     100000
+#define AUDIO_BYTES     4096
+
+static int fd_sink(void *arg, const void *data, size_t len) {
+    return write(*(const int *)arg, data, len) == (ssize_t)len ? 0 : -1;
+}
+
+static int temp_file(void) {
+    char path[] = "/tmp/id3_checkXXXXXX";
+    int const fd = mkstemp(path);
+
+    if (fd >= 0) {
+        unlink(path);
+    }
+    return fd;
+}
+
+static void set_text(id3_text_frame *frame, const char *id, const char *text, uint16_t *units) {
+    long n = (long)strlen(text);
+
+    for (long i = 0; i < n; ++i) {
+        units[i] = (unsigned char)text[i];
+    }
+    memcpy(frame->id, id, 5);
+    frame->text = units;
+    frame->length = n;
+}
+
+/* The converter's tlenFrame(): the real frame, or zeros if length_ms < 0. */
+static void tlen_frame(long length_ms, unsigned char *frame) {
+    char digits[TLEN_DIGITS + 1];
+
+    memset(frame, 0, TLEN_FRAME_SIZE);
+    if (length_ms < 0) {
+        return;
+    }
+    snprintf(digits, sizeof(digits), "%010ld", length_ms);
+    memcpy(frame, "TLEN", 4);
+    frame[7] = TLEN_FRAME_SIZE - 10;
+    frame[10] = 1;
+    frame[11] = 0xff;
+    frame[12] = 0xfe;
+    for (int i = 0; i < TLEN_DIGITS; ++i) {
+        frame[13 + 2 * i] = (unsigned char)digits[i];
+    }
+}
+
+/* Text of frame id in the ID3v2.3 tag at buf as ASCII, "" if missing. */
+static void find_text(const unsigned char *buf, long size, const char *id, char *out, int max) {
+    long p = 10;
+
+    out[0] = 0;
+    while (p + 10 <= size && buf[p] != 0) {
+        long const body = ((long)buf[p + 4] << 24) | ((long)buf[p + 5] << 16)
+                          | ((long)buf[p + 6] << 8) | buf[p + 7];
+        if (!memcmp(buf + p, id, 4)) {
+            int n = 0;
+            for (long i = p + 13; i + 1 < p + 10 + body && n < max - 1; i += 2) {
+                out[n++] = (char)buf[i];
+            }
+            out[n] = 0;
+            return;
+        }
+        p += 10 + body;
+    }
+}
+
+static int run_case(const char *name, int cover_fd, const unsigned char *cover, long length_ms) {
+    uint16_t units[3][32];
+    id3_text_frame frames[3];
+    id3_picture picture = { "image/jpeg", 3, cover_fd, 0, COVER_BYTES, NULL };
+    unsigned char patch[TLEN_FRAME_SIZE], *file;
+    char tlen[32], expected[32];
+    id3_info info;
+    long tag_size, file_size;
+    int ok = 1;
+    int const fd = temp_file();
+
+    set_text(&frames[0], "TIT2", "Title", units[0]);
+    set_text(&frames[1], "TPE1", "Artist", units[1]);
+    set_text(&frames[2], "TLEN", "0000000000", units[2]);
+    if (fd < 0) {
+        perror("id3_check");
+        return 0;
+    }
+    tag_size = id3_write(frames, 3, cover_fd >= 0 ? &picture : NULL, fd_sink, (void *)&fd);
+    file = (unsigned char *)calloc(1, (size_t)(tag_size > 0 ? tag_size : 0) + AUDIO_BYTES);
+    if (tag_size <= 0 || file == NULL || write(fd, file, AUDIO_BYTES) != AUDIO_BYTES) {
+        printf("%s: write failed\n", name);
+        free(file);
+        close(fd);
+        return 0;
+    }
+    tlen_frame(length_ms, patch);
+    if (pwrite(fd, patch, TLEN_FRAME_SIZE, tag_size - TLEN_FRAME_SIZE) != TLEN_FRAME_SIZE) {
+        ok = 0;
+    }
+    file_size = tag_size + AUDIO_BYTES;
+    if (pread(fd, file, (size_t)file_size, 0) != file_size) {
+        ok = 0;
+    }
+
+    if (id3_read(fd, &info) < 0 || info.text_length[ID3_TITLE] != 5) {
+        printf("%s: title not read back\n", name);
+        ok = 0;
+    }
+    if (cover_fd >= 0) {
+        if (info.picture_type != 3 || info.picture_length != COVER_BYTES || info.picture_offset < 0
+            || memcmp(file + info.picture_offset, cover, COVER_BYTES) != 0) {
+            printf("%s: cover damaged\n", name);
+            ok = 0;
+        }
+    }
+    find_text(file, tag_size, "TLEN", tlen, sizeof(tlen));
+    if (length_ms >= 0) {
+        snprintf(expected, sizeof(expected), "%010ld", length_ms);
+    } else {
+        expected[0] = 0;
+    }
+    if (strcmp(tlen, expected) != 0) {
+        printf("%s: TLEN \"%s\", expected \"%s\"\n", name, tlen, expected);
+        ok = 0;
+    }
+    printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+    free(file);
+    close(fd);
+    return ok;
+}
+
+int main(void) {
+    unsigned char *cover = (unsigned char *)malloc(COVER_BYTES);
+    int const cover_fd = temp_file();
+    int ok = 1;
+
+    if (cover == NULL || cover_fd < 0) {
+        perror("id3_check");
+        return 1;
+    }
+    for (long i = 0; i < COVER_BYTES; ++i) {
+        cover[i] = (unsigned char)(i * 7 + (i >> 8));
+    }
+    cover[0] = 0xff;
+    cover[1] = 0xd8;
+    cover[COVER_BYTES - 2] = 0xff;  /* EOI, what a misplaced patch hits first */
+    cover[COVER_BYTES - 1] = 0xd9;
+    if (write(cover_fd, cover, COVER_BYTES) != COVER_BYTES) {
+        perror("id3_check");
+        return 1;
+    }
+
+    ok &= run_case("cover, length", cover_fd, cover, 183456);
+    ok &= run_case("cover, unknown length", cover_fd, cover, -1);
+    ok &= run_case("no cover, length", -1, cover, 5000);
+    ok &= run_case("no cover, unknown length", -1, cover, -1);
+
+    close(cover_fd);
+    free(cover);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lame_kernels.h"
+#include "fft.h"
+#include "newmdct.h"
+#include "lame_global_flags.h"
+#if defined(LAME_KERNELS_SSE)
+#include "vector/lame_intrin.h"
+#endif
+
+void kernel_fht(FLOAT *fz, int n);
+void kernel_window_subband(const sample_t *x1, FLOAT a[SBLIMIT]);
+void kernel_init_xrpow_core(gr_info *cod_info, FLOAT xrpow[576], int upper, FLOAT *sum);
+void kernel_quantize_xrpow(const FLOAT *xp, int *pi, FLOAT istep, gr_info const *cod_info,
+                           calc_noise_data const *prev_noise);
+int kernel_choose_table(const int *ix, const int *end, int *s);
+int kernel_fill_buffer_resample(lame_internal_flags *gfc, sample_t *outbuf, int desired_len,
+                                sample_t const *inbuf, int len, int *num_used, int ch);
+void kernel_compute_masking_l(lame_internal_flags *gfc, const FLOAT fftenergy[HBLKSIZE],
+                              FLOAT eb_l[CBANDS], FLOAT thr[CBANDS], int chn);
+void kernel_putbits2(lame_internal_flags *gfc, const int *val, const int *bits, int n);
+void kernel_find_scalefacs(gr_info const *gi, const FLOAT *xr34, const FLOAT *l3_xmin,
+                           int sf[SFBMAX]);
+int kernel_outer_loop(lame_internal_flags *gfc, gr_info *cod_info, const FLOAT *l3_xmin,
+                      FLOAT xrpow[576], int targ_bits);
+
+static lame_internal_flags *internal_flags(lame_t gfp) {
+    return gfp != NULL ? gfp->internal_flags : NULL;
+}
+
+#define LAME_KERNELS_INIT(NAME, FHT, INIT_XRPOW_CORE) { \
+    NAME, \
+    LAME_API_INIT, \
+    internal_flags, \
+    lame_set_findReplayGain, \
+    lame_get_RadioGain, \
+    FHT, \
+    fft_long, \
+    fft_short, \
+    kernel_window_subband, \
+    mdct_sub48, \
+    INIT_XRPOW_CORE, \
+    kernel_quantize_xrpow, \
+    count_bits, \
+    kernel_choose_table, \
+    calc_noise, \
+    kernel_fill_buffer_resample, \
+    kernel_compute_masking_l, \
+    kernel_putbits2, \
+    kernel_find_scalefacs, \
+    kernel_outer_loop \
+}
+
+#if defined(LAME_NO_SIMD)
+
+__attribute__((visibility("default")))
+const lame_kernels *lame_kernels_c(void) {
+    static const lame_kernels kernels =
+        LAME_KERNELS_INIT("c", kernel_fht, kernel_init_xrpow_core);
+    return &kernels;
+}
+
+#else
+
+__attribute__((visibility("default")))
+const lame_kernels *lame_kernels_native(void) {
+#if defined(LAME_NEON)
+    static const lame_kernels kernels =
+        LAME_KERNELS_INIT("neon", kernel_fht, kernel_init_xrpow_core);
+#else
+    static const lame_kernels kernels =
+        LAME_KERNELS_INIT("native", kernel_fht, kernel_init_xrpow_core);
+#endif
+    return &kernels;
+}
+
+/* fft_long/fft_short go through gfc->fft_fht, which the encoder never
+ * points at fht_SSE2 without MIN_ARCH_SSE, so only the direct calls of
+ * this table use the SSE code. */
+__attribute__((visibility("default")))
+const lame_kernels *lame_kernels_sse(void) {
+#if defined(LAME_KERNELS_SSE)
+    static const lame_kernels kernels =
+        LAME_KERNELS_INIT("sse", fht_SSE2, init_xrpow_core_sse);
+    return &kernels;
+#else
+    return NULL;
+#endif
+}
+
+#endif
@@ -0,0 +1,11 @@
+/* bitstream.c with its static kernels reachable from the kernel table. */
+#include "bitstream.c"
+
+void kernel_putbits2(lame_internal_flags *gfc, const int *val, const int *bits, int n) {
+    gfc->bs.buf_byte_idx = -1;
+    gfc->bs.buf_bit_idx = 0;
+    gfc->bs.totbit = 0;
+    for (int i = 0; i < n; ++i) {
+        putbits2(gfc, val[i], bits[i]);
+    }
+}
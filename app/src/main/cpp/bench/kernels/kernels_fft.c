@@ -0,0 +1,6 @@
+/* fft.c with its static kernels reachable from the kernel table. */
+#include "fft.c"
+
+void kernel_fht(FLOAT *fz, int n) {
+    fht(fz, n);
+}
@@ -0,0 +1,6 @@
+/* newmdct.c with its static kernels reachable from the kernel table. */
+#include "newmdct.c"
+
+void kernel_window_subband(const sample_t *x1, FLOAT a[SBLIMIT]) {
+    window_subband(x1, a);
+}
@@ -0,0 +1,7 @@
+/* psymodel.c with its static kernels reachable from the kernel table. */
+#include "psymodel.c"
+
+void kernel_compute_masking_l(lame_internal_flags *gfc, const FLOAT fftenergy[HBLKSIZE],
+                              FLOAT eb_l[CBANDS], FLOAT thr[CBANDS], int chn) {
+    vbrpsy_compute_masking_l(gfc, fftenergy, eb_l, thr, chn);
+}
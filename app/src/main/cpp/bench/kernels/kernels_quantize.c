@@ -0,0 +1,17 @@
+/* quantize.c with its static kernels reachable from the kernel table. */
+#include "quantize.c"
+
+void kernel_init_xrpow_core(gr_info *cod_info, FLOAT xrpow[576], int upper, FLOAT *sum) {
+    init_xrpow_core_c(cod_info, xrpow, upper, sum);
+}
+
+/* One granule through the CBR path: init_outer_loop, init_xrpow and, for
+ * one that is not silent, outer_loop with its whole-struct working copies. */
+int kernel_outer_loop(lame_internal_flags *gfc, gr_info *cod_info, const FLOAT *l3_xmin,
+                      FLOAT xrpow[576], int targ_bits) {
+    init_outer_loop(gfc, cod_info);
+    if (init_xrpow(gfc, cod_info, xrpow) == 0) {
+        return 0;
+    }
+    return outer_loop(gfc, cod_info, l3_xmin, xrpow, 0, targ_bits);
+}
@@ -0,0 +1,11 @@
+/* takehiro.c with its static kernels reachable from the kernel table. */
+#include "takehiro.c"
+
+void kernel_quantize_xrpow(const FLOAT *xp, int *pi, FLOAT istep, gr_info const *cod_info,
+                           calc_noise_data const *prev_noise) {
+    quantize_xrpow(xp, pi, istep, cod_info, prev_noise);
+}
+
+int kernel_choose_table(const int *ix, const int *end, int *s) {
+    return choose_table_nonMMX(ix, end, s);
+}
@@ -0,0 +1,7 @@
+/* util.c with its static kernels reachable from the kernel table. */
+#include "util.c"
+
+int kernel_fill_buffer_resample(lame_internal_flags *gfc, sample_t *outbuf, int desired_len,
+                                sample_t const *inbuf, int len, int *num_used, int ch) {
+    return fill_buffer_resample(gfc, outbuf, desired_len, inbuf, len, num_used, ch);
+}
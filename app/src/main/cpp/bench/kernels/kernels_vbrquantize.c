@@ -0,0 +1,16 @@
+/* vbrquantize.c with its static kernels reachable from the kernel table. */
+#include "vbrquantize.c"
+
+/* The search block_sf makes for every band of gi below psymax: the
+ * lowest scalefactor that does not overflow, then the largest one that
+ * keeps the noise within l3_xmin. */
+void kernel_find_scalefacs(gr_info const *gi, const FLOAT *xr34, const FLOAT *l3_xmin, int sf[SFBMAX]) {
+    int sfb, j = 0;
+
+    for (sfb = 0; sfb < gi->psymax; ++sfb) {
+        unsigned int const w = (unsigned int) gi->width[sfb];
+        uint8_t const sf_min = find_lowest_scalefac(vec_max_c(&xr34[j], w));
+        sf[sfb] = find_scalefac_x34(&gi->xr[j], &xr34[j], l3_xmin[sfb], w, sf_min);
+        j += w;
+    }
+}
@@ -0,0 +1,481 @@
+/*
+ * lame_bench: host benchmark for the encoder as the app drives it.
+ *
+ * Every configuration is opened the way lamejni opens it (mono output,
+ * CBR, in rate = out rate, 128 kbps, quality 6, liblamemono where it
+ * applies) and fed in the chunks MediaCodecMp3Converter hands to
+ * encodeInterleavedMono(). Results are written as JSON, one configuration
+ * per line, so a previous run can be passed back with --baseline; the
+ * "host" record names the machine, compiler and build the run came from.
+ * baseline-x86_64.json is the reference for host runs, see README.md.
+ * --trace writes the encoder stages of the last events as Chrome trace
+ * JSON, see lame_trace.h. --perf adds the hardware counters per stage of
+ * lame_encode_mp3_frame (see perf.h) as IPC and events per frame, next
+ * to the stage wall times.
+ *
+ *   lame_bench [--seconds N] [--repeat N] [--rates 44100,48000,...]
+ *              [--baseline FILE] [--tolerance PCT] [--trace FILE] [--perf]
+ *              [file.wav ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/utsname.h>
+
+#include "bench.h"
+#include "perf.h"
+#include "lame_trace.h"
+
+#define BENCH_CHUNK (1152 * 32)     /* MediaCodecMp3Converter.TARGET_FRAMES */
+#define BENCH_MAX_RATES 8
+
+#ifndef LAME_BENCH_BUILD
+#define LAME_BENCH_BUILD ""
+#endif
+
+typedef enum {
+    PCM_S16,
+    PCM_FLOAT
+} pcm_format;
+
+typedef struct {
+    double seconds;
+    unsigned long bytes;
+    uint32_t crc;
+    const char *api;
+
+    /* --perf only */
+    perf_sample stage_perf[LAME_STAGES];
+    perf_sample total_perf;
+    perf_sample stage_start;
+    lame_encoder_stats stats;
+} bench_result;
+
+static const char *const stage_names[LAME_STAGES] = {
+    "psymodel", "adjust_ATH", "mdct", "ms", "iteration", "bitstream"
+};
+
+static const lame_api lame_generic_api = LAME_API_INIT;
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *p, size_t n) {
+    crc = ~crc;
+    while (n--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; ++k) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+/* lame_set_stage_hook callback of --perf, arg is the bench_result */
+static void perf_stage_hook(void *arg, lame_stage stage, int begin) {
+    bench_result *const res = (bench_result *)arg;
+
+    if (begin) {
+        perf_read(&res->stage_start);
+    } else {
+        perf_sample now;
+        perf_read(&now);
+        perf_accumulate(&res->stage_perf[stage], &res->stage_start, &now);
+    }
+    lame_trace_stage_hook(NULL, stage, begin);
+}
+
+/* Downmix one chunk the way encodeInterleavedMono / ...MonoFloat do. */
+static void downmix_s16(short *dst, const short *src, int frames, int channels) {
+    for (int i = 0; i < frames; ++i) {
+        int sum = 0;
+        for (int ch = 0; ch < channels; ++ch) {
+            sum += src[i * channels + ch];
+        }
+        dst[i] = (short)(sum / channels);
+    }
+}
+
+static void downmix_f32(float *dst, const float *src, int frames, int channels) {
+    for (int i = 0; i < frames; ++i) {
+        float sum = 0.0f;
+        for (int ch = 0; ch < channels; ++ch) {
+            sum += src[i * channels + ch];
+        }
+        dst[i] = sum / channels;
+    }
+}
+
+static int encode_clip(const bench_clip *clip, int rate, pcm_format fmt, bench_result *res) {
+    const lame_api *api = &lame_generic_api;
+    int const mp3buf_size = (int)(1.25 * BENCH_CHUNK + 7200);
+    unsigned char *mp3buf = (unsigned char *)malloc((size_t)mp3buf_size);
+    short *mono_s16 = (short *)malloc(sizeof(short) * BENCH_CHUNK);
+    float *mono_f32 = (float *)malloc(sizeof(float) * BENCH_CHUNK);
+    lame_t gfp = NULL;
+    perf_sample perf_start, perf_end;
+    double t0;
+    int status = -1;
+
+    if (mp3buf == NULL || mono_s16 == NULL || mono_f32 == NULL) {
+        goto done;
+    }
+    t0 = bench_now();
+    if (rate == 32000 || rate == 44100 || rate == 48000) {
+        api = lame_mono_api();
+    }
+    gfp = bench_open_encoder(api, rate);
+    if (gfp == NULL && api != &lame_generic_api) {
+        api = &lame_generic_api;
+        gfp = bench_open_encoder(api, rate);
+    }
+    if (gfp == NULL) {
+        goto done;
+    }
+    res->api = api == &lame_generic_api ? "generic" : "mono";
+    memset(res->stage_perf, 0, sizeof(res->stage_perf));
+    if (perf_available()) {
+        api->set_stage_hook(gfp, perf_stage_hook, res);
+        api->set_stage_timing(gfp, 1);
+    } else if (lame_trace_enabled()) {
+        api->set_stage_hook(gfp, lame_trace_stage_hook, NULL);
+    }
+    perf_read(&perf_start);
+    res->bytes = 0;
+    res->crc = 0;
+
+    for (long pos = 0; pos < clip->frames; pos += BENCH_CHUNK) {
+        int const frames = (int)(clip->frames - pos < BENCH_CHUNK ? clip->frames - pos : BENCH_CHUNK);
+        int encoded;
+        LAME_TRACE_SCOPE("bench.chunk");
+
+        if (fmt == PCM_S16) {
+            const short *in = clip->s16 + pos * clip->channels;
+            if (clip->channels > 1) {
+                downmix_s16(mono_s16, in, frames, clip->channels);
+                in = mono_s16;
+            }
+            encoded = api->encode_buffer(gfp, in, NULL, frames, mp3buf, mp3buf_size);
+        } else {
+            const float *in = clip->f32 + pos * clip->channels;
+            if (clip->channels > 1) {
+                downmix_f32(mono_f32, in, frames, clip->channels);
+                in = mono_f32;
+            }
+            encoded = api->encode_buffer_ieee_float(gfp, in, NULL, frames, mp3buf, mp3buf_size);
+        }
+        if (encoded < 0) {
+            goto done;
+        }
+        res->bytes += (unsigned long)encoded;
+        res->crc = crc32_update(res->crc, mp3buf, (size_t)encoded);
+    }
+    {
+        int const encoded = api->encode_flush(gfp, mp3buf, 7200);
+        if (encoded > 0) {
+            res->bytes += (unsigned long)encoded;
+            res->crc = crc32_update(res->crc, mp3buf, (size_t)encoded);
+        }
+    }
+    perf_read(&perf_end);
+    memset(&res->total_perf, 0, sizeof(res->total_perf));
+    perf_accumulate(&res->total_perf, &perf_start, &perf_end);
+    api->get_encoder_stats(gfp, &res->stats);
+    api->close(gfp);
+    gfp = NULL;
+    res->seconds = bench_now() - t0;
+    status = 0;
+
+done:
+    if (gfp != NULL) {
+        api->close(gfp);
+    }
+    free(mp3buf);
+    free(mono_s16);
+    free(mono_f32);
+    return status;
+}
+
+/* ----------------------------------------------------------------------
+ * baseline: a previous run's output, one configuration per line
+ * ---------------------------------------------------------------------- */
+
+typedef struct {
+    char name[160];
+    double x_realtime;
+    unsigned long bytes;
+    uint32_t crc;
+} baseline_entry;
+
+static baseline_entry *baseline;
+static int baseline_count;
+
+static int load_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[4096];
+    int cap = 0;
+
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        baseline_entry e;
+        char *p = strstr(line, "\"name\": \"");
+        char *q, *r;
+
+        if (p == NULL) {
+            continue;
+        }
+        p += 9;
+        q = strchr(p, '"');
+        if (q == NULL || (size_t)(q - p) >= sizeof(e.name)) {
+            continue;
+        }
+        memcpy(e.name, p, (size_t)(q - p));
+        e.name[q - p] = '\0';
+        r = strstr(q, "\"x_realtime\": ");
+        if (r == NULL || sscanf(r + 14, "%lf", &e.x_realtime) != 1) {
+            continue;
+        }
+        r = strstr(q, "\"bytes\": ");
+        e.bytes = r != NULL ? strtoul(r + 9, NULL, 10) : 0;
+        r = strstr(q, "\"crc32\": \"");
+        e.crc = r != NULL ? (uint32_t)strtoul(r + 10, NULL, 16) : 0;
+        if (baseline_count == cap) {
+            baseline_entry *grown;
+            cap = cap ? 2 * cap : 32;
+            grown = (baseline_entry *)realloc(baseline, sizeof(*baseline) * (size_t)cap);
+            if (grown == NULL) {
+                break;
+            }
+            baseline = grown;
+        }
+        baseline[baseline_count++] = e;
+    }
+    fclose(f);
+    return 0;
+}
+
+static const baseline_entry *find_baseline(const char *name) {
+    for (int i = 0; i < baseline_count; ++i) {
+        if (strcmp(baseline[i].name, name) == 0) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Machine, CPU, compiler and build of this run, so that a committed
+ * baseline says where its numbers come from. */
+static void print_host(void) {
+    struct utsname un;
+    char cpu[128] = "", line[256];
+    FILE *f = fopen("/proc/cpuinfo", "r");
+
+    if (f != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL) {
+            char *p = strchr(line, ':');
+            if (p != NULL && strncmp(line, "model name", 10) == 0) {
+                p += strspn(p + 1, " ") + 1;
+                p[strcspn(p, "\"\n")] = '\0';
+                snprintf(cpu, sizeof(cpu), "%s", p);
+                break;
+            }
+        }
+        fclose(f);
+    }
+    if (uname(&un) < 0) {
+        strcpy(un.machine, "unknown");
+    }
+    printf("  \"host\": {\"machine\": \"%s\", \"cpu\": \"%s\", \"compiler\": \"%s\", "
+           "\"build\": \"%s\", \"simd\": %s},\n",
+           un.machine, cpu, __VERSION__, LAME_BENCH_BUILD,
+#ifdef LAME_NO_SIMD
+           "false"
+#else
+           "true"
+#endif
+    );
+}
+
+static int parse_rates(const char *arg, int *rates) {
+    int n = 0;
+    while (*arg && n < BENCH_MAX_RATES) {
+        char *end;
+        long r = strtol(arg, &end, 10);
+        if (end == arg || r <= 0) {
+            return -1;
+        }
+        rates[n++] = (int)r;
+        arg = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: lame_bench [--seconds N] [--repeat N] [--rates R1,R2,...]\n"
+            "                  [--baseline FILE] [--tolerance PCT] [--trace FILE] [--perf]\n"
+            "                  [file.wav ...]\n");
+}
+
+int main(int argc, char **argv) {
+    double seconds = 20.0, tolerance = 5.0;
+    int repeat = 3, use_perf = 0;
+    int rates[BENCH_MAX_RATES] = {44100, 48000, 22050};
+    int nrates = 3;
+    const char *baseline_path = NULL, *trace_path = NULL;
+    bench_clip *clips;
+    int nclips = 0, nsynth = bench_synthetic_count();
+    int regressions = 0, changed = 0, first = 1;
+    double total_audio = 0.0, total_time = 0.0;
+    long total_frames = 0;
+    int i;
+
+    clips = (bench_clip *)calloc((size_t)(nsynth + argc), sizeof(*clips));
+    if (clips == NULL) {
+        return 2;
+    }
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--rates") && i + 1 < argc) {
+            nrates = parse_rates(argv[++i], rates);
+        } else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (!strcmp(argv[i], "--perf")) {
+            use_perf = 1;
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else if (bench_load_wav(&clips[nclips], argv[i]) == 0) {
+            ++nclips;
+        } else {
+            fprintf(stderr, "lame_bench: cannot read %s (16-bit PCM or float WAV)\n", argv[i]);
+            return 2;
+        }
+    }
+    if (seconds <= 0.0 || repeat <= 0 || nrates <= 0) {
+        usage();
+        return 2;
+    }
+    if (baseline_path != NULL && load_baseline(baseline_path) < 0) {
+        fprintf(stderr, "lame_bench: cannot read baseline %s\n", baseline_path);
+        return 2;
+    }
+    lame_trace_enable(trace_path != NULL);
+    if (use_perf && perf_open() < 0) {
+        fprintf(stderr, "lame_bench: no hardware counters (perf_event_open), --perf ignored\n");
+    }
+
+    printf("{\n  \"encoder\": {\"lame\": \"%s\", \"bitrate\": %d, \"quality\": %d, \"chunk\": %d},\n",
+           get_lame_version(), BENCH_BITRATE, BENCH_QUALITY, BENCH_CHUNK);
+    print_host();
+    printf("  \"results\": [\n");
+
+    for (int c = 0; c < nclips + nsynth * nrates; ++c) {
+        bench_clip synth;
+        const bench_clip *clip;
+
+        if (c < nclips) {
+            clip = &clips[c];
+        } else {
+            int const k = c - nclips;
+            if (bench_make_synthetic(&synth, k / nrates, rates[k % nrates], seconds) < 0) {
+                fprintf(stderr, "lame_bench: out of memory\n");
+                return 2;
+            }
+            clip = &synth;
+        }
+        for (int f = 0; f < 2; ++f) {
+            pcm_format const fmt = f == 0 ? PCM_S16 : PCM_FLOAT;
+            double const audio = (double)clip->frames / clip->sample_rate;
+            int const frame_size = clip->sample_rate >= 32000 ? 1152 : 576;
+            long const mp3_frames = (clip->frames + frame_size - 1) / frame_size;
+            bench_result best = {0}, res;
+            const baseline_entry *base;
+            char name[160];
+            double xrt;
+
+            snprintf(name, sizeof(name), "%s/%d/%s", clip->name, clip->sample_rate,
+                     fmt == PCM_S16 ? "s16" : "float");
+            for (int r = 0; r < repeat; ++r) {
+                if (encode_clip(clip, clip->sample_rate, fmt, &res) < 0) {
+                    fprintf(stderr, "lame_bench: %s: encoder refused the configuration\n", name);
+                    return 2;
+                }
+                if (r == 0 || res.seconds < best.seconds) {
+                    best = res;
+                }
+            }
+            xrt = audio / best.seconds;
+            total_audio += audio;
+            total_time += best.seconds;
+            total_frames += mp3_frames;
+
+            printf("%s    {\"name\": \"%s\", \"api\": \"%s\", \"audio_seconds\": %.3f, "
+                   "\"encode_seconds\": %.6f, \"x_realtime\": %.2f, \"fps\": %.1f, "
+                   "\"bytes\": %lu, \"crc32\": \"%08x\"",
+                   first ? "" : ",\n", name, best.api, audio, best.seconds, xrt,
+                   mp3_frames / best.seconds, best.bytes, (unsigned)best.crc);
+            first = 0;
+            base = baseline_path != NULL ? find_baseline(name) : NULL;
+            if (base != NULL) {
+                double const delta = 100.0 * (xrt - base->x_realtime) / base->x_realtime;
+                int const slower = delta < -tolerance;
+                int const differs = base->bytes != best.bytes || base->crc != best.crc;
+                printf(", \"baseline_x_realtime\": %.2f, \"delta_pct\": %.1f, "
+                       "\"regression\": %s, \"bitstream_changed\": %s",
+                       base->x_realtime, delta, slower ? "true" : "false",
+                       differs ? "true" : "false");
+                regressions += slower;
+                changed += differs;
+            }
+            if (perf_available()) {
+                double const nf = best.stats.frames > 0 ? (double)best.stats.frames : 1.0;
+                printf(", \"perf\": {\"frames\": %ld, \"total\": ", best.stats.frames);
+                perf_print_json(stdout, &best.total_perf, nf);
+                printf(", \"stages\": {");
+                for (int s = 0; s < LAME_STAGES; ++s) {
+                    printf("%s\"%s\": {\"seconds\": %.6f, \"per_frame\": ", s ? ", " : "",
+                           stage_names[s], best.stats.stage_seconds[s]);
+                    perf_print_json(stdout, &best.stage_perf[s], nf);
+                    printf("}");
+                }
+                printf("}}");
+            }
+            printf("}");
+            fflush(stdout);
+        }
+        if (clip == &synth) {
+            bench_clip_free(&synth);
+        }
+    }
+
+    printf("\n  ],\n  \"total\": {\"audio_seconds\": %.3f, \"encode_seconds\": %.6f, "
+           "\"x_realtime\": %.2f, \"fps\": %.1f}",
+           total_audio, total_time, total_audio / total_time, total_frames / total_time);
+    if (baseline_path != NULL) {
+        printf(",\n  \"baseline\": {\"file\": \"%s\", \"tolerance_pct\": %.1f, "
+               "\"regressions\": %d, \"bitstream_changes\": %d}",
+               baseline_path, tolerance, regressions, changed);
+    }
+    printf("\n}\n");
+    if (trace_path != NULL && lame_trace_dump(trace_path) < 0) {
+        fprintf(stderr, "lame_bench: cannot write %s\n", trace_path);
+    }
+    perf_close();
+
+    for (i = 0; i < nclips; ++i) {
+        bench_clip_free(&clips[i]);
+    }
+    free(clips);
+    free(baseline);
+    return regressions > 0 ? 1 : 0;
+}
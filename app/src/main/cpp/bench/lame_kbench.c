@@ -0,0 +1,284 @@
+/*
+ * lame_kbench: per-kernel timings of the encoder's DSP hot spots.
+ *
+ * The inputs are recorded from real encodes (the synthetic corpus of
+ * lame_bench, or the WAV files given) with the app's settings: the sample
+ * window, granule spectra and quantizer state, the psymodel energies.
+ * Every kernel then runs on the same fixtures in each available build -
+ * the portable C code, the native one (NEON on ARM) and, on x86, the SSE
+ * kernels - and the timings are printed side by side as JSON. With --perf
+ * the hardware counters per call (see perf.h) are printed next to them.
+ *
+ *   lame_kbench [--record FILE | --fixtures FILE] [--frames N] [--ms N]
+ *               [--perf] [file.wav ...]
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fixtures.h"
+#include "perf.h"
+
+typedef struct {
+    FLOAT x[BLKSIZE] __attribute__ ((aligned (16)));
+    FLOAT x_s[3][BLKSIZE_s] __attribute__ ((aligned (16)));
+    FLOAT a[SBLIMIT] __attribute__ ((aligned (16)));
+    FLOAT xrpow[576] __attribute__ ((aligned (16)));
+    int ix[576] __attribute__ ((aligned (16)));
+    FLOAT eb[CBANDS], thr[CBANDS];
+    FLOAT distort[SFBMAX];
+    int sf[SFBMAX];
+    sample_t out[2048];
+} kb_work;
+
+static kb_fixtures fx;
+static kb_work work;
+static volatile int sink;     /* keeps the results alive */
+
+/* ----------------------------------------------------------------------
+ * kernels; each run_* makes `calls` calls on one frame
+ * ---------------------------------------------------------------------- */
+
+static void run_fht(const kb_variant *v, kb_frame *f) {
+    memcpy(work.x, f->mfbuf, sizeof(work.x));
+    v->k->fht(work.x, BLKSIZE / 2);
+}
+
+static void run_fft_long(const kb_variant *v, kb_frame *f) {
+    const sample_t *const buffer[2] = {f->mfbuf, f->mfbuf};
+    v->k->fft_long(v->gfc, work.x, 0, buffer);
+}
+
+static void run_fft_short(const kb_variant *v, kb_frame *f) {
+    const sample_t *const buffer[2] = {f->mfbuf, f->mfbuf};
+    v->k->fft_short(v->gfc, work.x_s, 0, buffer);
+}
+
+static void run_window_subband(const kb_variant *v, kb_frame *f) {
+    for (int j = 0; j < 36; ++j) {
+        v->k->window_subband(f->mfbuf + 286 + 32 * j, work.a);
+    }
+}
+
+static void run_mdct_sub48(const kb_variant *v, kb_frame *f) {
+    v->k->mdct_sub48(v->gfc, f->mfbuf, f->mfbuf);
+}
+
+static void run_init_xrpow_core(const kb_variant *v, kb_frame *f) {
+    FLOAT sum;
+    for (int gr = 0; gr < 2; ++gr) {
+        v->k->init_xrpow_core(&f->gi[gr], work.xrpow, f->gi[gr].max_nonzero_coeff, &sum);
+    }
+}
+
+static void run_quantize_xrpow(const kb_variant *v, kb_frame *f) {
+    for (int gr = 0; gr < 2; ++gr) {
+        FLOAT const istep = (FLOAT)pow(2.0, -0.1875 * (f->gi[gr].global_gain - 210));
+        v->k->quantize_xrpow(f->xrpow[gr], work.ix, istep, &f->gi[gr], NULL);
+    }
+}
+
+static void run_count_bits(const kb_variant *v, kb_frame *f) {
+    for (int gr = 0; gr < 2; ++gr) {
+        gr_info gi = f->gi[gr];
+        sink += v->k->count_bits(v->gfc, f->xrpow[gr], &gi, NULL);
+    }
+}
+
+static void run_choose_table(const kb_variant *v, kb_frame *f) {
+    for (int gr = 0; gr < 2; ++gr) {
+        int bits = 0;
+        int const *ix = f->gi[gr].l3_enc;
+        sink += v->k->choose_table(ix, ix + f->gi[gr].big_values, &bits) + bits;
+    }
+}
+
+static void run_calc_noise(const kb_variant *v, kb_frame *f) {
+    for (int gr = 0; gr < 2; ++gr) {
+        calc_noise_result res;
+        sink += v->k->calc_noise(&f->gi[gr], f->xmin[gr], work.distort, &res, NULL);
+    }
+}
+
+static void run_fill_buffer_resample(const kb_variant *v, kb_frame *f) {
+    int used = 0;
+    sink += v->k->fill_buffer_resample(v->gfc_resample, work.out, 1152, f->mfbuf, 2048, &used, 0);
+}
+
+static void run_compute_masking_l(const kb_variant *v, kb_frame *f) {
+    v->k->compute_masking_l(v->gfc, f->fftenergy, work.eb, work.thr, 0);
+}
+
+static void run_putbits2(const kb_variant *v, kb_frame *f) {
+    v->k->putbits2(v->gfc, f->put_val, f->put_bits, f->npairs);
+}
+
+static void run_find_scalefacs(const kb_variant *v, kb_frame *f) {
+    for (int gr = 0; gr < 2; ++gr) {
+        v->k->find_scalefacs(&f->gi[gr], f->xrpow[gr], f->xmin[gr], work.sf);
+    }
+}
+
+static void run_outer_loop(const kb_variant *v, kb_frame *f) {
+    for (int gr = 0; gr < 2; ++gr) {
+        gr_info gi = f->gi[gr];
+        sink += v->k->outer_loop(v->gfc, &gi, f->xmin[gr], work.xrpow, f->gi[gr].part2_3_length);
+    }
+}
+
+static const struct {
+    const char *name;
+    void (*run)(const kb_variant *v, kb_frame *f);
+    int calls;      /* per frame, 0: one per putbits2 pair */
+} kernels[] = {
+    {"fht", run_fht, 1},
+    {"fft_long", run_fft_long, 1},
+    {"fft_short", run_fft_short, 1},
+    {"window_subband", run_window_subband, 36},
+    {"mdct_sub48", run_mdct_sub48, 1},
+    {"init_xrpow_core", run_init_xrpow_core, 2},
+    {"quantize_xrpow", run_quantize_xrpow, 2},
+    {"count_bits", run_count_bits, 2},
+    {"choose_table", run_choose_table, 2},
+    {"calc_noise", run_calc_noise, 2},
+    {"fill_buffer_resample", run_fill_buffer_resample, 1},
+    {"vbrpsy_compute_masking_l", run_compute_masking_l, 1},
+    {"putbits2", run_putbits2, 0},
+    {"find_scalefac_x34", run_find_scalefacs, 2},
+    {"outer_loop", run_outer_loop, 2},
+};
+
+/* ns per call, over as many passes through the fixtures as fit in ms;
+ * the counters over the same passes go to *counters */
+static double time_kernel(int which, const kb_variant *v, double ms, perf_sample *counters,
+                          long *ncalls) {
+    perf_sample start, end;
+    double const t0 = bench_now();
+    double t;
+    long calls = 0;
+
+    perf_read(&start);
+    do {
+        for (int i = 0; i < fx.count; ++i) {
+            kernels[which].run(v, &fx.frame[i]);
+            calls += kernels[which].calls ? kernels[which].calls : fx.frame[i].npairs;
+        }
+        t = bench_now() - t0;
+    } while (t * 1e3 < ms);
+    perf_read(&end);
+    memset(counters, 0, sizeof(*counters));
+    perf_accumulate(counters, &start, &end);
+    *ncalls = calls;
+    return calls > 0 ? t * 1e9 / calls : 0.0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: lame_kbench [--record FILE | --fixtures FILE] [--frames N] [--ms N]\n"
+            "                   [--perf] [file.wav ...]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *record_path = NULL, *fixture_path = NULL;
+    int want = 32, nvariants = 0, use_perf = 0;
+    double ms = 200.0;
+    kb_variant variants[KB_MAX_VARIANTS];
+    const lame_kernels *tables[KB_MAX_VARIANTS] = {
+        lame_kernels_c(), lame_kernels_native(), lame_kernels_sse()
+    };
+    int i, nwav = 0;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (!strcmp(argv[i], "--fixtures") && i + 1 < argc) {
+            fixture_path = argv[++i];
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            want = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--ms") && i + 1 < argc) {
+            ms = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--perf")) {
+            use_perf = 1;
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else {
+            argv[++nwav] = argv[i];
+        }
+    }
+    if (want <= 0 || (record_path != NULL && fixture_path != NULL)) {
+        usage();
+        return 2;
+    }
+
+    if (use_perf && perf_open() < 0) {
+        fprintf(stderr, "lame_kbench: no hardware counters (perf_event_open), --perf ignored\n");
+    }
+
+    for (i = 0; i < KB_MAX_VARIANTS; ++i) {
+        if (tables[i] == NULL) {
+            continue;
+        }
+        if (kb_open_variant(&variants[nvariants], tables[i]) < 0) {
+            fprintf(stderr, "lame_kbench: cannot open the %s encoder\n", tables[i]->name);
+            return 2;
+        }
+        ++nvariants;
+    }
+
+    if (fixture_path != NULL) {
+        if (kb_load(&fx, fixture_path) < 0) {
+            fprintf(stderr, "lame_kbench: cannot read fixtures %s\n", fixture_path);
+            return 2;
+        }
+    } else {
+        /* recorded with the shipping kernels */
+        if (kb_record(&fx, &variants[1], argv + 1, nwav, want) < 0) {
+            return 2;
+        }
+        if (record_path != NULL && kb_save(&fx, record_path) < 0) {
+            fprintf(stderr, "lame_kbench: cannot write %s\n", record_path);
+            return 2;
+        }
+    }
+
+    printf("{\n  \"fixtures\": {\"frames\": %d, \"source\": \"%s\"},\n  \"variants\": [",
+           fx.count, fixture_path != NULL ? fixture_path : (nwav > 0 ? "wav" : "synthetic"));
+    for (i = 0; i < nvariants; ++i) {
+        printf("%s\"%s\"", i ? ", " : "", variants[i].k->name);
+    }
+    printf("],\n  \"kernels\": [\n");
+    for (int k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); ++k) {
+        double ns[KB_MAX_VARIANTS];
+        perf_sample counters[KB_MAX_VARIANTS];
+        long calls[KB_MAX_VARIANTS];
+
+        printf("    {\"kernel\": \"%s\"", kernels[k].name);
+        for (i = 0; i < nvariants; ++i) {
+            ns[i] = time_kernel(k, &variants[i], ms, &counters[i], &calls[i]);
+            printf(", \"%s_ns\": %.1f", variants[i].k->name, ns[i]);
+        }
+        for (i = 1; i < nvariants; ++i) {
+            printf(", \"%s_speedup\": %.2f", variants[i].k->name, ns[i] > 0 ? ns[0] / ns[i] : 0.0);
+        }
+        for (i = 0; perf_available() && i < nvariants; ++i) {
+            printf(", \"%s_per_call\": ", variants[i].k->name);
+            perf_print_json(stdout, &counters[i], (double)calls[i]);
+        }
+        printf("}%s\n", k + 1 < (int)(sizeof(kernels) / sizeof(kernels[0])) ? "," : "");
+        fflush(stdout);
+    }
+    printf("  ]\n}\n");
+
+    for (i = 0; i < nvariants; ++i) {
+        kb_close_variant(&variants[i]);
+    }
+    kb_free(&fx);
+    perf_close();
+    return 0;
+}
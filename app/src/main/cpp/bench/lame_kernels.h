@@ -0,0 +1,68 @@
+#ifndef LAME_KERNELS_H
+#define LAME_KERNELS_H
+
+#include "lame_api.h"
+
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "quantize_pvt.h"
+
+/*
+ * The DSP hot spots of one libmp3lame build, as a table.
+ *
+ * Like liblamemono, each kernel library is the libmp3lame source built
+ * with hidden visibility; it exports nothing but its table function, so a
+ * portable C build (LAME_NO_SIMD) and the native one can be loaded into
+ * the same tool and fed the same inputs. The wrappers in bench/kernels/
+ * include the library sources to reach their static functions.
+ *
+ * Kernels that take a gfc must be given one opened through api from the
+ * same table.
+ */
+typedef struct {
+    const char *name;
+    lame_api api;
+    lame_internal_flags *(*internal_flags)(lame_t);
+    int (*set_findReplayGain)(lame_t, int);
+    int (*get_RadioGain)(const lame_global_flags *);
+
+    void (*fht)(FLOAT *fz, int n);
+    void (*fft_long)(lame_internal_flags const *gfc, FLOAT x[BLKSIZE], int chn,
+                     const sample_t *const buffer[2]);
+    void (*fft_short)(lame_internal_flags const *gfc, FLOAT x[3][BLKSIZE_s], int chn,
+                      const sample_t *const buffer[2]);
+    void (*window_subband)(const sample_t *x1, FLOAT a[SBLIMIT]);
+    void (*mdct_sub48)(lame_internal_flags *gfc, const sample_t *w0, const sample_t *w1);
+    void (*init_xrpow_core)(gr_info *cod_info, FLOAT xrpow[576], int upper, FLOAT *sum);
+    void (*quantize_xrpow)(const FLOAT *xp, int *pi, FLOAT istep, gr_info const *cod_info,
+                           calc_noise_data const *prev_noise);
+    int (*count_bits)(lame_internal_flags const *gfc, const FLOAT *xr, gr_info *gi,
+                      calc_noise_data *prev_noise);
+    int (*choose_table)(const int *ix, const int *end, int *s);
+    int (*calc_noise)(gr_info const *cod_info, FLOAT const *l3_xmin, FLOAT *distort,
+                      calc_noise_result *res, calc_noise_data *prev_noise);
+    int (*fill_buffer_resample)(lame_internal_flags *gfc, sample_t *outbuf, int desired_len,
+                                sample_t const *inbuf, int len, int *num_used, int ch);
+    void (*compute_masking_l)(lame_internal_flags *gfc, const FLOAT fftenergy[HBLKSIZE],
+                              FLOAT eb_l[CBANDS], FLOAT thr[CBANDS], int chn);
+    /* n calls of putbits2(gfc, val[i], bits[i]), after rewinding the buffer */
+    void (*putbits2)(lame_internal_flags *gfc, const int *val, const int *bits, int n);
+    /* the VBR scalefactor of every band below gi->psymax */
+    void (*find_scalefacs)(gr_info const *gi, const FLOAT *xr34, const FLOAT *l3_xmin,
+                           int sf[SFBMAX]);
+    /* init_outer_loop, init_xrpow and outer_loop of one granule (CBR) */
+    int (*outer_loop)(lame_internal_flags *gfc, gr_info *cod_info, const FLOAT *l3_xmin,
+                      FLOAT xrpow[576], int targ_bits);
+} lame_kernels;
+
+/* Portable C build of the kernels (LAME_NO_SIMD). */
+const lame_kernels *lame_kernels_c(void);
+
+/* The kernels as the app ships them for this target (NEON on ARM). */
+const lame_kernels *lame_kernels_native(void);
+
+/* The x86 SSE kernels from vector/xmm_quantize_sub.c, NULL elsewhere. */
+const lame_kernels *lame_kernels_sse(void);
+
+#endif
@@ -0,0 +1,695 @@
+/*
+ * lame_simd_check: do the SIMD kernels agree with the portable C code?
+ *
+ * Two levels, both against the C build (LAME_NO_SIMD) as the reference:
+ *
+ *  - kernels: every kernel of lame_kbench runs in lockstep in the C build
+ *    and in each optimized one (native, NEON on ARM, and the x86 SSE
+ *    kernels) on the same recorded fixtures. Stateful kernels (mdct_sub48,
+ *    the resampler, the masking) start from identically opened encoders.
+ *    The outputs are compared with a per-kernel tolerance: peak-relative
+ *    error for the float kernels, a share of lines off by one for the
+ *    quantizer, exact for table choice and bit packing.
+ *
+ *  - bitstreams: the corpus is encoded with every build in the app's CBR
+ *    setting at 44.1 and 22.05 kHz, as VBR, and with ReplayGain analysis.
+ *    A stream passes if it is bit-exact, or if it has the same frames
+ *    (headers and sizes) and every granule's global_gain is within
+ *    --gain-tolerance steps of the reference; the radio gain may differ by
+ *    0.1 dB.
+ *
+ * The SSE table's fht and init_xrpow_core are patched into its encoders,
+ * which otherwise never use them. --force KERNEL=VARIANT does the same
+ * for any table on the optimized encoders, for the kernels the encoder
+ * calls through a pointer (fht, init_xrpow_core, choose_table), e.g.
+ * --force fht=c to rule the FFT in or out of a bitstream difference.
+ *
+ * The result is JSON on stdout; the exit status is 1 if anything is out of
+ * tolerance. For aarch64 without a device, cross-compile the bench targets
+ * (an aarch64-linux-gnu toolchain file, -DLAME_BENCH=ON) and run them with
+ * qemu-user:
+ *
+ *   qemu-aarch64 -L /usr/aarch64-linux-gnu ./lame_simd_check
+ *
+ *   lame_simd_check [--fixtures FILE] [--frames N] [--seconds N]
+ *                   [--kernel NAME] [--variant NAME] [--force KERNEL=VARIANT]
+ *                   [--gain-tolerance N] [--no-bitstreams] [file.wav ...]
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fixtures.h"
+
+typedef struct {
+    FLOAT x[BLKSIZE] __attribute__ ((aligned (16)));
+    FLOAT x_s[3][BLKSIZE_s] __attribute__ ((aligned (16)));
+    FLOAT a[SBLIMIT] __attribute__ ((aligned (16)));
+    FLOAT xrpow[576] __attribute__ ((aligned (16)));
+    int ix[576] __attribute__ ((aligned (16)));
+    FLOAT eb[CBANDS], thr[CBANDS];
+    FLOAT distort[SFBMAX];
+    int sf[SFBMAX];
+    sample_t out[2048];
+} sc_work;
+
+static kb_fixtures fx;
+static sc_work ref_work, opt_work;
+
+/* ----------------------------------------------------------------------
+ * error measures
+ * ---------------------------------------------------------------------- */
+
+/* largest difference relative to the reference's peak magnitude */
+static double peak_error(const FLOAT *ref, const FLOAT *opt, int n) {
+    double peak = 0, diff = 0;
+
+    for (int i = 0; i < n; ++i) {
+        if (isnan(ref[i]) != isnan(opt[i]) || isinf(ref[i]) != isinf(opt[i])) {
+            return INFINITY;
+        }
+        if (peak < fabs(ref[i])) {
+            peak = fabs(ref[i]);
+        }
+        if (diff < fabs(ref[i] - opt[i])) {
+            diff = fabs(ref[i] - opt[i]);
+        }
+    }
+    return peak > 0 ? diff / peak : diff;
+}
+
+/* largest difference relative to each value, for data spanning decades */
+static double value_error(const FLOAT *ref, const FLOAT *opt, int n) {
+    double err = 0;
+
+    for (int i = 0; i < n; ++i) {
+        double const d = fabs(ref[i] - opt[i]);
+        double const m = fabs(ref[i]) > 1e-30 ? fabs(ref[i]) : 1e-30;
+        if (isnan(ref[i]) != isnan(opt[i])) {
+            return INFINITY;
+        }
+        if (err < d / m) {
+            err = d / m;
+        }
+    }
+    return err;
+}
+
+static double max2(double a, double b) {
+    return a > b ? a : b;
+}
+
+/* ----------------------------------------------------------------------
+ * kernels; each check_* runs one frame on both builds and returns the
+ * error, 0 for identical output
+ * ---------------------------------------------------------------------- */
+
+typedef double (*check_fn)(const kb_variant *ref, const kb_variant *opt, kb_frame *f);
+
+static double check_fht(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    memcpy(ref_work.x, f->mfbuf, sizeof(ref_work.x));
+    memcpy(opt_work.x, f->mfbuf, sizeof(opt_work.x));
+    ref->k->fht(ref_work.x, BLKSIZE / 2);
+    opt->k->fht(opt_work.x, BLKSIZE / 2);
+    return peak_error(ref_work.x, opt_work.x, BLKSIZE);
+}
+
+static double check_fft_long(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    const sample_t *const buffer[2] = {f->mfbuf, f->mfbuf};
+    ref->k->fft_long(ref->gfc, ref_work.x, 0, buffer);
+    opt->k->fft_long(opt->gfc, opt_work.x, 0, buffer);
+    return peak_error(ref_work.x, opt_work.x, BLKSIZE);
+}
+
+static double check_fft_short(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    const sample_t *const buffer[2] = {f->mfbuf, f->mfbuf};
+    ref->k->fft_short(ref->gfc, ref_work.x_s, 0, buffer);
+    opt->k->fft_short(opt->gfc, opt_work.x_s, 0, buffer);
+    return peak_error(ref_work.x_s[0], opt_work.x_s[0], 3 * BLKSIZE_s);
+}
+
+static double check_window_subband(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    double err = 0;
+    for (int j = 0; j < 36; ++j) {
+        ref->k->window_subband(f->mfbuf + 286 + 32 * j, ref_work.a);
+        opt->k->window_subband(f->mfbuf + 286 + 32 * j, opt_work.a);
+        err = max2(err, peak_error(ref_work.a, opt_work.a, SBLIMIT));
+    }
+    return err;
+}
+
+static double check_mdct_sub48(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    double err = 0;
+    ref->k->mdct_sub48(ref->gfc, f->mfbuf, f->mfbuf);
+    opt->k->mdct_sub48(opt->gfc, f->mfbuf, f->mfbuf);
+    for (int gr = 0; gr < 2; ++gr) {
+        err = max2(err, peak_error(ref->gfc->l3_side.xr[gr][0], opt->gfc->l3_side.xr[gr][0], 576));
+    }
+    return err;
+}
+
+static double check_init_xrpow_core(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    double err = 0;
+    for (int gr = 0; gr < 2; ++gr) {
+        gr_info ref_gi = f->gi[gr], opt_gi = f->gi[gr];
+        FLOAT ref_sum = 0, opt_sum = 0;
+        int const upper = f->gi[gr].max_nonzero_coeff;
+
+        ref->k->init_xrpow_core(&ref_gi, ref_work.xrpow, upper, &ref_sum);
+        opt->k->init_xrpow_core(&opt_gi, opt_work.xrpow, upper, &opt_sum);
+        err = max2(err, peak_error(ref_work.xrpow, opt_work.xrpow, upper + 1));
+        err = max2(err, value_error(&ref_sum, &opt_sum, 1));
+        err = max2(err, value_error(&ref_gi.xrpow_max, &opt_gi.xrpow_max, 1));
+    }
+    return err;
+}
+
+/* share of lines that differ, 1 if any is off by more than one step */
+static double check_quantize_xrpow(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    double err = 0;
+    for (int gr = 0; gr < 2; ++gr) {
+        FLOAT const istep = (FLOAT)pow(2.0, -0.1875 * (f->gi[gr].global_gain - 210));
+        int differ = 0;
+
+        ref->k->quantize_xrpow(f->xrpow[gr], ref_work.ix, istep, &f->gi[gr], NULL);
+        opt->k->quantize_xrpow(f->xrpow[gr], opt_work.ix, istep, &f->gi[gr], NULL);
+        for (int i = 0; i < 576; ++i) {
+            int const d = abs(ref_work.ix[i] - opt_work.ix[i]);
+            if (d > 1) {
+                return 1.0;
+            }
+            differ += d;
+        }
+        err = max2(err, differ / 576.0);
+    }
+    return err;
+}
+
+static double check_count_bits(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    double err = 0;
+    for (int gr = 0; gr < 2; ++gr) {
+        gr_info ref_gi = f->gi[gr], opt_gi = f->gi[gr];
+        int const a = ref->k->count_bits(ref->gfc, f->xrpow[gr], &ref_gi, NULL);
+        int const b = opt->k->count_bits(opt->gfc, f->xrpow[gr], &opt_gi, NULL);
+        err = max2(err, abs(a - b) / (double)(a > 1 ? a : 1));
+    }
+    return err;
+}
+
+static double check_choose_table(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    for (int gr = 0; gr < 2; ++gr) {
+        int const *ix = f->gi[gr].l3_enc;
+        int const *end = ix + f->gi[gr].big_values;
+        int ref_bits = 0, opt_bits = 0;
+
+        if (ref->k->choose_table(ix, end, &ref_bits) != opt->k->choose_table(ix, end, &opt_bits)
+            || ref_bits != opt_bits) {
+            return 1.0;
+        }
+    }
+    return 0.0;
+}
+
+/* over_count must agree within one band, the noise values relatively */
+static double check_calc_noise(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    double err = 0;
+    for (int gr = 0; gr < 2; ++gr) {
+        calc_noise_result ref_res, opt_res;
+        int const a = ref->k->calc_noise(&f->gi[gr], f->xmin[gr], ref_work.distort, &ref_res, NULL);
+        int const b = opt->k->calc_noise(&f->gi[gr], f->xmin[gr], opt_work.distort, &opt_res, NULL);
+
+        if (abs(a - b) > 1) {
+            return 1.0;
+        }
+        err = max2(err, value_error(ref_work.distort, opt_work.distort, f->gi[gr].psymax));
+        err = max2(err, value_error(&ref_res.tot_noise, &opt_res.tot_noise, 1));
+        err = max2(err, value_error(&ref_res.max_noise, &opt_res.max_noise, 1));
+    }
+    return err;
+}
+
+static double check_fill_buffer_resample(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    int ref_used = 0, opt_used = 0;
+    int const a = ref->k->fill_buffer_resample(ref->gfc_resample, ref_work.out, 1152,
+                                               f->mfbuf, 2048, &ref_used, 0);
+    int const b = opt->k->fill_buffer_resample(opt->gfc_resample, opt_work.out, 1152,
+                                               f->mfbuf, 2048, &opt_used, 0);
+    if (a != b || ref_used != opt_used) {
+        return 1.0;
+    }
+    return peak_error(ref_work.out, opt_work.out, a);
+}
+
+static double check_compute_masking_l(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    int const npart = ref->gfc->cd_psy->l.npart;
+    ref->k->compute_masking_l(ref->gfc, f->fftenergy, ref_work.eb, ref_work.thr, 0);
+    opt->k->compute_masking_l(opt->gfc, f->fftenergy, opt_work.eb, opt_work.thr, 0);
+    return max2(value_error(ref_work.eb, opt_work.eb, npart),
+                value_error(ref_work.thr, opt_work.thr, npart));
+}
+
+/* share of the packed bytes that differ */
+static double check_putbits2(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    int n, differ = 0;
+
+    ref->k->putbits2(ref->gfc, f->put_val, f->put_bits, f->npairs);
+    opt->k->putbits2(opt->gfc, f->put_val, f->put_bits, f->npairs);
+    if (ref->gfc->bs.totbit != opt->gfc->bs.totbit) {
+        return 1.0;
+    }
+    n = (ref->gfc->bs.totbit + 7) / 8;
+    for (int i = 0; i < n; ++i) {
+        differ += ref->gfc->bs.buf[i] != opt->gfc->bs.buf[i];
+    }
+    return n > 0 ? differ / (double)n : 0.0;
+}
+
+/* share of the bands whose scalefactor differs */
+static double check_find_scalefacs(const kb_variant *ref, const kb_variant *opt, kb_frame *f) {
+    int differ = 0, bands = 0;
+
+    for (int gr = 0; gr < 2; ++gr) {
+        ref->k->find_scalefacs(&f->gi[gr], f->xrpow[gr], f->xmin[gr], ref_work.sf);
+        opt->k->find_scalefacs(&f->gi[gr], f->xrpow[gr], f->xmin[gr], opt_work.sf);
+        for (int sfb = 0; sfb < f->gi[gr].psymax; ++sfb) {
+            differ += ref_work.sf[sfb] != opt_work.sf[sfb];
+        }
+        bands += f->gi[gr].psymax;
+    }
+    return bands > 0 ? differ / (double)bands : 0.0;
+}
+
+static const struct {
+    const char *name;
+    check_fn check;
+    double tolerance;
+} kernels[] = {
+    {"fht", check_fht, 1e-5},
+    {"fft_long", check_fft_long, 1e-5},
+    {"fft_short", check_fft_short, 1e-5},
+    {"window_subband", check_window_subband, 1e-5},
+    {"mdct_sub48", check_mdct_sub48, 1e-5},
+    {"init_xrpow_core", check_init_xrpow_core, 1e-5},
+    {"quantize_xrpow", check_quantize_xrpow, 0.01},
+    {"count_bits", check_count_bits, 0.02},
+    {"choose_table", check_choose_table, 0.0},
+    {"calc_noise", check_calc_noise, 1e-4},
+    {"fill_buffer_resample", check_fill_buffer_resample, 1e-5},
+    {"vbrpsy_compute_masking_l", check_compute_masking_l, 1e-4},
+    {"putbits2", check_putbits2, 0.0},
+    {"find_scalefac_x34", check_find_scalefacs, 0.01},
+};
+
+#define NKERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+/* ----------------------------------------------------------------------
+ * bitstreams
+ * ---------------------------------------------------------------------- */
+
+typedef struct {
+    const char *name;
+    int sample_rate;
+    vbr_mode vbr;
+    int replay_gain;
+} sc_config;
+
+static const sc_config configs[] = {
+    {"cbr/44100", 44100, vbr_off, 0},
+    {"cbr/22050", 22050, vbr_off, 0},
+    {"vbr/44100", 44100, vbr_mtrh, 0},
+    {"replaygain/44100", 44100, vbr_off, 1},
+};
+
+typedef struct {
+    int kernel;         /* index into kernels[] */
+    const lame_kernels *k;
+} sc_force;
+
+typedef struct {
+    unsigned char *data;
+    int size;
+    int radio_gain;
+} sc_stream;
+
+/* Points the encoder's dispatched kernels at those of table k. */
+static void patch_kernel(lame_internal_flags *gfc, const char *name, const lame_kernels *k) {
+    if (!strcmp(name, "fht")) {
+        gfc->fft_fht = k->fht;
+    } else if (!strcmp(name, "init_xrpow_core")) {
+        gfc->init_xrpow_core = k->init_xrpow_core;
+    } else if (!strcmp(name, "choose_table")) {
+        gfc->choose_table = k->choose_table;
+    }
+}
+
+static int encode(sc_stream *out, const lame_kernels *k, const sc_config *cfg,
+                  const bench_clip *clip, const sc_force *force, int nforce) {
+    const lame_api *const api = &k->api;
+    lame_t gfp = api->init();
+    lame_internal_flags *gfc;
+    int cap, n;
+
+    memset(out, 0, sizeof(*out));
+    if (gfp == NULL) {
+        return -1;
+    }
+    api->set_num_channels(gfp, 1);
+    api->set_in_samplerate(gfp, clip->sample_rate);
+    api->set_out_samplerate(gfp, clip->sample_rate);
+    api->set_brate(gfp, BENCH_BITRATE);
+    api->set_quality(gfp, BENCH_QUALITY);
+    api->set_mode(gfp, MONO);
+    api->set_VBR(gfp, cfg->vbr);
+    k->set_findReplayGain(gfp, cfg->replay_gain);
+    if (api->init_params(gfp) < 0) {
+        api->close(gfp);
+        return -1;
+    }
+    gfc = k->internal_flags(gfp);
+    patch_kernel(gfc, "fht", k);
+    patch_kernel(gfc, "init_xrpow_core", k);
+    for (int i = 0; i < nforce; ++i) {
+        patch_kernel(gfc, kernels[force[i].kernel].name, force[i].k);
+    }
+
+    cap = (int)(1.25 * clip->frames) + 7200 + LAME_MAXMP3BUFFER;
+    out->data = (unsigned char *)malloc((size_t)cap);
+    if (out->data == NULL) {
+        api->close(gfp);
+        return -1;
+    }
+    for (long pos = 0; pos < clip->frames; pos += 1152) {
+        int const len = (int)(clip->frames - pos < 1152 ? clip->frames - pos : 1152);
+        short mono[1152];
+
+        for (int j = 0; j < len; ++j) {
+            int sum = 0;
+            for (int ch = 0; ch < clip->channels; ++ch) {
+                sum += clip->s16[(pos + j) * clip->channels + ch];
+            }
+            mono[j] = (short)(sum / clip->channels);
+        }
+        n = api->encode_buffer(gfp, mono, NULL, len, out->data + out->size, cap - out->size);
+        if (n < 0) {
+            api->close(gfp);
+            return -1;
+        }
+        out->size += n;
+    }
+    n = api->encode_flush(gfp, out->data + out->size, cap - out->size);
+    out->size += n > 0 ? n : 0;
+    out->radio_gain = cfg->replay_gain ? k->get_RadioGain(gfp) : 0;
+    api->close(gfp);
+    return 0;
+}
+
+static unsigned get_bits(const unsigned char *p, int pos, int n) {
+    unsigned v = 0;
+    for (int i = 0; i < n; ++i, ++pos) {
+        v = (v << 1) | ((p[pos >> 3] >> (7 - (pos & 7))) & 1);
+    }
+    return v;
+}
+
+/* Length of the mono Layer III frame at p and its global_gain values,
+ * 0 if there is no frame. */
+static int parse_frame(const unsigned char *p, int avail, int gain[2], int *ngr) {
+    static const int brate[2][15] = {
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}
+    };
+    static const int srate[3] = {44100, 48000, 32000};
+    int mpeg1, shift, bri, sri, len, bit;
+
+    if (avail < 4 || p[0] != 0xff || (p[1] & 0xe0) != 0xe0) {
+        return 0;
+    }
+    mpeg1 = (p[1] >> 3) & 1;
+    shift = (p[1] & 0x10) ? (mpeg1 ? 0 : 1) : 2;
+    bri = p[2] >> 4;
+    sri = (p[2] >> 2) & 3;
+    if (bri == 0 || bri == 15 || sri == 3) {
+        return 0;
+    }
+    len = (mpeg1 ? 144000 : 72000) * brate[mpeg1][bri] / (srate[sri] >> shift) + ((p[2] >> 1) & 1);
+    if (len > avail || len < 4 + 2 + 17) {
+        return 0;
+    }
+    bit = 8 * (4 + ((p[1] & 1) ? 0 : 2));
+    if (mpeg1) {
+        /* main_data_begin, private_bits, scfsi; then 59 bits per granule */
+        *ngr = 2;
+        gain[0] = (int)get_bits(p, bit + 18 + 21, 8);
+        gain[1] = (int)get_bits(p, bit + 18 + 59 + 21, 8);
+    } else {
+        /* main_data_begin, private_bit */
+        *ngr = 1;
+        gain[0] = (int)get_bits(p, bit + 9 + 21, 8);
+        gain[1] = 0;
+    }
+    return len;
+}
+
+typedef struct {
+    int exact;
+    int frames;
+    int frames_differing;
+    int max_gain_delta;
+    int pass;
+} sc_compare;
+
+static void compare_streams(sc_compare *c, const sc_stream *ref, const sc_stream *opt,
+                            int gain_tolerance) {
+    int pr = 0, po = 0;
+
+    memset(c, 0, sizeof(*c));
+    c->exact = ref->size == opt->size && !memcmp(ref->data, opt->data, (size_t)ref->size);
+    c->pass = 1;
+    while (pr < ref->size || po < opt->size) {
+        int ref_gain[2], opt_gain[2], ref_ngr = 0, opt_ngr = 0;
+        int const a = parse_frame(ref->data + pr, ref->size - pr, ref_gain, &ref_ngr);
+        int const b = parse_frame(opt->data + po, opt->size - po, opt_gain, &opt_ngr);
+
+        if (a == 0 || b == 0 || a != b || memcmp(ref->data + pr, opt->data + po, 4) != 0) {
+            /* different frame layout, or something that is not a frame */
+            c->pass = c->exact;
+            break;
+        }
+        ++c->frames;
+        if (memcmp(ref->data + pr, opt->data + po, (size_t)a) != 0) {
+            ++c->frames_differing;
+        }
+        for (int gr = 0; gr < ref_ngr; ++gr) {
+            int const d = abs(ref_gain[gr] - opt_gain[gr]);
+            c->max_gain_delta = d > c->max_gain_delta ? d : c->max_gain_delta;
+        }
+        pr += a;
+        po += b;
+    }
+    if (c->max_gain_delta > gain_tolerance || abs(ref->radio_gain - opt->radio_gain) > 1) {
+        c->pass = c->exact;
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * main
+ * ---------------------------------------------------------------------- */
+
+static int find_kernel(const char *name, size_t len) {
+    for (int i = 0; i < NKERNELS; ++i) {
+        if (strlen(kernels[i].name) == len && !strncmp(kernels[i].name, name, len)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: lame_simd_check [--fixtures FILE] [--frames N] [--seconds N]\n"
+            "                       [--kernel NAME] [--variant NAME] [--force KERNEL=VARIANT]\n"
+            "                       [--gain-tolerance N] [--no-bitstreams] [file.wav ...]\n"
+            "  --force takes fht, init_xrpow_core or choose_table\n");
+}
+
+int main(int argc, char **argv) {
+    const char *fixture_path = NULL, *only_kernel = NULL, *only_variant = NULL;
+    int want = 16, gain_tolerance = 2, bitstreams = 1, nforce = 0, nvariants = 0;
+    int all_pass = 1, first;
+    double seconds = 10.0;
+    kb_variant variants[KB_MAX_VARIANTS];
+    sc_force force[NKERNELS];
+    const lame_kernels *tables[KB_MAX_VARIANTS] = {
+        lame_kernels_c(), lame_kernels_native(), lame_kernels_sse()
+    };
+    int i, nwav = 0;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--fixtures") && i + 1 < argc) {
+            fixture_path = argv[++i];
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            want = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--kernel") && i + 1 < argc) {
+            only_kernel = argv[++i];
+        } else if (!strcmp(argv[i], "--variant") && i + 1 < argc) {
+            only_variant = argv[++i];
+        } else if (!strcmp(argv[i], "--gain-tolerance") && i + 1 < argc) {
+            gain_tolerance = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-bitstreams")) {
+            bitstreams = 0;
+        } else if (!strcmp(argv[i], "--force") && i + 1 < argc) {
+            const char *const spec = argv[++i];
+            const char *const eq = strchr(spec, '=');
+            int const kernel = eq != NULL ? find_kernel(spec, (size_t)(eq - spec)) : -1;
+            const lame_kernels *k = NULL;
+
+            for (int t = 0; eq != NULL && t < KB_MAX_VARIANTS; ++t) {
+                if (tables[t] != NULL && !strcmp(tables[t]->name, eq + 1)) {
+                    k = tables[t];
+                }
+            }
+            if (kernel < 0 || k == NULL
+                || (strcmp(kernels[kernel].name, "fht") && strcmp(kernels[kernel].name, "init_xrpow_core")
+                    && strcmp(kernels[kernel].name, "choose_table"))) {
+                fprintf(stderr, "lame_simd_check: cannot force %s\n", spec);
+                usage();
+                return 2;
+            }
+            force[nforce].kernel = kernel;
+            force[nforce].k = k;
+            ++nforce;
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else {
+            argv[++nwav] = argv[i];
+        }
+    }
+    if (want <= 0 || seconds <= 0
+        || (only_kernel != NULL && find_kernel(only_kernel, strlen(only_kernel)) < 0)) {
+        usage();
+        return 2;
+    }
+
+    for (i = 0; i < KB_MAX_VARIANTS; ++i) {
+        if (tables[i] == NULL || (i > 0 && only_variant != NULL && strcmp(only_variant, tables[i]->name))) {
+            continue;
+        }
+        if (kb_open_variant(&variants[nvariants], tables[i]) < 0) {
+            fprintf(stderr, "lame_simd_check: cannot open the %s encoder\n", tables[i]->name);
+            return 2;
+        }
+        ++nvariants;
+    }
+    if (nvariants < 2) {
+        fprintf(stderr, "lame_simd_check: no optimized build to check\n");
+        return 2;
+    }
+
+    if (fixture_path != NULL ? kb_load(&fx, fixture_path) < 0
+                             : kb_record(&fx, &variants[0], argv + 1, nwav, want) < 0) {
+        fprintf(stderr, "lame_simd_check: no fixtures\n");
+        return 2;
+    }
+
+    printf("{\n  \"reference\": \"%s\",\n  \"fixtures\": {\"frames\": %d},\n  \"kernels\": [\n",
+           variants[0].k->name, fx.count);
+    first = 1;
+    for (int v = 1; v < nvariants; ++v) {
+        /* stateful kernels need a reference that has seen the same frames */
+        if (v > 1) {
+            kb_close_variant(&variants[0]);
+            if (kb_open_variant(&variants[0], tables[0]) < 0) {
+                fprintf(stderr, "lame_simd_check: cannot reopen the %s encoder\n", tables[0]->name);
+                return 2;
+            }
+        }
+        for (int k = 0; k < NKERNELS; ++k) {
+            double err = 0;
+            int pass;
+
+            if (only_kernel != NULL && strcmp(only_kernel, kernels[k].name)) {
+                continue;
+            }
+            for (i = 0; i < fx.count; ++i) {
+                err = max2(err, kernels[k].check(&variants[0], &variants[v], &fx.frame[i]));
+            }
+            pass = err <= kernels[k].tolerance;
+            all_pass &= pass;
+            printf("%s    {\"kernel\": \"%s\", \"variant\": \"%s\", \"max_error\": %.3g, "
+                   "\"tolerance\": %g, \"pass\": %s}",
+                   first ? "" : ",\n", kernels[k].name, variants[v].k->name, err,
+                   kernels[k].tolerance, pass ? "true" : "false");
+            first = 0;
+        }
+    }
+    printf("\n  ],\n  \"bitstreams\": [\n");
+    fflush(stdout);
+
+    first = 1;
+    for (int c = 0; bitstreams && c < (int)(sizeof(configs) / sizeof(configs[0])); ++c) {
+        int const nclips = nwav > 0 ? nwav : bench_synthetic_count();
+
+        for (int n = 0; n < nclips; ++n) {
+            bench_clip clip;
+            sc_stream ref;
+
+            if (nwav > 0 ? bench_load_wav(&clip, argv[1 + n]) < 0
+                         : bench_make_synthetic(&clip, n, configs[c].sample_rate, seconds) < 0) {
+                fprintf(stderr, "lame_simd_check: cannot read %s\n", nwav > 0 ? argv[1 + n] : "corpus");
+                return 2;
+            }
+            if (clip.sample_rate != configs[c].sample_rate) {
+                /* WAV files are checked in the configurations of their own rate */
+                bench_clip_free(&clip);
+                continue;
+            }
+            if (encode(&ref, variants[0].k, &configs[c], &clip, NULL, 0) < 0) {
+                fprintf(stderr, "lame_simd_check: %s: cannot encode %s\n", variants[0].k->name, clip.name);
+                return 2;
+            }
+            for (int v = 1; v < nvariants; ++v) {
+                sc_stream opt;
+                sc_compare cmp;
+
+                if (encode(&opt, variants[v].k, &configs[c], &clip, force, nforce) < 0) {
+                    fprintf(stderr, "lame_simd_check: %s: cannot encode %s\n",
+                            variants[v].k->name, clip.name);
+                    return 2;
+                }
+                compare_streams(&cmp, &ref, &opt, gain_tolerance);
+                all_pass &= cmp.pass;
+                printf("%s    {\"config\": \"%s\", \"clip\": \"%s\", \"variant\": \"%s\", "
+                       "\"bytes\": %d, \"exact\": %s, \"frames\": %d, \"frames_differing\": %d, "
+                       "\"max_gain_delta\": %d",
+                       first ? "" : ",\n", configs[c].name, clip.name, variants[v].k->name,
+                       opt.size, cmp.exact ? "true" : "false", cmp.frames, cmp.frames_differing,
+                       cmp.max_gain_delta);
+                if (configs[c].replay_gain) {
+                    printf(", \"radio_gain\": %d, \"reference_radio_gain\": %d",
+                           opt.radio_gain, ref.radio_gain);
+                }
+                printf(", \"pass\": %s}", cmp.pass ? "true" : "false");
+                first = 0;
+                fflush(stdout);
+                free(opt.data);
+            }
+            free(ref.data);
+            bench_clip_free(&clip);
+        }
+    }
+    printf("\n  ],\n  \"pass\": %s\n}\n", all_pass ? "true" : "false");
+
+    for (i = 0; i < nvariants; ++i) {
+        kb_close_variant(&variants[i]);
+    }
+    kb_free(&fx);
+    return all_pass ? 0 : 1;
+}
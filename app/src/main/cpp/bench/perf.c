@@ -0,0 +1,143 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "perf.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *const counter_names[PERF_COUNTERS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+#if defined(__linux__)
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} counter_events[PERF_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int leader = -1;
+static int fds[PERF_COUNTERS];
+static int slot[PERF_COUNTERS];     /* position in the group read, -1 if not open */
+static int nopen;
+
+int perf_open(void) {
+    perf_close();
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        struct perf_event_attr attr;
+
+        slot[i] = -1;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter_events[i].type;
+        attr.config = counter_events[i].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                           | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.disabled = leader < 0;
+        fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        if (fds[i] < 0) {
+            continue;
+        }
+        if (leader < 0) {
+            leader = fds[i];
+        }
+        slot[i] = nopen++;
+    }
+    if (leader < 0) {
+        return -1;
+    }
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return nopen;
+}
+
+void perf_close(void) {
+    for (int i = 0; i < PERF_COUNTERS && leader >= 0; ++i) {
+        if (slot[i] >= 0) {
+            close(fds[i]);
+        }
+        slot[i] = -1;
+    }
+    leader = -1;
+    nopen = 0;
+}
+
+int perf_available(void) {
+    return leader >= 0;
+}
+
+void perf_read(perf_sample *s) {
+    uint64_t buf[3 + PERF_COUNTERS];   /* nr, time_enabled, time_running, values */
+    double scale;
+
+    memset(s, 0, sizeof(*s));
+    if (leader < 0 || read(leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t))) {
+        return;
+    }
+    scale = buf[2] > 0 ? (double)buf[1] / (double)buf[2] : 0.0;
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        if (slot[i] >= 0 && slot[i] < (int)buf[0]) {
+            s->value[i] = (double)buf[3 + slot[i]] * scale;
+        }
+    }
+}
+
+#else
+
+int perf_open(void) {
+    return -1;
+}
+
+void perf_close(void) {
+}
+
+int perf_available(void) {
+    return 0;
+}
+
+void perf_read(perf_sample *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+#endif
+
+void perf_accumulate(perf_sample *acc, const perf_sample *start, const perf_sample *end) {
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        acc->value[i] += end->value[i] - start->value[i];
+    }
+}
+
+void perf_print_json(FILE *f, const perf_sample *s, double per) {
+    double const cycles = s->value[PERF_CYCLES];
+
+    per = per > 0 ? per : 1;
+    if (cycles > 0 && s->value[PERF_INSTRUCTIONS] > 0) {
+        fprintf(f, "{\"ipc\": %.2f", s->value[PERF_INSTRUCTIONS] / cycles);
+    } else {
+        fprintf(f, "{\"ipc\": null");
+    }
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+#if defined(__linux__)
+        if (slot[i] < 0) {
+            fprintf(f, ", \"%s\": null", counter_names[i]);
+            continue;
+        }
+#endif
+        fprintf(f, ", \"%s\": %.1f", counter_names[i], s->value[i] / per);
+    }
+    fprintf(f, "}");
+}
@@ -0,0 +1,42 @@
+#ifndef LAME_BENCH_PERF_H
+#define LAME_BENCH_PERF_H
+
+#include <stdio.h>
+
+/*
+ * Hardware counters of the calling thread through perf_event_open(2),
+ * user space only. Linux and Android; elsewhere perf_open fails.
+ *
+ * The counters run as one group, so they cover the same instructions;
+ * a counter the CPU or kernel does not offer is left out and printed as
+ * null. Reading costs a system call, so per-stage collection inflates the
+ * wall times a little.
+ */
+typedef enum {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTERS
+} perf_counter;
+
+typedef struct {
+    double  value[PERF_COUNTERS];   /* scaled for multiplexing */
+} perf_sample;
+
+/* Number of counters opened, -1 if there are none. */
+int perf_open(void);
+void perf_close(void);
+int perf_available(void);
+
+/* Current totals; all zero if perf is not open. */
+void perf_read(perf_sample *s);
+
+/* acc += end - start */
+void perf_accumulate(perf_sample *acc, const perf_sample *start, const perf_sample *end);
+
+/* {"ipc": ..., "cycles": ..., ...} with the counts divided by per. */
+void perf_print_json(FILE *f, const perf_sample *s, double per);
+
+#endif
@@ -0,0 +1,325 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#if defined(__ANDROID__)
+#include <android/api-level.h>
+#endif
+
+#include "file_copy.h"
+
+#define COPY_BUFFERS    2
+#define COPY_ALIGN      4096
+
+typedef enum {
+    COPY_FILE_RANGE,
+    COPY_SENDFILE
+} kernel_method;
+
+typedef struct {
+    int     in_fd;
+    int     out_fd;
+    int     flags;
+    file_copy_progress *progress;
+    int64_t copied;
+} copy_state;
+
+/* The progress fields are read by another thread while the copy runs. */
+static int64_t load64(const int64_t *p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static void store64(int64_t *p, int64_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+static int cancelled(const copy_state *c) {
+    if (c->progress != NULL && load64(&c->progress->cancel) != 0) {
+        errno = ECANCELED;
+        return 1;
+    }
+    return 0;
+}
+
+/* n more bytes are written */
+static int advance(copy_state *c, int64_t n) {
+    /* EINVAL: out_fd is a pipe or the like, nothing to sync */
+    if ((c->flags & COPY_SYNC) && fdatasync(c->out_fd) < 0 && errno != EINVAL) {
+        return -1;
+    }
+    c->copied += n;
+    if (c->progress != NULL) {
+        store64(&c->progress->copied, c->copied);
+    }
+    return 0;
+}
+
+static int copy_file_range_allowed(void) {
+#if !defined(__NR_copy_file_range)
+    return 0;
+#elif defined(__ANDROID__)
+    /* not in the app seccomp allowlist before bionic wraps it */
+    return android_get_device_api_level() >= 34;
+#else
+    return 1;
+#endif
+}
+
+/* The kernel will not do this copy; nothing was copied yet, so another way can. */
+static int refused(int err) {
+    return err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == EINVAL || err == EBADF
+           || err == EPERM || err == ESPIPE;
+}
+
+/* 1 when done, 0 if the kernel refused before copying anything, -1 on an error */
+static int kernel_copy(copy_state *c, kernel_method method, int64_t total) {
+    off_t in_offset = 0;
+#if defined(__NR_copy_file_range)
+    loff_t range_in = 0, range_out = 0;
+#endif
+
+    for (;;) {
+        ssize_t n;
+
+        if (cancelled(c)) {
+            return -1;
+        }
+        if (method == COPY_FILE_RANGE) {
+#if defined(__NR_copy_file_range)
+            n = (ssize_t)syscall(__NR_copy_file_range, c->in_fd, &range_in, c->out_fd, &range_out,
+                                 (size_t)COPY_CHUNK, 0u);
+#else
+            errno = ENOSYS;
+            n = -1;
+#endif
+        } else {
+            /* writes at out_fd's position, which is still 0 */
+            n = sendfile(c->out_fd, c->in_fd, &in_offset, COPY_CHUNK);
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return c->copied == 0 && refused(errno) ? 0 : -1;
+        }
+        if (n == 0) {
+            /* some filesystems report 0 instead of refusing */
+            return c->copied == 0 && total > 0 ? 0 : 1;
+        }
+        if (advance(c, n) < 0) {
+            return -1;
+        }
+    }
+}
+
+/* COPY_CHUNK bytes, fewer only at the end of the input; -1 with errno */
+static ssize_t read_chunk(int fd, int seekable, int64_t *offset, unsigned char *buf) {
+    size_t got = 0;
+
+    while (got < COPY_CHUNK) {
+        ssize_t n = seekable ? pread(fd, buf + got, COPY_CHUNK - got, (off_t)*offset)
+                             : read(fd, buf + got, COPY_CHUNK - got);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        got += (size_t)n;
+        *offset += n;
+    }
+    return (ssize_t)got;
+}
+
+static int write_all(int fd, int seekable, int64_t *offset, const unsigned char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = seekable ? pwrite(fd, buf, len, (off_t)*offset) : write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+        *offset += n;
+    }
+    return 0;
+}
+
+/* The reader thread fills buffers the calling thread writes out, in turn. */
+typedef struct {
+    copy_state *c;
+    int     in_seekable;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned char *buf[COPY_BUFFERS];
+    ssize_t len[COPY_BUFFERS];  /* of a full buffer; -1 if the read failed */
+    int     full[COPY_BUFFERS];
+    int     read_errno;
+    int     stop;
+} pipeline;
+
+static void *reader_main(void *arg) {
+    pipeline *p = (pipeline *)arg;
+    int64_t offset = 0;
+
+    for (int i = 0;; i = (i + 1) % COPY_BUFFERS) {
+        pthread_mutex_lock(&p->lock);
+        while (p->full[i] && !p->stop) {
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+        int const stop = p->stop;
+        pthread_mutex_unlock(&p->lock);
+        if (stop) {
+            break;
+        }
+
+        ssize_t n = read_chunk(p->c->in_fd, p->in_seekable, &offset, p->buf[i]);
+
+        pthread_mutex_lock(&p->lock);
+        if (n < 0) {
+            p->read_errno = errno;
+        }
+        p->len[i] = n;
+        p->full[i] = 1;
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->lock);
+        if (n < COPY_CHUNK) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int write_pipeline(pipeline *p, int out_seekable) {
+    int64_t offset = 0;
+
+    for (int i = 0;; i = (i + 1) % COPY_BUFFERS) {
+        pthread_mutex_lock(&p->lock);
+        while (!p->full[i]) {
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+        ssize_t const len = p->len[i];
+        pthread_mutex_unlock(&p->lock);
+
+        if (len < 0) {
+            errno = p->read_errno;
+            return -1;
+        }
+        if (cancelled(p->c)
+            || (len > 0 && (write_all(p->c->out_fd, out_seekable, &offset, p->buf[i], (size_t)len) < 0
+                            || advance(p->c, len) < 0))) {
+            return -1;
+        }
+        if (len < COPY_CHUNK) {
+            return 0;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        p->full[i] = 0;
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+/* One buffer in turn, if there is no reader thread to be had. */
+static int copy_serial(copy_state *c, unsigned char *buf, int in_seekable, int out_seekable) {
+    int64_t in_offset = 0, out_offset = 0;
+
+    for (;;) {
+        if (cancelled(c)) {
+            return -1;
+        }
+        ssize_t n = read_chunk(c->in_fd, in_seekable, &in_offset, buf);
+        if (n < 0 || (n > 0 && (write_all(c->out_fd, out_seekable, &out_offset, buf, (size_t)n) < 0
+                                || advance(c, n) < 0))) {
+            return -1;
+        }
+        if (n < COPY_CHUNK) {
+            return 0;
+        }
+    }
+}
+
+static int buffered_copy(copy_state *c) {
+    pipeline p;
+    pthread_t reader;
+    int result = -1;
+
+    memset(&p, 0, sizeof(p));
+    p.c = c;
+    p.in_seekable = lseek(c->in_fd, 0, SEEK_CUR) >= 0;
+    int const out_seekable = lseek(c->out_fd, 0, SEEK_CUR) >= 0;
+    for (int i = 0; i < COPY_BUFFERS; ++i) {
+        void *buf = NULL;
+        if (posix_memalign(&buf, COPY_ALIGN, COPY_CHUNK) != 0) {
+            errno = ENOMEM;
+            goto done;
+        }
+        p.buf[i] = (unsigned char *)buf;
+    }
+
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.changed, NULL);
+    if (pthread_create(&reader, NULL, reader_main, &p) != 0) {
+        result = copy_serial(c, p.buf[0], p.in_seekable, out_seekable);
+    } else {
+        result = write_pipeline(&p, out_seekable);
+        int const saved = errno;
+
+        pthread_mutex_lock(&p.lock);
+        p.stop = 1;
+        pthread_cond_broadcast(&p.changed);
+        pthread_mutex_unlock(&p.lock);
+        pthread_join(reader, NULL);
+        errno = saved;
+    }
+    pthread_cond_destroy(&p.changed);
+    pthread_mutex_destroy(&p.lock);
+
+done:
+    for (int i = 0; i < COPY_BUFFERS; ++i) {
+        free(p.buf[i]);
+    }
+    return result;
+}
+
+int64_t file_copy(int in_fd, int out_fd, file_copy_progress *progress, int flags) {
+    copy_state c;
+    struct stat st;
+    int64_t total = -1;
+    int done = 0;
+
+    if (fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        total = st.st_size;
+    }
+    c.in_fd = in_fd;
+    c.out_fd = out_fd;
+    c.flags = flags;
+    c.progress = progress;
+    c.copied = 0;
+    if (progress != NULL) {
+        store64(&progress->total, total);
+        store64(&progress->copied, 0);
+    }
+
+    if (copy_file_range_allowed()) {
+        done = kernel_copy(&c, COPY_FILE_RANGE, total);
+    }
+    if (done == 0) {
+        done = kernel_copy(&c, COPY_SENDFILE, total);
+    }
+    if (done == 0) {
+        done = buffered_copy(&c) == 0 ? 1 : -1;
+    }
+    return done < 0 ? -1 : c.copied;
+}
@@ -0,0 +1,40 @@
+#ifndef FILE_COPY_H
+#define FILE_COPY_H
+
+#include <stdint.h>
+
+/*
+ * Copies one fd to another without the data passing through Java.
+ *
+ * The kernel copies where it can: copy_file_range (same filesystem, and
+ * on Android only from API 34, where the app seccomp filter allows it),
+ * then sendfile. Otherwise, or when the kernel refuses, a reader thread
+ * preads COPY_CHUNK blocks into page-aligned buffers while the calling
+ * thread pwrites the previous one, so on latency-bound storage (USB
+ * behind FUSE) a read and a write are in flight together. Fds that
+ * cannot seek (pipes from content providers) are read and written in
+ * sequence.
+ *
+ * Progress goes through a file_copy_progress the caller may read from
+ * another thread while the copy runs, e.g. a direct ByteBuffer.
+ */
+
+#define COPY_CHUNK      (1024 * 1024)
+
+/* fdatasync out_fd after every chunk, so copied counts bytes on the device */
+#define COPY_SYNC       (1 << 0)
+
+typedef struct {
+    int64_t copied;             /* bytes written so far */
+    int64_t total;              /* size of in_fd, -1 if unknown */
+    int64_t cancel;             /* set non-zero to stop the copy */
+} file_copy_progress;
+
+/*
+ * Copies in_fd from offset 0 (or its position, if it cannot seek) to its
+ * end into out_fd from offset 0. progress may be NULL. Returns the bytes
+ * copied, or -1 with errno (ECANCELED if cancelled).
+ */
+int64_t file_copy(int in_fd, int out_fd, file_copy_progress *progress, int flags);
+
+#endif
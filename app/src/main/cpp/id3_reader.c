@@ -0,0 +1,380 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "id3_reader.h"
+
+#define TEXT_BODY_MAX   1024    /* bytes of a text frame looked at */
+#define PICTURE_HEAD    320     /* bytes of an APIC frame for encoding, MIME, type, description */
+
+#define FRONT_COVER     3
+
+/* The frames region of a tag: in the file, or undone unsynchronisation in memory. */
+typedef struct {
+    int     fd;
+    long    base;               /* file offset of the region */
+    const unsigned char *mem;   /* NULL to read the file */
+    long    size;
+} source;
+
+static long read_at(int fd, long off, unsigned char *buf, long n) {
+    long got = 0;
+
+    while (got < n) {
+        ssize_t const rc = pread(fd, buf + got, (size_t)(n - got), off + got);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc < 0) {
+            return -1;
+        }
+        if (rc == 0) {
+            break;
+        }
+        got += rc;
+    }
+    return got;
+}
+
+/* Up to n bytes at off of the region, fewer at its end. */
+static long source_read(const source *s, long off, unsigned char *buf, long n) {
+    if (off >= s->size) {
+        return 0;
+    }
+    if (n > s->size - off) {
+        n = s->size - off;
+    }
+    if (s->mem != NULL) {
+        memcpy(buf, s->mem + off, (size_t)n);
+        return n;
+    }
+    return read_at(s->fd, s->base + off, buf, n);
+}
+
+static long synchsafe(const unsigned char *p) {
+    return ((long)(p[0] & 0x7F) << 21) | ((long)(p[1] & 0x7F) << 14) | ((long)(p[2] & 0x7F) << 7)
+           | (p[3] & 0x7F);
+}
+
+static long be32(const unsigned char *p) {
+    return ((long)p[0] << 24) | ((long)p[1] << 16) | ((long)p[2] << 8) | p[3];
+}
+
+/* Drops the 0x00 after each 0xFF in place; the new length. */
+static long unsynchronise(unsigned char *p, long n) {
+    long out = 0;
+
+    for (long i = 0; i < n; ++i) {
+        p[out++] = p[i];
+        if (p[i] == 0xFF && i + 1 < n && p[i + 1] == 0x00) {
+            ++i;
+        }
+    }
+    return out;
+}
+
+static void put_unit(id3_info *info, id3_field field, unsigned unit) {
+    if (info->text_length[field] < ID3_TEXT_MAX) {
+        info->text[field][info->text_length[field]++] = (uint16_t)unit;
+    }
+}
+
+/* Length of text in the given encoding up to its terminator (exclusive). */
+static long text_end(const unsigned char *p, long n, int encoding) {
+    long i = 0;
+
+    if (encoding == 1 || encoding == 2) {
+        while (i + 1 < n && (p[i] | p[i + 1]) != 0) {
+            i += 2;
+        }
+        return i + 1 < n ? i : n;
+    }
+    while (i < n && p[i] != 0) {
+        ++i;
+    }
+    return i;
+}
+
+/* The first value of an encoded string as UTF-16. */
+static void decode_text(id3_info *info, id3_field field, int encoding, const unsigned char *p, long n) {
+    n = text_end(p, n, encoding);
+    info->text_length[field] = 0;
+    switch (encoding) {
+    case 0:
+        for (long i = 0; i < n; ++i) {
+            put_unit(info, field, p[i]);
+        }
+        break;
+    case 1:
+    case 2: {
+        int big_endian = encoding == 2;
+        long i = 0;
+        if (encoding == 1 && n >= 2 && ((p[0] == 0xFE && p[1] == 0xFF) || (p[0] == 0xFF && p[1] == 0xFE))) {
+            big_endian = p[0] == 0xFE;
+            i = 2;
+        }
+        for (; i + 1 < n; i += 2) {
+            put_unit(info, field, big_endian ? (p[i] << 8) | p[i + 1] : p[i] | (p[i + 1] << 8));
+        }
+        break;
+    }
+    case 3:
+        for (long i = 0; i < n;) {
+            unsigned c = p[i++];
+            int more = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+            if (more > 0) {
+                c &= 0x3F >> more;
+            }
+            while (more-- > 0 && i < n && (p[i] & 0xC0) == 0x80) {
+                c = (c << 6) | (p[i++] & 0x3F);
+            }
+            if (c >= 0x10000) {
+                put_unit(info, field, 0xD800 + ((c - 0x10000) >> 10));
+                put_unit(info, field, 0xDC00 + ((c - 0x10000) & 0x3FF));
+            } else {
+                put_unit(info, field, c);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static int text_field(const char *id, int version) {
+    static const char *const ids22[ID3_FIELDS] = {"TT2", "TP1", "TAL", "TRK"};
+    static const char *const ids[ID3_FIELDS] = {"TIT2", "TPE1", "TALB", "TRCK"};
+
+    for (int i = 0; i < ID3_FIELDS; ++i) {
+        if (!memcmp(id, version == 2 ? ids22[i] : ids[i], version == 2 ? 3 : 4)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Encoding, MIME type, picture type and description of an APIC (PIC in
+ * 2.2) frame; how many bytes they take, 0 if they do not fit in n. */
+static long picture_head(const unsigned char *p, long n, int version, char *mime, int *type) {
+    long i = 1, end;
+
+    if (n < 2) {
+        return 0;
+    }
+    if (version == 2) {
+        if (n < 5) {
+            return 0;
+        }
+        /* a three letter image format instead of a MIME type */
+        strcpy(mime, !memcmp(p + 1, "PNG", 3) ? "image/png" : "image/jpeg");
+        i = 4;
+    } else {
+        end = text_end(p + 1, n - 1, 0);
+        if (1 + end >= n) {
+            return 0;
+        }
+        if (end < 32) {
+            memcpy(mime, p + 1, (size_t)end);
+            mime[end] = 0;
+        }
+        if (mime[0] != 0 && strchr(mime, '/') == NULL) {
+            /* some writers put just "jpeg" or "png" here */
+            strcpy(mime, !strcmp(mime, "png") || !strcmp(mime, "PNG") ? "image/png" : "image/jpeg");
+        }
+        i = 1 + end + 1;
+    }
+    if (i >= n) {
+        return 0;
+    }
+    *type = p[i++];
+    end = text_end(p + i, n - i, p[0]);
+    i += end + (p[0] == 1 || p[0] == 2 ? 2 : 1);
+    return i <= n ? i : 0;
+}
+
+static void read_frames(const source *s, int version, id3_info *info) {
+    int const header_size = version == 2 ? 6 : 10;
+    unsigned char header[10];
+    unsigned char *body = (unsigned char *)malloc(TEXT_BODY_MAX > PICTURE_HEAD ? TEXT_BODY_MAX : PICTURE_HEAD);
+    long off = 0;
+
+    if (body == NULL) {
+        return;
+    }
+    while (off + header_size <= s->size && source_read(s, off, header, header_size) == header_size) {
+        long size, data = off + header_size;
+        int flags = 0, field;
+
+        if (header[0] == 0) {
+            break;              /* padding */
+        }
+        if (version == 2) {
+            size = ((long)header[3] << 16) | ((long)header[4] << 8) | header[5];
+        } else {
+            size = version == 4 ? synchsafe(header + 4) : be32(header + 4);
+            flags = header[9];
+        }
+        if (size <= 0 || data + size > s->size) {
+            break;
+        }
+
+        /* 2.3 compression/encryption; 2.4 compression/encryption, unsynchronisation, data length */
+        if (!(version == 3 && (flags & 0xC0)) && !(version == 4 && (flags & 0x0C))) {
+            int const frame_unsync = version == 4 && (flags & 0x02);
+            long skip = version == 4 && (flags & 0x01) ? 4 : 0;
+
+            field = text_field((const char *)header, version);
+            if (field >= 0 && info->text_length[field] == 0 && size > skip + 1) {
+                long n = source_read(s, data + skip, body, size - skip < TEXT_BODY_MAX ? size - skip : TEXT_BODY_MAX);
+                if (n > 1) {
+                    if (frame_unsync) {
+                        n = unsynchronise(body, n);
+                    }
+                    decode_text(info, (id3_field)field, body[0], body + 1, n - 1);
+                }
+            } else if (!memcmp(header, version == 2 ? "PIC" : "APIC", version == 2 ? 3 : 4)
+                       && (info->picture_type != FRONT_COVER)) {
+                long n = source_read(s, data + skip, body, size - skip < PICTURE_HEAD ? size - skip : PICTURE_HEAD);
+                char mime[32] = "";
+                int type = 0;
+                long head;
+
+                if (n > 0 && frame_unsync) {
+                    n = unsynchronise(body, n);
+                }
+                head = n > 0 ? picture_head(body, n, version, mime, &type) : 0;
+                if (head > 0 && head < size - skip && (info->picture_type < 0 || type == FRONT_COVER)) {
+                    strcpy(info->picture_mime, mime);
+                    info->picture_type = type;
+                    /* the image bytes are in the file as is only without unsynchronisation */
+                    info->picture_offset = s->mem == NULL && !frame_unsync ? s->base + data + skip + head : -1;
+                    info->picture_length = size - skip - head;
+                }
+            }
+        }
+        off = data + size;
+    }
+    free(body);
+}
+
+static int read_id3v2(int fd, id3_info *info) {
+    unsigned char header[10];
+    unsigned char *mem = NULL;
+    source s;
+    int version, flags;
+
+    if (read_at(fd, 0, header, 10) != 10 || memcmp(header, "ID3", 3) || header[3] < 2 || header[3] > 4
+        || header[4] == 0xFF || ((header[6] | header[7] | header[8] | header[9]) & 0x80)) {
+        return 0;
+    }
+    version = header[3];
+    flags = header[5];
+    s.fd = fd;
+    s.base = 10;
+    s.mem = NULL;
+    s.size = synchsafe(header + 6);
+    if (version == 2 && (flags & 0x40)) {
+        return 0;               /* compressed, never specified */
+    }
+
+    if ((flags & 0x80) && version < 4) {
+        /* tag-wide unsynchronisation, frame sizes count the undone bytes */
+        long n = s.size < ID3_UNSYNC_MAX ? s.size : ID3_UNSYNC_MAX;
+
+        mem = (unsigned char *)malloc((size_t)n);
+        if (mem == NULL || (n = read_at(fd, 10, mem, n)) < 0) {
+            free(mem);
+            return -1;
+        }
+        s.mem = mem;
+        s.size = unsynchronise(mem, n);
+    }
+
+    if (version >= 3 && (flags & 0x40)) {
+        unsigned char ext[4];
+        long ext_size;
+        if (source_read(&s, 0, ext, 4) != 4) {
+            ext_size = s.size;
+        } else {
+            ext_size = version == 4 ? synchsafe(ext) : be32(ext) + 4;
+        }
+        if (ext_size > s.size) {
+            ext_size = s.size;
+        }
+        if (s.mem != NULL) {
+            s.mem += ext_size;
+        } else {
+            s.base += ext_size;
+        }
+        s.size -= ext_size;
+    }
+
+    info->version = version;
+    read_frames(&s, version, info);
+    free(mem);
+    return 0;
+}
+
+/* Fills in fields the ID3v2 tag did not have. */
+static int read_id3v1(int fd, id3_info *info) {
+    static const struct {
+        id3_field field;
+        int offset;
+    } fields[] = {{ID3_TITLE, 3}, {ID3_ARTIST, 33}, {ID3_ALBUM, 63}};
+    unsigned char tag[128];
+    struct stat st;
+    int found = 0;
+
+    if (fstat(fd, &st) < 0) {
+        return -1;
+    }
+    if (st.st_size < 128 || read_at(fd, (long)st.st_size - 128, tag, 128) != 128 || memcmp(tag, "TAG", 3)) {
+        return 0;
+    }
+    for (unsigned i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+        const unsigned char *const text = tag + fields[i].offset;
+        const unsigned char *const nul = memchr(text, 0, 30);
+        long n = nul != NULL ? nul - text : 30;
+
+        while (n > 0 && text[n - 1] == ' ') {
+            --n;
+        }
+        if (n > 0 && info->text_length[fields[i].field] == 0) {
+            decode_text(info, fields[i].field, 0, text, n);
+            found = 1;
+        }
+    }
+    /* ID3v1.1: track number in the last byte of the comment */
+    if (tag[125] == 0 && tag[126] != 0 && info->text_length[ID3_TRACK] == 0) {
+        int const track = tag[126];
+        if (track >= 100) {
+            put_unit(info, ID3_TRACK, '0' + track / 100);
+        }
+        if (track >= 10) {
+            put_unit(info, ID3_TRACK, '0' + track / 10 % 10);
+        }
+        put_unit(info, ID3_TRACK, '0' + track % 10);
+        found = 1;
+    }
+    if (found && info->version == 0) {
+        info->version = 1;
+    }
+    return 0;
+}
+
+int id3_read(int fd, id3_info *info) {
+    memset(info, 0, sizeof(*info));
+    info->picture_type = -1;
+    info->picture_offset = -1;
+    if (read_id3v2(fd, info) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < ID3_FIELDS; ++i) {
+        if (info->text_length[i] == 0) {
+            return read_id3v1(fd, info);
+        }
+    }
+    return 0;
+}
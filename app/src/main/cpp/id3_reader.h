@@ -0,0 +1,40 @@
+#ifndef ID3_READER_H
+#define ID3_READER_H
+
+#include <stdint.h>
+
+/*
+ * Title, artist, album, track and the embedded picture of an MP3, read
+ * from its ID3v2.2/2.3/2.4 tag (the reading side of id3tag.c), with an
+ * ID3v1 tag at the end of the file filling in what is missing.
+ *
+ * Only the tag header, the frame headers and the bodies of the wanted
+ * frames are read, a few small preads per file; the picture is located,
+ * not copied. A tag with tag-wide unsynchronisation is the exception, it
+ * is read whole (up to ID3_UNSYNC_MAX) to undo that.
+ */
+typedef enum {
+    ID3_TITLE = 0,
+    ID3_ARTIST,
+    ID3_ALBUM,
+    ID3_TRACK,
+    ID3_FIELDS
+} id3_field;
+
+#define ID3_TEXT_MAX    256     /* UTF-16 units kept per field */
+#define ID3_UNSYNC_MAX  (1024 * 1024)
+
+typedef struct {
+    int     version;            /* 2, 3, 4 for ID3v2.x, 1 for ID3v1 only, 0 for no tag */
+    uint16_t text[ID3_FIELDS][ID3_TEXT_MAX];    /* UTF-16, first value only */
+    int     text_length[ID3_FIELDS];            /* 0 if missing */
+    char    picture_mime[32];   /* "image/jpeg", ...; "" without a picture */
+    int     picture_type;       /* APIC picture type, -1 without a picture */
+    long    picture_offset;     /* of the image data in the file, -1 if not stored as is */
+    long    picture_length;
+} id3_info;
+
+/* 0, or -1 with errno on a read error; a file without tags is not one. */
+int id3_read(int fd, id3_info *info);
+
+#endif
@@ -0,0 +1,180 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "id3_writer.h"
+
+#define HEADER_SIZE     10      /* of the tag and of a frame */
+#define TAG_SIZE_MAX    ((1L << 28) - 1)
+
+static unsigned char *put_be32(unsigned char *p, long v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+    return p + 4;
+}
+
+static unsigned char *put_frame_header(unsigned char *p, const char *id, long size) {
+    memcpy(p, id, 4);
+    p = put_be32(p + 4, size);
+    p[0] = p[1] = 0;            /* flags */
+    return p + 2;
+}
+
+/* encoding, BOM, text */
+static long text_body_size(const id3_text_frame *frame) {
+    return 3 + 2 * frame->length;
+}
+
+/* encoding, MIME and its NUL, type, empty description, image */
+static long picture_body_size(const id3_picture *picture) {
+    return 1 + (long)strlen(picture->mime) + 1 + 1 + 1 + picture->length;
+}
+
+static long read_at(int fd, long off, unsigned char *buf, long n) {
+    long got = 0;
+
+    while (got < n) {
+        ssize_t const rc = pread(fd, buf + got, (size_t)(n - got), off + got);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc < 0) {
+            return -1;
+        }
+        if (rc == 0) {
+            break;
+        }
+        got += rc;
+    }
+    return got;
+}
+
+static int stream_picture(const id3_picture *picture, id3_sink sink, void *arg) {
+    if (picture->fd < 0) {
+        return picture->length > 0 ? sink(arg, picture->data, (size_t)picture->length) : 0;
+    }
+    unsigned char *buf = (unsigned char *)malloc(ID3_WRITER_CHUNK);
+    if (buf == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int result = 0;
+    for (long done = 0; done < picture->length && result == 0;) {
+        long n = picture->length - done;
+        if (n > ID3_WRITER_CHUNK) {
+            n = ID3_WRITER_CHUNK;
+        }
+        long const got = read_at(picture->fd, picture->offset + done, buf, n);
+        if (got < n) {
+            if (got >= 0) {
+                errno = EIO;
+            }
+            result = -1;
+        } else {
+            result = sink(arg, buf, (size_t)n);
+            done += n;
+        }
+    }
+    free(buf);
+    return result;
+}
+
+long id3_write(const id3_text_frame *frames, int count, const id3_picture *picture,
+               id3_sink sink, void *arg) {
+    long head_size = HEADER_SIZE;
+    long text_size = 0;
+    long frames_size = 0;
+
+    if (picture != NULL && picture->mime == NULL) {
+        picture = NULL;
+    }
+    if (picture != NULL && (picture->length < 0 || (picture->fd < 0 && picture->data == NULL
+                                                    && picture->length > 0))) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (frames[i].length > 0) {
+            if (frames[i].length > TAG_SIZE_MAX / 2) {
+                errno = EFBIG;
+                return -1;
+            }
+            text_size += HEADER_SIZE + text_body_size(&frames[i]);
+            if (text_size > TAG_SIZE_MAX) {
+                errno = EFBIG;
+                return -1;
+            }
+        }
+    }
+    frames_size = text_size;
+    if (picture != NULL) {
+        if (picture->length > TAG_SIZE_MAX) {
+            errno = EFBIG;
+            return -1;
+        }
+        frames_size += HEADER_SIZE + picture_body_size(picture);
+        head_size += HEADER_SIZE + picture_body_size(picture) - picture->length;
+    }
+    if (frames_size == 0) {
+        return 0;
+    }
+    if (frames_size > TAG_SIZE_MAX) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    /* all but the image: header and APIC head, then the text frames */
+    unsigned char *head = (unsigned char *)malloc((size_t)(head_size + text_size));
+    if (head == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    unsigned char *p = head;
+    memcpy(p, "ID3\3\0\0", 6);  /* version 2.3, no flags */
+    p[6] = (unsigned char)((frames_size >> 21) & 0x7f);
+    p[7] = (unsigned char)((frames_size >> 14) & 0x7f);
+    p[8] = (unsigned char)((frames_size >> 7) & 0x7f);
+    p[9] = (unsigned char)(frames_size & 0x7f);
+    p += HEADER_SIZE;
+    if (picture != NULL) {
+        size_t const mime_length = strlen(picture->mime);
+        p = put_frame_header(p, "APIC", picture_body_size(picture));
+        *p++ = 0;               /* ISO-8859-1 MIME and description */
+        memcpy(p, picture->mime, mime_length + 1);
+        p += mime_length + 1;
+        *p++ = (unsigned char)picture->type;
+        *p++ = 0;               /* empty description */
+    }
+    for (int i = 0; i < count; ++i) {
+        const id3_text_frame *frame = &frames[i];
+        if (frame->length <= 0) {
+            continue;
+        }
+        p = put_frame_header(p, frame->id, text_body_size(frame));
+        *p++ = 1;               /* UTF-16 with BOM */
+        *p++ = 0xff;
+        *p++ = 0xfe;
+        for (long k = 0; k < frame->length; ++k) {
+            *p++ = (unsigned char)frame->text[k];
+            *p++ = (unsigned char)(frame->text[k] >> 8);
+        }
+    }
+
+    int result;
+    if (picture == NULL) {
+        result = sink(arg, head, (size_t)(head_size + text_size));
+    } else {
+        result = sink(arg, head, (size_t)head_size);
+        if (result == 0) {
+            result = stream_picture(picture, sink, arg);
+        }
+        if (result == 0 && text_size > 0) {
+            result = sink(arg, head + head_size, (size_t)text_size);
+        }
+    }
+    free(head);
+    return result < 0 ? -1 : HEADER_SIZE + frames_size;
+}
@@ -0,0 +1,50 @@
+#ifndef ID3_WRITER_H
+#define ID3_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Writes an ID3v2.3 tag (the writing side of id3tag.c, as the converter
+ * uses it): one APIC frame, then the text frames in the order given, as
+ * UTF-16 with BOM, no padding. The last text frame thus ends the tag, so
+ * a placeholder there (the converter's TLEN) can be patched in place at
+ * tag size minus its frame size, or zeroed into padding.
+ *
+ * The header and APIC head go to the sink in one block, the text frames
+ * in another after the image. The image is
+ * streamed from a range of another file, read ID3_WRITER_CHUNK bytes at a
+ * time (e.g. where id3_read located the cover of the source), or taken
+ * from memory the caller holds, so a large cover never needs a copy of
+ * its own.
+ */
+
+#define ID3_WRITER_CHUNK    (64 * 1024)
+
+typedef struct {
+    char    id[5];              /* "TIT2", ... */
+    const uint16_t *text;       /* UTF-16 units, no BOM; the frame is left out if length is 0 */
+    long    length;
+} id3_text_frame;
+
+typedef struct {
+    const char *mime;           /* "image/jpeg", ...; NULL for no APIC frame */
+    int     type;               /* APIC picture type, 3 is the front cover */
+    int     fd;                 /* image read from fd at offset, or data if fd < 0 */
+    long    offset;
+    long    length;
+    const unsigned char *data;
+} id3_picture;
+
+/* Takes len bytes; 0, or -1 with errno. */
+typedef int (*id3_sink)(void *arg, const void *data, size_t len);
+
+/*
+ * Writes the tag to sink. picture may be NULL. Returns the tag size (0
+ * and nothing written if there are no frames), or -1 with errno: EIO if
+ * fd ends before the image does, EFBIG if the tag does not fit 28 bits.
+ */
+long id3_write(const id3_text_frame *frames, int count, const id3_picture *picture,
+               id3_sink sink, void *arg);
+
+#endif
@@ -303,6 +303,15 @@ int CDECL lame_get_findReplayGain(const lame_global_flags *);
 int CDECL lame_set_decode_on_the_fly(lame_global_flags *, int);
 int CDECL lame_get_decode_on_the_fly(const lame_global_flags *);
 
+/* low memory profile: size the bitstream output buffer for the stream
+   actually being encoded instead of the worst case. (The frame buffers,
+   subband samples and psymodel state are always allocated for the coded
+   channels only.) The output buffer then has no room for embedded album
+   art, an ID3v2 tag that does not fit is not written.
+   default = 0 (disabled) */
+int CDECL lame_set_low_memory(lame_global_flags *, int);
+int CDECL lame_get_low_memory(const lame_global_flags *);
+
 #if DEPRECATED_OR_OBSOLETE_CODE_REMOVED
 #else
 /* DEPRECATED: now does the same as lame_set_findReplayGain()
@@ -602,6 +611,94 @@ int CDECL lame_get_frameNum(const lame_global_flags *);
 */
 int CDECL lame_get_totalframes(const lame_global_flags *);
 
+/*
+  bytes lame_encode_buffer* and lame_encode_flush will return for
+  num_samples, the Info frame included but no ID3 tags. CBR only: exact
+  unless resampling (then as good as lame_get_totalframes), 0 for VBR or
+  if num_samples was not set.
+*/
+unsigned long CDECL lame_get_cbr_stream_size(const lame_global_flags *);
+
+/*
+  largest nsamples the caller passes to lame_encode_buffer* at a time.
+  lame_init_params then sets aside the input buffers for such calls, per
+  input channel, with the rest of the encoder's memory; larger calls get
+  them from the heap. default = 0: nothing set aside.
+*/
+int CDECL lame_set_input_chunk(lame_global_flags *, int);
+int CDECL lame_get_input_chunk(const lame_global_flags *);
+
+/*
+  memory held by one encoder, current and peak bytes per subsystem, each
+  block counted once whether it lives in the arena or on the heap.
+  arena_size is what lame_init and lame_init_params allocated in one
+  piece each, arena_used how much of it has been handed out; heap_bytes is what did not fit and was
+  allocated separately, so the footprint is arena_size + heap_bytes.
+  LAME_MEM_ANALYSIS is the caller's plotting_data while one is attached
+  in analysis mode, it is not part of that footprint. ID3 tag strings
+  are not counted.
+*/
+typedef enum lame_mem_subsystem_e {
+    LAME_MEM_CORE = 0,      /* encoder state and frame buffers, ATH, ReplayGain */
+    LAME_MEM_PSYMODEL,      /* psymodel constants, state and frame work areas */
+    LAME_MEM_BITSTREAM,     /* output buffer, VBR seek table */
+    LAME_MEM_INPUT,         /* input sample buffers */
+    LAME_MEM_RESAMPLE,      /* resampler filters and history */
+    LAME_MEM_ANALYSIS,      /* plotting data filled in analysis mode */
+    LAME_MEM_SUBSYSTEMS
+} lame_mem_subsystem;
+
+typedef struct {
+    size_t  current[LAME_MEM_SUBSYSTEMS];
+    size_t  peak[LAME_MEM_SUBSYSTEMS];
+    size_t  arena_size;
+    size_t  arena_used;
+    size_t  heap_bytes;
+    size_t  heap_peak;
+} lame_memory_stats;
+
+int CDECL lame_get_memory_stats(const lame_global_flags *, lame_memory_stats *);
+
+/*
+  where one encoder spends its time, and how hard the quantizer works.
+  The counters are always kept; stage_seconds only while stage timing is
+  enabled (lame_set_stage_timing), which reads a monotonic clock seven
+  times per frame.
+*/
+typedef enum lame_stage_e {
+    LAME_STAGE_PSYMODEL = 0,    /* psychoacoustic model, block type decision */
+    LAME_STAGE_ATH,             /* adjust_ATH */
+    LAME_STAGE_MDCT,            /* polyphase filterbank and MDCT */
+    LAME_STAGE_MS,              /* M/S decision */
+    LAME_STAGE_ITERATION,       /* quantization and bit allocation */
+    LAME_STAGE_BITSTREAM,       /* format_bitstream, copy out, VBR tag data */
+    LAME_STAGES
+} lame_stage;
+
+typedef struct {
+    double  stage_seconds[LAME_STAGES];
+    long    frames;
+    long    granules;           /* granules times channels */
+    long    short_blocks;       /* of those, coded with short blocks */
+    long    silent_frames;      /* frames with every value quantized to 0 */
+    long    bin_search_probes;  /* count_bits calls in bin_search_StepSize */
+    long    outer_loops;        /* outer_loop calls */
+    long    outer_loop_trials;  /* scalefactor combinations tried there */
+} lame_encoder_stats;
+
+int CDECL lame_set_stage_timing(lame_global_flags *, int);
+int CDECL lame_get_stage_timing(const lame_global_flags *);
+int CDECL lame_get_encoder_stats(const lame_global_flags *, lame_encoder_stats *);
+
+/*
+  called on the encoding thread as each stage of a frame begins (begin=1)
+  and ends (begin=0), for tracers. May be set at any time; NULL, the
+  default, disables it.
+*/
+typedef void (*lame_stage_hook)(void *arg, lame_stage stage, int begin);
+
+int CDECL lame_set_stage_hook(lame_global_flags *, lame_stage_hook, void *arg);
+
 /* RadioGain value. Multiplied by 10 and rounded to the nearest. */
 int CDECL lame_get_RadioGain(const lame_global_flags *);
 
@@ -162,7 +162,7 @@ putbits2(lame_internal_flags * gfc, int val, int j)
         if (bs->buf_bit_idx == 0) {
             bs->buf_bit_idx = 8;
             bs->buf_byte_idx++;
-            assert(bs->buf_byte_idx < BUFFER_SIZE);
+            assert(bs->buf_byte_idx < bs->buf_size);
             assert(esv->header[esv->w_ptr].write_timing >= bs->totbit);
             if (esv->header[esv->w_ptr].write_timing == bs->totbit) {
                 putheader_bits(gfc);
@@ -197,7 +197,7 @@ putbits_noheaders(lame_internal_flags * gfc, int val, int j)
         if (bs->buf_bit_idx == 0) {
             bs->buf_bit_idx = 8;
             bs->buf_byte_idx++;
-            assert(bs->buf_byte_idx < BUFFER_SIZE);
+            assert(bs->buf_byte_idx < bs->buf_size);
             bs->buf[bs->buf_byte_idx] = 0;
         }
 
@@ -303,14 +303,21 @@ CRC_update(int value, int crc)
 void
 CRC_writeheader(lame_internal_flags const *gfc, char *header)
 {
-    SessionConfig_t const *const cfg = &gfc->cfg;
+    CRC_writeframe((unsigned char *) header, gfc->cfg.sideinfo_len);
+}
+
+
+/* the same for a frame read back, sideinfo_len counting header and CRC */
+void
+CRC_writeframe(unsigned char *header, int sideinfo_len)
+{
     int     crc = 0xffff;    /* (jo) init crc16 for error_protection */
     int     i;
 
-    crc = CRC_update(((unsigned char *) header)[2], crc);
-    crc = CRC_update(((unsigned char *) header)[3], crc);
-    for (i = 6; i < cfg->sideinfo_len; i++) {
-        crc = CRC_update(((unsigned char *) header)[i], crc);
+    crc = CRC_update(header[2], crc);
+    crc = CRC_update(header[3], crc);
+    for (i = 6; i < sideinfo_len; i++) {
+        crc = CRC_update(header[i], crc);
     }
 
     header[4] = crc >> 8;
@@ -340,7 +347,7 @@ encodeSideInfo2(lame_internal_flags * gfc, int bitsPerFrame)
     writeheader(gfc, (cfg->samplerate_index), 2);
     writeheader(gfc, (eov->padding), 1);
     writeheader(gfc, (cfg->extension), 1);
-    writeheader(gfc, (cfg->mode), 2);
+    writeheader(gfc, (CFG_MODE(cfg)), 2);
     writeheader(gfc, (eov->mode_ext), 2);
     writeheader(gfc, (cfg->copyright), 1);
     writeheader(gfc, (cfg->original), 1);
@@ -354,12 +361,12 @@ encodeSideInfo2(lame_internal_flags * gfc, int bitsPerFrame)
         assert(l3_side->main_data_begin >= 0);
         writeheader(gfc, (l3_side->main_data_begin), 9);
 
-        if (cfg->channels_out == 2)
+        if (CFG_CHANNELS_OUT(cfg) == 2)
             writeheader(gfc, l3_side->private_bits, 3);
         else
             writeheader(gfc, l3_side->private_bits, 5);
 
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             int     band;
             for (band = 0; band < 4; band++) {
                 writeheader(gfc, l3_side->scfsi[ch][band], 1);
@@ -367,7 +374,7 @@ encodeSideInfo2(lame_internal_flags * gfc, int bitsPerFrame)
         }
 
         for (gr = 0; gr < 2; gr++) {
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 gr_info *const gi = &l3_side->tt[gr][ch];
                 writeheader(gfc, gi->part2_3_length + gi->part2_length, 12);
                 writeheader(gfc, gi->big_values / 2, 9);
@@ -417,10 +424,10 @@ encodeSideInfo2(lame_internal_flags * gfc, int bitsPerFrame)
         /* MPEG2 */
         assert(l3_side->main_data_begin >= 0);
         writeheader(gfc, (l3_side->main_data_begin), 8);
-        writeheader(gfc, l3_side->private_bits, cfg->channels_out);
+        writeheader(gfc, l3_side->private_bits, CFG_CHANNELS_OUT(cfg));
 
         gr = 0;
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             gr_info *const gi = &l3_side->tt[gr][ch];
             writeheader(gfc, gi->part2_3_length + gi->part2_length, 12);
             writeheader(gfc, gi->big_values / 2, 9);
@@ -692,7 +699,7 @@ writeMainData(lame_internal_flags * const gfc)
     if (cfg->version == 1) {
         /* MPEG 1 */
         for (gr = 0; gr < 2; gr++) {
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 gr_info const *const gi = &l3_side->tt[gr][ch];
                 int const slen1 = slen1_tab[gi->scalefac_compress];
                 int const slen2 = slen2_tab[gi->scalefac_compress];
@@ -733,7 +740,7 @@ writeMainData(lame_internal_flags * const gfc)
     else {
         /* MPEG 2 */
         gr = 0;
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             gr_info const *const gi = &l3_side->tt[gr][ch];
             int     i, sfb_partition, scale_bits = 0;
             assert(gi->sfb_partition_table);
@@ -1030,7 +1037,7 @@ do_gain_analysis(lame_internal_flags * gfc, unsigned char* buffer, int minimum)
                         else if (-pcm_buf[0][i] > rov->PeakSample)
                             rov->PeakSample = -pcm_buf[0][i];
                     }
-                    if (cfg->channels_out > 1)
+                    if (CFG_CHANNELS_OUT(cfg) > 1)
                         for (i = 0; i < samples_out; i++) {
                             if (pcm_buf[1][i] > rov->PeakSample)
                                 rov->PeakSample = pcm_buf[1][i];
@@ -1042,7 +1049,7 @@ do_gain_analysis(lame_internal_flags * gfc, unsigned char* buffer, int minimum)
                 if (cfg->findReplayGain)
                     if (AnalyzeSamples
                         (rsv->rgdata, pcm_buf[0], pcm_buf[1], samples_out,
-                         cfg->channels_out) == GAIN_ANALYSIS_ERROR)
+                         CFG_CHANNELS_OUT(cfg)) == GAIN_ANALYSIS_ERROR)
                         return -6;
 
             }       /* if (samples_out>0) */
@@ -1097,12 +1104,13 @@ void
 init_bit_stream_w(lame_internal_flags * gfc)
 {
     EncStateVar_t *const esv = &gfc->sv_enc;
+    int const size = gfc->cfg.low_memory ? BUFFER_SIZE_LOWMEM : BUFFER_SIZE;
 
     esv->h_ptr = esv->w_ptr = 0;
     esv->header[esv->h_ptr].write_timing = 0;
 
-    gfc->bs.buf = lame_calloc(unsigned char, BUFFER_SIZE);
-    gfc->bs.buf_size = BUFFER_SIZE;
+    gfc->bs.buf = lame_arena_calloc(gfc, LAME_MEM_BITSTREAM, unsigned char, size);
+    gfc->bs.buf_size = size;
     gfc->bs.buf_byte_idx = -1;
     gfc->bs.buf_bit_idx = 0;
     gfc->bs.totbit = 0;
@@ -33,6 +33,7 @@ int     copy_buffer(lame_internal_flags * gfc, unsigned char *buffer, int buffer
                     int update_crc);
 void    init_bit_stream_w(lame_internal_flags * gfc);
 void    CRC_writeheader(lame_internal_flags const *gfc, char *buffer);
+void    CRC_writeframe(unsigned char *header, int sideinfo_len);
 int     compute_flushbits(const lame_internal_flags * gfp, int *nbytes);
 
 int     get_max_frame_buffer_size_by_constraint(SessionConfig_t const * cfg, int constraint);
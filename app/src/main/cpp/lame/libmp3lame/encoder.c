@@ -29,6 +29,7 @@
 #include <config.h>
 #endif
 
+#include <time.h>
 
 #include "lame.h"
 #include "machine.h"
@@ -69,7 +70,7 @@ adjust_ATH(lame_internal_flags const *const gfc)
     /* use granule with maximum combined loudness */
     max_pow = gfc->ov_psy.loudness_sq[0][0];
     gr2_max = gfc->ov_psy.loudness_sq[1][0];
-    if (cfg->channels_out == 2) {
+    if (CFG_CHANNELS_OUT(cfg) == 2) {
         max_pow += gfc->ov_psy.loudness_sq[0][1];
         gr2_max += gfc->ov_psy.loudness_sq[1][1];
     }
@@ -77,7 +78,7 @@ adjust_ATH(lame_internal_flags const *const gfc)
         max_pow += max_pow;
         gr2_max += gr2_max;
     }
-    if (cfg->mode_gr == 2) {
+    if (CFG_MODE_GR(cfg) == 2) {
         max_pow = Max(max_pow, gr2_max);
     }
     max_pow *= 0.5;     /* max_pow approaches 1.0 for full band noise */
@@ -166,12 +167,12 @@ updateStats(lame_internal_flags * const gfc)
     eov->bitrate_channelmode_hist[15][4]++;
 
     /* count 'em for every mode extension in case of 2 channel encoding */
-    if (cfg->channels_out == 2) {
+    if (CFG_CHANNELS_OUT(cfg) == 2) {
         eov->bitrate_channelmode_hist[eov->bitrate_index][eov->mode_ext]++;
         eov->bitrate_channelmode_hist[15][eov->mode_ext]++;
     }
-    for (gr = 0; gr < cfg->mode_gr; ++gr) {
-        for (ch = 0; ch < cfg->channels_out; ++ch) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); ++gr) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ++ch) {
             int     bt = gfc->l3_side.tt[gr][ch].block_type;
             if (gfc->l3_side.tt[gr][ch].mixed_block_flag)
                 bt = 4;
@@ -196,28 +197,28 @@ lame_encode_frame_init(lame_internal_flags * gfc, const sample_t *const inbuf[2]
     if (gfc->lame_encode_frame_init == 0) {
         sample_t primebuff0[286 + 1152 + 576];
         sample_t primebuff1[286 + 1152 + 576];
-        int const framesize = 576 * cfg->mode_gr;
+        int const framesize = 576 * CFG_MODE_GR(cfg);
         /* prime the MDCT/polyphase filterbank with a short block */
         int     i, j;
         gfc->lame_encode_frame_init = 1;
         memset(primebuff0, 0, sizeof(primebuff0));
         memset(primebuff1, 0, sizeof(primebuff1));
-        for (i = 0, j = 0; i < 286 + 576 * (1 + cfg->mode_gr); ++i) {
+        for (i = 0, j = 0; i < 286 + 576 * (1 + CFG_MODE_GR(cfg)); ++i) {
             if (i < framesize) {
                 primebuff0[i] = 0;
-                if (cfg->channels_out == 2)
+                if (CFG_CHANNELS_OUT(cfg) == 2)
                     primebuff1[i] = 0;
             }
             else {
                 primebuff0[i] = inbuf[0][j];
-                if (cfg->channels_out == 2)
+                if (CFG_CHANNELS_OUT(cfg) == 2)
                     primebuff1[i] = inbuf[1][j];
                 ++j;
             }
         }
         /* polyphase filtering / mdct */
-        for (gr = 0; gr < cfg->mode_gr; gr++) {
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 gfc->l3_side.tt[gr][ch].block_type = SHORT_TYPE;
             }
         }
@@ -302,6 +303,41 @@ FFT's                    <---------1024---------->
 typedef FLOAT chgrdata[2][2];
 
 
+/*
+ * stage timing, see lame_get_encoder_stats
+ */
+static double
+stage_clock(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void
+stage_begin(lame_internal_flags const *gfc, lame_stage stage)
+{
+    if (gfc->stage_hook != NULL)
+        gfc->stage_hook(gfc->stage_hook_arg, stage, 1);
+}
+
+static void
+stage_done(lame_internal_flags * gfc, lame_stage stage, double *t)
+{
+    if (gfc->stage_hook != NULL)
+        gfc->stage_hook(gfc->stage_hook_arg, stage, 0);
+    if (gfc->cfg.stage_timing) {
+        double const now = stage_clock();
+        gfc->sv_stats.stage_seconds[stage] += now - *t;
+        *t = now;
+    }
+}
+
+
 int
 lame_encode_mp3_frame(       /* Output */
                          lame_internal_flags * gfc, /* Context */
@@ -312,8 +348,8 @@ lame_encode_mp3_frame(       /* Output */
 {                       /* Output */
     SessionConfig_t const *const cfg = &gfc->cfg;
     int     mp3count;
-    III_psy_ratio masking_LR[2][2]; /*LR masking & energy */
-    III_psy_ratio masking_MS[2][2]; /*MS masking & energy */
+    III_psy_ratio (*const masking_LR)[2] = gfc->scratch->masking_LR; /*LR masking & energy */
+    III_psy_ratio (*const masking_MS)[2] = gfc->scratch->masking_MS; /*MS masking & energy */
     const III_psy_ratio (*masking)[2]; /*pointer to selected maskings */
     const sample_t *inbuf[2];
 
@@ -324,7 +360,8 @@ lame_encode_mp3_frame(       /* Output */
     0., 0.}};
     FLOAT (*pe_use)[2];
 
-    int     ch, gr;
+    int     ch, gr, silent;
+    double  t;
 
     inbuf[0] = inbuf_l;
     inbuf[1] = inbuf_r;
@@ -334,6 +371,8 @@ lame_encode_mp3_frame(       /* Output */
         lame_encode_frame_init(gfc, inbuf);
 
     }
+    t = cfg->stage_timing ? stage_clock() : 0;
+    stage_begin(gfc, LAME_STAGE_PSYMODEL);
 
 
     /********************** padding *****************************/
@@ -366,25 +405,27 @@ lame_encode_mp3_frame(       /* Output */
         const sample_t *bufp[2] = {0, 0}; /* address of beginning of left & right granule */
         int     blocktype[2];
 
-        for (gr = 0; gr < cfg->mode_gr; gr++) {
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
 
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 bufp[ch] = &inbuf[ch][576 + gr * 576 - FFTOFFSET];
             }
             ret = L3psycho_anal_vbr(gfc, bufp, gr,
                                     masking_LR, masking_MS,
                                     pe[gr], pe_MS[gr], tot_ener[gr], blocktype);
-            if (ret != 0)
+            if (ret != 0) {
+                stage_done(gfc, LAME_STAGE_PSYMODEL, &t);
                 return -4;
+            }
 
-            if (cfg->mode == JOINT_STEREO) {
+            if (CFG_MODE(cfg) == JOINT_STEREO) {
                 ms_ener_ratio[gr] = tot_ener[gr][2] + tot_ener[gr][3];
                 if (ms_ener_ratio[gr] > 0)
                     ms_ener_ratio[gr] = tot_ener[gr][3] / ms_ener_ratio[gr];
             }
 
             /* block type flags */
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 gr_info *const cod_info = &gfc->l3_side.tt[gr][ch];
                 cod_info->block_type = blocktype[ch];
                 cod_info->mixed_block_flag = 0;
@@ -393,8 +434,12 @@ lame_encode_mp3_frame(       /* Output */
     }
 
 
+    stage_done(gfc, LAME_STAGE_PSYMODEL, &t);
+
     /* auto-adjust of ATH, useful for low volume */
+    stage_begin(gfc, LAME_STAGE_ATH);
     adjust_ATH(gfc);
+    stage_done(gfc, LAME_STAGE_ATH, &t);
 
 
     /****************************************
@@ -402,7 +447,9 @@ lame_encode_mp3_frame(       /* Output */
     ****************************************/
 
     /* polyphase filtering / mdct */
+    stage_begin(gfc, LAME_STAGE_MDCT);
     mdct_sub48(gfc, inbuf[0], inbuf[1]);
+    stage_done(gfc, LAME_STAGE_MDCT, &t);
 
 
     /****************************************
@@ -410,12 +457,13 @@ lame_encode_mp3_frame(       /* Output */
     ****************************************/
 
     /* Here will be selected MS or LR coding of the 2 stereo channels */
+    stage_begin(gfc, LAME_STAGE_MS);
     gfc->ov_enc.mode_ext = MPG_MD_LR_LR;
 
     if (cfg->force_ms) {
         gfc->ov_enc.mode_ext = MPG_MD_MS_LR;
     }
-    else if (cfg->mode == JOINT_STEREO) {
+    else if (CFG_MODE(cfg) == JOINT_STEREO) {
         /* ms_ratio = is scaled, for historical reasons, to look like
            a ratio of side_channel / total.
            0 = signal is 100% mono
@@ -430,8 +478,8 @@ lame_encode_mp3_frame(       /* Output */
 
         FLOAT   sum_pe_MS = 0;
         FLOAT   sum_pe_LR = 0;
-        for (gr = 0; gr < cfg->mode_gr; gr++) {
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 sum_pe_MS += pe_MS[gr][ch];
                 sum_pe_LR += pe[gr][ch];
             }
@@ -441,7 +489,7 @@ lame_encode_mp3_frame(       /* Output */
         if (sum_pe_MS <= 1.00 * sum_pe_LR) {
 
             gr_info const *const gi0 = &gfc->l3_side.tt[0][0];
-            gr_info const *const gi1 = &gfc->l3_side.tt[cfg->mode_gr - 1][0];
+            gr_info const *const gi1 = &gfc->l3_side.tt[CFG_MODE_GR(cfg) - 1][0];
 
             if (gi0[0].block_type == gi0[1].block_type && gi1[0].block_type == gi1[1].block_type) {
 
@@ -463,8 +511,8 @@ lame_encode_mp3_frame(       /* Output */
 
     /* copy data for MP3 frame analyzer */
     if (cfg->analysis && gfc->pinfo != NULL) {
-        for (gr = 0; gr < cfg->mode_gr; gr++) {
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 gfc->pinfo->ms_ratio[gr] = 0;
                 gfc->pinfo->ms_ener_ratio[gr] = ms_ener_ratio[gr];
                 gfc->pinfo->blocktype[gr][ch] = gfc->l3_side.tt[gr][ch].block_type;
@@ -480,13 +528,16 @@ lame_encode_mp3_frame(       /* Output */
             }
         }
     }
+    stage_done(gfc, LAME_STAGE_MS, &t);
 
 
     /****************************************
     *   Stage 4: quantization loop          *
     ****************************************/
 
-    if (cfg->vbr == vbr_off || cfg->vbr == vbr_abr) {
+    stage_begin(gfc, LAME_STAGE_ITERATION);
+
+    if (CFG_VBR(cfg) == vbr_off || CFG_VBR(cfg) == vbr_abr) {
         static FLOAT const fircoef[9] = {
             -0.0207887 * 5, -0.0378413 * 5, -0.0432472 * 5, -0.031183 * 5,
             7.79609e-18 * 5, 0.0467745 * 5, 0.10091 * 5, 0.151365 * 5,
@@ -500,8 +551,8 @@ lame_encode_mp3_frame(       /* Output */
             gfc->sv_enc.pefirbuf[i] = gfc->sv_enc.pefirbuf[i + 1];
 
         f = 0.0;
-        for (gr = 0; gr < cfg->mode_gr; gr++)
-            for (ch = 0; ch < cfg->channels_out; ch++)
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++)
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++)
                 f += pe_use[gr][ch];
         gfc->sv_enc.pefirbuf[18] = f;
 
@@ -509,14 +560,14 @@ lame_encode_mp3_frame(       /* Output */
         for (i = 0; i < 9; i++)
             f += (gfc->sv_enc.pefirbuf[i] + gfc->sv_enc.pefirbuf[18 - i]) * fircoef[i];
 
-        f = (670 * 5 * cfg->mode_gr * cfg->channels_out) / f;
-        for (gr = 0; gr < cfg->mode_gr; gr++) {
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+        f = (670 * 5 * CFG_MODE_GR(cfg) * CFG_CHANNELS_OUT(cfg)) / f;
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 pe_use[gr][ch] *= f;
             }
         }
     }
-    switch (cfg->vbr)
+    switch (CFG_VBR(cfg))
     {
     default:
     case vbr_off:
@@ -533,6 +584,21 @@ lame_encode_mp3_frame(       /* Output */
         VBR_new_iteration_loop(gfc, (const FLOAT (*)[2])pe_use, ms_ener_ratio, masking);
         break;
     }
+    stage_done(gfc, LAME_STAGE_ITERATION, &t);
+
+    silent = 1;
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
+            gr_info const *const cod_info = &gfc->l3_side.tt[gr][ch];
+            gfc->sv_stats.granules++;
+            if (cod_info->block_type == SHORT_TYPE)
+                gfc->sv_stats.short_blocks++;
+            if (cod_info->big_values != 0 || cod_info->count1 != 0)
+                silent = 0;
+        }
+    }
+    gfc->sv_stats.frames++;
+    gfc->sv_stats.silent_frames += silent;
 
 
     /****************************************
@@ -541,6 +607,7 @@ lame_encode_mp3_frame(       /* Output */
 
 
     /*  write the frame to the bitstream  */
+    stage_begin(gfc, LAME_STAGE_BITSTREAM);
     (void) format_bitstream(gfc);
 
     /* copy mp3 bit buffer into array */
@@ -550,10 +617,11 @@ lame_encode_mp3_frame(       /* Output */
     if (cfg->write_lame_tag) {
         AddVbrFrame(gfc);
     }
+    stage_done(gfc, LAME_STAGE_BITSTREAM, &t);
 
     if (cfg->analysis && gfc->pinfo != NULL) {
-        int     framesize = 576 * cfg->mode_gr;
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+        int     framesize = 576 * CFG_MODE_GR(cfg);
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             int     j;
             for (j = 0; j < FFTOFFSET; j++)
                 gfc->pinfo->pcmdata[ch][j] = gfc->pinfo->pcmdata[ch][j + framesize];
@@ -45,7 +45,7 @@
 #include "fft.h"
 
 #include "vector/lame_intrin.h"
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 #include <arm_neon.h>
 #if !defined(__aarch64__)
 #define vcopyq_laneq_f32(a, lane1, b, lane2) vsetq_lane_f32(vgetq_lane_f32(b, lane2), a, lane1)
@@ -112,7 +112,7 @@ fht(FLOAT * fz, int n)
         } while (fi < fn);
         c1 = tri[0];
         s1 = tri[1];
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
         if (kx < 4) {
 #endif
         for (i = 1; i < kx; i++) {
@@ -154,7 +154,7 @@ fht(FLOAT * fz, int n)
             c1 = c2 * tri[0] - s1 * tri[1];
             s1 = c2 * tri[1] + s1 * tri[0];
         }
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
         } else {
             FLOAT   c2, s2;
             float cs[16] __attribute__ ((aligned (16)));
@@ -99,7 +99,7 @@
 #include "lame.h"
 #include "machine.h"
 #include "gain_analysis.h"
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 #include <arm_neon.h>
 #if !defined(__aarch64__)
 #define vaddvq_f32(a) ({ \
@@ -123,7 +123,7 @@
 
 
 /*lint -save -e736 loss of precision */
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 static const Float_t ABYule[9][multiple_of(4, 2 * YULE_ORDER + 1)] __attribute__ ((aligned (16))) = {
     /* 20                 18                 16                 14                 12                 10                 8                  6                  4                  2                 0                 19                 17                 15                 13                 11                 9                  7                  5                  3                  1              */
     { 0.00288463683916,  0.00012025322027,  0.00306428023191,  0.00594298065125, -0.02074045215285,  0.02161526843274, -0.01655260341619, -0.00009291677959, -0.00123395316851, -0.02160367184185, 0.03857599435200, 0, 0.13919314567432, -0.86984376593551,  2.75465861874613, -5.87257861775999,  9.48293806319790,-12.28759895145294, 13.05504219327545,-11.34170355132042,  7.81501653005538, -3.84664617118067, 0, 0},
@@ -185,7 +185,7 @@ static const Float_t ABButter[9][multiple_of(4, 2 * BUTTER_ORDER + 1)] = {
 
 /* When calling this procedure, make sure that ip[-order] and op[-order] point to real data! */
 
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 static void
 filterIntegrated(const Float_t * input, Float_t * output1, Float_t * output2, size_t nSamples, const Float_t * const kernel1, const Float_t * const kernel2)
 {
@@ -421,7 +421,7 @@ AnalyzeSamples(replaygain_t * rgData, const Float_t * left_samples, const Float_
             curright = right_samples + cursamplepos;
         }
 
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
         filterIntegrated(curleft, rgData->lstep + rgData->totsamp, rgData->lout + rgData->totsamp, cursamples,
                     ABYule[rgData->freqindex], ABButter[rgData->freqindex]);
         filterIntegrated(curright, rgData->rstep + rgData->totsamp, rgData->rout + rgData->totsamp, cursamples,
@@ -1824,6 +1824,12 @@ id3tag_write_v2(lame_t gfp)
             free(tag);
             return -1;
         }
+        else if (gfc->cfg.low_memory
+                 && tag_size > (size_t) (gfc->bs.buf_size - (LAME_MAXMP3BUFFER - LAME_MAXALBUMART))) {
+            /* the low memory output buffer has no room for album art */
+            free(tag);
+            return -1;
+        }
         else {
             size_t  i;
             /* write tag directly into bitstream at current position */
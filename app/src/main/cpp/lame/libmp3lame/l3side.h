@@ -44,10 +44,15 @@ typedef struct {
     III_psy_xmin en;
 } III_psy_ratio;
 
+/* Granule state. The small fields that the iteration loop reads on every
+ * pass come first, the per-band arrays next and l3_enc last. The spectrum
+ * itself does not change while a granule is quantized, so it lives in
+ * III_side_info_t and gr_info only points at it: the working copies made
+ * by outer_loop and the huffman table search no longer drag 576 floats
+ * along.
+ */
 typedef struct {
-    FLOAT   xr[576];
-    int     l3_enc[576];
-    int     scalefac[SFBMAX];
+    FLOAT  *xr;         /* -> III_side_info_t.xr[gr][ch] */
     FLOAT   xrpow_max;
 
     int     part2_3_length;
@@ -72,15 +77,18 @@ typedef struct {
     int     sfbmax;
     int     psymax;
     int     sfbdivide;
-    int     width[SFBMAX];
-    int     window[SFBMAX];
     int     count1bits;
+    int     max_nonzero_coeff;
     /* added for LSF */
     const int *sfb_partition_table;
     int     slen[4];
 
-    int     max_nonzero_coeff;
+    int     scalefac[SFBMAX];
+    int     width[SFBMAX];
+    int     window[SFBMAX];
     char    energy_above_cutoff[SFBMAX];
+
+    int     l3_enc[576] __attribute__ ((aligned (16)));
 } gr_info;
 
 typedef struct {
@@ -90,6 +98,7 @@ typedef struct {
     int     resvDrain_pre;
     int     resvDrain_post;
     int     scfsi[2][4];
+    FLOAT   xr[2][2][576] __attribute__ ((aligned (16)));
 } III_side_info_t;
 
 #endif
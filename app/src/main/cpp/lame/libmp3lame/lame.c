@@ -584,6 +584,8 @@ lame_init_params(lame_global_flags * gfp)
     gfc->report_msg = gfp->report.msgf;
     gfc->report_dbg = gfp->report.debugf;
     gfc->report_err = gfp->report.errorf;
+    gfc->stage_hook = gfp->stage_hook;
+    gfc->stage_hook_arg = gfp->stage_hook_arg;
 
     if (gfp->asm_optimizations.amd3dnow)
         gfc->CPU_features.AMD_3DNow = has_3DNow();
@@ -635,6 +637,8 @@ lame_init_params(lame_global_flags * gfp)
     }
 
     cfg->free_format = gfp->free_format;
+    cfg->low_memory = gfp->low_memory;
+    cfg->stage_timing = gfp->stage_timing;
 
     if (cfg->vbr == vbr_off && gfp->brate == 0) {
         /* no bitrate or compression ratio specified, use 11.025 */
@@ -867,6 +871,10 @@ lame_init_params(lame_global_flags * gfp)
 
     cfg->mode = gfp->mode;
 
+#ifdef LAME_FIXED_MONO_CBR
+    if (cfg->mode != MONO || cfg->channels_out != 1 || cfg->vbr != vbr_off || cfg->mode_gr != 2)
+        return -1;      /* this build only encodes mono CBR MPEG-1 */
+#endif
 
     /* apply user driven high pass filter */
     if (cfg->highpassfreq > 0) {
@@ -936,6 +944,14 @@ lame_init_params(lame_global_flags * gfp)
         gfc->ov_enc.bitrate_index = 1;
     }
 
+    lame_arena_reserve(gfc, gfp->input_chunk);
+    for (i = 0; i < cfg->channels_out; i++) {
+        EncStateVar_t *const esv = &gfc->sv_enc;
+        esv->mfbuf[i] = lame_arena_calloc(gfc, LAME_MEM_CORE, sample_t, MFSIZE);
+        esv->sb_sample[i] = lame_arena_alloc(gfc, LAME_MEM_CORE, 2 * sizeof(*esv->sb_sample[i]));
+        if (esv->mfbuf[i] == NULL || esv->sb_sample[i] == NULL)
+            return -2;
+    }
     init_bit_stream_w(gfc);
 
     j = cfg->samplerate_index + (3 * cfg->version) + 6 * (cfg->samplerate_out < 16000);
@@ -1276,7 +1292,8 @@ lame_init_params(lame_global_flags * gfp)
     (void) lame_init_bitstream(gfp);
 
     iteration_init(gfc);
-    (void) psymodel_init(gfp);
+    if (psymodel_init(gfp) < 0)
+        return -2;
 
     cfg->buffer_constraint = get_max_frame_buffer_size_by_constraint(cfg, gfp->strict_ISO);
 
@@ -1630,23 +1647,17 @@ update_inbuffer_size(lame_internal_flags * gfc, const int nsamples)
 {
     EncStateVar_t *const esv = &gfc->sv_enc;
     if (esv->in_buffer_0 == 0 || esv->in_buffer_nsamples < nsamples) {
-        if (esv->in_buffer_0) {
-            free(esv->in_buffer_0);
-        }
-        if (esv->in_buffer_1) {
-            free(esv->in_buffer_1);
-        }
-        esv->in_buffer_0 = lame_calloc(sample_t, nsamples);
-        esv->in_buffer_1 = lame_calloc(sample_t, nsamples);
+        lame_arena_free(gfc, esv->in_buffer_0);
+        lame_arena_free(gfc, esv->in_buffer_1);
+        esv->in_buffer_0 = lame_arena_calloc(gfc, LAME_MEM_INPUT, sample_t, nsamples);
+        esv->in_buffer_1 = NULL;
+        if (gfc->cfg.channels_out == 2)
+            esv->in_buffer_1 = lame_arena_calloc(gfc, LAME_MEM_INPUT, sample_t, nsamples);
         esv->in_buffer_nsamples = nsamples;
     }
-    if (esv->in_buffer_0 == NULL || esv->in_buffer_1 == NULL) {
-        if (esv->in_buffer_0) {
-            free(esv->in_buffer_0);
-        }
-        if (esv->in_buffer_1) {
-            free(esv->in_buffer_1);
-        }
+    if (esv->in_buffer_0 == NULL || (gfc->cfg.channels_out == 2 && esv->in_buffer_1 == NULL)) {
+        lame_arena_free(gfc, esv->in_buffer_0);
+        lame_arena_free(gfc, esv->in_buffer_1);
         esv->in_buffer_0 = 0;
         esv->in_buffer_1 = 0;
         esv->in_buffer_nsamples = 0;
@@ -1751,7 +1762,8 @@ lame_encode_buffer_sample_t(lame_internal_flags * gfc,
         /* compute ReplayGain of resampled input if requested */
         if (cfg->findReplayGain && !cfg->decode_on_the_fly)
             if (AnalyzeSamples
-                (gfc->sv_rpg.rgdata, &mfbuf[0][esv->mf_size], &mfbuf[1][esv->mf_size], n_out,
+                (gfc->sv_rpg.rgdata, &mfbuf[0][esv->mf_size],
+                 &mfbuf[cfg->channels_out - 1][esv->mf_size], n_out,
                  cfg->channels_out) == GAIN_ANALYSIS_ERROR)
                 return -6;
 
@@ -1846,7 +1858,8 @@ lame_copy_inbuffer(lame_internal_flags* gfc,
         sample_t const u = xl * m[0][0] + xr * m[0][1]; \
         sample_t const v = xl * m[1][0] + xr * m[1][1]; \
         ib0[i] = u; \
-        ib1[i] = v; \
+        if (ib1 != NULL) \
+            ib1[i] = v; \
         bl += jump; \
         br += jump; \
     } \
@@ -2364,11 +2377,22 @@ lame_init_internal_flags(lame_internal_flags* gfc)
     gfc->ov_rpg.noclipGainChange = 0;
     gfc->ov_rpg.noclipScale = -1.0;
 
-    gfc->ATH = lame_calloc(ATH_t, 1);
+    {
+        int     gr, ch;
+        for (gr = 0; gr < 2; ++gr)
+            for (ch = 0; ch < 2; ++ch)
+                gfc->l3_side.tt[gr][ch].xr = gfc->l3_side.xr[gr][ch];
+    }
+
+    gfc->ATH = lame_arena_calloc(gfc, LAME_MEM_CORE, ATH_t, 1);
     if (NULL == gfc->ATH)
         return -2;      /* maybe error codes should be enumerated in lame.h ?? */
 
-    gfc->sv_rpg.rgdata = lame_calloc(replaygain_t, 1);
+    gfc->scratch = lame_arena_calloc(gfc, LAME_MEM_PSYMODEL, EncScratch_t, 1);
+    if (NULL == gfc->scratch)
+        return -2;
+
+    gfc->sv_rpg.rgdata = lame_arena_calloc(gfc, LAME_MEM_CORE, replaygain_t, 1);
     if (NULL == gfc->sv_rpg.rgdata) {
         return -2;
     }
@@ -2455,7 +2479,11 @@ lame_init_old(lame_global_flags * gfp)
     gfp->report.errorf = &lame_report_def;
     gfp->report.msgf = &lame_report_def;
 
-    gfp->internal_flags = lame_calloc(lame_internal_flags, 1);
+#ifdef LAME_FIXED_MONO_CBR
+    gfp->low_memory = 1;
+#endif
+
+    gfp->internal_flags = lame_arena_create();
 
     if (lame_init_internal_flags(gfp->internal_flags) < 0) {
         freegfc(gfp->internal_flags);
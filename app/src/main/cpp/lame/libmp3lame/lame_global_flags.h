@@ -54,6 +54,9 @@ struct lame_global_struct {
     int     findReplayGain;  /* find the RG value? default=0       */
     int     decode_on_the_fly; /* decode on the fly? default=0                */
     int     write_id3tag_automatic; /* 1 (default) writes ID3 tags, 0 not */
+    int     low_memory;      /* size buffers for this stream only? default=0 */
+    int     stage_timing;    /* time the encoder stages? default=0          */
+    int     input_chunk;     /* largest encode call to keep in the arena, default=0 */
 
     int     nogap_total;
     int     nogap_current;
@@ -155,6 +158,9 @@ struct lame_global_struct {
         void    (*errorf) (const char *format, va_list ap);
     } report;
 
+    lame_stage_hook stage_hook;
+    void   *stage_hook_arg;
+
   /************************************************************************/
     /* internal variables, do not set...                                    */
     /* provided because they may be of use to calling application           */
@@ -184,6 +184,14 @@ typedef FLOAT sample_t;
 #  endif
 #endif
 
+/*
+ * LAME_NEON selects the NEON kernels on ARM. Define LAME_NO_SIMD to get
+ * the portable C code everywhere (reference runs, comparisons).
+ */
+#if (defined(__aarch64__) || defined(__arm__)) && !defined(LAME_NO_SIMD)
+# define LAME_NEON 1
+#endif
+
 #endif
 
 /* end of machine.h */
@@ -35,7 +35,7 @@
 #include "encoder.h"
 #include "util.h"
 #include "newmdct.h"
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 #include <arm_neon.h>
 #if !defined(__aarch64__) && !defined(__ARM_FEATURE_FMA)
 #define vfmaq_f32 vmlaq_f32
@@ -442,7 +442,7 @@ window_subband(const sample_t * x1, FLOAT a[SBLIMIT])
 
     const sample_t *x2 = &x1[238 - 14 - 286];
 
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
     for (i = 0; i < 16; i+=4) {
         float32x4x4_t vw;
         float32x4_t vs, vt, vx;
@@ -1046,10 +1046,10 @@ mdct_sub48(lame_internal_flags * gfc, const sample_t * w0, const sample_t * w1)
     int     gr, k, ch;
     const sample_t *wk;
 
-    wk = w0 + 286;
     /* thinking cache performance, ch->gr loop is better than gr->ch loop */
-    for (ch = 0; ch < cfg->channels_out; ch++) {
-        for (gr = 0; gr < cfg->mode_gr; gr++) {
+    for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
+        wk = (ch == 0 ? w0 : w1) + 286;
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
             int     band;
             gr_info *const gi = &(gfc->l3_side.tt[gr][ch]);
             FLOAT  *mdct_enc = gi->xr;
@@ -1128,8 +1128,7 @@ mdct_sub48(lame_internal_flags * gfc, const sample_t * w0, const sample_t * w1)
                 }
             }
         }
-        wk = w1 + 286;
-        if (cfg->mode_gr == 1) {
+        if (CFG_MODE_GR(cfg) == 1) {
             memcpy(esv->sb_sample[ch][0], esv->sb_sample[ch][1], 576 * sizeof(FLOAT));
         }
     }
@@ -154,7 +154,8 @@ blocktype_d[2]        block type to use for previous granule
 #include "lame_global_flags.h"
 #include "fft.h"
 #include "lame-analysis.h"
-#if defined(__aarch64__) || defined(__arm__)
+#include "vecmath.h"
+#if defined(LAME_NEON)
 #include <arm_neon.h>
 #if !defined(__aarch64__)
 #define vcopyq_laneq_f32(a, lane1, b, lane2) vsetq_lane_f32(vgetq_lane_f32(b, lane2), a, lane1)
@@ -163,6 +164,11 @@ blocktype_d[2]        block type to use for previous granule
     float32x4_t c = vaddq_f32(b.val[0], b.val[1]); \
     vget_lane_f32(vadd_f32(vget_high_f32(c), vget_low_f32(c)), 0); \
 })
+#define vmaxvq_f32(a) ({ \
+    float32x4x2_t b = vtrnq_f32(a, a); \
+    float32x4_t c = vmaxq_f32(b.val[0], b.val[1]); \
+    vget_lane_f32(vmax_f32(vget_high_f32(c), vget_low_f32(c)), 0); \
+})
 #if !defined(__ARM_FEATURE_FMA)
 #define vfmaq_f32 vmlaq_f32
 #define vfmsq_f32 vmlsq_f32
@@ -355,7 +361,19 @@ vbrpsy_mask_add(FLOAT m1, FLOAT m2, int b, int delta)
             return m1 + m2;
         }
         else {
+#ifdef LAME_LIBM_MATH
             int     i = (int) (FAST_LOG10_X(ratio, 16.0f));
+#else
+            /* i = floor(16 * log10(ratio)), counted against 10^(k/16) */
+            static const FLOAT ma_i_limit[I1LIMIT] = {
+                1.15478198, 1.33352143, 1.53992653, 1.77827941,
+                2.05352503, 2.37137371, 2.73841963, 3.16227766
+            };
+            int     i = 0, k;
+            for (k = 0; k < I1LIMIT; ++k) {
+                i += (ratio >= ma_i_limit[k]);
+            }
+#endif
             return (m1 + m2) * table2[i];
         }
     }
@@ -369,6 +387,50 @@ vbrpsy_mask_add(FLOAT m1, FLOAT m2, int b, int delta)
 }
 
 
+/* convolve the partitioned energy with the spreading function,
+ * row b of the s3 band matrix
+ *
+ * tabv[kk] = tab[mask_idx[kk]], mask_sum[kk] = sum of mask_idx[0..kk-1],
+ * the returned threshold is already scaled by *avg_mask
+ *
+ * The products s3 * eb * tab are formed four at a time, the nonlinear
+ * mask_add combination is the reference sequential fold, so the result
+ * matches the per-element loop bit for bit.
+ */
+static FLOAT
+vbrpsy_convolve_s3(PsyConst_CB2SB_t const *gd, int b, FLOAT const *eb, FLOAT const *tabv,
+                   int const *mask_sum, unsigned char const *mask_idx, FLOAT * avg_mask)
+{
+    FLOAT   x[CBANDS];
+    FLOAT const *const s3 = &gd->s3[b * gd->s3width];
+    int const first = gd->s3ind[b][0];
+    int const n = gd->s3ind[b][1] - first + 1;
+    int const delta = mask_add_delta(mask_idx[b]);
+    int     i = 0, dd;
+    FLOAT   ecb;
+
+#if defined(LAME_NEON)
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t const v = vmulq_f32(vld1q_f32(s3 + i), vld1q_f32(eb + first + i));
+        vst1q_f32(x + i, vmulq_f32(v, vld1q_f32(tabv + first + i)));
+    }
+#endif
+    for (; i < n; ++i) {
+        x[i] = s3[i] * eb[first + i] * tabv[first + i];
+    }
+
+    /* x[0] again, spelled out: n >= 1, but the compiler cannot see that */
+    ecb = s3[0] * eb[first] * tabv[first];
+    for (i = 1; i < n; ++i) {
+        ecb = vbrpsy_mask_add(ecb, x[i], first + i - b, delta);
+    }
+    dd = mask_sum[first + n] - mask_sum[first];
+    dd = (1 + 2 * dd) / (2 * n);
+    *avg_mask = tab[dd] * 0.5f;
+    return ecb * *avg_mask;
+}
+
+
 /* short block threshold calculation (part 2)
 
     partition band bo_s[sfb] is at the transition from scalefactor
@@ -430,8 +492,8 @@ convert_partition2scalefac_s(lame_internal_flags * gfc, FLOAT const *eb, FLOAT c
     int     sb;
     convert_partition2scalefac(gds, eb, thr, enn, thm);
     for (sb = 0; sb < SBMAX_s; ++sb) {
-        psv->en[chn].s[sb][sblock] = enn[sb];
-        psv->thm[chn].s[sb][sblock] = thm[sb];
+        psv->ch[chn].en.s[sb][sblock] = enn[sb];
+        psv->ch[chn].thm.s[sb][sblock] = thm[sb];
     }
 }
 
@@ -441,8 +503,8 @@ convert_partition2scalefac_l(lame_internal_flags * gfc, FLOAT const *eb, FLOAT c
 {
     PsyStateVar_t *const psv = &gfc->sv_psy;
     PsyConst_CB2SB_t const *const gdl = &gfc->cd_psy->l;
-    FLOAT  *enn = &psv->en[chn].l[0];
-    FLOAT  *thm = &psv->thm[chn].l[0];
+    FLOAT  *enn = &psv->ch[chn].en.l[0];
+    FLOAT  *thm = &psv->ch[chn].thm.l[0];
     convert_partition2scalefac(gdl, eb, thr, enn, thm);
 }
 
@@ -460,8 +522,8 @@ convert_partition2scalefac_l_to_s(lame_internal_flags * gfc, FLOAT const *eb, FL
         FLOAT const tmp_enn = enn[sb];
         FLOAT const tmp_thm = thm[sb] * scale;
         for (sblock = 0; sblock < 3; ++sblock) {
-            psv->en[chn].s[sb][sblock] = tmp_enn;
-            psv->thm[chn].s[sb][sblock] = tmp_thm;
+            psv->ch[chn].en.s[sb][sblock] = tmp_enn;
+            psv->ch[chn].thm.s[sb][sblock] = tmp_thm;
         }
     }
 }
@@ -502,7 +564,9 @@ pecalc_s(III_psy_ratio const *mr, FLOAT masking_lower)
         130,
 /*      255.8 */
     };
+    FLOAT   ratio[3 * (SBMAX_s - 1)], coef[3 * (SBMAX_s - 1)];
     unsigned int sb, sblock;
+    int     n = 0, i;
 
     pe_s = 1236.28f / 4;
     for (sb = 0; sb < SBMAX_s - 1; sb++) {
@@ -518,12 +582,17 @@ pecalc_s(III_psy_ratio const *mr, FLOAT masking_lower)
                     }
                     else {
                         assert(x > 0);
-                        pe_s += regcoef_s[sb] * FAST_LOG10(en / x);
+                        ratio[n] = en / x;
+                        coef[n++] = regcoef_s[sb];
                     }
                 }
             }
         }
     }
+    vec_log10(ratio, ratio, n);
+    for (i = 0; i < n; i++) {
+        pe_s += coef[i] * ratio[i];
+    }
 
     return pe_s;
 }
@@ -556,7 +625,9 @@ pecalc_l(III_psy_ratio const *mr, FLOAT masking_lower)
         126.1,
 /*      241.3 */
     };
+    FLOAT   ratio[SBMAX_l - 1], coef[SBMAX_l - 1];
     unsigned int sb;
+    int     n = 0, i;
 
     pe_l = 1124.23f / 4;
     for (sb = 0; sb < SBMAX_l - 1; sb++) {
@@ -571,11 +642,16 @@ pecalc_l(III_psy_ratio const *mr, FLOAT masking_lower)
                 }
                 else {
                     assert(x > 0);
-                    pe_l += regcoef_l[sb] * FAST_LOG10(en / x);
+                    ratio[n] = en / x;
+                    coef[n++] = regcoef_l[sb];
                 }
             }
         }
     }
+    vec_log10(ratio, ratio, n);
+    for (i = 0; i < n; i++) {
+        pe_l += coef[i] * ratio[i];
+    }
 
     return pe_l;
 }
@@ -680,7 +756,7 @@ calc_mask_index_l(lame_internal_flags const *gfc, FLOAT const *max,
 }
 
 
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 static void
 vbrpsy_compute_fft_l(lame_internal_flags * gfc, const sample_t * const buffer[2], int chn,
                      int gr_out, FLOAT fftenergy[HBLKSIZE], FLOAT(*wsamp_l)[BLKSIZE])
@@ -735,7 +811,7 @@ vbrpsy_compute_fft_l(lame_internal_flags * gfc, const sample_t * const buffer[2]
         for (j = 1; j < 11; j++)
             totalenergy -= fftenergy[j];
 
-        psv->tot_ener[chn] = totalenergy;
+        psv->ch[chn].tot_ener = totalenergy;
     }
 
     if (plt) {
@@ -850,11 +926,11 @@ vbrpsy_compute_fft_l_js(lame_internal_flags * gfc, const sample_t * const buffer
         FLOAT   totalenergy = vaddvq_f32(venergy_m);
         for (j = 4; j < 11; j++)
             totalenergy -= fftenergy_m[j];
-        psv->tot_ener[2] = totalenergy;
+        psv->ch[2].tot_ener = totalenergy;
         totalenergy = vaddvq_f32(venergy_s);
         for (j = 4; j < 11; j++)
             totalenergy -= fftenergy_s[j];
-        psv->tot_ener[3] = totalenergy;
+        psv->ch[3].tot_ener = totalenergy;
     }
 
     if (plt) {
@@ -907,7 +983,7 @@ vbrpsy_compute_fft_l(lame_internal_flags * gfc, const sample_t * const buffer[2]
         for (j = 11; j < HBLKSIZE; j++)
             totalenergy += fftenergy[j];
 
-        psv->tot_ener[chn] = totalenergy;
+        psv->ch[chn].tot_ener = totalenergy;
     }
 
     if (plt) {
@@ -968,6 +1044,70 @@ vbrpsy_compute_loudness_approximation_l(lame_internal_flags * gfc, int gr_out, i
 }
 
 
+/* largest magnitude (at least 1) of the 9 sub-short blocks of the
+ * high pass filtered signal. With four psy channels, mid and side are
+ * synthesized from L and R on the fly, so all channels take one pass.
+ */
+static void
+vbrpsy_subshort_peaks(FLOAT const ns_hpfsmpl[2][576], int n_chn_psy, FLOAT peak[4][9])
+{
+    FLOAT const *const l = ns_hpfsmpl[0];
+    FLOAT const *const r = ns_hpfsmpl[1];
+    int     i, j;
+
+#if defined(LAME_NEON)
+    for (i = 0; i < 9; i++) {
+        float32x4_t vone = vdupq_n_f32(1.f);
+        float32x4_t vl_max = vone, vr_max = vone, vm_max = vone, vs_max = vone;
+        if (n_chn_psy > 2) {
+            for (j = i * (576 / 9); j < (i + 1) * (576 / 9); j += 4) {
+                float32x4_t vl = vld1q_f32(l + j);
+                float32x4_t vr = vld1q_f32(r + j);
+                vl_max = vmaxq_f32(vl_max, vabsq_f32(vl));
+                vr_max = vmaxq_f32(vr_max, vabsq_f32(vr));
+                vm_max = vmaxq_f32(vm_max, vabsq_f32(vaddq_f32(vl, vr)));
+                vs_max = vmaxq_f32(vs_max, vabsq_f32(vsubq_f32(vl, vr)));
+            }
+            peak[2][i] = vmaxvq_f32(vm_max);
+            peak[3][i] = vmaxvq_f32(vs_max);
+        }
+        else {
+            for (j = i * (576 / 9); j < (i + 1) * (576 / 9); j += 4) {
+                vl_max = vmaxq_f32(vl_max, vabsq_f32(vld1q_f32(l + j)));
+                vr_max = vmaxq_f32(vr_max, vabsq_f32(vld1q_f32(r + j)));
+            }
+        }
+        peak[0][i] = vmaxvq_f32(vl_max);
+        peak[1][i] = vmaxvq_f32(vr_max);
+    }
+#else
+    for (i = 0; i < 9; i++) {
+        FLOAT   pl = 1., pr = 1., pm = 1., ps = 1.;
+        for (j = i * (576 / 9); j < (i + 1) * (576 / 9); j++) {
+            FLOAT const al = fabs(l[j]);
+            FLOAT const ar = fabs(r[j]);
+            if (pl < al)
+                pl = al;
+            if (pr < ar)
+                pr = ar;
+            if (n_chn_psy > 2) {
+                FLOAT const am = fabs(l[j] + r[j]);
+                FLOAT const as = fabs(l[j] - r[j]);
+                if (pm < am)
+                    pm = am;
+                if (ps < as)
+                    ps = as;
+            }
+        }
+        peak[0][i] = pl;
+        peak[1][i] = pr;
+        peak[2][i] = pm;
+        peak[3][i] = ps;
+    }
+#endif
+}
+
+
     /**********************************************************************
     *  Apply HPF of fs/4 to the input signal.
     *  This is used for attack detection / handling.
@@ -982,12 +1122,16 @@ vbrpsy_attack_detection(lame_internal_flags * gfc, const sample_t * const buffer
     SessionConfig_t const *const cfg = &gfc->cfg;
     PsyStateVar_t *const psv = &gfc->sv_psy;
     plotting_data *plt = cfg->analysis ? gfc->pinfo : 0;
-    int const n_chn_out = cfg->channels_out;
+    int const n_chn_out = CFG_CHANNELS_OUT(cfg);
     /* chn=2 and 3 = Mid and Side channels */
-    int const n_chn_psy = (cfg->mode == JOINT_STEREO) ? 4 : n_chn_out;
-    int     chn, i, j;
+    int const n_chn_psy = CFG_CHANNELS_PSY(cfg);
+    FLOAT   subshort_peak[4][9];
+    int     chn, i;
 
-    memset(&ns_hpfsmpl[0][0], 0, sizeof(ns_hpfsmpl));
+    if (n_chn_out < 2) {
+        /* only read by the peak search, which always scans both channels */
+        memset(&ns_hpfsmpl[1][0], 0, sizeof(ns_hpfsmpl[1]));
+    }
     /* Don't copy the input buffer into a temporary buffer */
     /* unroll the loop 2 times */
     for (chn = 0; chn < n_chn_out; chn++) {
@@ -999,7 +1143,7 @@ vbrpsy_attack_detection(lame_internal_flags * gfc, const sample_t * const buffer
         /* apply high pass filter of fs/4 */
         const sample_t *const firbuf = &buffer[chn][576 - 350 - NSFIRLEN + 192];
         assert(dimension_of(fircoef) == ((NSFIRLEN - 1) / 2));
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
         float32x4_t vbuf1, vbuf2, vbuf3, vbuf4, vbuf5, vbuf6, vbuf7;
         vbuf1 = vld1q_f32(firbuf);
         vbuf2 = vld1q_f32(firbuf+4);
@@ -1061,6 +1205,7 @@ vbrpsy_attack_detection(lame_internal_flags * gfc, const sample_t * const buffer
 #else
         for (i = 0; i < 576; i++) {
             FLOAT   sum1, sum2;
+            int     j;
             sum1 = firbuf[i + 10];
             sum2 = 0.0;
             for (j = 0; j < ((NSFIRLEN - 1) / 2) - 1; j += 2) {
@@ -1070,48 +1215,36 @@ vbrpsy_attack_detection(lame_internal_flags * gfc, const sample_t * const buffer
             ns_hpfsmpl[chn][i] = sum1 + sum2;
         }
 #endif
-        masking_ratio[gr_out][chn].en = psv->en[chn];
-        masking_ratio[gr_out][chn].thm = psv->thm[chn];
+        masking_ratio[gr_out][chn].en = psv->ch[chn].en;
+        masking_ratio[gr_out][chn].thm = psv->ch[chn].thm;
         if (n_chn_psy > 2) {
             /* MS maskings  */
             /*percep_MS_entropy         [chn-2]     = gfc -> pe  [chn];  */
-            masking_MS_ratio[gr_out][chn].en = psv->en[chn + 2];
-            masking_MS_ratio[gr_out][chn].thm = psv->thm[chn + 2];
+            masking_MS_ratio[gr_out][chn].en = psv->ch[chn + 2].en;
+            masking_MS_ratio[gr_out][chn].thm = psv->ch[chn + 2].thm;
         }
     }
+    vbrpsy_subshort_peaks((FLOAT const (*)[576]) ns_hpfsmpl, n_chn_psy, subshort_peak);
     for (chn = 0; chn < n_chn_psy; chn++) {
         FLOAT   attack_intensity[12];
         FLOAT   en_subshort[12];
         FLOAT   en_short[4] = { 0, 0, 0, 0 };
-        FLOAT const *pf = ns_hpfsmpl[chn & 1];
         int     ns_uselongblock = 1;
 
-        if (chn == 2) {
-            for (i = 0, j = 576; j > 0; ++i, --j) {
-                FLOAT const l = ns_hpfsmpl[0][i];
-                FLOAT const r = ns_hpfsmpl[1][i];
-                ns_hpfsmpl[0][i] = l + r;
-                ns_hpfsmpl[1][i] = l - r;
-            }
-        }
         /*************************************************************** 
         * determine the block type (window type)
         ***************************************************************/
         /* calculate energies of each sub-shortblocks */
         for (i = 0; i < 3; i++) {
-            en_subshort[i] = psv->last_en_subshort[chn][i + 6];
-            assert(psv->last_en_subshort[chn][i + 4] > 0);
-            attack_intensity[i] = en_subshort[i] / psv->last_en_subshort[chn][i + 4];
+            en_subshort[i] = psv->ch[chn].last_en_subshort[i + 6];
+            assert(psv->ch[chn].last_en_subshort[i + 4] > 0);
+            attack_intensity[i] = en_subshort[i] / psv->ch[chn].last_en_subshort[i + 4];
             en_short[0] += en_subshort[i];
         }
 
         for (i = 0; i < 9; i++) {
-            FLOAT const *const pfe = pf + 576 / 9;
-            FLOAT   p = 1.;
-            for (; pf < pfe; pf++)
-                if (p < fabs(*pf))
-                    p = fabs(*pf);
-            psv->last_en_subshort[chn][i] = en_subshort[i + 3] = p;
+            FLOAT   p = subshort_peak[chn][i];
+            psv->ch[chn].last_en_subshort[i] = en_subshort[i + 3] = p;
             en_short[1 + i / 3] += p;
             if (p > en_subshort[i + 3 - 2]) {
                 assert(en_subshort[i + 3 - 2] > 0);
@@ -1181,11 +1314,11 @@ vbrpsy_attack_detection(lame_internal_flags * gfc, const sample_t * const buffer
             }
         }
 
-        if (ns_attacks[chn][0] <= psv->last_attacks[chn]) {
+        if (ns_attacks[chn][0] <= psv->ch[chn].last_attacks) {
             ns_attacks[chn][0] = 0;
         }
 
-        if (psv->last_attacks[chn] == 3 ||
+        if (psv->ch[chn].last_attacks == 3 ||
             ns_attacks[chn][0] + ns_attacks[chn][1] + ns_attacks[chn][2] + ns_attacks[chn][3]) {
             ns_uselongblock = 0;
 
@@ -1212,7 +1345,7 @@ vbrpsy_attack_detection(lame_internal_flags * gfc, const sample_t * const buffer
         /* there is a one granule delay.  Copy maskings computed last call
          * into masking_ratio to return to calling program.
          */
-        energy[chn] = psv->tot_ener[chn];
+        energy[chn] = psv->ch[chn].tot_ener;
     }
 }
 
@@ -1221,8 +1354,8 @@ static void
 vbrpsy_skip_masking_s(lame_internal_flags * gfc, int chn, int sblock)
 {
     if (sblock == 0) {
-        FLOAT  *nbs2 = &gfc->sv_psy.nb_s2[chn][0];
-        FLOAT  *nbs1 = &gfc->sv_psy.nb_s1[chn][0];
+        FLOAT  *nbs2 = &gfc->sv_psy.ch[chn].nb_s2[0];
+        FLOAT  *nbs1 = &gfc->sv_psy.ch[chn].nb_s1[0];
         int const n = gfc->cd_psy->s.npart;
         int     b;
         for (b = 0; b < n; b++) {
@@ -1311,7 +1444,8 @@ vbrpsy_compute_masking_s(lame_internal_flags * gfc, const FLOAT(*fftenergy_s)[HB
 {
     PsyStateVar_t *const psv = &gfc->sv_psy;
     PsyConst_CB2SB_t const *const gds = &gfc->cd_psy->s;
-    FLOAT   max[CBANDS], avg[CBANDS];
+    FLOAT   max[CBANDS], avg[CBANDS], tabv[CBANDS];
+    int     mask_sum[CBANDS + 1];
     int     i, j, b;
     unsigned char mask_idx_s[CBANDS];
 
@@ -1337,46 +1471,34 @@ vbrpsy_compute_masking_s(lame_internal_flags * gfc, const FLOAT(*fftenergy_s)[HB
     assert(b == gds->npart);
     assert(j == 129);
     vbrpsy_calc_mask_index_s(gfc, max, avg, mask_idx_s);
-    for (j = b = 0; b < gds->npart; b++) {
-        int     kk = gds->s3ind[b][0];
-        int const last = gds->s3ind[b][1];
-        int const delta = mask_add_delta(mask_idx_s[b]);
-        int     dd, dd_n;
+    mask_sum[0] = 0;
+    for (b = 0; b < gds->npart; b++) {
+        tabv[b] = tab[mask_idx_s[b]];
+        mask_sum[b + 1] = mask_sum[b] + mask_idx_s[b];
+    }
+    for (b = 0; b < gds->npart; b++) {
         FLOAT   x, ecb, avg_mask;
         FLOAT const masking_lower = gds->masking_lower[b] * gfc->sv_qnt.masking_lower;
 
-        dd = mask_idx_s[kk];
-        dd_n = 1;
-        ecb = gds->s3[j] * eb[kk] * tab[mask_idx_s[kk]];
-        ++j, ++kk;
-        while (kk <= last) {
-            dd += mask_idx_s[kk];
-            dd_n += 1;
-            x = gds->s3[j] * eb[kk] * tab[mask_idx_s[kk]];
-            ecb = vbrpsy_mask_add(ecb, x, kk - b, delta);
-            ++j, ++kk;
-        }
-        dd = (1 + 2 * dd) / (2 * dd_n);
-        avg_mask = tab[dd] * 0.5f;
-        ecb *= avg_mask;
+        ecb = vbrpsy_convolve_s3(gds, b, eb, tabv, mask_sum, mask_idx_s, &avg_mask);
 #if 0                   /* we can do PRE ECHO control now here, or do it later */
         if (psv->blocktype_old[chn & 0x01] == SHORT_TYPE) {
             /* limit calculated threshold by even older granule */
-            FLOAT const t1 = rpelev_s * psv->nb_s1[chn][b];
-            FLOAT const t2 = rpelev2_s * psv->nb_s2[chn][b];
+            FLOAT const t1 = rpelev_s * psv->ch[chn].nb_s1[b];
+            FLOAT const t2 = rpelev2_s * psv->ch[chn].nb_s2[b];
             FLOAT const tm = (t2 > 0) ? Min(ecb, t2) : ecb;
             thr[b] = (t1 > 0) ? NS_INTERP(Min(tm, t1), ecb, 0.6) : ecb;
         }
         else {
             /* limit calculated threshold by older granule */
-            FLOAT const t1 = rpelev_s * psv->nb_s1[chn][b];
+            FLOAT const t1 = rpelev_s * psv->ch[chn].nb_s1[b];
             thr[b] = (t1 > 0) ? NS_INTERP(Min(ecb, t1), ecb, 0.6) : ecb;
         }
 #else /* we do it later */
         thr[b] = ecb;
 #endif
-        psv->nb_s2[chn][b] = psv->nb_s1[chn][b];
-        psv->nb_s1[chn][b] = ecb;
+        psv->ch[chn].nb_s2[b] = psv->ch[chn].nb_s1[b];
+        psv->ch[chn].nb_s1[b] = ecb;
         {
             /*  if THR exceeds EB, the quantization routines will take the difference
              *  from other bands. in case of strong tonal samples (tonaltest.wav)
@@ -1414,9 +1536,10 @@ vbrpsy_compute_masking_l(lame_internal_flags * gfc, const FLOAT fftenergy[HBLKSI
 {
     PsyStateVar_t *const psv = &gfc->sv_psy;
     PsyConst_CB2SB_t const *const gdl = &gfc->cd_psy->l;
-    FLOAT   max[CBANDS], avg[CBANDS];
+    FLOAT   max[CBANDS], avg[CBANDS], tabv[CBANDS];
+    int     mask_sum[CBANDS + 1];
     unsigned char mask_idx_l[CBANDS + 2];
-    int     k, b;
+    int     b;
 
  /*********************************************************************
     *    Calculate the energy and the tonality of each partition.
@@ -1428,38 +1551,17 @@ vbrpsy_compute_masking_l(lame_internal_flags * gfc, const FLOAT fftenergy[HBLKSI
     *      convolve the partitioned energy and unpredictability
     *      with the spreading function, s3_l[b][k]
  ********************************************************************/
-    k = 0;
+    mask_sum[0] = 0;
+    for (b = 0; b < gdl->npart; b++) {
+        tabv[b] = tab[mask_idx_l[b]];
+        mask_sum[b + 1] = mask_sum[b] + mask_idx_l[b];
+    }
     for (b = 0; b < gdl->npart; b++) {
-        FLOAT   x, ecb, avg_mask, t;
+        FLOAT   x, ecb, avg_mask;
         FLOAT const masking_lower = gdl->masking_lower[b] * gfc->sv_qnt.masking_lower;
+
         /* convolve the partitioned energy with the spreading function */
-        int     kk = gdl->s3ind[b][0];
-        int const last = gdl->s3ind[b][1];
-        int const delta = mask_add_delta(mask_idx_l[b]);
-        int     dd = 0, dd_n = 0;
-
-        dd = mask_idx_l[kk];
-        dd_n += 1;
-        ecb = gdl->s3[k] * eb_l[kk] * tab[mask_idx_l[kk]];
-        ++k, ++kk;
-        while (kk <= last) {
-            dd += mask_idx_l[kk];
-            dd_n += 1;
-            x = gdl->s3[k] * eb_l[kk] * tab[mask_idx_l[kk]];
-            t = vbrpsy_mask_add(ecb, x, kk - b, delta);
-#if 0
-            ecb += eb_l[kk];
-            if (ecb > t) {
-                ecb = t;
-            }
-#else
-            ecb = t;
-#endif
-            ++k, ++kk;
-        }
-        dd = (1 + 2 * dd) / (2 * dd_n);
-        avg_mask = tab[dd] * 0.5f;
-        ecb *= avg_mask;
+        ecb = vbrpsy_convolve_s3(gdl, b, eb_l, tabv, mask_sum, mask_idx_l, &avg_mask);
 
         /****   long block pre-echo control   ****/
         /* dont use long block pre-echo control if previous granule was 
@@ -1473,7 +1575,7 @@ vbrpsy_compute_masking_l(lame_internal_flags * gfc, const FLOAT fftenergy[HBLKSI
            chn=2,3   S and M channels.
          */
         if (psv->blocktype_old[chn & 0x01] == SHORT_TYPE) {
-            FLOAT const ecb_limit = rpelev * psv->nb_l1[chn][b];
+            FLOAT const ecb_limit = rpelev * psv->ch[chn].nb_l1[b];
             if (ecb_limit > 0) {
                 thr[b] = Min(ecb, ecb_limit);
             }
@@ -1490,8 +1592,8 @@ vbrpsy_compute_masking_l(lame_internal_flags * gfc, const FLOAT fftenergy[HBLKSI
             }
         }
         else {
-            FLOAT   ecb_limit_2 = rpelev2 * psv->nb_l2[chn][b];
-            FLOAT   ecb_limit_1 = rpelev * psv->nb_l1[chn][b];
+            FLOAT   ecb_limit_2 = rpelev2 * psv->ch[chn].nb_l2[b];
+            FLOAT   ecb_limit_1 = rpelev * psv->ch[chn].nb_l1[b];
             FLOAT   ecb_limit;
             if (ecb_limit_2 <= 0) {
                 ecb_limit_2 = ecb;
@@ -1507,8 +1609,8 @@ vbrpsy_compute_masking_l(lame_internal_flags * gfc, const FLOAT fftenergy[HBLKSI
             }
             thr[b] = Min(ecb, ecb_limit);
         }
-        psv->nb_l2[chn][b] = psv->nb_l1[chn][b];
-        psv->nb_l1[chn][b] = ecb;
+        psv->ch[chn].nb_l2[b] = psv->ch[chn].nb_l1[b];
+        psv->ch[chn].nb_l1[b] = ecb;
         {
             /*  if THR exceeds EB, the quantization routines will take the difference
              *  from other bands. in case of strong tonal samples (tonaltest.wav)
@@ -1544,14 +1646,16 @@ vbrpsy_compute_block_type(SessionConfig_t const *cfg, int *uselongblock)
 {
     int     chn;
 
-    if (cfg->short_blocks == short_block_coupled
+    /* uselongblock[1] is only set for two channels; the test also lets
+     * the mono build see that */
+    if (CFG_CHANNELS_OUT(cfg) == 2 && cfg->short_blocks == short_block_coupled
         /* force both channels to use the same block type */
         /* this is necessary if the frame is to be encoded in ms_stereo.  */
         /* But even without ms_stereo, FhG  does this */
         && !(uselongblock[0] && uselongblock[1]))
         uselongblock[0] = uselongblock[1] = 0;
 
-    for (chn = 0; chn < cfg->channels_out; chn++) {
+    for (chn = 0; chn < CFG_CHANNELS_OUT(cfg); chn++) {
         /* disable short blocks */
         if (cfg->short_blocks == short_block_dispensed) {
             uselongblock[chn] = 1;
@@ -1684,17 +1788,17 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
     PsyConst_CB2SB_t const *const gdl = &gfc->cd_psy->l;
     PsyConst_CB2SB_t const *const gds = &gfc->cd_psy->s;
     plotting_data *plt = cfg->analysis ? gfc->pinfo : 0;
-
-    III_psy_xmin last_thm[4];
+    EncScratch_t *const scratch = gfc->scratch;
 
     /* fft and energy calculation   */
     FLOAT(*wsamp_l)[BLKSIZE];
     FLOAT(*wsamp_s)[3][BLKSIZE_s];
-    FLOAT   fftenergy[HBLKSIZE] __attribute__ ((aligned (16)));
-    FLOAT   fftenergy_s[3][HBLKSIZE_s];
-    FLOAT   wsamp_L[2][BLKSIZE] __attribute__ ((aligned (16)));
-    FLOAT   wsamp_S[2][3][BLKSIZE_s];
-    FLOAT   eb[4][CBANDS], thr[4][CBANDS];
+    FLOAT  *const fftenergy = scratch->fftenergy;
+    FLOAT(*const fftenergy_s)[HBLKSIZE_s] = scratch->fftenergy_s;
+    FLOAT(*const wsamp_L)[BLKSIZE] = scratch->wsamp_L;
+    FLOAT(*const wsamp_S)[3][BLKSIZE_s] = scratch->wsamp_S;
+    FLOAT(*const eb)[CBANDS] = scratch->eb;
+    FLOAT(*const thr)[CBANDS] = scratch->thr;
 
     FLOAT   sub_short_factor[4][3];
     FLOAT   thmm;
@@ -1713,9 +1817,7 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
     int     chn, sb, sblock;
 
     /* chn=2 and 3 = Mid and Side channels */
-    int const n_chn_psy = (cfg->mode == JOINT_STEREO) ? 4 : cfg->channels_out;
-
-    memcpy(&last_thm[0], &psv->thm[0], sizeof(last_thm));
+    int const n_chn_psy = CFG_CHANNELS_PSY(cfg);
 
     vbrpsy_attack_detection(gfc, buffer, gr_out, masking_ratio, masking_MS_ratio, energy,
                             sub_short_factor, ns_attacks, uselongblock);
@@ -1724,8 +1826,8 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
 
     /* LONG BLOCK CASE */
     {
-#if defined(__aarch64__) || defined(__arm__)
-        for (chn = 0; chn < cfg->channels_out; chn++) {
+#if defined(LAME_NEON)
+        for (chn = 0; chn < CFG_CHANNELS_OUT(cfg); chn++) {
             int const ch01 = chn & 0x01;
 
             wsamp_l = wsamp_L + ch01;
@@ -1733,8 +1835,8 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
             vbrpsy_compute_loudness_approximation_l(gfc, gr_out, chn, fftenergy);
             vbrpsy_compute_masking_l(gfc, fftenergy, eb[chn], thr[chn], chn);
         }
-        if (cfg->mode == JOINT_STEREO) {
-            FLOAT   fftenergy_side[HBLKSIZE] __attribute__ ((aligned (16)));
+        if (CFG_MODE(cfg) == JOINT_STEREO) {
+            FLOAT  *const fftenergy_side = scratch->fftenergy_side;
             vbrpsy_compute_fft_l_js(gfc, buffer, gr_out, fftenergy, fftenergy_side, wsamp_L);
             vbrpsy_compute_masking_l(gfc, fftenergy, eb[2], thr[2], 2);
             vbrpsy_compute_masking_l(gfc, fftenergy_side, eb[3], thr[3], 3);
@@ -1752,7 +1854,7 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
             vbrpsy_compute_loudness_approximation_l(gfc, gr_out, chn, fftenergy);
             vbrpsy_compute_masking_l(gfc, fftenergy, eb[chn], thr[chn], chn);
         }
-        if (cfg->mode == JOINT_STEREO) {
+        if (CFG_MODE(cfg) == JOINT_STEREO) {
             if ((uselongblock[0] + uselongblock[1]) == 2) {
                 vbrpsy_compute_MS_thresholds(const_eb, thr, gdl->mld_cb, gfc->ATH->cb_l,
                                              ath_factor, cfg->msfix, gdl->npart);
@@ -1782,7 +1884,7 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
                                              sblock);
                 }
             }
-            if (cfg->mode == JOINT_STEREO) {
+            if (CFG_MODE(cfg) == JOINT_STEREO) {
                 if ((uselongblock[0] + uselongblock[1]) == 0) {
                     vbrpsy_compute_MS_thresholds(const_eb, thr, gds->mld_cb, gfc->ATH->cb_s,
                                                  ath_factor, cfg->msfix, gds->npart);
@@ -1802,7 +1904,7 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
             for (sb = 0; sb < SBMAX_s; sb++) {
                 FLOAT   new_thmm[3], prev_thm, t1, t2;
                 for (sblock = 0; sblock < 3; sblock++) {
-                    thmm = psv->thm[chn].s[sb][sblock];
+                    thmm = psv->ch[chn].thm.s[sb][sblock];
                     thmm *= NS_PREECHO_ATT0;
 
                     t1 = t2 = thmm;
@@ -1811,7 +1913,7 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
                         prev_thm = new_thmm[sblock - 1];
                     }
                     else {
-                        prev_thm = last_thm[chn].s[sb][2];
+                        prev_thm = psv->ch[chn].last_thm_s[sb][1];
                     }
                     if (ns_attacks[chn][sblock] >= 2 || ns_attacks[chn][sblock + 1] == 1) {
                         t1 = NS_INTERP(prev_thm, thmm, NS_PREECHO_ATT1 * pcfact);
@@ -1820,14 +1922,14 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
                     if (ns_attacks[chn][sblock] == 1) {
                         t2 = NS_INTERP(prev_thm, thmm, NS_PREECHO_ATT2 * pcfact);
                     }
-                    else if ((sblock == 0 && psv->last_attacks[chn] == 3)
+                    else if ((sblock == 0 && psv->ch[chn].last_attacks == 3)
                              || (sblock > 0 && ns_attacks[chn][sblock - 1] == 3)) { /* 2nd preceeding block */
                         switch (sblock) {
                         case 0:
-                            prev_thm = last_thm[chn].s[sb][1];
+                            prev_thm = psv->ch[chn].last_thm_s[sb][0];
                             break;
                         case 1:
-                            prev_thm = last_thm[chn].s[sb][2];
+                            prev_thm = psv->ch[chn].last_thm_s[sb][1];
                             break;
                         case 2:
                             prev_thm = new_thmm[0];
@@ -1845,20 +1947,23 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
                     new_thmm[sblock] = thmm;
                 }
                 for (sblock = 0; sblock < 3; sblock++) {
-                    psv->thm[chn].s[sb][sblock] = new_thmm[sblock];
+                    psv->ch[chn].thm.s[sb][sblock] = new_thmm[sblock];
                 }
+                /* psv->thm is left alone until the next granule gets here */
+                psv->ch[chn].last_thm_s[sb][0] = new_thmm[1];
+                psv->ch[chn].last_thm_s[sb][1] = new_thmm[2];
             }
         }
     }
     for (chn = 0; chn < n_chn_psy; chn++) {
-        psv->last_attacks[chn] = ns_attacks[chn][2];
+        psv->ch[chn].last_attacks = ns_attacks[chn][2];
     }
 
 
     /*************************************************************** 
     * determine final block type
     ***************************************************************/
-    vbrpsy_apply_block_type(psv, cfg->channels_out, uselongblock, blocktype_d);
+    vbrpsy_apply_block_type(psv, CFG_CHANNELS_OUT(cfg), uselongblock, blocktype_d);
 
     /*********************************************************************
     * compute the value of PE to return ... no delay and advance
@@ -2112,7 +2217,7 @@ compute_bark_values(PsyConst_CB2SB_t const *gd, FLOAT sfreq, int fft_size,
 }
 
 static int
-init_s3_values(FLOAT ** p, int (*s3ind)[2], int npart,
+init_s3_values(lame_internal_flags * gfc, FLOAT ** p, int *width, int (*s3ind)[2], int npart,
                FLOAT const *bval, FLOAT const *bval_width, FLOAT const *norm)
 {
     FLOAT   s3[CBANDS][CBANDS];
@@ -2120,7 +2225,7 @@ init_s3_values(FLOAT ** p, int (*s3ind)[2], int npart,
      * bval[x] should be used to get the bark value.
      */
     int     i, j, k;
-    int     numberOfNoneZero = 0;
+    int     w = 0;
 
     memset(&s3[0][0], 0, sizeof(s3));
 
@@ -2148,16 +2253,21 @@ init_s3_values(FLOAT ** p, int (*s3ind)[2], int npart,
                 break;
         }
         s3ind[i][1] = j;
-        numberOfNoneZero += (s3ind[i][1] - s3ind[i][0] + 1);
+        if (w < s3ind[i][1] - s3ind[i][0] + 1)
+            w = s3ind[i][1] - s3ind[i][0] + 1;
     }
-    *p = lame_calloc(FLOAT, numberOfNoneZero);
+    /* every row gets the same padded width, so the convolution can
+     * run over whole vectors without a per-row offset table
+     */
+    w = (w + 3) & ~3;
+    *width = w;
+    *p = lame_arena_calloc(gfc, LAME_MEM_PSYMODEL, FLOAT, npart * w);
     if (!*p)
         return -1;
 
-    k = 0;
     for (i = 0; i < npart; i++)
-        for (j = s3ind[i][0]; j <= s3ind[i][1]; j++)
-            (*p)[k++] = s3[i][j];
+        for (j = s3ind[i][0], k = 0; j <= s3ind[i][1]; j++, k++)
+            (*p)[i * w + k] = s3[i][j];
 
     return 0;
 }
@@ -2187,32 +2297,42 @@ psymodel_init(lame_global_flags const *gfp)
     }
     memset(norm, 0, sizeof(norm));
 
-    gd = lame_calloc(PsyConst_t, 1);
+    gd = lame_arena_calloc(gfc, LAME_MEM_PSYMODEL, PsyConst_t, 1);
+    psv->ch = lame_arena_calloc(gfc, LAME_MEM_PSYMODEL, PsyChannelState_t, CFG_CHANNELS_PSY(cfg));
+    if (gd == NULL || psv->ch == NULL) {
+        lame_arena_free(gfc, gd);
+        lame_arena_free(gfc, psv->ch);
+        psv->ch = NULL;
+        return -1;
+    }
     gfc->cd_psy = gd;
 
     gd->force_short_block_calc = gfp->experimentalZ;
 
     psv->blocktype_old[0] = psv->blocktype_old[1] = NORM_TYPE; /* the vbr header is long blocks */
 
-    for (i = 0; i < 4; ++i) {
+    for (i = 0; i < CFG_CHANNELS_PSY(cfg); ++i) {
         for (j = 0; j < CBANDS; ++j) {
-            psv->nb_l1[i][j] = 1e20;
-            psv->nb_l2[i][j] = 1e20;
-            psv->nb_s1[i][j] = psv->nb_s2[i][j] = 1.0;
+            psv->ch[i].nb_l1[j] = 1e20;
+            psv->ch[i].nb_l2[j] = 1e20;
+            psv->ch[i].nb_s1[j] = psv->ch[i].nb_s2[j] = 1.0;
         }
         for (sb = 0; sb < SBMAX_l; sb++) {
-            psv->en[i].l[sb] = 1e20;
-            psv->thm[i].l[sb] = 1e20;
+            psv->ch[i].en.l[sb] = 1e20;
+            psv->ch[i].thm.l[sb] = 1e20;
         }
         for (j = 0; j < 3; ++j) {
             for (sb = 0; sb < SBMAX_s; sb++) {
-                psv->en[i].s[sb][j] = 1e20;
-                psv->thm[i].s[sb][j] = 1e20;
+                psv->ch[i].en.s[sb][j] = 1e20;
+                psv->ch[i].thm.s[sb][j] = 1e20;
             }
-            psv->last_attacks[i] = 0;
+            psv->ch[i].last_attacks = 0;
+        }
+        for (sb = 0; sb < SBMAX_s; sb++) {
+            psv->ch[i].last_thm_s[sb][0] = psv->ch[i].last_thm_s[sb][1] = 1e20;
         }
         for (j = 0; j < 9; j++)
-            psv->last_en_subshort[i][j] = 10.;
+            psv->ch[i].last_en_subshort[j] = 10.;
     }
 
 
@@ -2238,7 +2358,7 @@ psymodel_init(lame_global_flags const *gfp)
         }
         norm[i] = pow(10.0, snr / 10.0);
     }
-    i = init_s3_values(&gd->l.s3, gd->l.s3ind, gd->l.npart, bval, bval_width, norm);
+    i = init_s3_values(gfc, &gd->l.s3, &gd->l.s3width, gd->l.s3ind, gd->l.npart, bval, bval_width, norm);
     if (i)
         return i;
 
@@ -2337,7 +2457,7 @@ psymodel_init(lame_global_flags const *gfp)
         gd->s.minval[i] = pow(10.0, x / 10) * gd->s.numlines[i];
     }
 
-    i = init_s3_values(&gd->s.s3, gd->s.s3ind, gd->s.npart, bval, bval_width, norm);
+    i = init_s3_values(gfc, &gd->s.s3, &gd->s.s3width, gd->s.s3ind, gd->s.npart, bval, bval_width, norm);
     if (i)
         return i;
 
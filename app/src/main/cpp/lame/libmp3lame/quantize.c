@@ -40,7 +40,7 @@
 #ifdef HAVE_XMMINTRIN_H
 #include "vector/lame_intrin.h"
 #endif
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 #include <arm_neon.h>
 #if !defined(__aarch64__)
 #define vaddvq_f32(a) ({ \
@@ -98,7 +98,7 @@ init_xrpow_core_c(gr_info * const cod_info, FLOAT xrpow[576], int upper, FLOAT *
     int     i = 0;
     FLOAT   tmp;
     *sum = 0;
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
     float32x4_t vsum = vdupq_n_f32(0);
     float32x4_t vmax = vdupq_n_f32(0);
     for (i = 0; i <= upper - 15; i += 16) {
@@ -337,7 +337,7 @@ init_outer_loop(lame_internal_flags const *gfc, gr_info * const cod_info)
              *  MPEG-2(.5):  sfbs 0-5 long block, 3-12 short blocks
              */
             cod_info->sfb_smin = 3;
-            cod_info->sfb_lmax = cfg->mode_gr * 2 + 4;
+            cod_info->sfb_lmax = CFG_MODE_GR(cfg) * 2 + 4;
         }
         if (cfg->samplerate_out <= 8000) {
             cod_info->psymax
@@ -398,7 +398,7 @@ init_outer_loop(lame_internal_flags const *gfc, gr_info * const cod_info)
      */
     memset(cod_info->scalefac, 0, sizeof(cod_info->scalefac));
 
-    if (cfg->vbr != vbr_mt && cfg->vbr != vbr_mtrh && cfg->vbr != vbr_abr && cfg->vbr != vbr_off) {
+    if (CFG_VBR(cfg) != vbr_mt && CFG_VBR(cfg) != vbr_mtrh && CFG_VBR(cfg) != vbr_abr && CFG_VBR(cfg) != vbr_off) {
         psfb21_analogsilence(gfc, cod_info);
     }
 }
@@ -438,6 +438,7 @@ bin_search_StepSize(lame_internal_flags * const gfc, gr_info * const cod_info,
     for (;;) {
         int     step;
         nBits = count_bits(gfc, xrpow, cod_info, 0);
+        gfc->sv_stats.bin_search_probes++;
 
         if (CurrentStep == 1 || nBits == desired_rate)
             break;      /* nothing to adjust anymore */
@@ -479,6 +480,7 @@ bin_search_StepSize(lame_internal_flags * const gfc, gr_info * const cod_info,
     while (nBits > desired_rate && cod_info->global_gain < 255) {
         cod_info->global_gain++;
         nBits = count_bits(gfc, xrpow, cod_info, 0);
+        gfc->sv_stats.bin_search_probes++;
     }
     gfc->sv_qnt.CurrentStep[ch] = (start - cod_info->global_gain >= 4) ? 4 : 2;
     gfc->sv_qnt.OldValue[ch] = cod_info->global_gain;
@@ -1084,6 +1086,7 @@ outer_loop(lame_internal_flags * gfc, gr_info * const cod_info, const FLOAT * co
     int     bRefine = 0;
     int     best_ggain_pass1 = 0;
 
+    gfc->sv_stats.outer_loops++;
     (void) bin_search_StepSize(gfc, cod_info, targ_bits, ch, xrpow);
 
     if (!cfg->noise_shaping)
@@ -1144,6 +1147,7 @@ outer_loop(lame_internal_flags * gfc, gr_info * const cod_info, const FLOAT * co
             /* try a new scalefactor conbination on cod_info_w */
             if (balance_noise(gfc, &cod_info_w, distort, xrpow, bRefine) == 0)
                 break;
+            gfc->sv_stats.outer_loop_trials++;
             if (cod_info_w.scalefac_scale)
                 maxggain = 254;
 
@@ -1243,7 +1247,7 @@ outer_loop(lame_internal_flags * gfc, gr_info * const cod_info, const FLOAT * co
     assert((cod_info->global_gain + cod_info->scalefac_scale) <= 255);
     /*  finish up
      */
-    if (cfg->vbr == vbr_rh || cfg->vbr == vbr_mtrh || cfg->vbr == vbr_mt)
+    if (CFG_VBR(cfg) == vbr_rh || CFG_VBR(cfg) == vbr_mtrh || CFG_VBR(cfg) == vbr_mt)
         /* restore for reuse on next try */
         memcpy(xrpow, save_xrpow, sizeof(FLOAT) * 576);
     /*  do the 'substep shaping'
@@ -1449,7 +1453,7 @@ VBR_old_prepare(lame_internal_flags * gfc,
                 const FLOAT pe[2][2], FLOAT const ms_ener_ratio[2],
                 const III_psy_ratio ratio[2][2],
                 FLOAT l3_xmin[2][2][SFBMAX],
-                int frameBits[16], int min_bits[2][2], int max_bits[2][2], int bands[2][2])
+                int frameBits[15], int min_bits[2][2], int max_bits[2][2], int bands[2][2])
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
     EncResult_t *const eov = &gfc->ov_enc;
@@ -1460,17 +1464,17 @@ VBR_old_prepare(lame_internal_flags * gfc,
     int     avg, mxb, bits = 0;
 
     eov->bitrate_index = cfg->vbr_max_bitrate_index;
-    avg = ResvFrameBegin(gfc, &avg) / cfg->mode_gr;
+    avg = ResvFrameBegin(gfc, &avg) / CFG_MODE_GR(cfg);
 
     get_framebits(gfc, frameBits);
 
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
         mxb = on_pe(gfc, pe, max_bits[gr], avg, gr, 0);
         if (gfc->ov_enc.mode_ext == MPG_MD_MS_LR) {
             ms_convert(&gfc->l3_side, gr);
             reduce_side(max_bits[gr], ms_ener_ratio[gr], avg, mxb);
         }
-        for (ch = 0; ch < cfg->channels_out; ++ch) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ++ch) {
             gr_info *const cod_info = &gfc->l3_side.tt[gr][ch];
 
             if (cod_info->block_type != SHORT_TYPE) { /* NORM, START or STOP type */
@@ -1493,8 +1497,8 @@ VBR_old_prepare(lame_internal_flags * gfc,
             bits += max_bits[gr][ch];
         }
     }
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             if (bits > frameBits[cfg->vbr_max_bitrate_index] && bits > 0) {
                 max_bits[gr][ch] *= frameBits[cfg->vbr_max_bitrate_index];
                 max_bits[gr][ch] /= bits;
@@ -1514,8 +1518,8 @@ bitpressure_strategy(lame_internal_flags const *gfc,
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
     int     gr, ch, sfb;
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             gr_info const *const gi = &gfc->l3_side.tt[gr][ch];
             FLOAT  *pxmin = l3_xmin[gr][ch];
             for (sfb = 0; sfb < gi->psy_lmax; sfb++)
@@ -1574,8 +1578,8 @@ VBR_old_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
 
         used_bits = 0;
 
-        for (gr = 0; gr < cfg->mode_gr; gr++) {
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 int     ret;
                 gr_info *const cod_info = &l3_side->tt[gr][ch];
 
@@ -1627,8 +1631,8 @@ VBR_old_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
     }                   /* breaks adjusted */
     /*--------------------------------------*/
 
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             iteration_finish_one(gfc, gr, ch);
         }               /* for ch */
     }                   /* for gr */
@@ -1640,7 +1644,7 @@ VBR_old_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
 static int
 VBR_new_prepare(lame_internal_flags * gfc,
                 const FLOAT pe[2][2], const III_psy_ratio ratio[2][2],
-                FLOAT l3_xmin[2][2][SFBMAX], int frameBits[16], int max_bits[2][2],
+                FLOAT l3_xmin[2][2][SFBMAX], int frameBits[15], int max_bits[2][2],
                 int* max_resv)
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
@@ -1666,12 +1670,12 @@ VBR_new_prepare(lame_internal_flags * gfc,
         *max_resv = gfc->sv_enc.ResvMax;
     }
 
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
         (void) on_pe(gfc, pe, max_bits[gr], avg, gr, 0);
         if (gfc->ov_enc.mode_ext == MPG_MD_MS_LR) {
             ms_convert(&gfc->l3_side, gr);
         }
-        for (ch = 0; ch < cfg->channels_out; ++ch) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ++ch) {
             gr_info *const cod_info = &gfc->l3_side.tt[gr][ch];
 
             gfc->sv_qnt.masking_lower = pow(10.0, gfc->sv_qnt.mask_adjust * 0.1);
@@ -1683,8 +1687,8 @@ VBR_new_prepare(lame_internal_flags * gfc,
             bits += max_bits[gr][ch];
         }
     }
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             if (bits > maximum_framebits && bits > 0) {
                 max_bits[gr][ch] *= maximum_framebits;
                 max_bits[gr][ch] /= bits;
@@ -1725,8 +1729,8 @@ VBR_new_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
 
     analog_silence = VBR_new_prepare(gfc, pe, ratio, l3_xmin, frameBits, max_bits, &pad);
 
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             gr_info *const cod_info = &l3_side->tt[gr][ch];
 
             /*  init_outer_loop sets up cod_info, scalefac and xrpow
@@ -1780,7 +1784,7 @@ VBR_new_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
 #if 0
         static int mmm = 0;
         int     fff = getFramesize_kbps(gfc, used_bits);
-        int     hhh = getFramesize_kbps(gfc, MAX_BITS_PER_GRANULE * cfg->mode_gr);
+        int     hhh = getFramesize_kbps(gfc, MAX_BITS_PER_GRANULE * CFG_MODE_GR(cfg));
         if (mmm < fff)
             mmm = fff;
         printf("demand=%3d kbps  max=%3d kbps   limit=%3d kbps\n", fff, mmm, hhh);
@@ -1792,8 +1796,8 @@ VBR_new_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
         int     mean_bits, fullframebits;
         fullframebits = ResvFrameBegin(gfc, &mean_bits);
         assert(used_bits <= fullframebits);
-        for (gr = 0; gr < cfg->mode_gr; gr++) {
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 gr_info const *const cod_info = &l3_side->tt[gr][ch];
                 ResvAdjust(gfc, cod_info);
             }
@@ -1833,21 +1837,21 @@ calc_target_bits(lame_internal_flags * gfc,
     III_side_info_t const *const l3_side = &gfc->l3_side;
     FLOAT   res_factor;
     int     gr, ch, totbits, mean_bits;
-    int     framesize = 576 * cfg->mode_gr;
+    int     framesize = 576 * CFG_MODE_GR(cfg);
 
     eov->bitrate_index = cfg->vbr_max_bitrate_index;
     *max_frame_bits = ResvFrameBegin(gfc, &mean_bits);
 
     eov->bitrate_index = 1;
     mean_bits = getframebits(gfc) - cfg->sideinfo_len * 8;
-    *analog_silence_bits = mean_bits / (cfg->mode_gr * cfg->channels_out);
+    *analog_silence_bits = mean_bits / (CFG_MODE_GR(cfg) * CFG_CHANNELS_OUT(cfg));
 
     mean_bits = cfg->vbr_avg_bitrate_kbps * framesize * 1000;
     if (gfc->sv_qnt.substep_shaping & 1)
         mean_bits *= 1.09;
     mean_bits /= cfg->samplerate_out;
     mean_bits -= cfg->sideinfo_len * 8;
-    mean_bits /= (cfg->mode_gr * cfg->channels_out);
+    mean_bits /= (CFG_MODE_GR(cfg) * CFG_CHANNELS_OUT(cfg));
 
     /*
        res_factor is the percentage of the target bitrate that should
@@ -1874,9 +1878,9 @@ calc_target_bits(lame_internal_flags * gfc,
     if (res_factor > 1.00)
         res_factor = 1.00;
 
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
         int     sum = 0;
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             targ_bits[gr][ch] = res_factor * mean_bits;
 
             if (pe[gr][ch] > 700) {
@@ -1904,7 +1908,7 @@ calc_target_bits(lame_internal_flags * gfc,
             sum += targ_bits[gr][ch];
         }               /* for ch */
         if (sum > MAX_BITS_PER_GRANULE) {
-            for (ch = 0; ch < cfg->channels_out; ++ch) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ++ch) {
                 targ_bits[gr][ch] *= MAX_BITS_PER_GRANULE;
                 targ_bits[gr][ch] /= sum;
             }
@@ -1912,16 +1916,16 @@ calc_target_bits(lame_internal_flags * gfc,
     }                   /* for gr */
 
     if (gfc->ov_enc.mode_ext == MPG_MD_MS_LR)
-        for (gr = 0; gr < cfg->mode_gr; gr++) {
-            reduce_side(targ_bits[gr], ms_ener_ratio[gr], mean_bits * cfg->channels_out,
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+            reduce_side(targ_bits[gr], ms_ener_ratio[gr], mean_bits * CFG_CHANNELS_OUT(cfg),
                         MAX_BITS_PER_GRANULE);
         }
 
     /*  sum target bits
      */
     totbits = 0;
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             if (targ_bits[gr][ch] > MAX_BITS_PER_CHANNEL)
                 targ_bits[gr][ch] = MAX_BITS_PER_CHANNEL;
             totbits += targ_bits[gr][ch];
@@ -1931,8 +1935,8 @@ calc_target_bits(lame_internal_flags * gfc,
     /*  repartion target bits if needed
      */
     if (totbits > *max_frame_bits && totbits > 0) {
-        for (gr = 0; gr < cfg->mode_gr; gr++) {
-            for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+            for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
                 targ_bits[gr][ch] *= *max_frame_bits;
                 targ_bits[gr][ch] /= totbits;
             }
@@ -1976,12 +1980,12 @@ ABR_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
 
     /*  encode granules
      */
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
 
         if (gfc->ov_enc.mode_ext == MPG_MD_MS_LR) {
             ms_convert(&gfc->l3_side, gr);
         }
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             FLOAT   adjust, masking_lower_db;
             cod_info = &l3_side->tt[gr][ch];
 
@@ -2059,7 +2063,7 @@ CBR_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
     (void) ResvFrameBegin(gfc, &mean_bits);
 
     /* quantize! */
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
 
         /*  calculate needed bits
          */
@@ -2070,7 +2074,7 @@ CBR_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
             reduce_side(targ_bits, ms_ener_ratio[gr], mean_bits, max_bits);
         }
 
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             FLOAT   adjust, masking_lower_db;
             cod_info = &l3_side->tt[gr][ch];
 
@@ -35,8 +35,9 @@
 #include "quantize_pvt.h"
 #include "reservoir.h"
 #include "lame-analysis.h"
+#include "vecmath.h"
 #include <float.h>
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 #include <arm_neon.h>
 #if !defined(__aarch64__)
 #define vaddvq_f32(a) ({ \
@@ -443,7 +444,7 @@ iteration_init(lame_internal_flags * gfc)
  * bugfixes rh 8/01: often allocated more than the allowed 4095 bits
  ************************************************************************/
 int
-on_pe(lame_internal_flags * gfc, const FLOAT pe[][2], int targ_bits[2], int mean_bits, int gr, int cbr)
+on_pe(lame_internal_flags * gfc, const FLOAT pe[2][2], int targ_bits[2], int mean_bits, int gr, int cbr)
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
     int     extra_bits = 0, tbits, bits;
@@ -457,11 +458,11 @@ on_pe(lame_internal_flags * gfc, const FLOAT pe[][2], int targ_bits[2], int mean
     if (max_bits > MAX_BITS_PER_GRANULE) /* hard limit per granule */
         max_bits = MAX_BITS_PER_GRANULE;
 
-    for (bits = 0, ch = 0; ch < cfg->channels_out; ++ch) {
+    for (bits = 0, ch = 0; ch < CFG_CHANNELS_OUT(cfg); ++ch) {
         /******************************************************************
          * allocate bits for each channel 
          ******************************************************************/
-        targ_bits[ch] = Min(MAX_BITS_PER_CHANNEL, tbits / cfg->channels_out);
+        targ_bits[ch] = Min(MAX_BITS_PER_CHANNEL, tbits / CFG_CHANNELS_OUT(cfg));
 
         add_bits[ch] = targ_bits[ch] * pe[gr][ch] / 700.0 - targ_bits[ch];
 
@@ -477,22 +478,22 @@ on_pe(lame_internal_flags * gfc, const FLOAT pe[][2], int targ_bits[2], int mean
         bits += add_bits[ch];
     }
     if (bits > extra_bits && bits > 0) {
-        for (ch = 0; ch < cfg->channels_out; ++ch) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ++ch) {
             add_bits[ch] = extra_bits * add_bits[ch] / bits;
         }
     }
 
-    for (ch = 0; ch < cfg->channels_out; ++ch) {
+    for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ++ch) {
         targ_bits[ch] += add_bits[ch];
         extra_bits -= add_bits[ch];
     }
 
-    for (bits = 0, ch = 0; ch < cfg->channels_out; ++ch) {
+    for (bits = 0, ch = 0; ch < CFG_CHANNELS_OUT(cfg); ++ch) {
         bits += targ_bits[ch];
     }
     if (bits > MAX_BITS_PER_GRANULE) {
         int     sum = 0;
-        for (ch = 0; ch < cfg->channels_out; ++ch) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ++ch) {
             targ_bits[ch] *= MAX_BITS_PER_GRANULE;
             targ_bits[ch] /= bits;
             sum += targ_bits[ch];
@@ -590,6 +591,42 @@ athAdjust(FLOAT a, FLOAT x, FLOAT athFloor, float ATHfixpoint)
 }
 
 
+/*  athAdjust for n bands at once, the weight only depends on a,
+ *  so the per band work is one log10 and one pow10
+ */
+void
+athAdjust_bands(FLOAT a, FLOAT const *x, FLOAT * out, int n, FLOAT athFloor, float ATHfixpoint)
+{
+#ifdef LAME_LIBM_MATH
+    int     i;
+    for (i = 0; i < n; ++i) {
+        out[i] = athAdjust(a, x[i], athFloor, ATHfixpoint);
+    }
+#else
+    FLOAT const o = 90.30873362f;
+    FLOAT const p = (ATHfixpoint < 1.f) ? 94.82444863f : ATHfixpoint;
+    FLOAT const v = a * a;
+    FLOAT   w = 0.0f;
+    int     i;
+    if (n <= 0)
+        return;
+    if (v > 1E-20f)
+        w = 1.f + FAST_LOG10_X(v, 10.0f / o);
+    if (w < 0)
+        w = 0.f;
+    vec_log10(out, x, n);
+    for (i = 0; i < n; ++i) {
+        FLOAT   u = out[i] * 10.0f;
+        u -= athFloor;  /* undo scaling */
+        u *= w;
+        u += athFloor + o - p; /* redo scaling */
+        out[i] = 0.1f * u;
+    }
+    vec_pow10(out, out, n);
+#endif
+}
+
+
 
 /*************************************************************************/
 /*            calc_xmin                                                  */
@@ -612,13 +649,16 @@ calc_xmin(lame_internal_flags const *gfc,
     ATH_t const *const ATH = gfc->ATH;
     const FLOAT *const xr = cod_info->xr;
     int     max_nonzero;
+    FLOAT   ath_l[SBMAX_l], ath_s[SBMAX_s];
 
+    athAdjust_bands(ATH->adjust_factor, ATH->l, ath_l, cod_info->psy_lmax, ATH->floor,
+                    cfg->ATHfixpoint);
     for (gsfb = 0; gsfb < cod_info->psy_lmax; gsfb++) {
         FLOAT   en0, xmin;
         FLOAT   rh1, rh2, rh3;
         int     width, l;
 
-        xmin = athAdjust(ATH->adjust_factor, ATH->l[gsfb], ATH->floor, cfg->ATHfixpoint);
+        xmin = ath_l[gsfb];
         xmin *= gfc->sv_qnt.longfact[gsfb];
 
         width = cod_info->width[gsfb];
@@ -701,11 +741,16 @@ calc_xmin(lame_internal_flags const *gfc,
 
 
 
+    if (gsfb < cod_info->psymax) {
+        sfb = cod_info->sfb_smin;
+        athAdjust_bands(ATH->adjust_factor, &ATH->s[sfb], &ath_s[sfb], SBMAX_s - sfb, ATH->floor,
+                        cfg->ATHfixpoint);
+    }
     for (sfb = cod_info->sfb_smin; gsfb < cod_info->psymax; sfb++, gsfb += 3) {
         int     width, b, l;
         FLOAT   tmpATH;
 
-        tmpATH = athAdjust(ATH->adjust_factor, ATH->s[sfb], ATH->floor, cfg->ATHfixpoint);
+        tmpATH = ath_s[sfb];
         tmpATH *= gfc->sv_qnt.shortfact[sfb];
         
         width = cod_info->width[gsfb];
@@ -783,7 +828,7 @@ calc_noise_core_c(const gr_info * const cod_info, int *startline, int l, FLOAT s
         }
     }
     else if (j > cod_info->big_values) {
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
         float32x4_t vnoise = vdupq_n_f32(0);
         float32x4_t vstep = vdupq_n_f32(step);
         for (; l - 3 > 0; l -= 4, j += 8) {
@@ -892,6 +937,8 @@ calc_noise(gr_info const *const cod_info,
     FLOAT   max_noise = -20.0; /* -200 dB relative to masking */
     int     j = 0;
     const int *scalefac = cod_info->scalefac;
+    FLOAT   noise_db[SFBMAX], distort_db[SFBMAX];
+    int     sfb_db[SFBMAX], n_db = 0, k;
 
     res->over_SSD = 0;
 
@@ -911,7 +958,7 @@ calc_noise(gr_info const *const cod_info,
             j += cod_info->width[sfb];
             distort_ = r_l3_xmin * prev_noise->noise[sfb];
 
-            noise = prev_noise->noise_log[sfb];
+            noise_db[sfb] = prev_noise->noise_log[sfb];
 
         }
         else {
@@ -939,21 +986,30 @@ calc_noise(gr_info const *const cod_info,
 
             distort_ = r_l3_xmin * noise;
 
-            /* multiplying here is adding in dB, but can overflow */
-            noise = FAST_LOG10(Max(distort_, 1E-20f));
-
-            if (prev_noise) {
-                /* save noise values */
-                prev_noise->noise_log[sfb] = noise;
-            }
+            /* multiplying here is adding in dB, but can overflow;
+             * the logs are taken below for all bands at once */
+            distort_db[n_db] = Max(distort_, 1E-20f);
+            sfb_db[n_db++] = sfb;
         }
         *distort++ = distort_;
+    }
 
+    if (n_db > 0)
+        vec_log10(distort_db, distort_db, n_db);
+    for (k = 0; k < n_db; ++k) {
+        noise_db[sfb_db[k]] = distort_db[k];
         if (prev_noise) {
             /* save noise values */
-            prev_noise->global_gain = cod_info->global_gain;;
+            prev_noise->noise_log[sfb_db[k]] = distort_db[k];
         }
+    }
+    if (prev_noise && cod_info->psymax > 0) {
+        /* save noise values */
+        prev_noise->global_gain = cod_info->global_gain;
+    }
 
+    for (sfb = 0; sfb < cod_info->psymax; sfb++) {
+        FLOAT const noise = noise_db[sfb];
 
         /*tot_noise *= Max(noise, 1E-20); */
         tot_noise_db += noise;
@@ -1119,8 +1175,8 @@ set_frame_pinfo(lame_internal_flags * gfc, const III_psy_ratio ratio[2][2])
 
     /* for every granule and channel patch l3_enc and set info
      */
-    for (gr = 0; gr < cfg->mode_gr; gr++) {
-        for (ch = 0; ch < cfg->channels_out; ch++) {
+    for (gr = 0; gr < CFG_MODE_GR(cfg); gr++) {
+        for (ch = 0; ch < CFG_CHANNELS_OUT(cfg); ch++) {
             gr_info *const cod_info = &gfc->l3_side.tt[gr][ch];
             int     scalefac_sav[SFBMAX];
             memcpy(scalefac_sav, cod_info->scalefac, sizeof(scalefac_sav));
@@ -122,6 +122,8 @@ void    huffman_init(lame_internal_flags * const gfc);
 void    init_xrpow_core_init(lame_internal_flags * const gfc);
 
 FLOAT   athAdjust(FLOAT a, FLOAT x, FLOAT athFloor, float ATHfixpoint);
+void    athAdjust_bands(FLOAT a, FLOAT const *x, FLOAT * out, int n, FLOAT athFloor,
+                        float ATHfixpoint);
 
 #define LARGE_BITS 100000
 
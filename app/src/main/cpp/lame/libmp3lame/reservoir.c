@@ -92,7 +92,7 @@ ResvFrameBegin(lame_internal_flags * gfc, int *mean_bits)
     int     meanBits;
 
     frameLength = getframebits(gfc);
-    meanBits = (frameLength - cfg->sideinfo_len * 8) / cfg->mode_gr;
+    meanBits = (frameLength - cfg->sideinfo_len * 8) / CFG_MODE_GR(cfg);
 
 /*
  *  Meaning of the variables:
@@ -135,7 +135,7 @@ ResvFrameBegin(lame_internal_flags * gfc, int *mean_bits)
  */
 
     /* main_data_begin has 9 bits in MPEG-1, 8 bits MPEG-2 */
-    resvLimit = (8 * 256) * cfg->mode_gr - 8;
+    resvLimit = (8 * 256) * CFG_MODE_GR(cfg) - 8;
 
     /* maximum allowed frame size.  dont use more than this number of
        bits, even if the frame has the space for them: */
@@ -146,7 +146,7 @@ ResvFrameBegin(lame_internal_flags * gfc, int *mean_bits)
     if (esv->ResvMax < 0 || cfg->disable_reservoir)
         esv->ResvMax = 0;
     
-    fullFrameBits = meanBits * cfg->mode_gr + Min(esv->ResvSize, esv->ResvMax);
+    fullFrameBits = meanBits * CFG_MODE_GR(cfg) + Min(esv->ResvSize, esv->ResvMax);
 
     if (fullFrameBits > maxmp3buf)
         fullFrameBits = maxmp3buf;
@@ -244,7 +244,7 @@ ResvFrameEnd(lame_internal_flags * gfc, int mean_bits)
     int     stuffingBits;
     int     over_bits;
 
-    esv->ResvSize += mean_bits * cfg->mode_gr;
+    esv->ResvSize += mean_bits * CFG_MODE_GR(cfg);
     stuffingBits = 0;
     l3_side->resvDrain_post = 0;
     l3_side->resvDrain_pre = 0;
@@ -31,6 +31,7 @@
 #include "encoder.h"
 #include "util.h"
 #include "bitstream.h"  /* because of compute_flushbits */
+#include "lame-analysis.h" /* sizeof(plotting_data) */
 
 #include "set_get.h"
 #include "lame_global_flags.h"
@@ -563,6 +564,91 @@ lame_get_decode_on_the_fly(const lame_global_flags * gfp)
     return 0;
 }
 
+/* Size the buffers for the stream being encoded instead of the worst case. */
+int
+lame_set_low_memory(lame_global_flags * gfp, int low_memory)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = 0 (disabled) */
+
+        /* enforce disable/enable meaning, if we need more than two values
+           we need to switch to an enum to have an apropriate representation
+           of the possible meanings of the value */
+        if (0 > low_memory || 1 < low_memory)
+            return -1;
+
+        gfp->low_memory = low_memory;
+
+        return 0;
+    }
+    return -1;
+}
+
+int
+lame_get_low_memory(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        assert(0 <= gfp->low_memory && 1 >= gfp->low_memory);
+        return gfp->low_memory;
+    }
+    return 0;
+}
+
+/* Largest encode call whose input buffers lame_init_params sets aside. */
+int
+lame_set_input_chunk(lame_global_flags * gfp, int input_chunk)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = 0 (none) */
+        if (input_chunk < 0)
+            return -1;
+        gfp->input_chunk = input_chunk;
+        return 0;
+    }
+    return -1;
+}
+
+int
+lame_get_input_chunk(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        assert(0 <= gfp->input_chunk);
+        return gfp->input_chunk;
+    }
+    return 0;
+}
+
+/* Time the stages of every frame, see lame_get_encoder_stats. */
+int
+lame_set_stage_timing(lame_global_flags * gfp, int stage_timing)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = 0 (disabled) */
+        if (0 > stage_timing || 1 < stage_timing)
+            return -1;
+
+        gfp->stage_timing = stage_timing;
+        {
+            /* may be switched while encoding */
+            lame_internal_flags *const gfc = gfp->internal_flags;
+            if (is_lame_internal_flags_valid(gfc))
+                gfc->cfg.stage_timing = stage_timing;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+int
+lame_get_stage_timing(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        assert(0 <= gfp->stage_timing && 1 >= gfp->stage_timing);
+        return gfp->stage_timing;
+    }
+    return 0;
+}
+
 #if DEPRECATED_OR_OBSOLETE_CODE_REMOVED
 /* DEPRECATED: now does the same as lame_set_findReplayGain()
    default = 0 (disabled) */
@@ -701,6 +787,22 @@ lame_set_msgf(lame_global_flags * gfp, void (*func) (const char *, va_list))
     return -1;
 }
 
+int
+lame_set_stage_hook(lame_global_flags * gfp, lame_stage_hook hook, void *arg)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags *const gfc = gfp->internal_flags;
+        gfp->stage_hook = hook;
+        gfp->stage_hook_arg = arg;
+        if (is_lame_internal_flags_valid(gfc)) {
+            gfc->stage_hook = hook;
+            gfc->stage_hook_arg = arg;
+        }
+        return 0;
+    }
+    return -1;
+}
+
 
 /*
  * Set one of
@@ -2120,6 +2222,70 @@ lame_get_noclipScale(const lame_global_flags * gfp)
 }
 
 
+/*
+ * Memory held by the encoder, per subsystem.
+ */
+int
+lame_get_memory_stats(const lame_global_flags * gfp, lame_memory_stats * stats)
+{
+    if (is_lame_global_flags_valid(gfp) && stats != 0) {
+        lame_internal_flags const *const gfc = gfp->internal_flags;
+        if (gfc != 0) {
+            lame_arena_t const *const arena = &gfc->arena;
+            int     i;
+
+            for (i = 0; i < LAME_MEM_SUBSYSTEMS; ++i) {
+                stats->current[i] = arena->current[i];
+                stats->peak[i] = arena->peak[i];
+            }
+            if (gfc->cfg.analysis && gfc->pinfo != 0) {
+                stats->current[LAME_MEM_ANALYSIS] = sizeof(plotting_data);
+                stats->peak[LAME_MEM_ANALYSIS] = sizeof(plotting_data);
+            }
+            stats->arena_size = 0;
+            stats->arena_used = 0;
+            for (i = 0; i < arena->blocks; ++i) {
+                stats->arena_size += arena->block[i].size;
+                stats->arena_used += arena->block[i].used;
+            }
+            stats->heap_bytes = arena->heap;
+            stats->heap_peak = arena->heap_peak;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Stage times and quantizer counters, see lame.h.
+ */
+int
+lame_get_encoder_stats(const lame_global_flags * gfp, lame_encoder_stats * stats)
+{
+    if (is_lame_global_flags_valid(gfp) && stats != 0) {
+        lame_internal_flags const *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc)) {
+            EncStats_t const *const st = &gfc->sv_stats;
+            int     i;
+
+            for (i = 0; i < LAME_STAGES; ++i) {
+                stats->stage_seconds[i] = st->stage_seconds[i];
+            }
+            stats->frames = st->frames;
+            stats->granules = st->granules;
+            stats->short_blocks = st->short_blocks;
+            stats->silent_frames = st->silent_frames;
+            stats->bin_search_probes = st->bin_search_probes;
+            stats->outer_loops = st->outer_loops;
+            stats->outer_loop_trials = st->outer_loop_trials;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
 /*
  * LAME's estimate of the total number of frames to be encoded.
  * Only valid if calling program set num_samples.
@@ -2180,6 +2346,37 @@ lame_get_totalframes(const lame_global_flags * gfp)
 
 
 
+/*
+ * Size of the whole CBR stream, see lame.h. Every frame is the same but
+ * for the padding byte, which the slot_lag schedule of lame_init_params
+ * gives to frames 2.. of the audio: after n frames ceil((n-1)*frac_SpF /
+ * samplerate_out) of them are padded. The Info frame comes first and is
+ * never padded.
+ */
+unsigned long
+lame_get_cbr_stream_size(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags const *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc)) {
+            SessionConfig_t const *const cfg = &gfc->cfg;
+            int const frames = lame_get_totalframes(gfp);
+            unsigned long frame_bytes, padded, bytes;
+
+            if (cfg->vbr != vbr_off || frames <= 0 || cfg->samplerate_out <= 0)
+                return 0;
+            frame_bytes = (cfg->version + 1) * 72000ul * cfg->avg_bitrate / cfg->samplerate_out;
+            padded = (unsigned long) ceil((double) (frames - 1) * gfc->sv_enc.frac_SpF
+                                          / cfg->samplerate_out);
+            bytes = frames * frame_bytes + padded;
+            if (cfg->write_lame_tag)
+                bytes += frame_bytes;
+            return bytes;
+        }
+    }
+    return 0;
+}
+
 
 int
 lame_set_preset(lame_global_flags * gfp, int preset)
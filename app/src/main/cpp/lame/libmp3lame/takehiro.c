@@ -33,7 +33,7 @@
 #include "util.h"
 #include "quantize_pvt.h"
 #include "tables.h"
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 #include <arm_neon.h>
 #if !defined(__aarch64__)
 #define vaddvq_u32(a) ({ \
@@ -588,7 +588,7 @@ count_bit_noESC_from3(const int *ix, const int *end, int max, unsigned int * s)
     return t;  
 }
 
-#if defined(__aarch64__)
+#if defined(LAME_NEON) && defined(__aarch64__)
 inline static int
 count_bit_noESC_from3_neon_7to9(const int *ix, const int *end, int max, unsigned int * s)
 {
@@ -754,7 +754,7 @@ count_bit_noESC_from3_neon_10to12(const int *ix, const int *end, int max, unsign
 }
 #endif
 
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 static const uint32_t table131415[16 * 16] = {
     0x00030101, 0x00050505, 0x00060707, 0x00080908, 0x00080a09, 0x00090a0a, 0x000a0b0a, 0x000a0b0b, 
     0x000a0c0a, 0x000b0c0b, 0x000b0c0c, 0x000c0d0c, 0x000c0d0d, 0x000c0d0d, 0x000d0e0e, 0x000e0b0e, 
@@ -919,7 +919,7 @@ static const count_fnc count_fncs[] =
 , &count_bit_noESC
 , &count_bit_noESC_from2
 , &count_bit_noESC_from2
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 #if defined(__aarch64__)
 , &count_bit_noESC_from3_neon_7to9
 , &count_bit_noESC_from3_neon_7to9
@@ -961,7 +961,7 @@ choose_table_nonMMX(const int *ix, const int *const end, int *const _s)
     unsigned int* s = (unsigned int*)_s;
     unsigned int  max;
     int     choice, choice2;
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
     const int *ixp = ix;
     int32x4_t vmax = vdupq_n_s32(0);
     for (; ixp < end - 7; ixp += 8) {
@@ -1003,7 +1003,7 @@ choose_table_nonMMX(const int *ix, const int *const end, int *const _s)
             break;
         }
     }
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
     return count_bit_ESC_neon(ix, end, choice, choice2, s);
 #else
     return count_bit_ESC(ix, end, choice, choice2, s);
@@ -1260,7 +1260,7 @@ best_huffman_divide(const lame_internal_flags * const gfc, gr_info * const gi)
 
 
     /* SHORT BLOCK stuff fails for MPEG2 */
-    if (gi->block_type == SHORT_TYPE && cfg->mode_gr == 1)
+    if (gi->block_type == SHORT_TYPE && CFG_MODE_GR(cfg) == 1)
         return;
 
 
@@ -1425,7 +1425,7 @@ best_scalefac_store(const lame_internal_flags * gfc,
         }
     }
 
-    if (!gi->preflag && gi->block_type != SHORT_TYPE && cfg->mode_gr == 2) {
+    if (!gi->preflag && gi->block_type != SHORT_TYPE && CFG_MODE_GR(cfg) == 2) {
         for (sfb = 11; sfb < SBPSY_l; sfb++)
             if (gi->scalefac[sfb] < pretab[sfb] && gi->scalefac[sfb] != -2)
                 break;
@@ -1441,7 +1441,7 @@ best_scalefac_store(const lame_internal_flags * gfc,
     for (i = 0; i < 4; i++)
         l3_side->scfsi[ch][i] = 0;
 
-    if (cfg->mode_gr == 2 && gr == 1
+    if (CFG_MODE_GR(cfg) == 2 && gr == 1
         && l3_side->tt[0][ch].block_type != SHORT_TYPE
         && l3_side->tt[1][ch].block_type != SHORT_TYPE) {
         scfsi_calc(ch, l3_side);
@@ -1682,7 +1682,7 @@ mpeg2_scale_bitcount(const lame_internal_flags * gfc, gr_info * const cod_info)
 int
 scale_bitcount(const lame_internal_flags * gfc, gr_info * cod_info)
 {
-    if (gfc->cfg.mode_gr == 2) {
+    if (CFG_MODE_GR(&gfc->cfg) == 2) {
         return mpeg1_scale_bitcount(gfc, cod_info);
     }
     else {
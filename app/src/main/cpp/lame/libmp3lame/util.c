@@ -32,6 +32,7 @@
 #include "encoder.h"
 #include "util.h"
 #include "tables.h"
+#include "gain_analysis.h"
 
 #define PRECOMPUTE
 #if defined(__FreeBSD__) && !defined(__alpha__)
@@ -94,16 +95,13 @@ static void
 free_global_data(lame_internal_flags * gfc)
 {
     if (gfc && gfc->cd_psy) {
-        if (gfc->cd_psy->l.s3) {
-            /* XXX allocated in psymodel_init() */
-            free(gfc->cd_psy->l.s3);
-        }
-        if (gfc->cd_psy->s.s3) {
-            /* XXX allocated in psymodel_init() */
-            free(gfc->cd_psy->s.s3);
-        }
-        free(gfc->cd_psy);
+        /* XXX allocated in psymodel_init() */
+        lame_arena_free(gfc, gfc->cd_psy->l.s3);
+        lame_arena_free(gfc, gfc->cd_psy->s.s3);
+        lame_arena_free(gfc, gfc->cd_psy);
         gfc->cd_psy = 0;
+        lame_arena_free(gfc, gfc->sv_psy.ch);
+        gfc->sv_psy.ch = 0;
     }
 }
 
@@ -112,44 +110,42 @@ void
 freegfc(lame_internal_flags * const gfc)
 {                       /* bit stream structure */
     int     i;
+    lame_arena_t arena;
 
     if (gfc == 0) return;
 
     for (i = 0; i <= 2 * BPC; i++)
         if (gfc->sv_enc.blackfilt[i] != NULL) {
-            free(gfc->sv_enc.blackfilt[i]);
+            lame_arena_free(gfc, gfc->sv_enc.blackfilt[i]);
             gfc->sv_enc.blackfilt[i] = NULL;
         }
     if (gfc->sv_enc.inbuf_old[0]) {
-        free(gfc->sv_enc.inbuf_old[0]);
+        lame_arena_free(gfc, gfc->sv_enc.inbuf_old[0]);
         gfc->sv_enc.inbuf_old[0] = NULL;
     }
     if (gfc->sv_enc.inbuf_old[1]) {
-        free(gfc->sv_enc.inbuf_old[1]);
+        lame_arena_free(gfc, gfc->sv_enc.inbuf_old[1]);
         gfc->sv_enc.inbuf_old[1] = NULL;
     }
 
     if (gfc->bs.buf != NULL) {
-        free(gfc->bs.buf);
+        lame_arena_free(gfc, gfc->bs.buf);
         gfc->bs.buf = NULL;
     }
 
     if (gfc->VBR_seek_table.bag) {
-        free(gfc->VBR_seek_table.bag);
+        lame_arena_free(gfc, gfc->VBR_seek_table.bag);
         gfc->VBR_seek_table.bag = NULL;
         gfc->VBR_seek_table.size = 0;
     }
-    if (gfc->ATH) {
-        free(gfc->ATH);
-    }
-    if (gfc->sv_rpg.rgdata) {
-        free(gfc->sv_rpg.rgdata);
-    }
-    if (gfc->sv_enc.in_buffer_0) {
-        free(gfc->sv_enc.in_buffer_0);
-    }
-    if (gfc->sv_enc.in_buffer_1) {
-        free(gfc->sv_enc.in_buffer_1);
+    lame_arena_free(gfc, gfc->ATH);
+    lame_arena_free(gfc, gfc->sv_rpg.rgdata);
+    lame_arena_free(gfc, gfc->scratch);
+    lame_arena_free(gfc, gfc->sv_enc.in_buffer_0);
+    lame_arena_free(gfc, gfc->sv_enc.in_buffer_1);
+    for (i = 0; i < 2; i++) {
+        lame_arena_free(gfc, gfc->sv_enc.mfbuf[i]);
+        lame_arena_free(gfc, gfc->sv_enc.sb_sample[i]);
     }
     free_id3tag(gfc);
 
@@ -162,7 +158,151 @@ freegfc(lame_internal_flags * const gfc)
 
     free_global_data(gfc);
 
-    free(gfc);
+    /* gfc lives in the first block */
+    arena = gfc->arena;
+    for (i = arena.blocks - 1; i >= 0; i--)
+        free(arena.block[i].base);
+}
+
+
+#define ARENA_ROUND(n) (((size_t)(n) + LAME_ARENA_ALIGN - 1) & ~(size_t)(LAME_ARENA_ALIGN - 1))
+
+/* every block carries its size and subsystem in front, for the
+ * accounting: heap fallbacks in 16 bytes, which keep the payload as
+ * aligned as calloc's, arena pieces in the cache line before them */
+typedef union {
+    struct {
+        size_t  bytes;
+        int     sub;
+    } h;
+    double  align[2];
+} arena_heap_header;
+
+#define ARENA_PIECE(n) (LAME_ARENA_ALIGN + ARENA_ROUND(n))
+
+/* what lame_init allocates: lame_internal_flags, ATH, ReplayGain, scratch */
+static size_t
+arena_init_capacity(void)
+{
+    return ARENA_ROUND(sizeof(lame_internal_flags))
+        + ARENA_PIECE(sizeof(ATH_t))
+        + ARENA_PIECE(sizeof(replaygain_t))
+        + ARENA_PIECE(sizeof(EncScratch_t));
+}
+
+/* what lame_init_params and the encode calls allocate for this stream */
+static size_t
+arena_stream_capacity(SessionConfig_t const *cfg, int input_chunk)
+{
+    return ARENA_PIECE(sizeof(PsyConst_t))
+        + 2 * ARENA_PIECE(CBANDS * CBANDS * sizeof(FLOAT)) /* s3 long, short */
+        + ARENA_PIECE(cfg->low_memory ? BUFFER_SIZE_LOWMEM : BUFFER_SIZE) /* bs.buf */
+        + ARENA_PIECE(400 * sizeof(int)) /* VBR_seek_table.bag */
+        + ARENA_PIECE(CFG_CHANNELS_PSY(cfg) * sizeof(PsyChannelState_t)) /* sv_psy.ch */
+        + cfg->channels_out * (ARENA_PIECE(MFSIZE * sizeof(sample_t)) /* mfbuf */
+                               + ARENA_PIECE(2 * 18 * SBLIMIT * sizeof(FLOAT)) /* sb_sample */
+                               + (input_chunk > 0 ? ARENA_PIECE(input_chunk * sizeof(sample_t)) : 0));
+}
+
+static void
+arena_account(lame_arena_t * a, int sub, size_t bytes)
+{
+    a->current[sub] += bytes;
+    if (a->peak[sub] < a->current[sub])
+        a->peak[sub] = a->current[sub];
+}
+
+/* a zeroed block whose first usable byte is cache line aligned */
+static unsigned char *
+arena_block_alloc(lame_arena_block_t * blk, size_t size)
+{
+    unsigned char *const base = calloc(1, size + LAME_ARENA_ALIGN);
+
+    if (base == NULL)
+        return NULL;
+    blk->base = base;
+    blk->size = size + LAME_ARENA_ALIGN;
+    blk->used = ARENA_ROUND((size_t) base) - (size_t) base;
+    return base + blk->used;
+}
+
+lame_internal_flags *
+lame_arena_create(void)
+{
+    lame_arena_block_t blk;
+    unsigned char *const p = arena_block_alloc(&blk, arena_init_capacity());
+    lame_internal_flags *gfc;
+
+    if (p == NULL)
+        return NULL;
+    gfc = (lame_internal_flags *) p;
+    blk.used += ARENA_ROUND(sizeof(lame_internal_flags));
+    gfc->arena.block[0] = blk;
+    gfc->arena.blocks = 1;
+    arena_account(&gfc->arena, LAME_MEM_CORE, ARENA_ROUND(sizeof(lame_internal_flags)));
+    return gfc;
+}
+
+/* Called by lame_init_params once gfc->cfg is set; input_chunk is
+ * lame_set_input_chunk's. Without the block (out of memory, a second
+ * lame_init_params) the pieces come from the heap, nothing else changes. */
+void
+lame_arena_reserve(lame_internal_flags * gfc, int input_chunk)
+{
+    lame_arena_t *const a = &gfc->arena;
+
+    if (a->blocks < LAME_ARENA_BLOCKS
+        && arena_block_alloc(&a->block[a->blocks], arena_stream_capacity(&gfc->cfg, input_chunk)) != NULL)
+        a->blocks++;
+}
+
+void   *
+lame_arena_alloc(lame_internal_flags * gfc, lame_mem_subsystem sub, size_t bytes)
+{
+    lame_arena_t *const a = &gfc->arena;
+    lame_arena_block_t *const blk = &a->block[a->blocks - 1];
+    size_t const need = ARENA_PIECE(bytes);
+    arena_heap_header *hdr;
+
+    if (bytes > 0 && need <= blk->size - blk->used) {
+        unsigned char *p = blk->base + blk->used + LAME_ARENA_ALIGN;
+        blk->used += need;
+        hdr = (arena_heap_header *) p - 1;
+        hdr->h.bytes = need - LAME_ARENA_ALIGN;
+        hdr->h.sub = sub;
+        arena_account(a, sub, hdr->h.bytes);
+        return p;
+    }
+    hdr = calloc(1, sizeof(*hdr) + bytes);
+    if (hdr == NULL)
+        return NULL;
+    hdr->h.bytes = bytes;
+    hdr->h.sub = sub;
+    a->heap += bytes;
+    if (a->heap_peak < a->heap)
+        a->heap_peak = a->heap;
+    arena_account(a, sub, bytes);
+    return hdr + 1;
+}
+
+void
+lame_arena_free(lame_internal_flags * gfc, void *p)
+{
+    unsigned char const *const q = p;
+    lame_arena_t *const a = &gfc->arena;
+    arena_heap_header *hdr;
+    int     i;
+
+    if (p == NULL)
+        return;
+    hdr = (arena_heap_header *) p - 1;
+    a->current[hdr->h.sub] -= hdr->h.bytes;
+    /* a piece of a block is not reused, only uncounted */
+    for (i = 0; i < a->blocks; i++)
+        if (q >= a->block[i].base && q < a->block[i].base + a->block[i].size)
+            return;
+    a->heap -= hdr->h.bytes;
+    free(hdr);
 }
 
 void
@@ -564,10 +704,10 @@ fill_buffer_resample(lame_internal_flags * gfc,
     BLACKSIZE = filter_l + 1; /* size of data needed for FIR */
 
     if (gfc->fill_buffer_resample_init == 0) {
-        esv->inbuf_old[0] = lame_calloc(sample_t, BLACKSIZE);
-        esv->inbuf_old[1] = lame_calloc(sample_t, BLACKSIZE);
+        esv->inbuf_old[0] = lame_arena_calloc(gfc, LAME_MEM_RESAMPLE, sample_t, BLACKSIZE);
+        esv->inbuf_old[1] = lame_arena_calloc(gfc, LAME_MEM_RESAMPLE, sample_t, BLACKSIZE);
         for (i = 0; i <= 2 * bpc; ++i)
-            esv->blackfilt[i] = lame_calloc(sample_t, BLACKSIZE);
+            esv->blackfilt[i] = lame_arena_calloc(gfc, LAME_MEM_RESAMPLE, sample_t, BLACKSIZE);
 
         esv->itime[0] = 0;
         esv->itime[1] = 0;
@@ -675,9 +815,9 @@ fill_buffer(lame_internal_flags * gfc,
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
     int     mf_size = gfc->sv_enc.mf_size;
-    int     framesize = 576 * cfg->mode_gr;
+    int     framesize = 576 * CFG_MODE_GR(cfg);
     int     nout, ch = 0;
-    int     nch = cfg->channels_out;
+    int     nch = CFG_CHANNELS_OUT(cfg);
 
     /* copy in new samples into mfbuf, with resampling if necessary */
     if (isResamplingNecessary(cfg)) {
@@ -87,6 +87,8 @@ extern  "C" {
 
 /* "bit_stream.h" Definitions */
 #define         BUFFER_SIZE     LAME_MAXMP3BUFFER
+/* low memory profile: room for frames plus a text-only ID3v2 tag */
+#define         BUFFER_SIZE_LOWMEM (LAME_MAXMP3BUFFER - LAME_MAXALBUMART + 4096)
 
 #define         Min(A, B)       ((A) < (B) ? (A) : (B))
 #define         Max(A, B)       ((A) > (B) ? (A) : (B))
@@ -130,6 +132,39 @@ extern  "C" {
     void    calloc_aligned(aligned_pointer_t * ptr, unsigned int size, unsigned int bytes);
     void    free_aligned(aligned_pointer_t * ptr);
 
+    /* Per-encoder arena: lame_internal_flags and the encoder state are
+     * carved out of zeroed blocks, every piece starting on a cache line.
+     * lame_init allocates the first block, for lame_internal_flags and
+     * what does not depend on the stream; lame_init_params a second one
+     * sized from the configuration (channels, low_memory, the input
+     * chunk set by lame_set_input_chunk). Requests that do not fit any
+     * more (larger input calls, the resampler) fall back to calloc.
+     * The arena is bump-only: lame_arena_free uncounts either kind of
+     * block but only releases the heap ones, a piece of a block is never
+     * handed out again. The id3 strings stay on the heap, they are
+     * replaced at will by the caller.
+     */
+#define LAME_ARENA_ALIGN 64
+#define LAME_ARENA_BLOCKS 2
+
+    typedef struct {
+        unsigned char *base; /* block from malloc, free this */
+        size_t  size;
+        size_t  used;
+    } lame_arena_block_t;
+
+    typedef struct {
+        lame_arena_block_t block[LAME_ARENA_BLOCKS]; /* pieces come from the last one */
+        int     blocks;
+        size_t  current[LAME_MEM_SUBSYSTEMS]; /* see lame_get_memory_stats */
+        size_t  peak[LAME_MEM_SUBSYSTEMS];
+        size_t  heap; /* bytes currently in heap fallbacks */
+        size_t  heap_peak;
+    } lame_arena_t;
+
+#define lame_arena_calloc(GFC, SUB, TYPE, COUNT) \
+    ((TYPE*)lame_arena_alloc(GFC, SUB, (size_t)(COUNT) * sizeof(TYPE)))
+
 
     /* "bit_stream.h" Type Definitions */
 
@@ -199,7 +234,8 @@ extern  "C" {
         int     bo[Max(SBMAX_l,SBMAX_s)];
         int     npart;
         int     n_sb; /* SBMAX_l or SBMAX_s */
-        FLOAT  *s3;
+        int     s3width; /* row stride of s3, a multiple of 4 */
+        FLOAT  *s3; /* band matrix, row b holds s3[b][s3ind[b][0]..s3ind[b][1]] zero padded */
     } PsyConst_CB2SB_t;
 
 
@@ -217,26 +253,49 @@ extern  "C" {
     } PsyConst_t;
 
 
+    /* psymodel state of one channel, see CFG_CHANNELS_PSY */
     typedef struct {
+        FLOAT   nb_l1[CBANDS], nb_l2[CBANDS];
+        FLOAT   nb_s1[CBANDS], nb_s2[CBANDS];
 
-        FLOAT   nb_l1[4][CBANDS], nb_l2[4][CBANDS];
-        FLOAT   nb_s1[4][CBANDS], nb_s2[4][CBANDS];
+        III_psy_xmin thm;
+        III_psy_xmin en;
+        FLOAT   last_thm_s[SBMAX_s][2]; /* thm.s[sb][1..2] of the previous granule */
 
-        III_psy_xmin thm[4];
-        III_psy_xmin en[4];
+        FLOAT   tot_ener;
 
-        /* loudness calculation (for adaptive threshold of hearing) */
-        FLOAT   loudness_sq_save[2]; /* account for granule delay of L3psycho_anal */
+        FLOAT   last_en_subshort[9];
+        int     last_attacks;
+    } PsyChannelState_t;
 
-        FLOAT   tot_ener[4];
+    typedef struct {
+        PsyChannelState_t *ch; /* CFG_CHANNELS_PSY of them, from psymodel_init */
 
-        FLOAT   last_en_subshort[4][9];
-        int     last_attacks[4];
+        /* loudness calculation (for adaptive threshold of hearing) */
+        FLOAT   loudness_sq_save[2]; /* account for granule delay of L3psycho_anal */
 
         int     blocktype_old[2];
     } PsyStateVar_t;
 
 
+    /* Per-frame work areas of the psymodel and lame_encode_mp3_frame.
+     * They used to live on the stack (some 26 KB per call); keeping them
+     * in the encoder lets worker threads run with small stacks, and every
+     * array starts on a 32 byte boundary for vector loads.
+     */
+    typedef struct {
+        FLOAT   wsamp_L[2][BLKSIZE] __attribute__ ((aligned (32)));
+        FLOAT   wsamp_S[2][3][BLKSIZE_s] __attribute__ ((aligned (32)));
+        FLOAT   fftenergy[HBLKSIZE] __attribute__ ((aligned (32)));
+        FLOAT   fftenergy_side[HBLKSIZE] __attribute__ ((aligned (32)));
+        FLOAT   fftenergy_s[3][HBLKSIZE_s] __attribute__ ((aligned (32)));
+        FLOAT   eb[4][CBANDS] __attribute__ ((aligned (32)));
+        FLOAT   thr[4][CBANDS] __attribute__ ((aligned (32)));
+        III_psy_ratio masking_LR[2][2] __attribute__ ((aligned (32))); /* LR masking & energy */
+        III_psy_ratio masking_MS[2][2] __attribute__ ((aligned (32))); /* MS masking & energy */
+    } EncScratch_t;
+
+
     typedef struct {
         /* loudness calculation (for adaptive threshold of hearing) */
         FLOAT   loudness_sq[2][2]; /* loudness^2 approx. per granule and channel */
@@ -246,7 +305,7 @@ extern  "C" {
     /* variables used by encoder.c */
     typedef struct {
         /* variables for newmdct.c */
-        FLOAT   sb_sample[2][2][18][SBLIMIT];
+        FLOAT   (*sb_sample[2])[18][SBLIMIT]; /* [ch][gr], one block per coded channel */
         FLOAT   amp_filter[32];
 
         /* variables used by util.c */
@@ -293,7 +352,7 @@ extern  "C" {
 #ifndef  MFSIZE
 # define MFSIZE  ( 3*1152 + ENCDELAY - MDCTDELAY )
 #endif
-        sample_t mfbuf[2][MFSIZE];
+        sample_t *mfbuf[2]; /* MFSIZE each, for the coded channels only */
 
         int     mf_samples_to_encode;
         int     mf_size;
@@ -345,6 +404,18 @@ extern  "C" {
     } RpgStateVar_t;
 
 
+    typedef struct {
+        double  stage_seconds[LAME_STAGES];
+        long    frames;
+        long    granules;
+        long    short_blocks;
+        long    silent_frames;
+        long    bin_search_probes;
+        long    outer_loops;
+        long    outer_loop_trials;
+    } EncStats_t;        /* see lame_get_encoder_stats */
+
+
     typedef struct {
         FLOAT   noclipScale; /* user-specified scale factor required for preventing clipping */
         sample_t PeakSample;
@@ -408,6 +479,8 @@ extern  "C" {
         int     findReplayGain; /* find the RG value? default=0       */
         int     findPeakSample;
         int     decode_on_the_fly; /* decode on the fly? default=0                */
+        int     low_memory; /* see lame_set_low_memory */
+        int     stage_timing; /* see lame_set_stage_timing */
         int     analysis;
         int     disable_reservoir;
         int     buffer_constraint;  /* enforce ISO spec as much as possible   */
@@ -459,9 +532,33 @@ extern  "C" {
         FLOAT   minval;
     } SessionConfig_t;
 
+    /* Per-frame code reads the stream layout through these. A build with
+     * LAME_FIXED_MONO_CBR is specialized for mono CBR MPEG-1 output: the
+     * values become constants, so the compiler drops the stereo, VBR and
+     * LSF branches and unrolls the granule/channel loops.
+     * lame_init_params rejects any other configuration in that build.
+     */
+#ifdef LAME_FIXED_MONO_CBR
+#define CFG_CHANNELS_OUT(cfg) ((void)(cfg), 1)
+#define CFG_MODE_GR(cfg)      ((void)(cfg), 2)
+#define CFG_VBR(cfg)          ((void)(cfg), vbr_off)
+#define CFG_MODE(cfg)         ((void)(cfg), MONO)
+#else
+#define CFG_CHANNELS_OUT(cfg) ((cfg)->channels_out)
+#define CFG_MODE_GR(cfg)      ((cfg)->mode_gr)
+#define CFG_VBR(cfg)          ((cfg)->vbr)
+#define CFG_MODE(cfg)         ((cfg)->mode)
+#endif
+
+/* channels the psymodel keeps state for: the coded ones, and M and S
+ * besides L and R in joint stereo */
+#define CFG_CHANNELS_PSY(cfg) (CFG_MODE(cfg) == JOINT_STEREO ? 4 : CFG_CHANNELS_OUT(cfg))
+
 
     struct lame_internal_flags {
 
+        lame_arena_t arena; /* owns the memory this struct lives in */
+
   /********************************************************************
    * internal variables NOT set by calling program, and should not be *
    * modified by the calling program                                  *
@@ -497,6 +594,7 @@ extern  "C" {
         scalefac_struct scalefac_band;
 
         PsyStateVar_t sv_psy; /* DATA FROM PSYMODEL.C */
+        EncScratch_t *scratch; /* per-frame work areas, see above */
         PsyResult_t ov_psy;
         EncStateVar_t sv_enc; /* DATA FROM ENCODER.C */
         EncResult_t ov_enc;
@@ -505,6 +603,8 @@ extern  "C" {
         RpgStateVar_t sv_rpg;
         RpgResult_t ov_rpg;
 
+        EncStats_t sv_stats; /* DATA FROM ENCODER.C and QUANTIZE.C */
+
         /* optional ID3 tags, used in id3tag.c  */
         struct id3tag_spec tag_spec;
         uint16_t nMusicCRC;
@@ -541,6 +641,9 @@ extern  "C" {
         lame_report_function report_msg;
         lame_report_function report_dbg;
         lame_report_function report_err;
+
+        lame_stage_hook stage_hook;
+        void   *stage_hook_arg;
     };
 
 #ifndef lame_internal_flags_defined
@@ -554,6 +657,10 @@ extern  "C" {
 *  Global Function Prototype Declarations
 *
 ***********************************************************************/
+    lame_internal_flags *lame_arena_create(void);
+    void    lame_arena_reserve(lame_internal_flags * gfc, int input_chunk);
+    void   *lame_arena_alloc(lame_internal_flags * gfc, lame_mem_subsystem sub, size_t bytes);
+    void    lame_arena_free(lame_internal_flags * gfc, void *p);
     void    freegfc(lame_internal_flags * const gfc);
     void    free_id3tag(lame_internal_flags * const gfc);
     extern int BitrateIndex(int, int, int);
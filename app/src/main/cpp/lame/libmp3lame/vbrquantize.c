@@ -33,7 +33,7 @@
 #include "util.h"
 #include "vbrquantize.h"
 #include "quantize_pvt.h"
-#if defined(__aarch64__) || defined(__arm__)
+#if defined(LAME_NEON)
 #include <arm_neon.h>
 #if !defined(__aarch64__)
 #define vaddvq_f32(a) ({ \
@@ -239,10 +239,56 @@ k_34_4(DOUBLEX x[4], int l3[4])
 
 /*  do call the calc_sfb_noise_* functions only with sf values
  *  for which holds: sfpow34*xr34 <= IXMAX_VAL
+ *
+ *  the callers only want to know whether the noise exceeds l3_xmin,
+ *  so the summation stops as soon as the partial sum does. The
+ *  returned value is exact below the bound and a lower bound above it.
  */
 
+#if defined(LAME_NEON)
+/*  four coefficients per step. Each is quantized to the nearer of the
+ *  two steps around sfpow34*xr34 (the pow43 pair at the truncated value),
+ *  which is what k_34_4 works out in scalar code.
+ */
+static  FLOAT
+calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_t sf, FLOAT l3_xmin)
+{
+    const FLOAT sfpow = pow20[sf + Q_MAX2]; /*pow(2.0,sf/4.0); */
+    const FLOAT sfpow34 = ipow20[sf]; /*pow(sfpow,-3.0/4.0); */
+    float32x4_t const vsfpow = vdupq_n_f32(sfpow);
+    float32x4_t verr = vdupq_n_f32(0);
+    FLOAT   xfsf = 0;
+    unsigned int i;
+
+    for (i = 0; i + 4 <= bw; i += 4) {
+        float32x4_t const vxr = vabsq_f32(vld1q_f32(xr + i));
+        int32x4_t const vix = vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(xr34 + i), sfpow34));
+        float32x4_t const v0 = vcombine_f32(vld1_f32(pow43 + vgetq_lane_s32(vix, 0)),
+                                            vld1_f32(pow43 + vgetq_lane_s32(vix, 1)));
+        float32x4_t const v1 = vcombine_f32(vld1_f32(pow43 + vgetq_lane_s32(vix, 2)),
+                                            vld1_f32(pow43 + vgetq_lane_s32(vix, 3)));
+        float32x4_t const verr1 = vsubq_f32(vxr, vmulq_f32(vuzp1q_f32(v0, v1), vsfpow));
+        float32x4_t const verr2 = vsubq_f32(vmulq_f32(vuzp2q_f32(v0, v1), vsfpow), vxr);
+        float32x4_t const e = vminq_f32(verr1, verr2);
+        verr = vfmaq_f32(verr, e, e);
+        xfsf = vaddvq_f32(verr);
+        if (xfsf > l3_xmin) {
+            return xfsf;
+        }
+    }
+    for (; i < bw; ++i) {
+        FLOAT const a = fabsf(xr[i]);
+        int const ix = (int) (sfpow34 * xr34[i]);
+        FLOAT const e1 = a - sfpow * pow43[ix];
+        FLOAT const e2 = sfpow * pow43[ix + 1] - a;
+        FLOAT const e = e1 < e2 ? e1 : e2;
+        xfsf += e * e;
+    }
+    return xfsf;
+}
+#else
 static  FLOAT
-calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_t sf)
+calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_t sf, FLOAT l3_xmin)
 {
     DOUBLEX x[4];
     int     l3[4];
@@ -253,54 +299,6 @@ calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_
     unsigned int i = bw >> 2u;
     unsigned int const remaining = (bw & 0x03u);
 
-#if defined(__aarch64__) || defined(__arm__)
-    float32x4_t verr = vdupq_n_f32(0);
-    for (;i > 1; i -= 2) {
-        float32x4_t vxr34_1 = vmulq_n_f32(vld1q_f32(xr34), sfpow34);
-        float32x4_t vxr34_2 = vmulq_n_f32(vld1q_f32(xr34+4), sfpow34);
-        float32x4_t vxr_1 = vabsq_f32(vld1q_f32(xr));
-        float32x4_t vxr_2 = vabsq_f32(vld1q_f32(xr+4));
-        float32x4_t vxrn_1 = vnegq_f32(vxr_1);
-        float32x4_t vxrn_2 = vnegq_f32(vxr_2);
-        int32x4_t vix_1 = vcvtq_s32_f32(vxr34_1);
-        int32x4_t vix_2 = vcvtq_s32_f32(vxr34_2);
-        float32x4_t v0 = vcombine_f32(vld1_f32(pow43+vgetq_lane_s32(vix_1, 0)), vld1_f32(pow43+vgetq_lane_s32(vix_1, 1)));
-        float32x4_t v1 = vcombine_f32(vld1_f32(pow43+vgetq_lane_s32(vix_1, 2)), vld1_f32(pow43+vgetq_lane_s32(vix_1, 3)));
-        float32x4_t v2 = vcombine_f32(vld1_f32(pow43+vgetq_lane_s32(vix_2, 0)), vld1_f32(pow43+vgetq_lane_s32(vix_2, 1)));
-        float32x4_t v3 = vcombine_f32(vld1_f32(pow43+vgetq_lane_s32(vix_2, 2)), vld1_f32(pow43+vgetq_lane_s32(vix_2, 3)));
-        float32x4_t v4 = vuzp1q_f32(v0, v1);
-        float32x4_t v5 = vuzp2q_f32(v0, v1);
-        float32x4_t v6 = vuzp1q_f32(v2, v3);
-        float32x4_t v7 = vuzp2q_f32(v2, v3);
-        float32x4_t verr1_1 = vfmsq_n_f32(vxr_1, v4, sfpow);
-        float32x4_t verr2_1 = vfmaq_n_f32(vxrn_1, v5, sfpow);
-        float32x4_t verr1_2 = vfmsq_n_f32(vxr_2, v6, sfpow);
-        float32x4_t verr2_2 = vfmaq_n_f32(vxrn_2, v7, sfpow);
-        verr1_1 = vminq_f32(verr1_1, verr2_1);
-        verr1_2 = vminq_f32(verr1_2, verr2_2);
-        verr = vfmaq_f32(verr, verr1_1, verr1_1);
-        verr = vfmaq_f32(verr, verr1_2, verr1_2);
-        xr += 8;
-        xr34 += 8;
-    }
-    while (i-- > 0) {
-        float32x4_t vxr34 = vmulq_n_f32(vld1q_f32(xr34), sfpow34);
-        float32x4_t vxr = vabsq_f32(vld1q_f32(xr));
-        float32x4_t vxrn = vnegq_f32(vxr);
-        int32x4_t vix = vcvtq_s32_f32(vxr34);
-        float32x4_t v0 = vcombine_f32(vld1_f32(pow43+vgetq_lane_s32(vix, 0)), vld1_f32(pow43+vgetq_lane_s32(vix, 1)));
-        float32x4_t v1 = vcombine_f32(vld1_f32(pow43+vgetq_lane_s32(vix, 2)), vld1_f32(pow43+vgetq_lane_s32(vix, 3)));
-        float32x4_t v2 = vuzp1q_f32(v0, v1);
-        float32x4_t v3 = vuzp2q_f32(v0, v1);
-        float32x4_t verr1 = vfmsq_n_f32(vxr, v2, sfpow);
-        float32x4_t verr2 = vfmaq_n_f32(vxrn, v3, sfpow);
-        verr1 = vminq_f32(verr1, verr2);
-        verr = vfmaq_f32(verr, verr1, verr1);
-        xr += 4;
-        xr34 += 4;
-    }
-    xfsf += vaddvq_f32(verr);
-#else
     while (i-- > 0) {
         x[0] = sfpow34 * xr34[0];
         x[1] = sfpow34 * xr34[1];
@@ -314,11 +312,13 @@ calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_
         x[2] = fabsf(xr[2]) - sfpow * pow43[l3[2]];
         x[3] = fabsf(xr[3]) - sfpow * pow43[l3[3]];
         xfsf += (x[0] * x[0] + x[1] * x[1]) + (x[2] * x[2] + x[3] * x[3]);
+        if (xfsf > l3_xmin) {
+            return xfsf;
+        }
 
         xr += 4;
         xr34 += 4;
     }
-#endif
     if (remaining) {
         x[0] = x[1] = x[2] = x[3] = 0;
         switch( remaining ) {
@@ -339,6 +339,7 @@ calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_
     }
     return xfsf;
 }
+#endif
 
 
 
@@ -356,7 +357,7 @@ tri_calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, FLOAT l3_xmin, unsi
 {
     if (did_it[sf].valid == 0) {
         did_it[sf].valid = 1;
-        did_it[sf].value = calc_sfb_noise_x34(xr, xr34, bw, sf);
+        did_it[sf].value = calc_sfb_noise_x34(xr, xr34, bw, sf, l3_xmin);
     }
     if (l3_xmin < did_it[sf].value) {
         return 1;
@@ -365,7 +366,7 @@ tri_calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, FLOAT l3_xmin, unsi
         uint8_t const sf_x = sf + 1;
         if (did_it[sf_x].valid == 0) {
             did_it[sf_x].valid = 1;
-            did_it[sf_x].value = calc_sfb_noise_x34(xr, xr34, bw, sf_x);
+            did_it[sf_x].value = calc_sfb_noise_x34(xr, xr34, bw, sf_x, l3_xmin);
         }
         if (l3_xmin < did_it[sf_x].value) {
             return 1;
@@ -375,7 +376,7 @@ tri_calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, FLOAT l3_xmin, unsi
         uint8_t const sf_x = sf - 1;
         if (did_it[sf_x].valid == 0) {
             did_it[sf_x].valid = 1;
-            did_it[sf_x].value = calc_sfb_noise_x34(xr, xr34, bw, sf_x);
+            did_it[sf_x].value = calc_sfb_noise_x34(xr, xr34, bw, sf_x, l3_xmin);
         }
         if (l3_xmin < did_it[sf_x].value) {
             return 1;
@@ -934,7 +935,7 @@ long_block_constrain(const algo_t * that, const int vbrsf[SFBMAX], const int vbr
     int     v, v0, v1, v0p, v1p, vm0p = 1, vm1p = 1;
     int const psymax = cod_info->psymax;
 
-    max_rangep = cfg->mode_gr == 2 ? max_range_long : max_range_long_lsf_pretab;
+    max_rangep = CFG_MODE_GR(cfg) == 2 ? max_range_long : max_range_long_lsf_pretab;
 
     maxover0 = 0;
     maxover1 = 0;
@@ -1335,8 +1336,8 @@ VBR_encode_frame(lame_internal_flags * gfc, const FLOAT xr34orig[2][2][576],
     int     sfwork_[2][2][SFBMAX];
     int     vbrsfmin_[2][2][SFBMAX];
     algo_t  that_[2][2];
-    int const ngr = cfg->mode_gr;
-    int const nch = cfg->channels_out;
+    int const ngr = CFG_MODE_GR(cfg);
+    int const nch = CFG_CHANNELS_OUT(cfg);
     int     max_nbits_ch[2][2] = {{0, 0}, {0 ,0}};
     int     max_nbits_gr[2] = {0, 0};
     int     max_nbits_fr = 0;
@@ -0,0 +1,283 @@
+/*
+ *	Vectorized log/exp approximations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "lame.h"
+#include "machine.h"
+#include "vecmath.h"
+
+#if !defined(LAME_LIBM_MATH)
+#if defined(LAME_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__) && !defined(LAME_NO_SIMD)
+#include <emmintrin.h>
+#endif
+#endif
+
+
+#if !defined(LAME_LIBM_MATH)
+
+/*  log2(x) = e + log2(m) with m in [sqrt(1/2), sqrt(2)).
+ *  log2(m) = 2/ln(2) * atanh(t), t = (m-1)/(m+1), |t| <= 0.1716,
+ *  the odd series up to t^9 is good to 1e-9 before rounding.
+ *
+ *  2^x = 2^n * 2^g with n = floor(x+1/2) and g in [-1/2, 1/2),
+ *  2^g is the Taylor series of exp(g*ln(2)) up to g^7, good to
+ *  6e-9 before rounding.
+ */
+#define SQRT_HALF_BITS 0x3f3504f3
+
+#define LOG2_C1 2.8853900817779268f /* 2/ln(2) */
+#define LOG2_C3 0.9617966939259756f /* 2/(3 ln(2)) */
+#define LOG2_C5 0.5770780163555854f /* 2/(5 ln(2)) */
+#define LOG2_C7 0.4121985831111324f /* 2/(7 ln(2)) */
+#define LOG2_C9 0.3205988979753252f /* 2/(9 ln(2)) */
+
+#define EXP2_C1 0.6931471805599453f /* ln(2)^k / k! */
+#define EXP2_C2 0.2402265069591007f
+#define EXP2_C3 0.0555041086648216f
+#define EXP2_C4 0.0096181291076285f
+#define EXP2_C5 0.0013333558146428f
+#define EXP2_C6 0.0001540353039338f
+#define EXP2_C7 0.0000152527338041f
+
+#define EXP2_MIN -126.f
+#define EXP2_MAX 126.f
+
+#define LOG10_2 0.30102999566398120f
+#define LOG2_10 3.32192809488736235f
+
+
+#if defined(LAME_NEON)
+
+static inline float32x4_t
+vlog2q_f32(float32x4_t x)
+{
+    int32x4_t const bits = vreinterpretq_s32_f32(x);
+    int32x4_t const e = vshrq_n_s32(vsubq_s32(bits, vdupq_n_s32(SQRT_HALF_BITS)), 23);
+    float32x4_t const m = vreinterpretq_f32_s32(vsubq_s32(bits, vshlq_n_s32(e, 23)));
+    float32x4_t const num = vsubq_f32(m, vdupq_n_f32(1.f));
+    float32x4_t const den = vaddq_f32(m, vdupq_n_f32(1.f));
+#if defined(__aarch64__)
+    float32x4_t const t = vdivq_f32(num, den);
+#else
+    float32x4_t r = vrecpeq_f32(den);
+    r = vmulq_f32(r, vrecpsq_f32(den, r));
+    r = vmulq_f32(r, vrecpsq_f32(den, r));
+    float32x4_t const t = vmulq_f32(num, r);
+#endif
+    float32x4_t const t2 = vmulq_f32(t, t);
+    float32x4_t p = vdupq_n_f32(LOG2_C9);
+    p = vaddq_f32(vdupq_n_f32(LOG2_C7), vmulq_f32(p, t2));
+    p = vaddq_f32(vdupq_n_f32(LOG2_C5), vmulq_f32(p, t2));
+    p = vaddq_f32(vdupq_n_f32(LOG2_C3), vmulq_f32(p, t2));
+    p = vaddq_f32(vdupq_n_f32(LOG2_C1), vmulq_f32(p, t2));
+    return vaddq_f32(vcvtq_f32_s32(e), vmulq_f32(p, t));
+}
+
+static inline float32x4_t
+vexp2q_f32(float32x4_t x)
+{
+    /* truncating x+127.5 gives n+127, the biased exponent of 2^n */
+    float32x4_t const xc = vminq_f32(vmaxq_f32(x, vdupq_n_f32(EXP2_MIN)), vdupq_n_f32(EXP2_MAX));
+    int32x4_t const n = vcvtq_s32_f32(vaddq_f32(xc, vdupq_n_f32(127.5f)));
+    float32x4_t const g = vsubq_f32(xc, vcvtq_f32_s32(vsubq_s32(n, vdupq_n_s32(127))));
+    float32x4_t p = vdupq_n_f32(EXP2_C7);
+    p = vaddq_f32(vdupq_n_f32(EXP2_C6), vmulq_f32(p, g));
+    p = vaddq_f32(vdupq_n_f32(EXP2_C5), vmulq_f32(p, g));
+    p = vaddq_f32(vdupq_n_f32(EXP2_C4), vmulq_f32(p, g));
+    p = vaddq_f32(vdupq_n_f32(EXP2_C3), vmulq_f32(p, g));
+    p = vaddq_f32(vdupq_n_f32(EXP2_C2), vmulq_f32(p, g));
+    p = vaddq_f32(vdupq_n_f32(EXP2_C1), vmulq_f32(p, g));
+    p = vaddq_f32(vdupq_n_f32(1.f), vmulq_f32(p, g));
+    return vmulq_f32(p, vreinterpretq_f32_s32(vshlq_n_s32(n, 23)));
+}
+
+static inline void
+log10_4(float *dst, float const *src)
+{
+    vst1q_f32(dst, vmulq_n_f32(vlog2q_f32(vld1q_f32(src)), LOG10_2));
+}
+
+static inline void
+pow10_4(float *dst, float const *src)
+{
+    vst1q_f32(dst, vexp2q_f32(vmulq_n_f32(vld1q_f32(src), LOG2_10)));
+}
+
+#elif defined(__SSE2__) && !defined(LAME_NO_SIMD)
+
+static inline __m128
+log2_ps(__m128 x)
+{
+    __m128i const bits = _mm_castps_si128(x);
+    __m128i const e = _mm_srai_epi32(_mm_sub_epi32(bits, _mm_set1_epi32(SQRT_HALF_BITS)), 23);
+    __m128 const m = _mm_castsi128_ps(_mm_sub_epi32(bits, _mm_slli_epi32(e, 23)));
+    __m128 const t = _mm_div_ps(_mm_sub_ps(m, _mm_set1_ps(1.f)), _mm_add_ps(m, _mm_set1_ps(1.f)));
+    __m128 const t2 = _mm_mul_ps(t, t);
+    __m128  p = _mm_set1_ps(LOG2_C9);
+    p = _mm_add_ps(_mm_set1_ps(LOG2_C7), _mm_mul_ps(p, t2));
+    p = _mm_add_ps(_mm_set1_ps(LOG2_C5), _mm_mul_ps(p, t2));
+    p = _mm_add_ps(_mm_set1_ps(LOG2_C3), _mm_mul_ps(p, t2));
+    p = _mm_add_ps(_mm_set1_ps(LOG2_C1), _mm_mul_ps(p, t2));
+    return _mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(p, t));
+}
+
+static inline __m128
+exp2_ps(__m128 x)
+{
+    /* truncating x+127.5 gives n+127, the biased exponent of 2^n */
+    __m128 const xc = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(EXP2_MIN)), _mm_set1_ps(EXP2_MAX));
+    __m128i const n = _mm_cvttps_epi32(_mm_add_ps(xc, _mm_set1_ps(127.5f)));
+    __m128 const g = _mm_sub_ps(xc, _mm_cvtepi32_ps(_mm_sub_epi32(n, _mm_set1_epi32(127))));
+    __m128  p = _mm_set1_ps(EXP2_C7);
+    p = _mm_add_ps(_mm_set1_ps(EXP2_C6), _mm_mul_ps(p, g));
+    p = _mm_add_ps(_mm_set1_ps(EXP2_C5), _mm_mul_ps(p, g));
+    p = _mm_add_ps(_mm_set1_ps(EXP2_C4), _mm_mul_ps(p, g));
+    p = _mm_add_ps(_mm_set1_ps(EXP2_C3), _mm_mul_ps(p, g));
+    p = _mm_add_ps(_mm_set1_ps(EXP2_C2), _mm_mul_ps(p, g));
+    p = _mm_add_ps(_mm_set1_ps(EXP2_C1), _mm_mul_ps(p, g));
+    p = _mm_add_ps(_mm_set1_ps(1.f), _mm_mul_ps(p, g));
+    return _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(n, 23)));
+}
+
+static inline void
+log10_4(float *dst, float const *src)
+{
+    _mm_storeu_ps(dst, _mm_mul_ps(log2_ps(_mm_loadu_ps(src)), _mm_set1_ps(LOG10_2)));
+}
+
+static inline void
+pow10_4(float *dst, float const *src)
+{
+    _mm_storeu_ps(dst, exp2_ps(_mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(LOG2_10))));
+}
+
+#else
+
+typedef union {
+    float   f;
+    int32_t i;
+} vm_fi_union;
+
+static inline void
+log10_4(float *dst, float const *src)
+{
+    int     k;
+    for (k = 0; k < 4; ++k) {
+        vm_fi_union fi;
+        int32_t e;
+        float   t, t2, p;
+        fi.f = src[k];
+        e = (fi.i - SQRT_HALF_BITS) >> 23;
+        fi.i -= e * (1 << 23);
+        t = (fi.f - 1.f) / (fi.f + 1.f);
+        t2 = t * t;
+        p = LOG2_C9;
+        p = LOG2_C7 + p * t2;
+        p = LOG2_C5 + p * t2;
+        p = LOG2_C3 + p * t2;
+        p = LOG2_C1 + p * t2;
+        dst[k] = ((float) e + p * t) * LOG10_2;
+    }
+}
+
+static inline void
+pow10_4(float *dst, float const *src)
+{
+    int     k;
+    for (k = 0; k < 4; ++k) {
+        vm_fi_union fi;
+        float   x = src[k] * LOG2_10, g, p;
+        int32_t n;
+        x = x < EXP2_MIN ? EXP2_MIN : (x > EXP2_MAX ? EXP2_MAX : x);
+        n = (int32_t) (x + 127.5f);
+        g = x - (float) (n - 127);
+        p = EXP2_C7;
+        p = EXP2_C6 + p * g;
+        p = EXP2_C5 + p * g;
+        p = EXP2_C4 + p * g;
+        p = EXP2_C3 + p * g;
+        p = EXP2_C2 + p * g;
+        p = EXP2_C1 + p * g;
+        p = 1.f + p * g;
+        fi.i = n << 23;
+        dst[k] = p * fi.f;
+    }
+}
+
+#endif
+
+
+/* remaining elements go through a padded copy */
+#define VEC_APPLY_4(f, dst, src, n) do {                        \
+        int     i_;                                             \
+        for (i_ = 0; i_ + 4 <= (n); i_ += 4) {                  \
+            f((dst) + i_, (src) + i_);                          \
+        }                                                       \
+        if (i_ < (n)) {                                         \
+            float   tmp_[4] = { 1.f, 1.f, 1.f, 1.f };           \
+            int     k_;                                         \
+            for (k_ = 0; i_ + k_ < (n); ++k_) {                 \
+                tmp_[k_] = (src)[i_ + k_];                      \
+            }                                                   \
+            f(tmp_, tmp_);                                      \
+            for (k_ = 0; i_ + k_ < (n); ++k_) {                 \
+                (dst)[i_ + k_] = tmp_[k_];                      \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+
+void
+vec_log10(FLOAT * dst, FLOAT const *src, int n)
+{
+    VEC_APPLY_4(log10_4, dst, src, n);
+}
+
+void
+vec_pow10(FLOAT * dst, FLOAT const *src, int n)
+{
+    VEC_APPLY_4(pow10_4, dst, src, n);
+}
+
+#else /* LAME_LIBM_MATH */
+
+void
+vec_log10(FLOAT * dst, FLOAT const *src, int n)
+{
+    int     i;
+    for (i = 0; i < n; ++i) {
+        dst[i] = log10(src[i]);
+    }
+}
+
+void
+vec_pow10(FLOAT * dst, FLOAT const *src, int n)
+{
+    int     i;
+    for (i = 0; i < n; ++i) {
+        dst[i] = powf(10.f, src[i]);
+    }
+}
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ *	Vectorized log/exp approximations include file
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_VECMATH_H
+#define LAME_VECMATH_H
+
+/*  The functions below work on whole arrays, four lanes at a time
+ *  (NEON on ARM, SSE2 on x86, plain C otherwise). dst may equal src.
+ *
+ *  vec_log10:  src must be positive and normal,
+ *              error below 2e-7 * max(1, |dst|)
+ *  vec_pow10:  relative error below 2.5e-7 * max(1, |src|),
+ *              src is clamped to [-37.9, 37.9]
+ *
+ *  Define LAME_LIBM_MATH to route everything through libm,
+ *  for reference runs; LAME_NO_SIMD keeps the approximations
+ *  but computes the lanes in plain C.
+ */
+
+void    vec_log10(FLOAT * dst, FLOAT const *src, int n);
+void    vec_pow10(FLOAT * dst, FLOAT const *src, int n);
+
+#endif
+
+/* End of vecmath.h */
@@ -65,8 +65,8 @@ init_xrpow_core_sse(gr_info * const cod_info, FLOAT xrpow[576], int upper, FLOAT
     int     i;
     float   tmp_max = 0;
     float   tmp_sum = 0;
-    int     upper4 = (upper / 4) * 4;
-    int     rest = upper-upper4;
+    int     upper4 = ((upper + 1) / 4) * 4; /* like the C code, xr[0..upper] */
+    int     rest = upper + 1 - upper4;
 
     const vecfloat_union fabs_mask = {{ 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF }};
     const __m128 vec_fabs_mask = _mm_loadu_ps(&fabs_mask._float[0]);
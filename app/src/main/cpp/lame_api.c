@@ -0,0 +1,7 @@
+#include "lame_api.h"
+
+__attribute__((visibility("default")))
+const lame_api *lame_mono_api(void) {
+    static const lame_api api = LAME_API_INIT;
+    return &api;
+}
@@ -0,0 +1,67 @@
+#ifndef LAME_API_H
+#define LAME_API_H
+
+#include "lame.h"
+
+/*
+ * The lame_* entry points used by lamejni, as a table.
+ *
+ * lamejni links the generic libmp3lame directly. liblamemono is the same
+ * libmp3lame source built with LAME_FIXED_MONO_CBR and hidden visibility;
+ * it exports nothing but lame_mono_api(), so both encoders can live in
+ * one process without their symbols clashing.
+ */
+typedef struct {
+    lame_t (*init)(void);
+    int (*set_num_channels)(lame_t, int);
+    int (*set_num_samples)(lame_t, unsigned long);
+    int (*set_in_samplerate)(lame_t, int);
+    int (*set_out_samplerate)(lame_t, int);
+    int (*set_brate)(lame_t, int);
+    int (*set_quality)(lame_t, int);
+    int (*set_mode)(lame_t, MPEG_mode);
+    int (*set_VBR)(lame_t, vbr_mode);
+    int (*init_params)(lame_t);
+    int (*encode_buffer)(lame_t, const short int[], const short int[], const int,
+                         unsigned char *, const int);
+    int (*encode_buffer_ieee_float)(lame_t, const float[], const float[], const int,
+                                    unsigned char *, const int);
+    int (*encode_flush)(lame_t, unsigned char *, int);
+    size_t (*get_lametag_frame)(const lame_global_flags *, unsigned char *, size_t);
+    int (*close)(lame_t);
+    int (*set_stage_timing)(lame_t, int);
+    int (*get_encoder_stats)(const lame_global_flags *, lame_encoder_stats *);
+    int (*set_stage_hook)(lame_t, lame_stage_hook, void *);
+    unsigned long (*get_cbr_stream_size)(const lame_global_flags *);
+    int (*set_input_chunk)(lame_t, int);
+    int (*get_memory_stats)(const lame_global_flags *, lame_memory_stats *);
+} lame_api;
+
+#define LAME_API_INIT { \
+    lame_init, \
+    lame_set_num_channels, \
+    lame_set_num_samples, \
+    lame_set_in_samplerate, \
+    lame_set_out_samplerate, \
+    lame_set_brate, \
+    lame_set_quality, \
+    lame_set_mode, \
+    lame_set_VBR, \
+    lame_init_params, \
+    lame_encode_buffer, \
+    lame_encode_buffer_ieee_float, \
+    lame_encode_flush, \
+    lame_get_lametag_frame, \
+    lame_close, \
+    lame_set_stage_timing, \
+    lame_get_encoder_stats, \
+    lame_set_stage_hook, \
+    lame_get_cbr_stream_size, \
+    lame_set_input_chunk, \
+    lame_get_memory_stats \
+}
+
+/* Encoder specialized for mono CBR MPEG-1 output (32, 44.1 and 48 kHz). */
+const lame_api *lame_mono_api(void);
+
+#endif
@@ -0,0 +1,207 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#if defined(__ANDROID__)
+#include <android/trace.h>
+#endif
+
+#include "lame_trace.h"
+
+#define TRACE_EVENTS 32768      /* per ring, a power of two */
+#define TRACE_RINGS 16          /* at most, ~768 KB each */
+
+typedef struct {
+    uint64_t ts_ns;
+    const char *name;
+    int tid;                    /* a ring outlives its thread */
+    char phase;                 /* 'B' or 'E' */
+} trace_event;
+
+/* Written by the thread that owns it only; head counts the events ever
+ * written and is published with release order, so a dump sees complete
+ * events. When the thread exits the ring is marked free and the next new
+ * thread takes it over, the old events stay until they are overwritten. */
+typedef struct trace_ring {
+    struct trace_ring *next;
+    int free;
+    unsigned head;
+    trace_event event[TRACE_EVENTS];
+} trace_ring;
+
+static int enabled;
+static trace_ring *rings;       /* never unlinked, newest first */
+static int ring_count;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;  /* frees the ring at thread exit */
+static __thread trace_ring *ring;
+static __thread int tid;
+static __thread int depth;      /* open sections, ends without a begin are dropped */
+
+static const char *const stage_names[LAME_STAGES] = {
+    "lame.psymodel",
+    "lame.adjust_ATH",
+    "lame.mdct",
+    "lame.ms",
+    "lame.iteration",
+    "lame.bitstream",
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static long thread_id(void) {
+#if defined(__linux__)
+    return (long)syscall(SYS_gettid);
+#else
+    return 0;
+#endif
+}
+
+static void release_ring(void *r) {
+    __atomic_store_n(&((trace_ring *)r)->free, 1, __ATOMIC_RELEASE);
+}
+
+static void create_ring_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+static trace_ring *claim_ring(void) {
+    for (trace_ring *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        int expected = 1;
+        if (__atomic_compare_exchange_n(&r->free, &expected, 0, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return r;
+        }
+    }
+    if (__atomic_fetch_add(&ring_count, 1, __ATOMIC_RELAXED) >= TRACE_RINGS) {
+        __atomic_fetch_sub(&ring_count, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    trace_ring *r = (trace_ring *)calloc(1, sizeof(*r));
+    if (r == NULL) {
+        __atomic_fetch_sub(&ring_count, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    r->next = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+    }
+    return r;
+}
+
+/* NULL once TRACE_RINGS threads are tracing at the same time; the others
+ * only get their ATrace sections. */
+static trace_ring *thread_ring(void) {
+    if (ring == NULL) {
+        pthread_once(&ring_key_once, create_ring_key);
+        ring = claim_ring();
+        if (ring == NULL) {
+            return NULL;
+        }
+        pthread_setspecific(ring_key, ring);
+        tid = (int)thread_id();
+    }
+    return ring;
+}
+
+static void record(const char *name, char phase) {
+    trace_ring *const r = thread_ring();
+    if (r != NULL) {
+        unsigned const head = r->head;
+        trace_event *const e = &r->event[head & (TRACE_EVENTS - 1)];
+        e->ts_ns = now_ns();
+        e->name = name;
+        e->tid = tid;
+        e->phase = phase;
+        __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    }
+}
+
+void lame_trace_enable(int enable) {
+    __atomic_store_n(&enabled, enable != 0, __ATOMIC_RELAXED);
+}
+
+int lame_trace_enabled(void) {
+    return __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+}
+
+void lame_trace_begin(const char *name) {
+    if (!lame_trace_enabled()) {
+        return;
+    }
+    ++depth;
+    record(name, 'B');
+#if defined(__ANDROID__)
+    ATrace_beginSection(name);
+#endif
+}
+
+void lame_trace_end(const char *name) {
+    if (depth == 0) {
+        return;
+    }
+    --depth;
+    record(name, 'E');
+#if defined(__ANDROID__)
+    ATrace_endSection();
+#endif
+}
+
+void lame_trace_stage_hook(void *arg, lame_stage stage, int begin) {
+    (void)arg;
+    if (stage < 0 || stage >= LAME_STAGES) {
+        return;
+    }
+    if (begin) {
+        lame_trace_begin(stage_names[stage]);
+    } else {
+        lame_trace_end(stage_names[stage]);
+    }
+}
+
+const char *lame_trace_scope_begin(const char *name) {
+    if (!lame_trace_enabled()) {
+        return NULL;
+    }
+    lame_trace_begin(name);
+    return name;
+}
+
+void lame_trace_scope_end(const char **name) {
+    if (*name != NULL) {
+        lame_trace_end(*name);
+    }
+}
+
+int lame_trace_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    long const pid = (long)getpid();
+    int first = 1;
+
+    if (f == NULL) {
+        return -1;
+    }
+    fputs("{\"traceEvents\": [\n", f);
+    for (trace_ring *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        unsigned const head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        unsigned const start = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+
+        for (unsigned i = start; i != head; ++i) {
+            trace_event const *const e = &r->event[i & (TRACE_EVENTS - 1)];
+            fprintf(f, "%s{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": %ld, \"tid\": %d}",
+                    first ? "" : ",\n", e->name, e->phase, e->ts_ns / 1e3, pid, e->tid);
+            first = 0;
+        }
+    }
+    fputs("\n], \"displayTimeUnit\": \"ms\"}\n", f);
+    return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,39 @@
+#ifndef LAME_TRACE_H
+#define LAME_TRACE_H
+
+#include "lame.h"
+
+/*
+ * Opt-in tracing of the encoder stages and the JNI calls.
+ *
+ * While enabled, every begin/end goes into a ring buffer of the calling
+ * thread (lock-free, the oldest events are overwritten; at most 16 rings,
+ * a thread that exits leaves its ring to the next one), and on Android
+ * also into an ATrace section, so it shows up in Perfetto next to the
+ * MediaCodec threads. lame_trace_dump writes the rings as Chrome trace
+ * JSON (chrome://tracing, ui.perfetto.dev).
+ *
+ * Names must be string literals or otherwise outlive the dump.
+ */
+void lame_trace_enable(int enable);
+int lame_trace_enabled(void);
+
+void lame_trace_begin(const char *name);
+void lame_trace_end(const char *name);
+
+/* For lame_set_stage_hook; arg is unused. */
+void lame_trace_stage_hook(void *arg, lame_stage stage, int begin);
+
+/* Writes all rings to path; 0 on success. Call it while no thread is
+ * tracing, or take a torn event or two at the ring boundaries. */
+int lame_trace_dump(const char *path);
+
+/* Traces the rest of the enclosing block. */
+#define LAME_TRACE_SCOPE(name) \
+    const char *lame_trace_scope_ __attribute__((cleanup(lame_trace_scope_end), unused)) = \
+        lame_trace_scope_begin(name)
+
+const char *lame_trace_scope_begin(const char *name);
+void lame_trace_scope_end(const char **name);
+
+#endif
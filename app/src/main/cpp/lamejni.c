@@ -1,10 +1,21 @@
 #include <jni.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 
-#include "lame.h"
+#include "lame_api.h"
+#include "lame_trace.h"
+#include "mp3_stream.h"
+#include "id3_reader.h"
+#include "id3_writer.h"
+#include "metadata_index.h"
+#include "file_copy.h"
+#include "async_writer.h"
 
 typedef struct {
+    const lame_api *api;
     lame_t gfp;
     unsigned char *mp3buf;
     int mp3buf_size;
@@ -12,8 +23,15 @@ typedef struct {
     int mono_buf_size;
     float *mono_float_buf;
     int mono_float_buf_size;
+    int flushed;
 } lame_jni_handle;
 
+static const lame_api lame_generic_api = LAME_API_INIT;
+
+/* samples per channel handed to the encoder at a time, 32 frames; the
+ * encoder sets its input buffers aside for that (set_input_chunk) */
+#define CHUNK_SAMPLES (1152 * 32)
+
 static jfieldID get_handle_field(JNIEnv *env, jobject thiz) {
     static jfieldID handle_field = NULL;
     if (handle_field == NULL) {
@@ -41,14 +59,57 @@ static void set_handle(JNIEnv *env, jobject thiz, lame_jni_handle *handle) {
     (*env)->SetLongField(env, thiz, handle_field, (jlong)(intptr_t)handle);
 }
 
+/* num_samples per channel, -1 if unknown */
+static lame_t open_encoder(const lame_api *api, int channels, int sample_rate,
+                           int bit_rate, int quality, jlong num_samples) {
+    lame_t gfp = api->init();
+    if (gfp == NULL) {
+        return NULL;
+    }
+
+    api->set_num_channels(gfp, channels);
+    if (num_samples >= 0) {
+        api->set_num_samples(gfp, (unsigned long)num_samples);
+    }
+    api->set_in_samplerate(gfp, sample_rate);
+    api->set_out_samplerate(gfp, sample_rate);
+    api->set_brate(gfp, bit_rate);
+    api->set_quality(gfp, quality);
+    api->set_mode(gfp, channels == 1 ? MONO : STEREO);
+    api->set_VBR(gfp, vbr_off);
+    api->set_input_chunk(gfp, CHUNK_SAMPLES);
+    /* stage times for Lame.getStats() and the trace hook: a few clock
+     * reads and calls per frame, paid only while tracing is on */
+    if (lame_trace_enabled()) {
+        api->set_stage_timing(gfp, 1);
+        api->set_stage_hook(gfp, lame_trace_stage_hook, NULL);
+    }
+
+    if (api->init_params(gfp) < 0) {
+        api->close(gfp);
+        return NULL;
+    }
+    return gfp;
+}
+
+/* mono CBR at MPEG-1 rates is what the converter always asks for;
+ * it gets the specialized build, anything else the generic one */
+static const lame_api *choose_api(int channels, int sample_rate) {
+    if (channels == 1 && (sample_rate == 32000 || sample_rate == 44100 || sample_rate == 48000)) {
+        return lame_mono_api();
+    }
+    return &lame_generic_api;
+}
+
 JNIEXPORT void JNICALL
 Java_com_github_axet_lamejni_Lame_open(JNIEnv *env, jobject thiz, jint channels,
                                       jint sample_rate, jint bit_rate,
                                       jint quality) {
+    LAME_TRACE_SCOPE("Lame.open");
     lame_jni_handle *existing = get_handle(env, thiz);
     if (existing != NULL) {
         if (existing->gfp != NULL) {
-            lame_close(existing->gfp);
+            existing->api->close(existing->gfp);
         }
         free(existing->mp3buf);
         free(existing->mono_buf);
@@ -57,29 +118,22 @@ Java_com_github_axet_lamejni_Lame_open(JNIEnv *env, jobject thiz, jint channels,
         set_handle(env, thiz, NULL);
     }
 
-    lame_t gfp = lame_init();
-    if (gfp == NULL) {
-        return;
+    const lame_api *api = choose_api(channels, sample_rate);
+    lame_t gfp = open_encoder(api, channels, sample_rate, bit_rate, quality, -1);
+    if (gfp == NULL && api != &lame_generic_api) {
+        api = &lame_generic_api;
+        gfp = open_encoder(api, channels, sample_rate, bit_rate, quality, -1);
     }
-
-    lame_set_num_channels(gfp, channels);
-    lame_set_in_samplerate(gfp, sample_rate);
-    lame_set_out_samplerate(gfp, sample_rate);
-    lame_set_brate(gfp, bit_rate);
-    lame_set_quality(gfp, quality);
-    lame_set_mode(gfp, channels == 1 ? MONO : STEREO);
-    lame_set_VBR(gfp, vbr_off);
-
-    if (lame_init_params(gfp) < 0) {
-        lame_close(gfp);
+    if (gfp == NULL) {
         return;
     }
 
     lame_jni_handle *handle = (lame_jni_handle *)calloc(1, sizeof(*handle));
     if (handle == NULL) {
-        lame_close(gfp);
+        api->close(gfp);
         return;
     }
+    handle->api = api;
     handle->gfp = gfp;
     set_handle(env, thiz, handle);
 }
@@ -123,10 +177,49 @@ static int ensure_mono_float_capacity(lame_jni_handle *handle, int frames) {
     return 1;
 }
 
+/*
+ * encode_buffer in calls of at most CHUNK_SAMPLES, so the encoder's
+ * input buffers stay in its arena; the MP3 data is appended to
+ * handle->mp3buf. Bytes written, or LAME's error code.
+ */
+static int encode_chunked(lame_jni_handle *handle, const short *pcm, int samples, int mp3buf_size) {
+    int total = 0;
+
+    for (int done = 0; done < samples;) {
+        int const n = samples - done < CHUNK_SAMPLES ? samples - done : CHUNK_SAMPLES;
+        int const encoded = handle->api->encode_buffer(handle->gfp, pcm + done, NULL, n,
+                                                       handle->mp3buf + total, mp3buf_size - total);
+        if (encoded < 0) {
+            return encoded;
+        }
+        total += encoded;
+        done += n;
+    }
+    return total;
+}
+
+static int encode_float_chunked(lame_jni_handle *handle, const float *pcm, int samples, int mp3buf_size) {
+    int total = 0;
+
+    for (int done = 0; done < samples;) {
+        int const n = samples - done < CHUNK_SAMPLES ? samples - done : CHUNK_SAMPLES;
+        int const encoded = handle->api->encode_buffer_ieee_float(handle->gfp, pcm + done, NULL, n,
+                                                                  handle->mp3buf + total,
+                                                                  mp3buf_size - total);
+        if (encoded < 0) {
+            return encoded;
+        }
+        total += encoded;
+        done += n;
+    }
+    return total;
+}
+
 JNIEXPORT jbyteArray JNICALL
 Java_com_github_axet_lamejni_Lame_encode(JNIEnv *env, jobject thiz,
                                         jshortArray pcm, jint offset,
                                         jint length) {
+    LAME_TRACE_SCOPE("Lame.encode");
     if (pcm == NULL || length <= 0) {
         return NULL;
     }
@@ -153,7 +246,7 @@ Java_com_github_axet_lamejni_Lame_encode(JNIEnv *env, jobject thiz,
         return NULL;
     }
 
-    int encoded = lame_encode_buffer(handle->gfp, pcm_ptr, NULL, length, handle->mp3buf, mp3buf_size);
+    int encoded = encode_chunked(handle, pcm_ptr, length, mp3buf_size);
 
     (*env)->ReleaseShortArrayElements(env, pcm, input, JNI_ABORT);
 
@@ -172,6 +265,7 @@ JNIEXPORT jbyteArray JNICALL
 Java_com_github_axet_lamejni_Lame_encodeInterleavedMono(JNIEnv *env, jobject thiz,
                                                         jshortArray pcm, jint offset,
                                                         jint length, jint channels) {
+    LAME_TRACE_SCOPE("Lame.encodeInterleavedMono");
     if (pcm == NULL || length <= 0 || channels <= 0) {
         return NULL;
     }
@@ -224,7 +318,7 @@ Java_com_github_axet_lamejni_Lame_encodeInterleavedMono(JNIEnv *env, jobject thi
         return NULL;
     }
 
-    int encoded = lame_encode_buffer(handle->gfp, mono_ptr, NULL, frames, handle->mp3buf, mp3buf_size);
+    int encoded = encode_chunked(handle, mono_ptr, frames, mp3buf_size);
 
     (*env)->ReleaseShortArrayElements(env, pcm, input, JNI_ABORT);
 
@@ -243,6 +337,7 @@ JNIEXPORT jbyteArray JNICALL
 Java_com_github_axet_lamejni_Lame_encode_1float(JNIEnv *env, jobject thiz,
                                                jfloatArray pcm, jint offset,
                                                jint length) {
+    LAME_TRACE_SCOPE("Lame.encode_float");
     if (pcm == NULL || length <= 0) {
         return NULL;
     }
@@ -269,7 +364,7 @@ Java_com_github_axet_lamejni_Lame_encode_1float(JNIEnv *env, jobject thiz,
         return NULL;
     }
 
-    int encoded = lame_encode_buffer_ieee_float(handle->gfp, pcm_ptr, NULL, length, handle->mp3buf, mp3buf_size);
+    int encoded = encode_float_chunked(handle, pcm_ptr, length, mp3buf_size);
 
     (*env)->ReleaseFloatArrayElements(env, pcm, input, JNI_ABORT);
 
@@ -288,6 +383,7 @@ JNIEXPORT jbyteArray JNICALL
 Java_com_github_axet_lamejni_Lame_encodeInterleavedMonoFloat(JNIEnv *env, jobject thiz,
                                                              jfloatArray pcm, jint offset,
                                                              jint length, jint channels) {
+    LAME_TRACE_SCOPE("Lame.encodeInterleavedMonoFloat");
     if (pcm == NULL || length <= 0 || channels <= 0) {
         return NULL;
     }
@@ -341,7 +437,7 @@ Java_com_github_axet_lamejni_Lame_encodeInterleavedMonoFloat(JNIEnv *env, jobjec
         return NULL;
     }
 
-    int encoded = lame_encode_buffer_ieee_float(handle->gfp, mono_ptr, NULL, frames, handle->mp3buf, mp3buf_size);
+    int encoded = encode_float_chunked(handle, mono_ptr, frames, mp3buf_size);
 
     (*env)->ReleaseFloatArrayElements(env, pcm, input, JNI_ABORT);
 
@@ -356,30 +452,763 @@ Java_com_github_axet_lamejni_Lame_encodeInterleavedMonoFloat(JNIEnv *env, jobjec
     return output;
 }
 
+JNIEXPORT void JNICALL
+Java_com_github_axet_lamejni_Lame_setTracing(JNIEnv *env, jclass clazz, jboolean enabled) {
+    lame_trace_enable(enabled == JNI_TRUE);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_github_axet_lamejni_Lame_dumpTrace(JNIEnv *env, jclass clazz, jstring path) {
+    if (path == NULL) {
+        return JNI_FALSE;
+    }
+    const char *cpath = (*env)->GetStringUTFChars(env, path, NULL);
+    if (cpath == NULL) {
+        return JNI_FALSE;
+    }
+    int rc = lame_trace_dump(cpath);
+    (*env)->ReleaseStringUTFChars(env, path, cpath);
+    return rc == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+/* layout as in Lame.STAT_* */
+#define LAME_JNI_STATS (LAME_STAGES + 9)
+
+JNIEXPORT jlongArray JNICALL
+Java_com_github_axet_lamejni_Lame_getStats(JNIEnv *env, jobject thiz) {
+    lame_jni_handle *handle = get_handle(env, thiz);
+    if (handle == NULL || handle->gfp == NULL) {
+        return NULL;
+    }
+
+    lame_encoder_stats stats;
+    lame_memory_stats memory;
+    if (handle->api->get_encoder_stats(handle->gfp, &stats) < 0
+        || handle->api->get_memory_stats(handle->gfp, &memory) < 0) {
+        return NULL;
+    }
+
+    jlong values[LAME_JNI_STATS];
+    int n = 0;
+    for (int i = 0; i < LAME_STAGES; ++i) {
+        values[n++] = (jlong)(stats.stage_seconds[i] * 1e9);
+    }
+    values[n++] = stats.frames;
+    values[n++] = stats.granules;
+    values[n++] = stats.short_blocks;
+    values[n++] = stats.silent_frames;
+    values[n++] = stats.bin_search_probes;
+    values[n++] = stats.outer_loops;
+    values[n++] = stats.outer_loop_trials;
+    values[n++] = (jlong)(memory.arena_size + memory.heap_bytes);
+    values[n++] = (jlong)(memory.arena_size + memory.heap_peak);
+
+    jlongArray output = (*env)->NewLongArray(env, n);
+    if (output != NULL) {
+        (*env)->SetLongArrayRegion(env, output, 0, n, values);
+    }
+    return output;
+}
+
+/* The last frames, once; a byte array of them (possibly empty). */
+static jbyteArray flush_encoder(JNIEnv *env, lame_jni_handle *handle) {
+    unsigned char mp3buf[7200];
+    int encoded = 0;
+
+    if (!handle->flushed) {
+        encoded = handle->api->encode_flush(handle->gfp, mp3buf, (int)sizeof(mp3buf));
+        handle->flushed = 1;
+    }
+    if (encoded < 0) {
+        encoded = 0;
+    }
+
+    jbyteArray output = (*env)->NewByteArray(env, encoded);
+    if (encoded > 0 && output != NULL) {
+        (*env)->SetByteArrayRegion(env, output, 0, encoded, (jbyte *)mp3buf);
+    }
+    return output;
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_com_github_axet_lamejni_Lame_flush(JNIEnv *env, jobject thiz) {
+    LAME_TRACE_SCOPE("Lame.flush");
+    lame_jni_handle *handle = get_handle(env, thiz);
+    if (handle == NULL || handle->gfp == NULL) {
+        return (*env)->NewByteArray(env, 0);
+    }
+    return flush_encoder(env, handle);
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_com_github_axet_lamejni_Lame_getLametagFrame(JNIEnv *env, jobject thiz) {
+    LAME_TRACE_SCOPE("Lame.getLametagFrame");
+    lame_jni_handle *handle = get_handle(env, thiz);
+    if (handle == NULL || handle->gfp == NULL || !handle->flushed) {
+        return NULL;
+    }
+    /* the largest frame LAME puts the tag in, MAXFRAMESIZE of VbrTag.c */
+    unsigned char frame[2880];
+    size_t const size = handle->api->get_lametag_frame(handle->gfp, frame, sizeof(frame));
+    if (size == 0 || size > sizeof(frame)) {
+        return NULL;
+    }
+    jbyteArray output = (*env)->NewByteArray(env, (jsize)size);
+    if (output != NULL) {
+        (*env)->SetByteArrayRegion(env, output, 0, (jsize)size, (jbyte *)frame);
+    }
+    return output;
+}
+
 JNIEXPORT jbyteArray JNICALL
 Java_com_github_axet_lamejni_Lame_close(JNIEnv *env, jobject thiz) {
+    LAME_TRACE_SCOPE("Lame.close");
     lame_jni_handle *handle = get_handle(env, thiz);
     if (handle == NULL || handle->gfp == NULL) {
         return (*env)->NewByteArray(env, 0);
     }
 
-    unsigned char mp3buf[7200];
-    int encoded = lame_encode_flush(handle->gfp, mp3buf, (int)sizeof(mp3buf));
+    jbyteArray output = flush_encoder(env, handle);
 
-    lame_close(handle->gfp);
+    handle->api->close(handle->gfp);
     free(handle->mp3buf);
     free(handle->mono_buf);
     free(handle->mono_float_buf);
     free(handle);
     set_handle(env, thiz, NULL);
+    return output;
+}
 
-    if (encoded < 0) {
-        encoded = 0;
+JNIEXPORT jlong JNICALL
+Java_com_github_axet_lamejni_Lame_predictSize(JNIEnv *env, jclass clazz, jint channels,
+                                             jint sample_rate, jint bit_rate, jlong samples) {
+    LAME_TRACE_SCOPE("Lame.predictSize");
+    if (samples <= 0) {
+        return -1;
     }
+    /* the size depends on the stream parameters only, quality does not matter */
+    const lame_api *api = choose_api(channels, sample_rate);
+    lame_t gfp = open_encoder(api, channels, sample_rate, bit_rate, 9, samples);
+    if (gfp == NULL && api != &lame_generic_api) {
+        api = &lame_generic_api;
+        gfp = open_encoder(api, channels, sample_rate, bit_rate, 9, samples);
+    }
+    if (gfp == NULL) {
+        return -1;
+    }
+    unsigned long bytes = api->get_cbr_stream_size(gfp);
+    api->close(gfp);
+    return bytes > 0 ? (jlong)bytes : -1;
+}
 
-    jbyteArray output = (*env)->NewByteArray(env, encoded);
-    if (encoded > 0 && output != NULL) {
-        (*env)->SetByteArrayRegion(env, output, 0, encoded, (jbyte *)mp3buf);
+/* layout as in Mp3Stream.INFO_* */
+#define MP3_JNI_INFO 14
+
+JNIEXPORT jlongArray JNICALL
+Java_com_github_axet_lamejni_Mp3Stream_scan(JNIEnv *env, jclass clazz, jint fd, jboolean cbr,
+                                            jint min_sample_rate, jint max_sample_rate,
+                                            jint channel_modes, jint max_bitrate,
+                                            jint max_dropped_permille) {
+    LAME_TRACE_SCOPE("Mp3Stream.scan");
+    mp3_stream_info info;
+    if (mp3_scan(fd, &info) < 0) {
+        return NULL;
+    }
+
+    mp3_constraints constraints = {
+        .cbr = cbr == JNI_TRUE,
+        .min_sample_rate = min_sample_rate,
+        .max_sample_rate = max_sample_rate,
+        .channel_modes = channel_modes,
+        .max_bitrate = max_bitrate,
+        .max_dropped_permille = max_dropped_permille,
+    };
+    jlong values[MP3_JNI_INFO];
+    int n = 0;
+    values[n++] = info.version;
+    values[n++] = info.sample_rate;
+    values[n++] = info.channel_modes;
+    values[n++] = info.min_bitrate;
+    values[n++] = info.max_bitrate;
+    values[n++] = info.frames;
+    values[n++] = info.samples;
+    values[n++] = info.audio_bytes;
+    values[n++] = info.dropped_frames;
+    values[n++] = info.skipped_bytes;
+    values[n++] = info.info_tag;
+    values[n++] = info.enc_delay;
+    values[n++] = info.enc_padding;
+    values[n++] = mp3_check(&info, &constraints);
+
+    jlongArray output = (*env)->NewLongArray(env, n);
+    if (output != NULL) {
+        (*env)->SetLongArrayRegion(env, output, 0, n, values);
     }
     return output;
 }
+
+/* layout as in Mp3Stream.INDEX_* */
+#define MP3_JNI_INDEX 10
+
+JNIEXPORT jlongArray JNICALL
+Java_com_github_axet_lamejni_Mp3Stream_index(JNIEnv *env, jclass clazz, jint fd) {
+    LAME_TRACE_SCOPE("Mp3Stream.index");
+    mp3_index_info index;
+    if (mp3_index(fd, &index) < 0) {
+        return NULL;
+    }
+
+    jlong values[MP3_JNI_INDEX];
+    int n = 0;
+    values[n++] = index.version;
+    values[n++] = index.sample_rate;
+    values[n++] = index.vbr;
+    values[n++] = index.bitrate;
+    values[n++] = index.frames;
+    values[n++] = index.samples;
+    values[n++] = index.duration_ms;
+    values[n++] = index.enc_delay;
+    values[n++] = index.enc_padding;
+    values[n++] = index.from_tag;
+
+    jlongArray output = (*env)->NewLongArray(env, n);
+    if (output != NULL) {
+        (*env)->SetLongArrayRegion(env, output, 0, n, values);
+    }
+    return output;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_github_axet_lamejni_Mp3Stream_remux(JNIEnv *env, jclass clazz, jint in_fd, jint out_fd,
+                                             jlong dropped_frames, jbyteArray tag) {
+    LAME_TRACE_SCOPE("Mp3Stream.remux");
+    jbyte *tag_bytes = NULL;
+    jsize tag_size = 0;
+    if (tag != NULL) {
+        tag_size = (*env)->GetArrayLength(env, tag);
+        tag_bytes = (*env)->GetByteArrayElements(env, tag, NULL);
+        if (tag_bytes == NULL) {
+            return -1;
+        }
+    }
+
+    long written = mp3_remux(in_fd, out_fd, (long)dropped_frames,
+                             (const unsigned char *)tag_bytes, tag_size);
+
+    if (tag_bytes != NULL) {
+        (*env)->ReleaseByteArrayElements(env, tag, tag_bytes, JNI_ABORT);
+    }
+    return written;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_github_axet_lamejni_Mp3Stream_gain(JNIEnv *env, jclass clazz, jint fd, jint steps) {
+    LAME_TRACE_SCOPE("Mp3Stream.gain");
+    return mp3_gain(fd, steps);
+}
+
+/* layout as in Id3Reader.TEXT_* and Id3Reader.PICTURE_* */
+#define ID3_JNI_TEXT (ID3_FIELDS + 1)
+#define ID3_JNI_PICTURE 3
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_github_axet_lamejni_Id3Reader_read(JNIEnv *env, jclass clazz, jintArray fds,
+                                            jlongArray pictures) {
+    LAME_TRACE_SCOPE("Id3Reader.read");
+    if (fds == NULL || pictures == NULL) {
+        return NULL;
+    }
+    jsize count = (*env)->GetArrayLength(env, fds);
+    if ((*env)->GetArrayLength(env, pictures) < count * ID3_JNI_PICTURE) {
+        return NULL;
+    }
+    jclass string_class = (*env)->FindClass(env, "java/lang/String");
+    if (string_class == NULL) {
+        return NULL;
+    }
+    jobjectArray output = (*env)->NewObjectArray(env, count * ID3_JNI_TEXT, string_class, NULL);
+    jint *fd = (*env)->GetIntArrayElements(env, fds, NULL);
+    if (output == NULL || fd == NULL) {
+        return NULL;
+    }
+
+    for (jsize i = 0; i < count; ++i) {
+        id3_info info;
+        jlong picture[ID3_JNI_PICTURE] = {-1, 0, -1};
+
+        if (id3_read(fd[i], &info) == 0) {
+            for (int f = 0; f < ID3_FIELDS; ++f) {
+                if (info.text_length[f] > 0) {
+                    jstring text = (*env)->NewString(env, info.text[f], info.text_length[f]);
+                    (*env)->SetObjectArrayElement(env, output, i * ID3_JNI_TEXT + f, text);
+                    (*env)->DeleteLocalRef(env, text);
+                }
+            }
+            if (info.picture_type >= 0) {
+                jstring mime = (*env)->NewStringUTF(env, info.picture_mime);
+                (*env)->SetObjectArrayElement(env, output, i * ID3_JNI_TEXT + ID3_FIELDS, mime);
+                (*env)->DeleteLocalRef(env, mime);
+                picture[0] = info.picture_offset;
+                picture[1] = info.picture_length;
+                picture[2] = info.picture_type;
+            }
+        }
+        (*env)->SetLongArrayRegion(env, pictures, i * ID3_JNI_PICTURE, ID3_JNI_PICTURE, picture);
+    }
+    (*env)->ReleaseIntArrayElements(env, fds, fd, JNI_ABORT);
+    return output;
+}
+
+#define ID3_JNI_FRAMES 16
+
+/*
+ * Id3Writer.write and AsyncWriter.writeId3Tag: frames ids[i] with
+ * texts[i], then the picture from picture_fd or the direct buffer
+ * picture_data, placed as picture (Id3Reader.PICTURE_* layout) says.
+ * The strings are pinned while the tag is written; the image is not
+ * copied here.
+ */
+static jlong write_id3_tag(JNIEnv *env, jobjectArray ids, jobjectArray texts, jstring picture_mime,
+                           jint picture_fd, jlongArray picture, jobject picture_data,
+                           id3_sink sink, void *arg) {
+    id3_text_frame frames[ID3_JNI_FRAMES];
+    jstring strings[ID3_JNI_FRAMES];
+    id3_picture image;
+    const char *mime = NULL;
+    int count = 0;
+    jlong result = -EINVAL;
+
+    if (ids == NULL || texts == NULL) {
+        return -EINVAL;
+    }
+    count = (*env)->GetArrayLength(env, ids);
+    if (count > ID3_JNI_FRAMES || (*env)->GetArrayLength(env, texts) != count) {
+        return -EINVAL;
+    }
+    memset(frames, 0, sizeof(frames));
+    memset(strings, 0, sizeof(strings));
+    for (int i = 0; i < count; ++i) {
+        jstring id = (jstring)(*env)->GetObjectArrayElement(env, ids, i);
+        const char *id_chars = id != NULL ? (*env)->GetStringUTFChars(env, id, NULL) : NULL;
+        int const valid = id_chars != NULL && strlen(id_chars) == 4;
+        if (valid) {
+            memcpy(frames[i].id, id_chars, 5);
+        }
+        if (id_chars != NULL) {
+            (*env)->ReleaseStringUTFChars(env, id, id_chars);
+        }
+        (*env)->DeleteLocalRef(env, id);
+        if (!valid) {
+            count = i;
+            goto done;
+        }
+        strings[i] = (jstring)(*env)->GetObjectArrayElement(env, texts, i);
+        if (strings[i] != NULL) {
+            frames[i].text = (const uint16_t *)(*env)->GetStringChars(env, strings[i], NULL);
+            if (frames[i].text == NULL) {
+                result = -ENOMEM;
+                count = i + 1;
+                goto done;
+            }
+            frames[i].length = (*env)->GetStringLength(env, strings[i]);
+        }
+    }
+
+    memset(&image, 0, sizeof(image));
+    image.fd = -1;
+    if (picture_mime != NULL) {
+        jlong place[ID3_JNI_PICTURE];
+        if (picture == NULL || (*env)->GetArrayLength(env, picture) < ID3_JNI_PICTURE) {
+            goto done;
+        }
+        (*env)->GetLongArrayRegion(env, picture, 0, ID3_JNI_PICTURE, place);
+        image.type = (int)place[2];
+        image.offset = (long)place[0];
+        image.length = (long)place[1];
+        if (picture_fd >= 0) {
+            image.fd = picture_fd;
+        } else {
+            image.data = picture_data != NULL
+                         ? (const unsigned char *)(*env)->GetDirectBufferAddress(env, picture_data) : NULL;
+            if (image.data == NULL || image.offset < 0
+                || image.offset + image.length > (*env)->GetDirectBufferCapacity(env, picture_data)) {
+                goto done;
+            }
+            image.data += image.offset;
+        }
+        mime = (*env)->GetStringUTFChars(env, picture_mime, NULL);
+        if (mime == NULL) {
+            result = -ENOMEM;
+            goto done;
+        }
+        image.mime = mime;
+    }
+
+    {
+        long const size = id3_write(frames, count, mime != NULL ? &image : NULL, sink, arg);
+        result = size < 0 ? -errno : size;
+    }
+
+done:
+    if (mime != NULL) {
+        (*env)->ReleaseStringUTFChars(env, picture_mime, mime);
+    }
+    for (int i = 0; i < count; ++i) {
+        if (strings[i] != NULL) {
+            if (frames[i].text != NULL) {
+                (*env)->ReleaseStringChars(env, strings[i], (const jchar *)frames[i].text);
+            }
+            (*env)->DeleteLocalRef(env, strings[i]);
+        }
+    }
+    return result;
+}
+
+static int fd_sink(void *arg, const void *data, size_t len) {
+    int const fd = *(const int *)arg;
+    const unsigned char *p = (const unsigned char *)data;
+
+    while (len > 0) {
+        ssize_t const n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_github_axet_lamejni_Id3Writer_write(JNIEnv *env, jclass clazz, jint fd, jobjectArray ids,
+                                            jobjectArray texts, jstring picture_mime, jint picture_fd,
+                                            jlongArray picture, jobject picture_data) {
+    LAME_TRACE_SCOPE("Id3Writer.write");
+    int out_fd = fd;
+    return write_id3_tag(env, ids, texts, picture_mime, picture_fd, picture, picture_data,
+                         fd_sink, &out_fd);
+}
+
+/* MetadataIndex.handle, apart from Lame.handle as the field ids are cached per class */
+static jfieldID get_index_field(JNIEnv *env, jobject thiz) {
+    static jfieldID index_field = NULL;
+    if (index_field == NULL) {
+        jclass clazz = (*env)->GetObjectClass(env, thiz);
+        index_field = (*env)->GetFieldID(env, clazz, "handle", "J");
+        (*env)->DeleteLocalRef(env, clazz);
+    }
+    return index_field;
+}
+
+static meta_index *get_index(JNIEnv *env, jobject thiz) {
+    jfieldID index_field = get_index_field(env, thiz);
+    if (index_field == NULL) {
+        return NULL;
+    }
+    return (meta_index *)(intptr_t)(*env)->GetLongField(env, thiz, index_field);
+}
+
+static void set_index(JNIEnv *env, jobject thiz, meta_index *index) {
+    jfieldID index_field = get_index_field(env, thiz);
+    if (index_field != NULL) {
+        (*env)->SetLongField(env, thiz, index_field, (jlong)(intptr_t)index);
+    }
+}
+
+/* malloc'd copy of s, NULL for null; sets *failed if out of memory */
+static char *copy_utf(JNIEnv *env, jstring s, int *failed) {
+    if (s == NULL) {
+        return NULL;
+    }
+    const char *chars = (*env)->GetStringUTFChars(env, s, NULL);
+    char *copy = chars != NULL ? strdup(chars) : NULL;
+    if (chars != NULL) {
+        (*env)->ReleaseStringUTFChars(env, s, chars);
+    }
+    if (copy == NULL) {
+        *failed = 1;
+    }
+    return copy;
+}
+
+static char *copy_utf_element(JNIEnv *env, jobjectArray array, jsize i, int *failed) {
+    jstring s = (jstring)(*env)->GetObjectArrayElement(env, array, i);
+    char *copy = copy_utf(env, s, failed);
+    (*env)->DeleteLocalRef(env, s);
+    return copy;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_github_axet_lamejni_MetadataIndex_open(JNIEnv *env, jobject thiz, jstring path) {
+    LAME_TRACE_SCOPE("MetadataIndex.open");
+    meta_index_close(get_index(env, thiz));
+    set_index(env, thiz, NULL);
+    if (path == NULL) {
+        return JNI_FALSE;
+    }
+    const char *path_chars = (*env)->GetStringUTFChars(env, path, NULL);
+    if (path_chars == NULL) {
+        return JNI_FALSE;
+    }
+    meta_index *index = meta_index_open(path_chars);
+    (*env)->ReleaseStringUTFChars(env, path, path_chars);
+    set_index(env, thiz, index);
+    return index != NULL ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_github_axet_lamejni_MetadataIndex_find(JNIEnv *env, jobject thiz, jstring key,
+                                                jlong size, jlong mtime, jlongArray values,
+                                                jobjectArray strings) {
+    LAME_TRACE_SCOPE("MetadataIndex.find");
+    meta_index *index = get_index(env, thiz);
+    if (index == NULL || key == NULL || values == NULL || strings == NULL
+        || (*env)->GetArrayLength(env, values) < META_VALUES
+        || (*env)->GetArrayLength(env, strings) < META_STRINGS) {
+        return JNI_FALSE;
+    }
+    const char *key_chars = (*env)->GetStringUTFChars(env, key, NULL);
+    if (key_chars == NULL) {
+        return JNI_FALSE;
+    }
+    meta_record record;
+    int found = meta_index_find(index, key_chars, size, mtime, &record);
+    (*env)->ReleaseStringUTFChars(env, key, key_chars);
+    if (!found) {
+        return JNI_FALSE;
+    }
+
+    jlong record_values[META_VALUES];
+    for (int i = 0; i < META_VALUES; ++i) {
+        record_values[i] = record.values[i];
+    }
+    (*env)->SetLongArrayRegion(env, values, 0, META_VALUES, record_values);
+    for (int i = 0; i < META_STRINGS; ++i) {
+        jstring s = record.strings[i] != NULL ? (*env)->NewStringUTF(env, record.strings[i]) : NULL;
+        (*env)->SetObjectArrayElement(env, strings, i, s);
+        if (s != NULL) {
+            (*env)->DeleteLocalRef(env, s);
+        }
+    }
+    return JNI_TRUE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_github_axet_lamejni_MetadataIndex_put(JNIEnv *env, jobject thiz, jstring parent,
+                                               jobjectArray keys, jlongArray stamps,
+                                               jlongArray values, jobjectArray strings) {
+    LAME_TRACE_SCOPE("MetadataIndex.put");
+    meta_index *index = get_index(env, thiz);
+    if (index == NULL || parent == NULL || keys == NULL || stamps == NULL || values == NULL
+        || strings == NULL) {
+        return JNI_FALSE;
+    }
+    jsize const n = (*env)->GetArrayLength(env, keys);
+    if ((*env)->GetArrayLength(env, stamps) < n * 2
+        || (*env)->GetArrayLength(env, values) < n * META_VALUES
+        || (*env)->GetArrayLength(env, strings) < n * META_STRINGS) {
+        return JNI_FALSE;
+    }
+
+    meta_record *records = (meta_record *)calloc(n > 0 ? (size_t)n : 1, sizeof(*records));
+    jlong *stamp = (*env)->GetLongArrayElements(env, stamps, NULL);
+    jlong *value = (*env)->GetLongArrayElements(env, values, NULL);
+    int failed = records == NULL || stamp == NULL || value == NULL;
+    char *parent_chars = failed ? NULL : copy_utf(env, parent, &failed);
+
+    for (jsize i = 0; i < n && !failed; ++i) {
+        meta_record *r = &records[i];
+        r->key = copy_utf_element(env, keys, i, &failed);
+        failed |= r->key == NULL;
+        r->size = stamp[i * 2];
+        r->mtime = stamp[i * 2 + 1];
+        for (int v = 0; v < META_VALUES; ++v) {
+            r->values[v] = value[i * META_VALUES + v];
+        }
+        for (int s = 0; s < META_STRINGS && !failed; ++s) {
+            r->strings[s] = copy_utf_element(env, strings, i * META_STRINGS + s, &failed);
+        }
+    }
+    if (!failed) {
+        failed = meta_index_put(index, parent_chars, records, n) < 0;
+    }
+
+    if (stamp != NULL) {
+        (*env)->ReleaseLongArrayElements(env, stamps, stamp, JNI_ABORT);
+    }
+    if (value != NULL) {
+        (*env)->ReleaseLongArrayElements(env, values, value, JNI_ABORT);
+    }
+    for (jsize i = 0; records != NULL && i < n; ++i) {
+        free((void *)records[i].key);
+        for (int s = 0; s < META_STRINGS; ++s) {
+            free((void *)records[i].strings[s]);
+        }
+    }
+    free(records);
+    free(parent_chars);
+    return failed ? JNI_FALSE : JNI_TRUE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_github_axet_lamejni_MetadataIndex_commit(JNIEnv *env, jobject thiz) {
+    LAME_TRACE_SCOPE("MetadataIndex.commit");
+    meta_index *index = get_index(env, thiz);
+    return index != NULL && meta_index_commit(index) == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_github_axet_lamejni_MetadataIndex_close(JNIEnv *env, jobject thiz) {
+    LAME_TRACE_SCOPE("MetadataIndex.close");
+    meta_index_close(get_index(env, thiz));
+    set_index(env, thiz, NULL);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_github_axet_lamejni_FileCopy_copy(JNIEnv *env, jclass clazz, jint in_fd, jint out_fd,
+                                           jobject progress, jint flags) {
+    LAME_TRACE_SCOPE("FileCopy.copy");
+    file_copy_progress *shared = NULL;
+    if (progress != NULL) {
+        shared = (file_copy_progress *)(*env)->GetDirectBufferAddress(env, progress);
+        if (shared == NULL
+            || (*env)->GetDirectBufferCapacity(env, progress) < (jlong)sizeof(*shared)
+            || ((uintptr_t)shared & (sizeof(int64_t) - 1)) != 0) {
+            return -EINVAL;
+        }
+    }
+    int64_t copied = file_copy(in_fd, out_fd, shared, flags);
+    return copied < 0 ? -errno : copied;
+}
+
+/* AsyncWriter.handle */
+static jfieldID get_writer_field(JNIEnv *env, jobject thiz) {
+    static jfieldID writer_field = NULL;
+    if (writer_field == NULL) {
+        jclass clazz = (*env)->GetObjectClass(env, thiz);
+        writer_field = (*env)->GetFieldID(env, clazz, "handle", "J");
+        (*env)->DeleteLocalRef(env, clazz);
+    }
+    return writer_field;
+}
+
+static async_writer *get_writer(JNIEnv *env, jobject thiz) {
+    jfieldID writer_field = get_writer_field(env, thiz);
+    if (writer_field == NULL) {
+        return NULL;
+    }
+    return (async_writer *)(intptr_t)(*env)->GetLongField(env, thiz, writer_field);
+}
+
+static void set_writer(JNIEnv *env, jobject thiz, async_writer *w) {
+    jfieldID writer_field = get_writer_field(env, thiz);
+    if (writer_field != NULL) {
+        (*env)->SetLongField(env, thiz, writer_field, (jlong)(intptr_t)w);
+    }
+}
+
+JNIEXPORT jint JNICALL
+Java_com_github_axet_lamejni_AsyncWriter_open(JNIEnv *env, jobject thiz, jint fd) {
+    LAME_TRACE_SCOPE("AsyncWriter.open");
+    async_writer_close(get_writer(env, thiz));
+    async_writer *w = async_writer_open(fd);
+    set_writer(env, thiz, w);
+    return w != NULL ? 0 : -errno;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_github_axet_lamejni_AsyncWriter_write(JNIEnv *env, jobject thiz, jbyteArray data,
+                                               jint offset, jint length) {
+    LAME_TRACE_SCOPE("AsyncWriter.write");
+    async_writer *w = get_writer(env, thiz);
+    if (w == NULL) {
+        return -EBADF;
+    }
+    if (data == NULL || offset < 0 || length < 0
+        || offset > (*env)->GetArrayLength(env, data) - length) {
+        return -EINVAL;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    /* not a critical section: the write waits for the writer thread when the ring is full */
+    jbyte *bytes = (*env)->GetByteArrayElements(env, data, NULL);
+    if (bytes == NULL) {
+        return -ENOMEM;
+    }
+    int const result = async_writer_write(w, bytes + offset, (size_t)length);
+    int const err = errno;
+    (*env)->ReleaseByteArrayElements(env, data, bytes, JNI_ABORT);
+    return result < 0 ? -err : 0;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_github_axet_lamejni_AsyncWriter_reserve(JNIEnv *env, jobject thiz, jlong bytes) {
+    LAME_TRACE_SCOPE("AsyncWriter.reserve");
+    async_writer *w = get_writer(env, thiz);
+    if (w == NULL) {
+        return -EBADF;
+    }
+    return async_writer_reserve(w, bytes) < 0 ? -errno : 0;
+}
+
+static int writer_sink(void *arg, const void *data, size_t len) {
+    return async_writer_write((async_writer *)arg, data, len);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_github_axet_lamejni_AsyncWriter_writeId3Tag(JNIEnv *env, jobject thiz, jobjectArray ids,
+                                                     jobjectArray texts, jstring picture_mime,
+                                                     jint picture_fd, jlongArray picture,
+                                                     jobject picture_data) {
+    LAME_TRACE_SCOPE("AsyncWriter.writeId3Tag");
+    async_writer *w = get_writer(env, thiz);
+    if (w == NULL) {
+        return -EBADF;
+    }
+    return write_id3_tag(env, ids, texts, picture_mime, picture_fd, picture, picture_data,
+                         writer_sink, w);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_github_axet_lamejni_AsyncWriter_patch(JNIEnv *env, jobject thiz, jlong offset,
+                                               jbyteArray data) {
+    LAME_TRACE_SCOPE("AsyncWriter.patch");
+    async_writer *w = get_writer(env, thiz);
+    if (w == NULL) {
+        return -EBADF;
+    }
+    if (data == NULL) {
+        return -EINVAL;
+    }
+    jsize const length = (*env)->GetArrayLength(env, data);
+    jbyte *bytes = (*env)->GetByteArrayElements(env, data, NULL);
+    if (bytes == NULL) {
+        return -ENOMEM;
+    }
+    int const result = async_writer_patch(w, offset, bytes, (size_t)length);
+    int const err = errno;
+    (*env)->ReleaseByteArrayElements(env, data, bytes, JNI_ABORT);
+    return result < 0 ? -err : 0;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_github_axet_lamejni_AsyncWriter_finish(JNIEnv *env, jobject thiz, jboolean sync) {
+    LAME_TRACE_SCOPE("AsyncWriter.finish");
+    async_writer *w = get_writer(env, thiz);
+    if (w == NULL) {
+        return -EBADF;
+    }
+    int64_t written = async_writer_finish(w, sync == JNI_TRUE);
+    return written < 0 ? -errno : written;
+}
+
+JNIEXPORT void JNICALL
+Java_com_github_axet_lamejni_AsyncWriter_close(JNIEnv *env, jobject thiz) {
+    LAME_TRACE_SCOPE("AsyncWriter.close");
+    async_writer_close(get_writer(env, thiz));
+    set_writer(env, thiz, NULL);
+}
@@ -0,0 +1,509 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "metadata_index.h"
+
+#define INDEX_MAGIC     "TMIX"
+#define INDEX_VERSION   1
+#define NO_STRING       0xFFFFFFFFu
+
+typedef struct {
+    char     magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t pool_size;
+} disk_header;
+
+/* 128 bytes; the strings are offsets into the pool after the records */
+typedef struct {
+    uint64_t hash;              /* of the key */
+    uint64_t parent;            /* hash of the parent */
+    int64_t  size;
+    int64_t  mtime;
+    int64_t  values[META_VALUES];
+    uint32_t key;
+    uint32_t strings[META_STRINGS];
+    uint32_t reserved[3];
+} disk_entry;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t parent;
+    meta_record record;
+} item;
+
+struct meta_index {
+    char   *path;
+    void   *map;
+    size_t  map_size;
+    const disk_entry *entries;  /* in the map, sorted by hash and key */
+    uint32_t count;
+    const char *pool;
+    uint32_t pool_size;
+
+    item   *pending;            /* put since the last commit, own their strings */
+    int     npending;
+    int     pending_cap;
+    uint64_t *replaced;         /* parents put since the last commit */
+    int     nreplaced;
+    int     replaced_cap;
+    int     dirty;
+};
+
+static uint64_t hash_string(const char *s) {
+    uint64_t h = 0xcbf29ce484222325ull;     /* FNV-1a */
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static int string_equal(const char *a, const char *b) {
+    return a == b || (a != NULL && b != NULL && strcmp(a, b) == 0);
+}
+
+static int grow(void **array, int *cap, int need, size_t elem) {
+    if (need <= *cap) {
+        return 0;
+    }
+    int n = *cap > 0 ? *cap * 2 : 64;
+    while (n < need) {
+        n *= 2;
+    }
+    void *tmp = realloc(*array, (size_t)n * elem);
+    if (tmp == NULL) {
+        return -1;
+    }
+    *array = tmp;
+    *cap = n;
+    return 0;
+}
+
+static const char *pool_string(const meta_index *index, uint32_t offset) {
+    return offset == NO_STRING ? NULL : index->pool + offset;
+}
+
+static void entry_record(const meta_index *index, const disk_entry *e, meta_record *record) {
+    record->key = pool_string(index, e->key);
+    record->size = e->size;
+    record->mtime = e->mtime;
+    memcpy(record->values, e->values, sizeof(record->values));
+    for (int i = 0; i < META_STRINGS; ++i) {
+        record->strings[i] = pool_string(index, e->strings[i]);
+    }
+}
+
+static int string_ok(const meta_index *index, uint32_t offset) {
+    return offset == NO_STRING || offset < index->pool_size;
+}
+
+static void unmap(meta_index *index) {
+    if (index->map != NULL) {
+        munmap(index->map, index->map_size);
+    }
+    index->map = NULL;
+    index->map_size = 0;
+    index->entries = NULL;
+    index->count = 0;
+    index->pool = NULL;
+    index->pool_size = 0;
+}
+
+/* Maps the file at index->path; a missing or broken one leaves the index empty. */
+static void map_file(meta_index *index) {
+    struct stat st;
+    int fd = open(index->path, O_RDONLY | O_CLOEXEC);
+
+    unmap(index);
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(disk_header)) {
+        close(fd);
+        return;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    index->map = map;
+    index->map_size = (size_t)st.st_size;
+
+    const disk_header *header = (const disk_header *)map;
+    size_t const records = sizeof(disk_header) + (size_t)header->count * sizeof(disk_entry);
+    if (memcmp(header->magic, INDEX_MAGIC, 4) != 0 || header->version != INDEX_VERSION
+        || header->count > (index->map_size - sizeof(disk_header)) / sizeof(disk_entry)
+        || records + header->pool_size != index->map_size
+        || (header->pool_size > 0 && ((const char *)map)[index->map_size - 1] != '\0')) {
+        unmap(index);
+        return;
+    }
+    index->entries = (const disk_entry *)((const char *)map + sizeof(disk_header));
+    index->count = header->count;
+    index->pool = (const char *)map + records;
+    index->pool_size = header->pool_size;
+    for (uint32_t i = 0; i < index->count; ++i) {
+        const disk_entry *e = &index->entries[i];
+        int ok = e->key != NO_STRING && string_ok(index, e->key);
+        for (int s = 0; s < META_STRINGS && ok; ++s) {
+            ok = string_ok(index, e->strings[s]);
+        }
+        if (!ok) {
+            unmap(index);
+            return;
+        }
+    }
+}
+
+meta_index *meta_index_open(const char *path) {
+    meta_index *index = (meta_index *)calloc(1, sizeof(*index));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->path = strdup(path);
+    if (index->path == NULL) {
+        free(index);
+        return NULL;
+    }
+    map_file(index);
+    return index;
+}
+
+static void free_item(item *it) {
+    free((void *)it->record.key);
+    for (int i = 0; i < META_STRINGS; ++i) {
+        free((void *)it->record.strings[i]);
+    }
+}
+
+static void clear_pending(meta_index *index) {
+    for (int i = 0; i < index->npending; ++i) {
+        free_item(&index->pending[i]);
+    }
+    index->npending = 0;
+    index->nreplaced = 0;
+    index->dirty = 0;
+}
+
+void meta_index_close(meta_index *index) {
+    if (index == NULL) {
+        return;
+    }
+    clear_pending(index);
+    free(index->pending);
+    free(index->replaced);
+    unmap(index);
+    free(index->path);
+    free(index);
+}
+
+static int is_replaced(const meta_index *index, uint64_t parent) {
+    for (int i = 0; i < index->nreplaced; ++i) {
+        if (index->replaced[i] == parent) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static const disk_entry *find_entry(const meta_index *index, uint64_t hash, const char *key) {
+    uint32_t lo = 0, hi = index->count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (index->entries[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (; lo < index->count && index->entries[lo].hash == hash; ++lo) {
+        if (strcmp(index->pool + index->entries[lo].key, key) == 0) {
+            return &index->entries[lo];
+        }
+    }
+    return NULL;
+}
+
+/* The current record of key, from the puts or the file; 0 if there is none. */
+static int find_live(const meta_index *index, const char *key, uint64_t *parent,
+                     meta_record *record) {
+    uint64_t const hash = hash_string(key);
+
+    for (int i = index->npending - 1; i >= 0; --i) {
+        const item *it = &index->pending[i];
+        if (it->hash == hash && strcmp(it->record.key, key) == 0) {
+            *parent = it->parent;
+            *record = it->record;
+            return 1;
+        }
+    }
+    const disk_entry *e = find_entry(index, hash, key);
+    if (e == NULL || is_replaced(index, e->parent)) {
+        return 0;
+    }
+    *parent = e->parent;
+    entry_record(index, e, record);
+    return 1;
+}
+
+int meta_index_find(meta_index *index, const char *key, int64_t size, int64_t mtime,
+                    meta_record *record) {
+    uint64_t parent;
+
+    return find_live(index, key, &parent, record)
+           && record->size == size && record->mtime == mtime;
+}
+
+static int same_record(const meta_record *a, const meta_record *b) {
+    if (a->size != b->size || a->mtime != b->mtime
+        || memcmp(a->values, b->values, sizeof(a->values)) != 0) {
+        return 0;
+    }
+    for (int i = 0; i < META_STRINGS; ++i) {
+        if (!string_equal(a->strings[i], b->strings[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Whether parent already has exactly these records. */
+static int unchanged(const meta_index *index, uint64_t parent, const meta_record *records, int n) {
+    long live = 0;
+
+    if (is_replaced(index, parent)) {
+        for (int i = 0; i < index->npending; ++i) {
+            live += index->pending[i].parent == parent;
+        }
+    } else {
+        for (uint32_t i = 0; i < index->count; ++i) {
+            live += index->entries[i].parent == parent;
+        }
+    }
+    if (live != n) {
+        return 0;
+    }
+    for (int i = 0; i < n; ++i) {
+        meta_record current;
+        uint64_t current_parent;
+        if (!find_live(index, records[i].key, &current_parent, &current)
+            || current_parent != parent || !same_record(&current, &records[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static char *copy_string(const char *s, int *failed) {
+    if (s == NULL) {
+        return NULL;
+    }
+    char *copy = strdup(s);
+    if (copy == NULL) {
+        *failed = 1;
+    }
+    return copy;
+}
+
+int meta_index_put(meta_index *index, const char *parent, const meta_record *records, int n) {
+    uint64_t const parent_hash = hash_string(parent);
+
+    if (unchanged(index, parent_hash, records, n)) {
+        return 0;
+    }
+    if (grow((void **)&index->pending, &index->pending_cap, index->npending + n, sizeof(item)) < 0
+        || grow((void **)&index->replaced, &index->replaced_cap, index->nreplaced + 1,
+                sizeof(uint64_t)) < 0) {
+        return -1;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < index->npending; ++i) {
+        if (index->pending[i].parent == parent_hash) {
+            free_item(&index->pending[i]);
+        } else {
+            index->pending[kept++] = index->pending[i];
+        }
+    }
+    index->npending = kept;
+    if (!is_replaced(index, parent_hash)) {
+        index->replaced[index->nreplaced++] = parent_hash;
+    }
+    index->dirty = 1;
+
+    for (int i = 0; i < n; ++i) {
+        item *it = &index->pending[index->npending];
+        int failed = 0;
+
+        it->hash = hash_string(records[i].key);
+        it->parent = parent_hash;
+        it->record = records[i];
+        it->record.key = copy_string(records[i].key, &failed);
+        for (int s = 0; s < META_STRINGS; ++s) {
+            it->record.strings[s] = copy_string(records[i].strings[s], &failed);
+        }
+        if (failed) {
+            free_item(it);
+            return -1;
+        }
+        index->npending++;
+    }
+    return 0;
+}
+
+static int compare_items(const void *a, const void *b) {
+    const item *x = (const item *)a;
+    const item *y = (const item *)b;
+
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return strcmp(x->record.key, y->record.key);
+}
+
+static uint32_t add_string(const char *s, uint32_t *pool_size) {
+    if (s == NULL) {
+        return NO_STRING;
+    }
+    uint32_t const offset = *pool_size;
+    *pool_size += (uint32_t)strlen(s) + 1;
+    return offset;
+}
+
+static int write_items(FILE *f, const item *items, uint32_t n) {
+    disk_header header;
+    uint32_t pool_size = 0;
+
+    memcpy(header.magic, INDEX_MAGIC, 4);
+    header.version = INDEX_VERSION;
+    header.count = n;
+    for (uint32_t i = 0; i < n; ++i) {
+        add_string(items[i].record.key, &pool_size);
+        for (int s = 0; s < META_STRINGS; ++s) {
+            add_string(items[i].record.strings[s], &pool_size);
+        }
+    }
+    header.pool_size = pool_size;
+    if (fwrite(&header, sizeof(header), 1, f) != 1) {
+        return -1;
+    }
+
+    pool_size = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        const meta_record *r = &items[i].record;
+        disk_entry e;
+
+        memset(&e, 0, sizeof(e));
+        e.hash = items[i].hash;
+        e.parent = items[i].parent;
+        e.size = r->size;
+        e.mtime = r->mtime;
+        memcpy(e.values, r->values, sizeof(e.values));
+        e.key = add_string(r->key, &pool_size);
+        for (int s = 0; s < META_STRINGS; ++s) {
+            e.strings[s] = add_string(r->strings[s], &pool_size);
+        }
+        if (fwrite(&e, sizeof(e), 1, f) != 1) {
+            return -1;
+        }
+    }
+
+    for (uint32_t i = 0; i < n; ++i) {
+        const meta_record *r = &items[i].record;
+        if (fwrite(r->key, strlen(r->key) + 1, 1, f) != 1) {
+            return -1;
+        }
+        for (int s = 0; s < META_STRINGS; ++s) {
+            if (r->strings[s] != NULL && fwrite(r->strings[s], strlen(r->strings[s]) + 1, 1, f) != 1) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int meta_index_commit(meta_index *index) {
+    if (!index->dirty) {
+        return 0;
+    }
+
+    /* the records of the file that were not put again, then the puts, merged by hash */
+    size_t const total = (size_t)index->count + (size_t)index->npending;
+    item *items = (item *)malloc((total > 0 ? total : 1) * sizeof(item));
+    if (items == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    qsort(index->pending, (size_t)index->npending, sizeof(item), compare_items);
+
+    uint32_t n = 0;
+    int p = 0;
+    for (uint32_t i = 0; i <= index->count; ++i) {
+        item file_item;
+        if (i < index->count) {
+            const disk_entry *e = &index->entries[i];
+            if (is_replaced(index, e->parent)) {
+                continue;
+            }
+            file_item.hash = e->hash;
+            file_item.parent = e->parent;
+            entry_record(index, e, &file_item.record);
+        }
+        while (p < index->npending
+               && (i == index->count || compare_items(&index->pending[p], &file_item) <= 0)) {
+            if (i < index->count && compare_items(&index->pending[p], &file_item) == 0) {
+                file_item.record.key = NULL;    /* put again under another parent */
+            }
+            items[n++] = index->pending[p++];
+        }
+        if (i < index->count && file_item.record.key != NULL) {
+            items[n++] = file_item;
+        }
+    }
+
+    size_t const path_length = strlen(index->path);
+    char *tmp = (char *)malloc(path_length + 5);
+    if (tmp == NULL) {
+        free(items);
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(tmp, index->path, path_length);
+    memcpy(tmp + path_length, ".tmp", 5);
+
+    int result = -1;
+    FILE *f = fopen(tmp, "wb");
+    if (f != NULL) {
+        int failed = write_items(f, items, n) < 0 || fflush(f) != 0 || fsync(fileno(f)) < 0;
+        int saved = errno;
+        if (fclose(f) != 0 && !failed) {
+            failed = 1;
+            saved = errno;
+        }
+        if (!failed && rename(tmp, index->path) == 0) {
+            result = 0;
+        } else {
+            if (!failed) {
+                saved = errno;
+            }
+            unlink(tmp);
+            errno = saved;
+        }
+    }
+    free(items);
+    free(tmp);
+    if (result == 0) {
+        clear_pending(index);
+        map_file(index);
+    }
+    return result;
+}
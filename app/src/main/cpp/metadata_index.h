@@ -0,0 +1,58 @@
+#ifndef METADATA_INDEX_H
+#define METADATA_INDEX_H
+
+#include <stdint.h>
+
+/*
+ * Persistent index of what was read from the files of a drive (tags,
+ * durations, where the album art is), so a drive seen before does not
+ * have to be read again.
+ *
+ * A record is keyed by a document id and holds META_VALUES numbers and
+ * META_STRINGS UTF-8 strings whose meaning is up to the caller; it is
+ * only returned while the file's size and mtime match the ones it was
+ * stored with. Records belong to a parent (their directory) and are
+ * replaced a parent at a time.
+ *
+ * The file is a header, the records sorted by key hash and a string
+ * pool. It is mapped on open and searched in place; puts are kept in
+ * memory until meta_index_commit writes a new file next to the old one
+ * and renames it over. A file that is missing or does not check out is
+ * an empty index.
+ */
+
+#define META_VALUES     8
+#define META_STRINGS    4
+
+typedef struct {
+    const char *key;
+    int64_t     size;
+    int64_t     mtime;
+    int64_t     values[META_VALUES];
+    const char *strings[META_STRINGS];  /* NULL if missing */
+} meta_record;
+
+typedef struct meta_index meta_index;
+
+/* NULL only if out of memory. */
+meta_index *meta_index_open(const char *path);
+
+void meta_index_close(meta_index *index);
+
+/*
+ * 1 and the record if key is there with this size and mtime, else 0. The
+ * strings point into the index, valid until the next put or commit.
+ */
+int meta_index_find(meta_index *index, const char *key, int64_t size, int64_t mtime,
+                    meta_record *record);
+
+/*
+ * Replaces the records of parent with records[0..n); n may be 0. Puts the
+ * same records again are no change. 0, or -1 if out of memory.
+ */
+int meta_index_put(meta_index *index, const char *parent, const meta_record *records, int n);
+
+/* Writes the index out if it changed. 0, or -1 with errno. */
+int meta_index_commit(meta_index *index);
+
+#endif
@@ -0,0 +1,773 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "bitstream.h"
+#include "VbrTag.h"
+#include "tables.h"
+
+#include "mp3_stream.h"
+
+#if defined(LAME_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__) && !defined(LAME_NO_SIMD)
+#include <emmintrin.h>
+#endif
+
+#define READ_BLOCK  (64 * 1024)
+#define PEEK_SIZE   4096        /* two of the largest Layer III frames and then some */
+#define PEEK_PAD    256         /* zeros after the data, GetVbrTag reads up to ~200 bytes */
+#define WRITE_BLOCK (64 * 1024)
+#define PROBE_FRAMES 32         /* mp3_index checks this many for CBR */
+
+typedef struct {
+    int     fd;
+    long    base;               /* file offset of buf[0] */
+    long    len;                /* valid bytes in buf */
+    int     error;              /* errno of a failed read, reading stops there */
+    unsigned char buf[READ_BLOCK + PEEK_PAD];
+} reader;
+
+typedef struct {
+    int     version;            /* 1, 2 or 25 */
+    int     sample_rate;
+    int     bitrate;            /* kbps */
+    int     mode;               /* 0 stereo .. 3 mono, as in the header */
+    int     samples;
+    long    size;
+} frame_header;
+
+/* Called with every frame kept and its file offset, is_info for the Xing/Info frame. */
+typedef int (*frame_fn)(void *arg, const unsigned char *frame, long offset, long size, int is_info);
+
+/* Bytes at [off, off + n), fewer at the end of the file; *avail says how
+ * many. NULL (and *avail 0) once a read has failed, see r->error. */
+static const unsigned char *peek(reader *r, long off, long n, long *avail) {
+    if (r->error != 0) {
+        *avail = 0;
+        return NULL;
+    }
+    if (off < r->base || off + n > r->base + r->len) {
+        long got = 0;
+
+        while (got < READ_BLOCK) {
+            ssize_t const rc = pread(r->fd, r->buf + got, READ_BLOCK - got, off + got);
+            if (rc < 0 && errno == EINTR) {
+                continue;
+            }
+            if (rc < 0) {
+                r->error = errno;
+                *avail = 0;
+                return NULL;
+            }
+            if (rc == 0) {
+                break;
+            }
+            got += rc;
+        }
+        r->base = off;
+        r->len = got;
+        memset(r->buf + got, 0, PEEK_PAD);
+    }
+    *avail = r->base + r->len - off;
+    if (*avail > n) {
+        *avail = n;
+    }
+    return r->buf + (off - r->base);
+}
+
+static int parse_header(const unsigned char *h, frame_header *fh) {
+    int const version_bits = (h[1] >> 3) & 3;
+    int const bitrate_index = h[2] >> 4;
+    int const rate_index = (h[2] >> 2) & 3;
+    int const mpeg1 = version_bits == 3;
+
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0 || version_bits == 1 || ((h[1] >> 1) & 3) != 1
+        || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3 || (h[3] & 3) == 2) {
+        return 0;
+    }
+    fh->version = mpeg1 ? 1 : version_bits == 2 ? 2 : 25;
+    /* MPEG-2.5 uses the MPEG-2 bitrates, tables.c stops them at 64 kbps */
+    fh->bitrate = bitrate_table[mpeg1][bitrate_index];
+    fh->sample_rate = samplerate_table[fh->version == 25 ? 2 : mpeg1][rate_index];
+    fh->mode = h[3] >> 6;
+    fh->samples = mpeg1 ? 1152 : 576;
+    fh->size = (long)(fh->samples / 8) * fh->bitrate * 1000 / fh->sample_rate + ((h[2] >> 1) & 1);
+    return 1;
+}
+
+static mp3_info_tag info_tag_type(const unsigned char *frame, const frame_header *fh) {
+    int const offset = fh->version == 1 ? (fh->mode != 3 ? 36 : 21) : (fh->mode != 3 ? 21 : 13);
+    return frame[offset] == 'X' ? MP3_INFO_XING : MP3_INFO_INFO;
+}
+
+static int same_stream(const frame_header *a, const frame_header *b) {
+    return a->version == b->version && a->sample_rate == b->sample_rate;
+}
+
+/* Size of an ID3v2 tag at p, 0 if there is none. */
+static long id3v2_size(const unsigned char *p, long avail) {
+    if (avail < 10 || p[0] != 'I' || p[1] != 'D' || p[2] != '3' || p[3] == 0xFF || p[4] == 0xFF
+        || ((p[6] | p[7] | p[8] | p[9]) & 0x80)) {
+        return 0;
+    }
+    return 10 + (((long)p[6] << 21) | ((long)p[7] << 14) | ((long)p[8] << 7) | p[9])
+           + ((p[5] & 0x10) ? 10 : 0);
+}
+
+/* Whether a frame with header fh at p is followed by another of the same
+ * stream, or the audio ends right after it. */
+static int followed(reader *r, long p, const frame_header *fh, long end) {
+    long const next = p + fh->size;
+    frame_header nh;
+    long avail;
+    const unsigned char *b;
+
+    if (next == end) {
+        return 1;
+    }
+    if (next + 4 > end) {
+        return 0;
+    }
+    b = peek(r, next, 4, &avail);
+    return avail == 4 && parse_header(b, &nh) && same_stream(fh, &nh);
+}
+
+/*
+ * Offset of the first 11-bit frame sync (0xFF, then three set bits) in
+ * b[0, n), n - 1 if there is none, as the last byte may still start one.
+ * Most of a file is frame payload, so this is where a scan spends its time.
+ */
+static long find_sync(const unsigned char *b, long n) {
+    long i = 0;
+
+#if defined(LAME_NEON)
+    uint8x16_t const ff = vdupq_n_u8(0xFF);
+    uint8x16_t const e0 = vdupq_n_u8(0xE0);
+
+    for (; i + 17 <= n; i += 16) {
+        uint8x16_t const hit = vandq_u8(vceqq_u8(vld1q_u8(b + i), ff), vcgeq_u8(vld1q_u8(b + i + 1), e0));
+        uint8x8_t const any = vorr_u8(vget_low_u8(hit), vget_high_u8(hit));
+        if (vget_lane_u64(vreinterpret_u64_u8(any), 0) != 0) {
+            break;
+        }
+    }
+#elif defined(__SSE2__) && !defined(LAME_NO_SIMD)
+    __m128i const ff = _mm_set1_epi8((char)0xFF);
+    __m128i const e0 = _mm_set1_epi8((char)0xE0);
+
+    for (; i + 17 <= n; i += 16) {
+        __m128i const first = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i const second = _mm_loadu_si128((const __m128i *)(b + i + 1));
+        __m128i const hit = _mm_and_si128(_mm_cmpeq_epi8(first, ff),
+                                          _mm_cmpeq_epi8(_mm_max_epu8(second, e0), second));
+        int const mask = _mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i + 1 < n; ++i) {
+        if (b[i] == 0xFF && b[i + 1] >= 0xE0) {
+            return i;
+        }
+    }
+    return n > 0 ? n - 1 : 0;
+}
+
+/*
+ * Next frame from p on that is followed by another; with a lock, only
+ * frames of that stream are taken, frames of another one are counted as
+ * dropped and skipped whole. -1 if there is none before end.
+ */
+static long find_frame(reader *r, long p, long end, const frame_header *lock, frame_header *fh,
+                       mp3_stream_info *info) {
+    while (p + 4 <= end) {
+        long avail, tag, skip;
+        const unsigned char *const b = peek(r, p, PEEK_SIZE, &avail);
+
+        if (b == NULL) {
+            return -1;
+        }
+        if ((tag = id3v2_size(b, avail)) > 0) {
+            p += tag;
+            continue;
+        }
+        if ((skip = find_sync(b, avail)) > 0) {
+            p += skip;
+            continue;
+        }
+        if (parse_header(b, fh) && p + fh->size <= end && followed(r, p, fh, end)) {
+            if (lock == NULL || same_stream(lock, fh)) {
+                return p;
+            }
+            info->dropped_frames++;
+            p += fh->size;
+            continue;
+        }
+        ++p;
+    }
+    return -1;
+}
+
+/* Start and end of the audio, without leading ID3v2 and trailing APEv2 / ID3v1 tags. */
+static void audio_range(reader *r, long size, long *start, long *end) {
+    long avail, tag;
+    const unsigned char *b;
+
+    *start = 0;
+    *end = size;
+    for (;;) {
+        b = peek(r, *start, 10, &avail);
+        if ((tag = id3v2_size(b, avail)) == 0) {
+            break;
+        }
+        *start += tag;
+    }
+    if (*end - *start >= 128) {
+        b = peek(r, *end - 128, 3, &avail);
+        if (avail == 3 && !memcmp(b, "TAG", 3)) {
+            *end -= 128;
+        }
+    }
+    if (*end - *start >= 32) {
+        b = peek(r, *end - 32, 32, &avail);
+        if (avail == 32 && !memcmp(b, "APETAGEX", 8)) {
+            long const tag_size = (long)b[12] | ((long)b[13] << 8) | ((long)b[14] << 16)
+                                  | ((long)b[15] << 24);
+            long const total = tag_size + ((b[23] & 0x80) ? 32 : 0);
+            if (total > 0 && total <= *end - *start) {
+                *end -= total;
+            }
+        }
+    }
+    if (*start > *end) {
+        *start = *end;
+    }
+}
+
+static int walk(int fd, mp3_stream_info *info, frame_fn fn, void *arg) {
+    reader *r;
+    frame_header lock, fh;
+    struct stat st;
+    long start, end, p, info_bytes = 0;
+    int rc = 0;
+
+    memset(info, 0, sizeof(*info));
+    info->enc_delay = info->enc_padding = -1;
+    if (fstat(fd, &st) < 0) {
+        return -1;
+    }
+    if ((r = (reader *)malloc(sizeof(reader))) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    r->fd = fd;
+    r->base = r->len = 0;
+    r->error = 0;
+    audio_range(r, (long)st.st_size, &start, &end);
+
+    p = find_frame(r, start, end, NULL, &fh, info);
+    if (p >= 0) {
+        lock = fh;
+        info->version = fh.version;
+        info->sample_rate = fh.sample_rate;
+    }
+    while (p >= 0 && rc >= 0) {
+        long const next = p + fh.size;
+        frame_header nh;
+        const unsigned char *frame;
+        long avail, q = next;
+        int is_info = 0;
+
+        if (next > end) {
+            info->dropped_frames++;     /* truncated */
+            break;
+        }
+        if (next < end && !followed(r, p, &fh, end)) {
+            /* overlapping the next frame means broken, junk or a tag after
+             * the last frame or between two is only skipped */
+            const unsigned char *const b = peek(r, next, 10, &avail);
+            long const tag = id3v2_size(b, avail);
+            q = find_frame(r, tag > 0 ? next + tag : p + 1, end, &lock, &nh, info);
+            if (tag == 0 && q >= 0 && q < next) {
+                info->dropped_frames++;
+                p = q;
+                fh = nh;
+                continue;
+            }
+        } else if (next < end) {
+            const unsigned char *const b = peek(r, next, 4, &avail);
+            if (b == NULL) {
+                break;
+            }
+            parse_header(b, &nh);
+        }
+
+        /* GetVbrTag looks past the end of small frames */
+        frame = peek(r, p, fh.size > PEEK_PAD ? fh.size : PEEK_PAD, &avail);
+        if (frame == NULL) {
+            break;
+        }
+        if (info->frames == 0 && info->info_tag == MP3_INFO_NONE) {
+            VBRTAGDATA tag;
+            if (GetVbrTag(&tag, frame)) {
+                info->info_tag = info_tag_type(frame, &fh);
+                info->enc_delay = tag.enc_delay;
+                info->enc_padding = tag.enc_padding;
+                info_bytes = fh.size;
+                is_info = 1;
+            }
+        }
+        if (!is_info) {
+            if (info->frames == 0 || fh.bitrate < info->min_bitrate) {
+                info->min_bitrate = fh.bitrate;
+            }
+            if (fh.bitrate > info->max_bitrate) {
+                info->max_bitrate = fh.bitrate;
+            }
+            info->channel_modes |= 1 << fh.mode;
+            info->frames++;
+            info->samples += fh.samples;
+            info->audio_bytes += fh.size;
+        }
+        if (fn != NULL) {
+            rc = fn(arg, frame, p, fh.size, is_info);
+        }
+
+        p = q < end ? q : -1;
+        fh = nh;
+    }
+    info->skipped_bytes = (long)st.st_size - info->audio_bytes - info_bytes;
+    if (r->error != 0) {
+        errno = r->error;
+        rc = -1;
+    }
+    free(r);
+    return rc < 0 ? -1 : 0;
+}
+
+int mp3_scan(int fd, mp3_stream_info *info) {
+    return walk(fd, info, NULL, NULL);
+}
+
+/*
+ * Frames of a stream without Xing/Info frame from its first frame at p
+ * (header fh) to end, if the first PROBE_FRAMES all have fh's bitrate
+ * and follow one another; 0 if they do not, -1 on a read error. Past the
+ * probe, the count comes from the size of the audio: the frame size if
+ * no probed frame was padded or all were, the average (which the padding
+ * bit keeps) otherwise.
+ */
+static long cbr_frames(reader *r, long p, long end, const frame_header *fh) {
+    long const unpadded = (long)(fh->samples / 8) * fh->bitrate * 1000 / fh->sample_rate;
+    long q = p;
+    int padded = 0;
+
+    for (int i = 0; i < PROBE_FRAMES; ++i) {
+        frame_header h;
+        long avail;
+        const unsigned char *const b = peek(r, q, 4, &avail);
+
+        if (b == NULL) {
+            return -1;
+        }
+        if (avail < 4 || !parse_header(b, &h) || !same_stream(fh, &h) || h.bitrate != fh->bitrate
+            || q + h.size > end) {
+            return 0;
+        }
+        padded += h.size > unpadded;
+        q += h.size;
+        if (q == end) {
+            return i + 1;
+        }
+    }
+    if (padded == 0) {
+        return (end - p) / unpadded;
+    }
+    if (padded == PROBE_FRAMES) {
+        return (end - p) / (unpadded + 1);
+    }
+    return (long)((double)(end - p) * 8 * fh->sample_rate / ((double)fh->samples * fh->bitrate * 1000) + 0.5);
+}
+
+int mp3_index(int fd, mp3_index_info *index) {
+    reader *r;
+    frame_header fh;
+    mp3_stream_info info;
+    VBRTAGDATA tag;
+    struct stat st;
+    long start, end, p, cbr = 0;
+    int tagged = 0;
+
+    memset(index, 0, sizeof(*index));
+    index->enc_delay = index->enc_padding = -1;
+    if (fstat(fd, &st) < 0) {
+        return -1;
+    }
+    if ((r = (reader *)malloc(sizeof(reader))) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    r->fd = fd;
+    r->base = r->len = 0;
+    r->error = 0;
+    audio_range(r, (long)st.st_size, &start, &end);
+    p = find_frame(r, start, end, NULL, &fh, &info);
+    if (p >= 0) {
+        long avail;
+        const unsigned char *const frame = peek(r, p, fh.size > PEEK_PAD ? fh.size : PEEK_PAD, &avail);
+
+        /* a file cut short after encoding falls back to the walk */
+        int const has_tag = frame != NULL && GetVbrTag(&tag, frame);
+        tagged = has_tag && (tag.flags & FRAMES_FLAG) && tag.frames > 0
+                 && (!(tag.flags & BYTES_FLAG) || tag.bytes <= end - p);
+        if (tagged) {
+            index->vbr = info_tag_type(frame, &fh) == MP3_INFO_XING;
+        } else if (frame != NULL && !has_tag) {
+            cbr = cbr_frames(r, p, end, &fh);
+        }
+    }
+    if (r->error != 0) {
+        errno = r->error;
+        free(r);
+        return -1;
+    }
+    free(r);
+
+    if (tagged) {
+        index->version = fh.version;
+        index->sample_rate = fh.sample_rate;
+        index->frames = tag.frames;
+        index->samples = (long)tag.frames * fh.samples;
+        index->bitrate = index->vbr && (tag.flags & BYTES_FLAG) && tag.bytes > fh.size
+            ? (int)((double)(tag.bytes - fh.size) * 8 * fh.sample_rate / index->samples / 1000 + 0.5)
+            : fh.bitrate;
+        index->enc_delay = tag.enc_delay;
+        index->enc_padding = tag.enc_padding;
+        index->from_tag = 1;
+    } else if (cbr > 0) {
+        index->version = fh.version;
+        index->sample_rate = fh.sample_rate;
+        index->bitrate = fh.bitrate;
+        index->frames = cbr;
+        index->samples = cbr * fh.samples;
+    } else {
+        if (mp3_scan(fd, &info) < 0) {
+            return -1;
+        }
+        index->version = info.version;
+        index->sample_rate = info.sample_rate;
+        index->vbr = info.min_bitrate != info.max_bitrate || info.info_tag == MP3_INFO_XING;
+        index->frames = info.frames;
+        index->samples = info.samples;
+        index->bitrate = index->vbr && info.samples > 0
+            ? (int)((double)info.audio_bytes * 8 * info.sample_rate / info.samples / 1000 + 0.5)
+            : info.min_bitrate;
+        index->enc_delay = info.enc_delay;
+        index->enc_padding = info.enc_padding;
+    }
+    if (index->enc_delay >= 0 && index->enc_padding >= 0
+        && index->samples > index->enc_delay + index->enc_padding) {
+        index->samples -= index->enc_delay + index->enc_padding;
+    }
+    if (index->sample_rate > 0) {
+        index->duration_ms = (long)((double)index->samples * 1000 / index->sample_rate + 0.5);
+    }
+    return 0;
+}
+
+unsigned mp3_check(const mp3_stream_info *info, const mp3_constraints *constraints) {
+    unsigned result = 0;
+
+    if (info->frames == 0) {
+        return MP3_NO_AUDIO;
+    }
+    if (constraints->cbr
+        && (info->min_bitrate != info->max_bitrate || info->info_tag == MP3_INFO_XING)) {
+        result |= MP3_NOT_CBR;
+    }
+    if (info->sample_rate < constraints->min_sample_rate
+        || (constraints->max_sample_rate > 0 && info->sample_rate > constraints->max_sample_rate)) {
+        result |= MP3_SAMPLE_RATE;
+    }
+    if (constraints->channel_modes != 0 && (info->channel_modes & ~constraints->channel_modes)) {
+        result |= MP3_CHANNEL_MODE;
+    }
+    if (constraints->max_bitrate > 0 && info->max_bitrate > constraints->max_bitrate) {
+        result |= MP3_BITRATE;
+    }
+    if (constraints->max_dropped_permille >= 0
+        && info->dropped_frames * 1000 > info->frames * (long)constraints->max_dropped_permille) {
+        result |= MP3_DAMAGED;
+    }
+    return result;
+}
+
+typedef struct {
+    int     fd;
+    int     keep_info;
+    long    written;
+    long    len;
+    unsigned char buf[WRITE_BLOCK];
+} writer;
+
+static int write_all(int fd, const unsigned char *data, long size) {
+    while (size > 0) {
+        ssize_t const rc = write(fd, data, (size_t)size);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return -1;
+        }
+        data += rc;
+        size -= rc;
+    }
+    return 0;
+}
+
+static int put(writer *w, const unsigned char *data, long size) {
+    if (w->len + size > WRITE_BLOCK) {
+        if (write_all(w->fd, w->buf, w->len) < 0) {
+            return -1;
+        }
+        w->len = 0;
+    }
+    if (size > WRITE_BLOCK) {
+        if (write_all(w->fd, data, size) < 0) {
+            return -1;
+        }
+    } else {
+        memcpy(w->buf + w->len, data, (size_t)size);
+        w->len += size;
+    }
+    w->written += size;
+    return 0;
+}
+
+static int put_frame(void *arg, const unsigned char *frame, long offset, long size, int is_info) {
+    writer *const w = (writer *)arg;
+    (void)offset;
+    return is_info && !w->keep_info ? 0 : put(w, frame, size);
+}
+
+long mp3_remux(int in_fd, int out_fd, long dropped_frames, const unsigned char *tag, long tag_size) {
+    mp3_stream_info info;
+    writer *w;
+    long written = -1;
+
+    /* a first pass tells whether the Info frame still holds */
+    if (dropped_frames < 0) {
+        if (mp3_scan(in_fd, &info) < 0) {
+            return -1;
+        }
+        dropped_frames = info.dropped_frames;
+    }
+    if ((w = (writer *)malloc(sizeof(writer))) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    w->fd = out_fd;
+    w->keep_info = dropped_frames == 0;
+    w->written = w->len = 0;
+    if ((tag == NULL || put(w, tag, tag_size) == 0)
+        && walk(in_fd, &info, put_frame, w) == 0
+        && write_all(out_fd, w->buf, w->len) == 0) {
+        written = w->written;
+    }
+    free(w);
+    return written;
+}
+
+typedef struct {
+    int     fd;
+    int     steps;
+    long    frames;             /* edited */
+    uint16_t old_crc;           /* LAME music CRC of the frames as they were */
+    uint16_t new_crc;           /* and as they are written */
+    long    info_offset;        /* of the Xing/Info frame, -1 if none */
+    long    info_size;
+    unsigned char info[PEEK_SIZE];
+    long    base;               /* file offset of buf[0] */
+    long    len;
+    unsigned char buf[WRITE_BLOCK];
+} gain_editor;
+
+/*
+ * Where the global_gain fields of a frame are: bit offsets in the side info
+ * of the first one and between two, as ISO 11172-3 / 13818-3 lay out the
+ * granule/channel blocks (gr_info in l3side.h). 8 bits each.
+ */
+static void gain_fields(const frame_header *fh, int *side_bytes, int *first, int *stride, int *count) {
+    int const mono = fh->mode == 3;
+
+    if (fh->version == 1) {
+        *side_bytes = mono ? 17 : 32;
+        *first = (mono ? 18 : 20) + 21;     /* main_data_begin, private_bits, scfsi */
+        *stride = 59;
+        *count = mono ? 2 : 4;
+    } else {
+        *side_bytes = mono ? 9 : 17;
+        *first = (mono ? 9 : 10) + 21;
+        *stride = 63;
+        *count = mono ? 1 : 2;
+    }
+}
+
+static int pwrite_all(int fd, const unsigned char *data, long size, long offset) {
+    while (size > 0) {
+        ssize_t const rc = pwrite(fd, data, (size_t)size, offset);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return -1;
+        }
+        data += rc;
+        size -= rc;
+        offset += rc;
+    }
+    return 0;
+}
+
+static int flush_gain(gain_editor *g) {
+    int const rc = pwrite_all(g->fd, g->buf, g->len, g->base);
+    g->len = 0;
+    return rc;
+}
+
+static int edit_frame(void *arg, const unsigned char *frame, long offset, long size, int is_info) {
+    gain_editor *const g = (gain_editor *)arg;
+    frame_header fh;
+    unsigned char *out, *side;
+    int side_bytes, first, stride, count;
+
+    if (is_info) {
+        if (size <= (long)sizeof(g->info)) {
+            memcpy(g->info, frame, (size_t)size);
+            g->info_offset = offset;
+            g->info_size = size;
+        }
+        return 0;
+    }
+    /* runs of adjacent frames go back in one pwrite */
+    if (g->len > 0 && (offset != g->base + g->len || g->len + size > WRITE_BLOCK)) {
+        if (flush_gain(g) < 0) {
+            return -1;
+        }
+    }
+    if (g->len == 0) {
+        g->base = offset;
+    }
+    out = g->buf + g->len;
+    memcpy(out, frame, (size_t)size);
+    g->len += size;
+    UpdateMusicCRC(&g->old_crc, frame, (int)size);
+
+    parse_header(out, &fh);
+    gain_fields(&fh, &side_bytes, &first, &stride, &count);
+    side = out + ((out[1] & 1) ? 4 : 6);       /* protection bit clear: a CRC follows the header */
+    for (int k = 0; k < count; ++k) {
+        int const bit = first + k * stride;
+        int const shift = 8 - (bit & 7);
+        unsigned char *const b = side + (bit >> 3);
+        unsigned window = ((unsigned)b[0] << 8) | b[1];
+        int gain = (int)((window >> shift) & 0xFF) + g->steps;
+
+        gain = gain < 0 ? 0 : gain > 255 ? 255 : gain;
+        window = (window & ~(0xFFu << shift)) | ((unsigned)gain << shift);
+        b[0] = (unsigned char)(window >> 8);
+        b[1] = (unsigned char)window;
+    }
+    if (!(out[1] & 1)) {
+        CRC_writeframe(out, 6 + side_bytes);
+    }
+    UpdateMusicCRC(&g->new_crc, out, (int)size);
+    g->frames++;
+    return 0;
+}
+
+/*
+ * Brings the LAME extension of the Info frame up to date: its music CRC,
+ * if it held for the frames before, and the MP3 Gain byte, which counts
+ * the steps applied since encoding. Tags whose CRC does not check are not
+ * LAME's and are left alone.
+ */
+static int update_lame_tag(gain_editor *g) {
+    frame_header fh;
+    unsigned char *const f = g->info;
+    long p;
+    int flags, gain;
+    uint16_t crc = 0;
+
+    /* "Xing"/"Info", flags, the fields they announce, then LAME's 36 bytes */
+    parse_header(f, &fh);
+    p = (fh.version == 1 ? (fh.mode != 3 ? 36 : 21) : (fh.mode != 3 ? 21 : 13)) + 4;
+    if (p + 4 > g->info_size) {
+        return 0;
+    }
+    flags = (f[p] << 24) | (f[p + 1] << 16) | (f[p + 2] << 8) | f[p + 3];
+    p += 4 + ((flags & FRAMES_FLAG) ? 4 : 0) + ((flags & BYTES_FLAG) ? 4 : 0)
+         + ((flags & TOC_FLAG) ? NUMTOCENTRIES : 0) + ((flags & VBR_SCALE_FLAG) ? 4 : 0);
+    if (p + 36 > g->info_size) {
+        return 0;
+    }
+    UpdateMusicCRC(&crc, f, (int)(p + 34));
+    if (crc != ((f[p + 34] << 8) | f[p + 35])) {
+        return 0;
+    }
+    if (((f[p + 32] << 8) | f[p + 33]) == g->old_crc) {
+        f[p + 32] = (unsigned char)(g->new_crc >> 8);
+        f[p + 33] = (unsigned char)g->new_crc;
+    }
+    gain = (signed char)f[p + 25] + g->steps;
+    f[p + 25] = (unsigned char)(gain < -128 ? -128 : gain > 127 ? 127 : gain);
+    crc = 0;
+    UpdateMusicCRC(&crc, f, (int)(p + 34));
+    f[p + 34] = (unsigned char)(crc >> 8);
+    f[p + 35] = (unsigned char)crc;
+    return pwrite_all(g->fd, f + p, 36, g->info_offset + p);
+}
+
+long mp3_gain(int fd, int steps) {
+    mp3_stream_info info;
+    gain_editor *g;
+    long edited = -1;
+
+    if (steps < -255 || steps > 255) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (steps == 0) {
+        return 0;
+    }
+    if ((g = (gain_editor *)malloc(sizeof(gain_editor))) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    g->fd = fd;
+    g->steps = steps;
+    g->frames = 0;
+    g->old_crc = g->new_crc = 0;
+    g->info_offset = -1;
+    g->len = 0;
+    if (walk(fd, &info, edit_frame, g) == 0 && flush_gain(g) == 0
+        && (g->info_offset < 0 || update_lame_tag(g) == 0)) {
+        edited = g->frames;
+    }
+    free(g);
+    return edited;
+}
@@ -0,0 +1,118 @@
+#ifndef MP3_STREAM_H
+#define MP3_STREAM_H
+
+/*
+ * MPEG audio Layer III streams as they come from the user's library:
+ * validation, constraint checks and a clean frame-by-frame copy, so MP3
+ * sources that already suit the player can skip decoding and re-encoding,
+ * and lossless volume changes in place.
+ *
+ * A frame counts when the next one follows right where its header says
+ * it ends (or the audio ends there). Everything else - ID3v2 tags, also
+ * ones in the middle, a trailing ID3v1 or APEv2 tag, junk, truncated or
+ * broken frames, frames of a different MPEG version or sample rate than
+ * the first one - is skipped. A Xing/Info frame is parsed with GetVbrTag
+ * and not counted as audio.
+ *
+ * Files are read through pread in 64 KiB blocks, and the frame sync is
+ * searched with NEON or SSE2 where there is one.
+ */
+
+#define MP3_MODE_STEREO         (1 << 0)
+#define MP3_MODE_JOINT_STEREO   (1 << 1)
+#define MP3_MODE_DUAL_CHANNEL   (1 << 2)
+#define MP3_MODE_MONO           (1 << 3)
+
+typedef enum {
+    MP3_INFO_NONE = 0,
+    MP3_INFO_XING,              /* VBR */
+    MP3_INFO_INFO               /* CBR, as LAME writes it */
+} mp3_info_tag;
+
+typedef struct {
+    int     version;            /* 1 MPEG-1, 2 MPEG-2, 25 MPEG-2.5; 0 if no frame */
+    int     sample_rate;
+    int     channel_modes;      /* MP3_MODE_* of all frames */
+    int     min_bitrate;        /* kbps */
+    int     max_bitrate;
+    long    frames;             /* audio frames, without the Xing/Info frame */
+    long    samples;            /* per channel, frames * 1152 or 576 */
+    long    audio_bytes;        /* of those frames */
+    long    dropped_frames;     /* broken or foreign frames */
+    long    skipped_bytes;      /* tags, junk, dropped frames */
+    mp3_info_tag info_tag;
+    int     enc_delay;          /* from the Info frame, -1 if unknown */
+    int     enc_padding;
+} mp3_stream_info;
+
+/* Limits of 0 are left out, but for max_dropped_permille -1 is. */
+typedef struct {
+    int     cbr;                /* all frames at one bitrate, no Xing frame */
+    int     min_sample_rate;
+    int     max_sample_rate;
+    int     channel_modes;      /* MP3_MODE_* allowed */
+    int     max_bitrate;        /* kbps */
+    int     max_dropped_permille;   /* of the frames */
+} mp3_constraints;
+
+/* mp3_check result, 0 if the stream conforms */
+#define MP3_NO_AUDIO            (1 << 0)
+#define MP3_NOT_CBR             (1 << 1)
+#define MP3_SAMPLE_RATE         (1 << 2)
+#define MP3_CHANNEL_MODE        (1 << 3)
+#define MP3_BITRATE             (1 << 4)
+#define MP3_DAMAGED             (1 << 5)
+
+typedef struct {
+    int     version;            /* as in mp3_stream_info */
+    int     sample_rate;
+    int     vbr;                /* Xing frame, or more than one bitrate */
+    int     bitrate;            /* kbps, the average for VBR */
+    long    frames;
+    long    samples;            /* per channel, less encoder delay and padding if known */
+    long    duration_ms;
+    int     enc_delay;          /* -1 if unknown */
+    int     enc_padding;
+    int     from_tag;           /* counts from the Xing/Info frame, not estimated or walked */
+} mp3_index_info;
+
+/* Reads fd from its start to the end; 0, or -1 with errno on a read error
+ * (info then holds what was read up to it). */
+int mp3_scan(int fd, mp3_stream_info *info);
+
+/*
+ * Duration of the MP3 at fd. A Xing/Info frame with a frame count is taken
+ * at its word and the rest of the file is not read. Without one, a stream
+ * whose first frames are all at one bitrate is taken as CBR and its frames
+ * are counted from the size of the audio (less leading ID3v2 and trailing
+ * ID3v1/APEv2 tags), which is exact unless there is junk in between; only
+ * other streams have all frames walked as in mp3_scan. 0, or -1 with errno
+ * on a read error.
+ */
+int mp3_index(int fd, mp3_index_info *index);
+
+unsigned mp3_check(const mp3_stream_info *info, const mp3_constraints *constraints);
+
+/*
+ * Writes tag (may be NULL), then the frames of in_fd to out_fd; the
+ * Xing/Info frame is kept only if no frame was dropped, as its counts
+ * would be off otherwise. dropped_frames is that count from an mp3_scan
+ * of in_fd already done, -1 to have it scanned first. Both fds are used
+ * from offset 0 / their current position. Returns the bytes written, or
+ * -1 with errno, also if in_fd could not be read to its end.
+ */
+long mp3_remux(int in_fd, int out_fd, long dropped_frames, const unsigned char *tag, long tag_size);
+
+/*
+ * Makes the MP3 at fd louder or quieter by steps of 1.5 dB, in place and
+ * without decoding: the global_gain of every granule of every frame
+ * kept by the walk is shifted by steps (and held within 0..255), frame
+ * CRCs are redone, and a LAME Info frame gets its music CRC and MP3 Gain
+ * byte updated. fd must be open for reading and writing; runs of frames
+ * are written back through pwrite. Returns the frames edited, or -1 with
+ * errno (EINVAL if steps is outside -255..255); after a read error the
+ * frames before it are edited already.
+ */
+long mp3_gain(int fd, int steps);
+
+#endif
@@ -3,8 +3,11 @@ package com.example.tonuinoaudiomanager
 import android.content.ContentResolver
 import android.net.Uri
 import android.os.ParcelFileDescriptor
+import com.github.axet.lamejni.AsyncWriter
 import java.io.BufferedOutputStream
+import java.io.IOException
 import java.io.OutputStream
+import java.nio.ByteBuffer
 
 const val SYNCED_OUTPUT_BUFFER_SIZE = 256 * 1024
 
@@ -26,3 +29,59 @@ inline fun <T> ContentResolver.withSyncedOutputStream(
         output.close()
     }
 }
+
+// Like withSyncedOutputStream, but block's writes are handed to an
+// AsyncWriter, which writes the file on a native thread, so a slow drive
+// stalls the encoder only once the writer's ring is full.
+inline fun <T> ContentResolver.withAsyncOutputStream(
+    targetUri: Uri,
+    mode: String = "w",
+    onUnavailable: () -> Throwable = { IllegalStateException("Stream unavailable") },
+    block: (AsyncWriterOutputStream) -> T
+): T {
+    val pfd = openFileDescriptor(targetUri, mode) ?: throw onUnavailable()
+    val writer = AsyncWriter()
+    val opened = writer.open(pfd.detachFd())
+    if (opened < 0) throw IOException("Cannot write $targetUri: errno ${-opened}")
+    return try {
+        val result = block(AsyncWriterOutputStream(writer))
+        val written = writer.finish(true)
+        if (written < 0) throw IOException("Failed to write $targetUri: errno ${-written}")
+        result
+    } finally {
+        writer.close()
+    }
+}
+
+class AsyncWriterOutputStream(private val writer: AsyncWriter) : OutputStream() {
+    private val single = ByteArray(1)
+
+    // Preallocates bytes more of the file; false if the drive cannot
+    fun reserve(bytes: Long): Boolean = writer.reserve(bytes) == 0
+
+    // Queues an ID3 tag as Id3Writer.write builds it; returns its size or -errno
+    fun writeId3Tag(
+        ids: Array<String>,
+        texts: Array<String?>,
+        pictureMime: String?,
+        pictureFd: Int,
+        picture: LongArray?,
+        pictureData: ByteBuffer?
+    ): Long = writer.writeId3Tag(ids, texts, pictureMime, pictureFd, picture, pictureData)
+
+    // Overwrites offset with data once everything is written
+    fun patch(offset: Long, data: ByteArray) {
+        val result = writer.patch(offset, data)
+        if (result < 0) throw IOException("Patch failed: errno ${-result}")
+    }
+
+    override fun write(b: Int) {
+        single[0] = b.toByte()
+        write(single, 0, 1)
+    }
+
+    override fun write(b: ByteArray, off: Int, len: Int) {
+        val result = writer.write(b, off, len)
+        if (result < 0) throw IOException("Write failed: errno ${-result}")
+    }
+}
@@ -17,11 +17,16 @@ import android.nfc.Tag
 import android.os.Bundle
 import android.os.Environment
 import android.os.Looper
+import android.os.ParcelFileDescriptor
+import android.os.StatFs
 import android.os.SystemClock
 import android.os.storage.StorageManager
 import android.os.storage.StorageVolume
 import android.provider.DocumentsContract
 import android.provider.OpenableColumns
+import android.text.format.Formatter
+import android.system.Os
+import android.system.OsConstants
 import android.view.Menu
 import android.view.MenuItem
 import android.util.Log
@@ -38,11 +43,16 @@ import androidx.recyclerview.widget.RecyclerView
 import com.example.tonuinoaudiomanager.databinding.ActivityMainBinding
 import com.example.tonuinoaudiomanager.databinding.BottomSheetItemActionsBinding
 import com.example.tonuinoaudiomanager.nfc.NfcIntentHelper
+import com.github.axet.lamejni.FileCopy
+import com.github.axet.lamejni.Id3Reader
+import com.github.axet.lamejni.Mp3Stream
 import com.google.android.material.bottomsheet.BottomSheetDialog
 import com.google.android.material.color.DynamicColors
 import com.google.android.material.dialog.MaterialAlertDialogBuilder
 import com.google.android.material.snackbar.Snackbar
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.delay
 import kotlinx.coroutines.launch
 import kotlinx.coroutines.withContext
 import kotlin.math.ceil
@@ -54,6 +64,8 @@ class MainActivity : AppCompatActivity() {
     private lateinit var storageManager: StorageManager
     private val directoryStack = ArrayDeque<DocumentFile>()
     private val fileCache = FileCache()
+    @Volatile
+    private var metadataStore: MetadataStore? = null
     private val fileAdapter = UsbFileAdapter(
         onDirectoryClick = { directory ->
             navigateIntoDirectory(directory)
@@ -209,6 +221,7 @@ class MainActivity : AppCompatActivity() {
 
     override fun onDestroy() {
         itemActionsSheet?.dismiss()
+        metadataStore?.close()
         super.onDestroy()
         unregisterReceiver(storageBroadcastReceiver)
         storageManager.unregisterStorageVolumeCallback(volumeCallback)
@@ -363,6 +376,7 @@ class MainActivity : AppCompatActivity() {
             val rootDocument = rootResult.getOrNull()
             directoryStack.clear()
             fileCache.clearAll()
+            openMetadataStore(rootUri)
 
             if (rootDocument == null) {
                 showLoading(false)
@@ -377,6 +391,16 @@ class MainActivity : AppCompatActivity() {
         }
     }
 
+    // One index file per drive, see MetadataStore
+    private suspend fun openMetadataStore(treeUri: Uri) {
+        if (metadataStore?.treeUri == treeUri) return
+        val store = withContext(Dispatchers.IO) {
+            runCatching { MetadataStore(this@MainActivity, treeUri) }.getOrNull()
+        }
+        metadataStore?.close()
+        metadataStore = store
+    }
+
     private fun showDirectory(directory: DocumentFile) {
         setActionsExpanded(false)
         val loadToken = beginDirectoryLoading()
@@ -436,6 +460,7 @@ class MainActivity : AppCompatActivity() {
             return cached
         }
         val children = getDirectoryChildren(directory)
+        prefetchMetadata(children.filter { it.isFile && it.name?.endsWith(".mp3", ignoreCase = true) == true })
         val entries = ArrayList<UsbFile>(children.size)
         for (child in children) {
             val isAllowed = isAllowedEntry(child, isRoot, isChildOfRoot)
@@ -469,6 +494,12 @@ class MainActivity : AppCompatActivity() {
                 )
             }
         }
+        metadataStore?.let { store ->
+            if (isChildOfRoot) {
+                store.putTracks(directory, indexedTracks(getSummaryFiles(directory)))
+            }
+            store.commit()
+        }
         return entries.sortedWith(compareBy({ !it.document.isDirectory }, { it.document.name ?: "" }))
             .also { fileCache.putEntries(cacheKey, it) }
     }
@@ -498,14 +529,47 @@ class MainActivity : AppCompatActivity() {
         return if (basePath.isBlank()) segment else "$basePath/$segment"
     }
 
+    private fun invalidateDirectory(directory: DocumentFile) {
+        fileCache.invalidateDirectory(directory)
+        metadataStore?.invalidate(directory)
+    }
+
     private fun getDirectoryChildren(directory: DocumentFile): List<DocumentFile> {
         return fileCache.getDirectory(directory) ?: directory.listFiles().toList().also {
             fileCache.putDirectory(directory, it)
+            metadataStore?.loadStamps(directory)
         }
     }
 
     private fun getMetadataCached(file: DocumentFile): AudioMetadata? {
-        return fileCache.getOrPutMetadata(file) { extractMetadata(file) }
+        if (!fileCache.hasMetadata(file)) {
+            prefetchMetadata(listOf(file))
+        }
+        return fileCache.getMetadata(file)
+    }
+
+    // Tags of the files not cached yet: from the metadata index where it still
+    // has them, the rest read METADATA_BATCH_SIZE per native call
+    private fun prefetchMetadata(files: List<DocumentFile>) {
+        val store = metadataStore
+        val unindexed = ArrayList<DocumentFile>()
+        for (file in files.filter { !fileCache.hasMetadata(it) }) {
+            val tags = store?.findTags(file)
+            if (tags == null) {
+                unindexed.add(file)
+            } else {
+                fileCache.putTrack(file, tags, toAudioMetadata(tags, openAlbumArt(file.uri, tags)))
+            }
+        }
+        for (batch in unindexed.chunked(METADATA_BATCH_SIZE)) {
+            readTags(batch) { file, tags, albumArt ->
+                fileCache.putTrack(file, tags, tags?.let { toAudioMetadata(it, albumArt) })
+            }
+        }
+    }
+
+    private fun indexedTracks(files: List<DocumentFile>): List<Pair<DocumentFile, TrackTags>> {
+        return files.mapNotNull { file -> fileCache.getTags(file)?.let { file to it } }
     }
 
     private fun getDirectorySummaryCached(
@@ -519,6 +583,11 @@ class MainActivity : AppCompatActivity() {
             }
             return summary
         }
+        metadataStore?.findSummary(directory)?.let { indexed ->
+            progressReporter?.onFiles(basePath, indexed.trackCount)
+            return toDirectorySummary(indexed)
+                .also { fileCache.putDirectorySummary(directory, it) }
+        }
         return collectDirectorySummary(directory, basePath, progressReporter)
             .also { fileCache.putDirectorySummary(directory, it) }
     }
@@ -648,6 +717,11 @@ class MainActivity : AppCompatActivity() {
             onUpdate(processedFiles, totalFiles, path)
         }
 
+        fun onFiles(path: String, count: Int) {
+            processedFiles += count
+            onUpdate(processedFiles, totalFiles, path)
+        }
+
         fun onFolder(path: String) {
             onUpdate(processedFiles, totalFiles, path)
         }
@@ -941,7 +1015,7 @@ class MainActivity : AppCompatActivity() {
         showLoading(false)
 
         if (created != null) {
-            fileCache.invalidateDirectory(targetDirectory)
+            invalidateDirectory(targetDirectory)
             directoryStack.add(created)
             showDirectory(created)
         } else {
@@ -995,6 +1069,14 @@ class MainActivity : AppCompatActivity() {
                 showTrackLimitDialog()
                 return@launch
             }
+            val spaceShortfall = withContext(Dispatchers.IO) {
+                findSpaceShortfall(pickedFiles)
+            }
+            if (spaceShortfall != null) {
+                showLoading(false)
+                showDriveFullDialog(spaceShortfall.first, spaceShortfall.second)
+                return@launch
+            }
             val totalFiles = pickedFiles.size
             var completedFiles = 0
             var successCount = 0
@@ -1116,7 +1198,11 @@ class MainActivity : AppCompatActivity() {
                             var bytesCopied = 0L
                             try {
                                 if (needsTranscode) {
-                                    audioConverter.convertToMp3(uri, createdFile.uri) { progress ->
+                                    audioConverter.convertToMp3(
+                                        uri,
+                                        createdFile.uri,
+                                        allowPassthrough = isMp3File(displayName, mimeType)
+                                    ) { progress ->
                                         val fileSize = picked.sizeBytes ?: 0L
                                         val bytesSoFar = completedBytesActual +
                                                 (fileSize.toDouble() * progress.toDouble()).toLong()
@@ -1213,10 +1299,10 @@ class MainActivity : AppCompatActivity() {
             }
 
             if (successCount > 0) {
-                fileCache.invalidateDirectory(targetDirectory)
+                invalidateDirectory(targetDirectory)
                 directoryStack.firstOrNull()
                     ?.takeIf { it != targetDirectory }
-                    ?.let { fileCache.invalidateDirectory(it) }
+                    ?.let { invalidateDirectory(it) }
                 directoryStack.lastOrNull()?.let { showDirectory(it) }
             }
 
@@ -1407,6 +1493,8 @@ class MainActivity : AppCompatActivity() {
                             error("Rename failed")
                         }
                     }
+                    // renamed files keep their size and mtime, so their old records would still match
+                    metadataStore?.invalidate(directory)
                 }
             }
             showLoading(false)
@@ -1529,13 +1617,13 @@ class MainActivity : AppCompatActivity() {
             showLoading(false)
 
             if (deleteResult.getOrDefault(false)) {
-                fileCache.invalidateDirectory(parentDirectory)
+                invalidateDirectory(parentDirectory)
                 if (target.document.isDirectory) {
-                    fileCache.invalidateDirectory(target.document)
+                    invalidateDirectory(target.document)
                 }
                 directoryStack.firstOrNull()
                     ?.takeIf { it != parentDirectory }
-                    ?.let { fileCache.invalidateDirectory(it) }
+                    ?.let { invalidateDirectory(it) }
                 showDirectory(parentDirectory)
                 showSnackbar(getString(R.string.delete_success))
             } else {
@@ -1681,12 +1769,14 @@ class MainActivity : AppCompatActivity() {
     ): DirectorySummary {
         return runCatching {
             val mp3Files = getSummaryFiles(directory)
+            prefetchMetadata(mp3Files)
             val metadataByTrack = mp3Files.map { file ->
                 progressReporter?.onFile(appendRelativePath(basePath, file.name))
                 file to getMetadataCached(file)
             }
             val firstMetadata = metadataByTrack.firstOrNull { it.second != null }?.second
-            val albumArt = metadataByTrack.firstOrNull { it.second?.albumArt != null }?.second?.albumArt
+            val albumArtTrack = metadataByTrack.firstOrNull { it.second?.albumArt != null }
+            val albumArt = albumArtTrack?.second?.albumArt
             val distinctAlbums = metadataByTrack.mapNotNull { it.second }
                 .map { it.artist to it.album }
                 .distinct()
@@ -1699,14 +1789,71 @@ class MainActivity : AppCompatActivity() {
                 artist = firstMetadata?.artist,
                 albumArt = albumArt,
                 trackCount = mp3Files.size,
+                durationMs = mp3Files.sumOf { trackDurationMs(it) },
                 otherAlbumCount = (distinctAlbums.size - 1).coerceAtLeast(0),
                 otherArtistCount = (distinctArtists.size - 1).coerceAtLeast(0)
-            )
+            ).also { summary ->
+                metadataStore?.let { store ->
+                    val pictureTags = albumArtTrack?.first?.let { fileCache.getTags(it) }
+                    store.putTracks(directory, indexedTracks(mp3Files))
+                    store.putSummary(
+                        directory,
+                        IndexedSummary(
+                            album = summary.album,
+                            artist = summary.artist,
+                            pictureDocumentId = albumArtTrack?.first
+                                ?.let { DocumentsContract.getDocumentId(it.uri) },
+                            pictureOffset = pictureTags?.pictureOffset ?: -1,
+                            pictureBytes = pictureTags?.pictureBytes ?: 0,
+                            trackCount = summary.trackCount,
+                            durationMs = summary.durationMs,
+                            otherAlbumCount = summary.otherAlbumCount,
+                            otherArtistCount = summary.otherArtistCount
+                        )
+                    )
+                }
+            }
         }.getOrElse {
             DirectorySummary()
         }
     }
 
+    private fun toDirectorySummary(indexed: IndexedSummary): DirectorySummary {
+        val albumArt = indexed.pictureDocumentId?.let { documentId ->
+            metadataStore?.documentUri(documentId)?.let { uri ->
+                val tags = TrackTags(pictureOffset = indexed.pictureOffset, pictureBytes = indexed.pictureBytes)
+                openAlbumArt(uri, tags)
+            }
+        }
+        return DirectorySummary(
+            album = indexed.album,
+            artist = indexed.artist,
+            albumArt = albumArt,
+            trackCount = indexed.trackCount,
+            durationMs = indexed.durationMs,
+            otherAlbumCount = indexed.otherAlbumCount,
+            otherArtistCount = indexed.otherArtistCount
+        )
+    }
+
+    // Kept with the tags, so the index has it for the next time
+    private fun trackDurationMs(file: DocumentFile): Long {
+        val tags = fileCache.getTags(file)
+        if (tags != null && tags.durationMs >= 0) return tags.durationMs
+        return readDurationMs(file).also { durationMs ->
+            tags?.let { fileCache.putTags(file, it.copy(durationMs = durationMs)) }
+        }
+    }
+
+    // From the Xing/Info frame or the frame headers, see Mp3Stream.index
+    private fun readDurationMs(file: DocumentFile): Long {
+        return runCatching {
+            contentResolver.openFileDescriptor(file.uri, "r")?.use { pfd ->
+                Mp3Stream.index(pfd.fd)?.get(Mp3Stream.INDEX_DURATION_MS)
+            }
+        }.getOrNull() ?: 0L
+    }
+
     private fun getSummaryFiles(directory: DocumentFile): List<DocumentFile> {
         return getDirectoryChildren(directory)
             .asSequence()
@@ -1743,7 +1890,7 @@ class MainActivity : AppCompatActivity() {
                     val shouldInclude = isAllowed || showHiddenFiles
                     if (!shouldInclude) continue
                     total += if (child.isDirectory) {
-                        getSummaryFiles(child).size
+                        metadataStore?.findSummary(child)?.trackCount ?: getSummaryFiles(child).size
                     } else if (child.isFile) {
                         1
                     } else {
@@ -1761,35 +1908,84 @@ class MainActivity : AppCompatActivity() {
         }.getOrElse { 0 }
     }
 
-    private fun extractMetadata(file: DocumentFile): AudioMetadata? {
-        val retriever = MediaMetadataRetriever()
-        return try {
-            contentResolver.openFileDescriptor(file.uri, "r")?.use { pfd ->
-                retriever.setDataSource(pfd.fileDescriptor)
-                val title = retriever.extractMetadata(MediaMetadataRetriever.METADATA_KEY_TITLE)
-                val artist = retriever.extractMetadata(MediaMetadataRetriever.METADATA_KEY_ARTIST)
-                val album = retriever.extractMetadata(MediaMetadataRetriever.METADATA_KEY_ALBUM)
-                val track = retriever.extractMetadata(MediaMetadataRetriever.METADATA_KEY_CD_TRACK_NUMBER)
-                val albumArt = retriever.embeddedPicture?.let { data ->
-                    decodeAlbumArt(data)
-                }
+    // Tags from Id3Reader, which reads the tag headers only; onTrack gets null
+    // tags for a file that cannot be read. The album art is decoded while the
+    // file is open.
+    private fun readTags(
+        files: List<DocumentFile>,
+        onTrack: (DocumentFile, TrackTags?, Bitmap?) -> Unit
+    ) {
+        val descriptors = files.map { file ->
+            runCatching { contentResolver.openFileDescriptor(file.uri, "r") }.getOrNull()
+        }
+        try {
+            val fds = IntArray(files.size) { descriptors[it]?.fd ?: -1 }
+            val pictures = LongArray(files.size * Id3Reader.PICTURE_LENGTH)
+            val texts = runCatching { Id3Reader.read(fds, pictures) }.getOrNull()
+            files.forEachIndexed { index, file ->
+                val pfd = descriptors[index]
+                val tags = if (pfd != null && texts != null) toTrackTags(texts, pictures, index) else null
+                val albumArt = if (pfd != null && tags != null) decodeAlbumArt(pfd, tags) else null
+                onTrack(file, tags, albumArt)
+            }
+        } finally {
+            descriptors.forEach { pfd -> runCatching { pfd?.close() } }
+        }
+    }
+
+    private fun toTrackTags(texts: Array<String?>, pictures: LongArray, index: Int): TrackTags {
+        val text = index * Id3Reader.TEXT_LENGTH
+        val picture = index * Id3Reader.PICTURE_LENGTH
+        return TrackTags(
+            title = texts[text + Id3Reader.TEXT_TITLE],
+            artist = texts[text + Id3Reader.TEXT_ARTIST],
+            album = texts[text + Id3Reader.TEXT_ALBUM],
+            track = texts[text + Id3Reader.TEXT_TRACK],
+            pictureOffset = pictures[picture + Id3Reader.PICTURE_OFFSET],
+            pictureBytes = pictures[picture + Id3Reader.PICTURE_BYTES]
+        )
+    }
 
-                val hasMetadata = listOf(title, artist, album, track).any { !it.isNullOrBlank() } ||
-                        albumArt != null
+    private fun toAudioMetadata(tags: TrackTags, albumArt: Bitmap?): AudioMetadata? {
+        val hasMetadata = listOf(tags.title, tags.artist, tags.album, tags.track).any { !it.isNullOrBlank() } ||
+                albumArt != null
 
-                if (!hasMetadata) {
-                    null
-                } else {
-                    AudioMetadata(
-                        title = title?.trim().takeUnless { it.isNullOrEmpty() },
-                        artist = artist?.trim().takeUnless { it.isNullOrEmpty() },
-                        album = album?.trim().takeUnless { it.isNullOrEmpty() },
-                        trackNumber = track?.substringBefore('/')?.trim()
-                            ?.takeUnless { it.isNullOrEmpty() },
-                        albumArt = albumArt
-                    )
-                }
-            }
+        return if (!hasMetadata) {
+            null
+        } else {
+            AudioMetadata(
+                title = tags.title?.trim().takeUnless { it.isNullOrEmpty() },
+                artist = tags.artist?.trim().takeUnless { it.isNullOrEmpty() },
+                album = tags.album?.trim().takeUnless { it.isNullOrEmpty() },
+                trackNumber = tags.track?.substringBefore('/')?.trim()
+                    ?.takeUnless { it.isNullOrEmpty() },
+                albumArt = albumArt
+            )
+        }
+    }
+
+    // Only unsynchronised pictures, which are not stored as is, go through
+    // MediaMetadataRetriever
+    private fun decodeAlbumArt(pfd: ParcelFileDescriptor, tags: TrackTags): Bitmap? {
+        return when {
+            tags.pictureOffset >= 0 -> decodeAlbumArt(pfd, tags.pictureOffset)
+            tags.pictureBytes > 0 -> extractEmbeddedPicture(pfd)?.let { data -> decodeAlbumArt(data) }
+            else -> null
+        }
+    }
+
+    private fun openAlbumArt(uri: Uri, tags: TrackTags): Bitmap? {
+        if (tags.pictureBytes <= 0) return null
+        return runCatching {
+            contentResolver.openFileDescriptor(uri, "r")?.use { pfd -> decodeAlbumArt(pfd, tags) }
+        }.getOrNull()
+    }
+
+    private fun extractEmbeddedPicture(pfd: ParcelFileDescriptor): ByteArray? {
+        val retriever = MediaMetadataRetriever()
+        return try {
+            retriever.setDataSource(pfd.fileDescriptor)
+            retriever.embeddedPicture
         } catch (_: Exception) {
             null
         } finally {
@@ -1810,6 +2006,23 @@ class MainActivity : AppCompatActivity() {
         }
     }
 
+    // Decodes the image data at offset without copying it out of the file;
+    // the decoder stops at the end of the image, so the audio after it is not read
+    private fun decodeAlbumArt(pfd: ParcelFileDescriptor, offset: Long): Bitmap? {
+        return try {
+            val options = BitmapFactory.Options().apply { inJustDecodeBounds = true }
+            Os.lseek(pfd.fileDescriptor, offset, OsConstants.SEEK_SET)
+            BitmapFactory.decodeFileDescriptor(pfd.fileDescriptor, null, options)
+            val maxSize = 128
+            val sampleSize = calculateInSampleSize(options.outWidth, options.outHeight, maxSize, maxSize)
+            val decodeOptions = BitmapFactory.Options().apply { inSampleSize = sampleSize }
+            Os.lseek(pfd.fileDescriptor, offset, OsConstants.SEEK_SET)
+            BitmapFactory.decodeFileDescriptor(pfd.fileDescriptor, null, decodeOptions)
+        } catch (_: Exception) {
+            null
+        }
+    }
+
     private fun calculateInSampleSize(width: Int, height: Int, reqWidth: Int, reqHeight: Int): Int {
         var inSampleSize = 1
         if (height > reqHeight || width > reqWidth) {
@@ -1885,7 +2098,50 @@ class MainActivity : AppCompatActivity() {
         }
     }
 
-    private fun copyUriToTarget(
+    // fd to fd in native code, see FileCopy, with the progress polled from the
+    // buffer it updates; through streams if the source has no plain fd
+    private suspend fun copyUriToTarget(
+        sourceUri: Uri,
+        targetUri: Uri,
+        totalBytes: Long?,
+        onProgress: ((Long, Long?) -> Unit)? = null
+    ): Long {
+        val input = runCatching { contentResolver.openFileDescriptor(sourceUri, "r") }.getOrNull()
+            ?: return streamUriToTarget(sourceUri, targetUri, totalBytes, onProgress)
+        return input.use { inputPfd ->
+            openOutputDescriptor(targetUri).use { outputPfd ->
+                val progress = FileCopy.newProgress()
+                val reportProgress = {
+                    val total = progress.getLong(FileCopy.PROGRESS_TOTAL * 8).takeIf { it >= 0 }
+                        ?: totalBytes?.takeIf { it > 0 }
+                    onProgress?.invoke(progress.getLong(FileCopy.PROGRESS_COPIED * 8), total)
+                }
+                val copied = coroutineScope {
+                    var copying = true
+                    val poller = launch {
+                        try {
+                            while (true) {
+                                delay(COPY_PROGRESS_INTERVAL_MS)
+                                reportProgress()
+                            }
+                        } finally {
+                            // cancelled with the import, stop the copy too
+                            if (copying) progress.putLong(FileCopy.PROGRESS_CANCEL * 8, 1)
+                        }
+                    }
+                    FileCopy.copy(inputPfd.fd, outputPfd.fd, progress, FileCopy.SYNC).also {
+                        copying = false
+                        poller.cancel()
+                    }
+                }
+                if (copied < 0) error("Copy failed: ${Os.strerror((-copied).toInt())}")
+                reportProgress()
+                copied
+            }
+        }
+    }
+
+    private fun streamUriToTarget(
         sourceUri: Uri,
         targetUri: Uri,
         totalBytes: Long?,
@@ -1947,6 +2203,43 @@ class MainActivity : AppCompatActivity() {
         return fallback
     }
 
+    // Bytes the batch needs on the drive and the bytes free there, if it
+    // does not fit; null if it does or the free space is unknown. Transcoded
+    // files count with their predicted size, copies with their own, each
+    // rounded up to whole clusters.
+    private fun findSpaceShortfall(pickedFiles: List<PickedFile>): Pair<Long, Long>? {
+        val directory = lastRemovableVolume?.directory ?: return null
+        val stat = runCatching { StatFs(directory.path) }.getOrNull() ?: return null
+        val cluster = stat.blockSizeLong.coerceAtLeast(1)
+        var needed = 0L
+        for (picked in pickedFiles) {
+            if (!isAudioFile(picked.displayName, picked.mimeType)) continue
+            val predicted = if (shouldTranscodeFile(picked.displayName, picked.mimeType)) {
+                audioConverter.predictOutputSize(picked.uri)?.let { it + audioConverter.predictTagSize(picked.uri) }
+            } else {
+                null
+            }
+            val bytes = predicted ?: picked.sizeBytes ?: 0L
+            needed += (bytes + cluster - 1) / cluster * cluster
+        }
+        val available = stat.availableBytes
+        return if (needed > available) needed to available else null
+    }
+
+    private fun showDriveFullDialog(neededBytes: Long, availableBytes: Long) {
+        MaterialAlertDialogBuilder(this)
+            .setTitle(R.string.add_file_error_full_title)
+            .setMessage(
+                getString(
+                    R.string.add_file_error_space_message,
+                    Formatter.formatShortFileSize(this, neededBytes),
+                    Formatter.formatShortFileSize(this, availableBytes)
+                )
+            )
+            .setPositiveButton(android.R.string.ok, null)
+            .show()
+    }
+
     private fun showTrackLimitDialog() {
         MaterialAlertDialogBuilder(this)
             .setTitle(R.string.add_file_error_full_title)
@@ -1988,6 +2281,7 @@ class MainActivity : AppCompatActivity() {
         private val entriesCache = mutableMapOf<EntriesKey, List<UsbFile>>()
         private val directoryCache = mutableMapOf<String, List<DocumentFile>>()
         private val metadataCache = mutableMapOf<String, AudioMetadata?>()
+        private val tagsCache = mutableMapOf<String, TrackTags>()
         private val directorySummaryCache = mutableMapOf<String, DirectorySummary>()
 
         @Synchronized
@@ -2021,13 +2315,32 @@ class MainActivity : AppCompatActivity() {
             entriesCache.clear()
             directoryCache.clear()
             metadataCache.clear()
+            tagsCache.clear()
             directorySummaryCache.clear()
         }
 
         @Synchronized
-        fun getOrPutMetadata(file: DocumentFile, loader: () -> AudioMetadata?): AudioMetadata? {
+        fun hasMetadata(file: DocumentFile): Boolean = metadataCache.containsKey(file.uri.toString())
+
+        @Synchronized
+        fun getMetadata(file: DocumentFile): AudioMetadata? = metadataCache[file.uri.toString()]
+
+        // tags is null for a file that could not be read, nothing to keep then
+        @Synchronized
+        fun putTrack(file: DocumentFile, tags: TrackTags?, metadata: AudioMetadata?) {
             val key = file.uri.toString()
-            return metadataCache.getOrPut(key) { loader() }
+            metadataCache[key] = metadata
+            if (tags != null) {
+                tagsCache[key] = tags
+            }
+        }
+
+        @Synchronized
+        fun getTags(file: DocumentFile): TrackTags? = tagsCache[file.uri.toString()]
+
+        @Synchronized
+        fun putTags(file: DocumentFile, tags: TrackTags) {
+            tagsCache[file.uri.toString()] = tags
         }
 
         @Synchronized
@@ -2063,6 +2376,8 @@ class MainActivity : AppCompatActivity() {
         private const val KEY_SHOW_HIDDEN = "show_hidden"
         private const val KEY_TRANSCODE_MP3 = "transcode_mp3"
         private const val COPY_BUFFER_SIZE = 256 * 1024
+        private const val COPY_PROGRESS_INTERVAL_MS = 100L
+        private const val METADATA_BATCH_SIZE = 64       // open fds per Id3Reader.read
         private const val BYTES_PER_MEGABYTE = 1024 * 1024
         private val ROOT_WHITELIST = Regex("^(0[1-9]|[1-9][0-9])$")
         private val TRACK_WHITELIST = Regex("^(?!000)\\d{3}\\.mp3$", RegexOption.IGNORE_CASE)
@@ -9,9 +9,12 @@ import android.media.MediaMetadataRetriever
 import android.net.Uri
 import android.os.Handler
 import android.os.Looper
+import android.os.Trace
 import android.util.Log
+import com.github.axet.lamejni.Id3Reader
+import com.github.axet.lamejni.Id3Writer
 import com.github.axet.lamejni.Lame
-import java.io.ByteArrayOutputStream
+import com.github.axet.lamejni.Mp3Stream
 import java.io.OutputStream
 import java.nio.ByteBuffer
 import java.nio.ByteOrder
@@ -22,9 +25,12 @@ class AudioConversionException(message: String, cause: Throwable? = null) : Exce
 
 class MediaCodecMp3Converter(private val context: Context) {
 
+    // allowPassthrough: MP3 sources that already suit the player are copied
+    // frame by frame instead of being decoded and re-encoded
     suspend fun convertToMp3(
         sourceUri: Uri,
         targetUri: Uri,
+        allowPassthrough: Boolean = false,
         onProgress: ((Float) -> Unit)? = null
     ) {
         withContext(Dispatchers.IO) {
@@ -37,15 +43,21 @@ class MediaCodecMp3Converter(private val context: Context) {
             Log.i(TAG, "Starting conversion for uri=$sourceUri")
             try {
                 val metadata = extractMetadata(sourceUri)
-                context.contentResolver.withSyncedOutputStream(
+                if (allowPassthrough && remuxIfConforming(sourceUri, targetUri, metadata)) {
+                    progressUpdater?.invoke(1f)
+                    Log.i(TAG, "Copied MP3 frames for uri=$sourceUri")
+                    return@withContext
+                }
+                context.contentResolver.withAsyncOutputStream(
                     targetUri,
                     onUnavailable = { AudioConversionException("Stream unavailable") }
                 ) { output ->
-                    val tagBytes = buildId3v23Tag(metadata)
-                    if (tagBytes.isNotEmpty()) {
-                        output.write(tagBytes)
-                    }
-                    decodeToMp3(sourceUri, output, progressUpdater)
+                    // TLEN is written blank, and LAME starts the audio with a
+                    // blank Info frame; both are patched in once the length is known
+                    val tagSize = writeId3v23Tag(sourceUri, metadata, withLength = true, output::writeId3Tag)
+                    val encoded = decodeToMp3(sourceUri, output, progressUpdater) { bytes -> output.reserve(bytes) }
+                    output.patch(tagSize - TLEN_FRAME_SIZE, tlenFrame(encoded.durationMs))
+                    encoded.lametagFrame?.let { output.patch(tagSize, it) }
                 }
                 progressUpdater?.invoke(1f)
                 Log.i(TAG, "Conversion completed for uri=$sourceUri")
@@ -57,11 +69,48 @@ class MediaCodecMp3Converter(private val context: Context) {
         }
     }
 
+    // Copies the frames behind a fresh tag if the source is CBR, MPEG-1, not
+    // dual channel, within the bitrate ceiling and not damaged; the old tags,
+    // junk and broken frames stay behind. False (nothing written) otherwise.
+    private fun remuxIfConforming(sourceUri: Uri, targetUri: Uri, metadata: RawAudioMetadata): Boolean {
+        val input = context.contentResolver.openFileDescriptor(sourceUri, "r") ?: return false
+        input.use { inputPfd ->
+            val info = Mp3Stream.scan(
+                inputPfd.fd,
+                true,
+                PASSTHROUGH_MIN_SAMPLE_RATE,
+                PASSTHROUGH_MAX_SAMPLE_RATE,
+                Mp3Stream.MODE_STEREO or Mp3Stream.MODE_JOINT_STEREO or Mp3Stream.MODE_MONO,
+                PASSTHROUGH_MAX_BITRATE,
+                PASSTHROUGH_MAX_DROPPED_PERMILLE
+            ) ?: return false
+            val problems = info[Mp3Stream.INFO_PROBLEMS]
+            if (problems != 0L) {
+                Log.i(TAG, "Transcoding uri=$sourceUri, MP3 problems=0x${problems.toString(16)}")
+                return false
+            }
+            val output = context.contentResolver.openFileDescriptor(targetUri, "w")
+                ?: throw AudioConversionException("Stream unavailable")
+            output.use { outputPfd ->
+                writeId3v23Tag(sourceUri, metadata, withLength = false) { ids, texts, mime, pictureFd, picture, data ->
+                    Id3Writer.write(outputPfd.fd, ids, texts, mime, pictureFd, picture, data)
+                }
+                if (Mp3Stream.remux(inputPfd.fd, outputPfd.fd, info[Mp3Stream.INFO_DROPPED_FRAMES], null) < 0) {
+                    throw AudioConversionException("Failed to copy MP3 frames")
+                }
+                outputPfd.fileDescriptor.sync()
+            }
+        }
+        return true
+    }
+
+    // preallocate: told the size of the MP3 audio ahead, if it can be predicted
     private fun decodeToMp3(
         sourceUri: Uri,
         outputStream: OutputStream,
-        onProgress: ((Float) -> Unit)?
-    ) {
+        onProgress: ((Float) -> Unit)?,
+        preallocate: ((Long) -> Unit)? = null
+    ): EncodedMp3 {
         val extractor = MediaExtractor()
         var codec: MediaCodec? = null
         val encoder = LamePcmEncoder(outputStream)
@@ -80,13 +129,17 @@ class MediaCodecMp3Converter(private val context: Context) {
             } else {
                 null
             }
+            predictOutputSize(inputFormat)?.let { preallocate?.invoke(it) }
 
             codec = MediaCodec.createDecoderByType(mime)
             codec.configure(inputFormat, null, null, 0)
             codec.start()
 
+            // native encoder stages show up next to these sections in Perfetto
+            Lame.setTracing(Trace.isEnabled())
             pumpCodec(extractor, codec, encoder, durationUs, onProgress)
             encoder.finish()
+            return EncodedMp3(encoder.durationMs, encoder.lametagFrame)
         } finally {
             runCatching { codec?.stop() }
             runCatching { codec?.release() }
@@ -110,11 +163,15 @@ class MediaCodecMp3Converter(private val context: Context) {
 
         while (!outputEnded) {
             if (!inputEnded) {
-                val inputIndex = codec.dequeueInputBuffer(TIMEOUT_US)
+                val inputIndex = traced("MediaCodec.dequeueInputBuffer") {
+                    codec.dequeueInputBuffer(TIMEOUT_US)
+                }
                 if (inputIndex >= 0) {
                     val inputBuffer = codec.getInputBuffer(inputIndex) ?: continue
                     inputBuffer.clear()
-                    val size = extractor.readSampleData(inputBuffer, 0)
+                    val size = traced("MediaExtractor.readSampleData") {
+                        extractor.readSampleData(inputBuffer, 0)
+                    }
                     if (size < 0) {
                         codec.queueInputBuffer(
                             inputIndex,
@@ -142,7 +199,9 @@ class MediaCodecMp3Converter(private val context: Context) {
                 }
             }
 
-            val outputIndex = codec.dequeueOutputBuffer(bufferInfo, TIMEOUT_US)
+            val outputIndex = traced("MediaCodec.dequeueOutputBuffer") {
+                codec.dequeueOutputBuffer(bufferInfo, TIMEOUT_US)
+            }
             when (outputIndex) {
                 MediaCodec.INFO_TRY_AGAIN_LATER -> {
                     // No output available yet.
@@ -166,7 +225,9 @@ class MediaCodecMp3Converter(private val context: Context) {
                             if (!encoder.isConfigured) {
                                 encoder.configureFromFormat(pendingFormat)
                             }
-                            encoder.encodeBuffer(outputBuffer)
+                            traced("LamePcmEncoder.encodeBuffer") {
+                                encoder.encodeBuffer(outputBuffer)
+                            }
                         }
                         codec.releaseOutputBuffer(outputIndex, false)
                         if ((bufferInfo.flags and MediaCodec.BUFFER_FLAG_END_OF_STREAM) != 0) {
@@ -179,6 +240,51 @@ class MediaCodecMp3Converter(private val context: Context) {
         onProgress?.invoke(1f)
     }
 
+    // Size of the MP3 audio convertToMp3 writes when it transcodes
+    // sourceUri, tags not included; null if the source does not declare its
+    // duration. Exact if the duration is.
+    fun predictOutputSize(sourceUri: Uri): Long? {
+        val extractor = MediaExtractor()
+        return try {
+            extractor.setDataSource(context, sourceUri, null)
+            selectAudioTrack(extractor)?.let { predictOutputSize(extractor.getTrackFormat(it)) }
+        } catch (_: Exception) {
+            null
+        } finally {
+            extractor.release()
+        }
+    }
+
+    private fun predictOutputSize(format: MediaFormat): Long? {
+        if (!format.containsKey(MediaFormat.KEY_DURATION) || !format.containsKey(MediaFormat.KEY_SAMPLE_RATE)) {
+            return null
+        }
+        val durationUs = format.getLong(MediaFormat.KEY_DURATION)
+        val sampleRate = format.getInteger(MediaFormat.KEY_SAMPLE_RATE)
+        if (durationUs <= 0 || sampleRate <= 0) return null
+        val samples = (durationUs * sampleRate + 999_999) / 1_000_000
+        return LamePcmEncoder.predictSize(sampleRate, samples)
+    }
+
+    // Size of the tag convertToMp3 writes ahead of the transcoded audio:
+    // the text frames, the blank TLEN and the cover, laid out as id3_write
+    // does (UTF-16 text, the picture copied whole).
+    fun predictTagSize(sourceUri: Uri): Long {
+        val metadata = extractMetadata(sourceUri)
+        var size = ID3_HEADER_SIZE.toLong()
+        for (text in tagTexts(metadata, withLength = true)) {
+            if (!text.isNullOrEmpty()) size += ID3_HEADER_SIZE + 1 + 2 + 2L * text.length
+        }
+        val pictureBytes = metadata.artworkInSource?.get(Id3Reader.PICTURE_BYTES)
+            ?: metadata.artwork?.capacity()?.toLong()
+        val mime = metadata.artworkMimeType
+        if (pictureBytes != null && mime != null) {
+            // encoding, MIME type, NUL, picture type, empty description
+            size += ID3_HEADER_SIZE + 1 + mime.length + 1 + 1 + 1 + pictureBytes
+        }
+        return size
+    }
+
     private fun selectAudioTrack(extractor: MediaExtractor): Int? {
         for (index in 0 until extractor.trackCount) {
             val format = extractor.getTrackFormat(index)
@@ -188,7 +294,58 @@ class MediaCodecMp3Converter(private val context: Context) {
         return null
     }
 
+    // Writes the tag of metadata through write (Id3Writer.write or
+    // AsyncWriter.writeId3Tag), the cover streamed from where Id3Reader found
+    // it in the source. withLength: ends the tag with a blank TLEN frame of
+    // TLEN_FRAME_SIZE bytes, for tlenFrame() to overwrite. Returns the tag size.
+    private inline fun writeId3v23Tag(
+        sourceUri: Uri,
+        metadata: RawAudioMetadata,
+        withLength: Boolean,
+        write: (Array<String>, Array<String?>, String?, Int, LongArray?, ByteBuffer?) -> Long
+    ): Long {
+        val texts = tagTexts(metadata, withLength)
+        val pictureInput = metadata.artworkInSource?.let { context.contentResolver.openFileDescriptor(sourceUri, "r") }
+        val size = try {
+            val picture = metadata.artworkInSource?.takeIf { pictureInput != null }
+                ?: metadata.artwork?.let { longArrayOf(0, it.capacity().toLong(), FRONT_COVER) }
+            write(
+                TAG_IDS,
+                texts,
+                metadata.artworkMimeType.takeIf { picture != null },
+                pictureInput?.fd ?: -1,
+                picture,
+                metadata.artwork
+            )
+        } finally {
+            pictureInput?.close()
+        }
+        if (size < 0) throw AudioConversionException("Failed to write tag: errno ${-size}")
+        return size
+    }
+
+    // Text frames of the tag, in TAG_IDS order; null for frames not written
+    private fun tagTexts(metadata: RawAudioMetadata, withLength: Boolean): Array<String?> = arrayOf(
+        metadata.title?.takeUnless { it.isBlank() },
+        metadata.album?.takeUnless { it.isBlank() },
+        metadata.artist?.takeUnless { it.isBlank() },
+        metadata.track?.takeUnless { it.isBlank() },
+        if (withLength) "0".repeat(TLEN_DIGITS) else null
+    )
+
+    // Text of the source's own ID3 tag is read by MediaMetadataRetriever like
+    // that of any other format; its picture is only located, so it can be
+    // streamed into the new tag. Other pictures are held in a direct buffer.
     private fun extractMetadata(uri: Uri): RawAudioMetadata {
+        val picture = LongArray(Id3Reader.PICTURE_LENGTH)
+        val pictureMime = runCatching {
+            context.contentResolver.openFileDescriptor(uri, "r")?.use { pfd ->
+                Id3Reader.read(intArrayOf(pfd.fd), picture)?.get(Id3Reader.TEXT_PICTURE_MIME)
+            }
+        }.getOrNull()
+        val artworkInSource = picture.takeIf {
+            pictureMime != null && it[Id3Reader.PICTURE_OFFSET] >= 0 && it[Id3Reader.PICTURE_BYTES] > 0
+        }
         val retriever = MediaMetadataRetriever()
         return try {
             retriever.setDataSource(context, uri)
@@ -196,17 +353,18 @@ class MediaCodecMp3Converter(private val context: Context) {
             val album = retriever.extractMetadata(MediaMetadataRetriever.METADATA_KEY_ALBUM)
             val artist = retriever.extractMetadata(MediaMetadataRetriever.METADATA_KEY_ARTIST)
             val track = retriever.extractMetadata(MediaMetadataRetriever.METADATA_KEY_CD_TRACK_NUMBER)
-            val art = retriever.embeddedPicture
+            val art = if (artworkInSource == null) retriever.embeddedPicture else null
             RawAudioMetadata(
                 title = title,
                 album = album,
                 artist = artist,
                 track = track,
-                artwork = art,
-                artworkMimeType = art?.let { detectMimeType(it) }
+                artworkInSource = artworkInSource,
+                artwork = art?.let { ByteBuffer.allocateDirect(it.size).put(it) },
+                artworkMimeType = if (artworkInSource != null) pictureMime else art?.let { detectMimeType(it) }
             )
         } catch (_: Throwable) {
-            RawAudioMetadata(null, null, null, null, null, null)
+            RawAudioMetadata(null, null, null, null, null, null, null)
         } finally {
             retriever.release()
         }
@@ -215,71 +373,57 @@ class MediaCodecMp3Converter(private val context: Context) {
     private companion object {
         private const val TAG = "MediaCodecMp3Converter"
         private const val TIMEOUT_US = 10_000L
+
+        // MP3 sources re-encoding would not improve: MPEG-1 rates and at most
+        // the bitrate LamePcmEncoder writes
+        private const val PASSTHROUGH_MIN_SAMPLE_RATE = 32000
+        private const val PASSTHROUGH_MAX_SAMPLE_RATE = 48000
+        private const val PASSTHROUGH_MAX_BITRATE = 128
+        private const val PASSTHROUGH_MAX_DROPPED_PERMILLE = 10
+
+        private const val FRONT_COVER = 3L
     }
 }
 
+// durationMs: of the audio encoded, -1 if unknown. lametagFrame: the final
+// Info frame for the placeholder at the start of the audio, if LAME wrote one.
+private class EncodedMp3(val durationMs: Long, val lametagFrame: ByteArray?)
+
+// artworkInSource: where the picture is in the source, in the
+// Id3Reader.PICTURE_* layout. artwork: the picture otherwise, if any.
 private data class RawAudioMetadata(
     val title: String?,
     val album: String?,
     val artist: String?,
     val track: String?,
-    val artwork: ByteArray?,
+    val artworkInSource: LongArray?,
+    val artwork: ByteBuffer?,
     val artworkMimeType: String?
 )
 
-private fun buildId3v23Tag(metadata: RawAudioMetadata): ByteArray {
-    val frames = ByteArrayOutputStream()
-
-    fun writeFrame(id: String, payload: ByteArray) {
-        if (payload.isEmpty()) return
-        val idBytes = id.toByteArray(Charsets.ISO_8859_1)
-        if (idBytes.size != 4) return
-        val sizeBytes = intToBytes(payload.size)
-        frames.write(idBytes)
-        frames.write(sizeBytes)
-        frames.write(byteArrayOf(0x00, 0x00)) // flags
-        frames.write(payload)
-    }
-
-    fun writeTextFrame(id: String, text: String?) {
-        if (text.isNullOrBlank()) return
-        val data = ByteArrayOutputStream().apply {
-            write(0x01) // UTF-16 with BOM
-            write(byteArrayOf(0xFF.toByte(), 0xFE.toByte()))
-            write(text.toByteArray(Charsets.UTF_16LE))
-        }.toByteArray()
-        writeFrame(id, data)
-    }
-
-    metadata.title?.let { writeTextFrame("TIT2", it) }
-    metadata.album?.let { writeTextFrame("TALB", it) }
-    metadata.artist?.let { writeTextFrame("TPE1", it) }
-    metadata.track?.let { writeTextFrame("TRCK", it) }
-
-    if (metadata.artwork != null && metadata.artworkMimeType != null) {
-        val pictureData = ByteArrayOutputStream().apply {
-            write(0x00) // ISO-8859-1 encoding for MIME and description
-            write(metadata.artworkMimeType.toByteArray(Charsets.ISO_8859_1))
-            write(0x00)
-            write(0x03) // Front cover
-            write(0x00) // Empty description (NUL-terminated)
-            write(metadata.artwork)
-        }.toByteArray()
-        writeFrame("APIC", pictureData)
-    }
-
-    val frameBytes = frames.toByteArray()
-    if (frameBytes.isEmpty()) return ByteArray(0)
-
-    val tagSize = frameBytes.size
-    val header = ByteArrayOutputStream().apply {
-        write(byteArrayOf('I'.code.toByte(), 'D'.code.toByte(), '3'.code.toByte()))
-        write(byteArrayOf(0x03, 0x00)) // ID3v2.3
-        write(0x00) // flags
-        write(toSynchSafe(tagSize))
-    }.toByteArray()
-
-    return header + frameBytes
+// id3_write puts APIC first, so the last of these ends the tag
+private val TAG_IDS = arrayOf("TIT2", "TALB", "TPE1", "TRCK", "TLEN")
+
+// Of the tag and of each frame
+private const val ID3_HEADER_SIZE = 10
+
+// TLEN as the writer lays it out: header, encoding, BOM, UTF-16 digits
+private const val TLEN_DIGITS = 10
+private const val TLEN_FRAME_SIZE = ID3_HEADER_SIZE + 1 + 2 + 2 * TLEN_DIGITS
+
+// The blank TLEN frame filled in with lengthMs; all zeros (padding, to
+// readers) if the length is unknown.
+private fun tlenFrame(lengthMs: Long): ByteArray {
+    val frame = ByteArray(TLEN_FRAME_SIZE)
+    if (lengthMs < 0) return frame
+    val digits = lengthMs.coerceAtMost(9_999_999_999L).toString().padStart(TLEN_DIGITS, '0')
+    "TLEN".toByteArray(Charsets.ISO_8859_1).copyInto(frame)
+    frame[7] = (TLEN_FRAME_SIZE - 10).toByte()
+    frame[10] = 0x01 // UTF-16 with BOM
+    frame[11] = 0xFF.toByte()
+    frame[12] = 0xFE.toByte()
+    digits.toByteArray(Charsets.UTF_16LE).copyInto(frame, 13)
+    return frame
 }
 
 private fun detectMimeType(data: ByteArray): String {
@@ -295,21 +439,13 @@ private fun detectMimeType(data: ByteArray): String {
     }
 }
 
-private fun intToBytes(value: Int): ByteArray {
-    return byteArrayOf(
-        ((value shr 24) and 0xFF).toByte(),
-        ((value shr 16) and 0xFF).toByte(),
-        ((value shr 8) and 0xFF).toByte(),
-        (value and 0xFF).toByte()
-    )
-}
-
-private fun toSynchSafe(value: Int): ByteArray {
-    val b1 = (value shr 21) and 0x7F
-    val b2 = (value shr 14) and 0x7F
-    val b3 = (value shr 7) and 0x7F
-    val b4 = value and 0x7F
-    return byteArrayOf(b1.toByte(), b2.toByte(), b3.toByte(), b4.toByte())
+private inline fun <T> traced(section: String, block: () -> T): T {
+    Trace.beginSection(section)
+    try {
+        return block()
+    } finally {
+        Trace.endSection()
+    }
 }
 
 private class LamePcmEncoder(
@@ -329,10 +465,18 @@ private class LamePcmEncoder(
     private var pendingFloat = FloatArray(0)
     private var pendingFloatCount = 0
     private var targetSampleCount = 0
+    private var framesEncoded = 0L
+
+    // after finish(), see EncodedMp3
+    var lametagFrame: ByteArray? = null
+        private set
 
     val isConfigured: Boolean
         get() = configured
 
+    val durationMs: Long
+        get() = if (sampleRate > 0) framesEncoded * 1000 / sampleRate else -1
+
     fun configureFromFormat(format: MediaFormat) {
         val sampleRate = format.getInteger(MediaFormat.KEY_SAMPLE_RATE)
         val channels = format.getInteger(MediaFormat.KEY_CHANNEL_COUNT)
@@ -444,6 +588,7 @@ private class LamePcmEncoder(
         if (encoded != null && encoded.isNotEmpty()) {
             output.write(encoded)
         }
+        framesEncoded += samplesToFlush / inputChannels
         val remaining = pendingShortCount - samplesToFlush
         if (remaining > 0) {
             System.arraycopy(pendingShort, samplesToFlush, pendingShort, 0, remaining)
@@ -475,6 +620,7 @@ private class LamePcmEncoder(
         if (encoded != null && encoded.isNotEmpty()) {
             output.write(encoded)
         }
+        framesEncoded += samplesToFlush / inputChannels
         val remaining = pendingFloatCount - samplesToFlush
         if (remaining > 0) {
             System.arraycopy(pendingFloat, samplesToFlush, pendingFloat, 0, remaining)
@@ -513,9 +659,12 @@ private class LamePcmEncoder(
             if (flushBytes.isNotEmpty()) output.write(flushBytes)
         }
         runCatching {
-            val tail = encoder.close()
+            val tail = encoder.flush()
             if (tail.isNotEmpty()) output.write(tail)
+            lametagFrame = encoder.getLametagFrame()
         }
+        encoder.getStats()?.let { logStats(it) }
+        runCatching { encoder.close() }
         configured = false
         lame = null
     }
@@ -524,7 +673,21 @@ private class LamePcmEncoder(
         finish()
     }
 
+    private fun logStats(stats: LongArray) {
+        Log.i(
+            TAG,
+            "Encoded ${stats[Lame.STAT_FRAMES]} frames, " +
+                "encoder memory ${stats[Lame.STAT_MEMORY_BYTES] / 1024} KB " +
+                "(peak ${stats[Lame.STAT_MEMORY_PEAK_BYTES] / 1024} KB)"
+        )
+    }
+
     companion object {
+        // what an encoder for sampleRate writes for samples per channel
+        fun predictSize(sampleRate: Int, samples: Long): Long? =
+            Lame.predictSize(MAX_OUTPUT_CHANNELS, sampleRate, DEFAULT_BITRATE, samples).takeIf { it > 0 }
+
+        private const val TAG = "LamePcmEncoder"
         private const val DEFAULT_BITRATE = 128
         private const val DEFAULT_QUALITY = 6
         private const val MAX_OUTPUT_CHANNELS = 1
@@ -0,0 +1,277 @@
+package com.example.tonuinoaudiomanager
+
+import android.content.Context
+import android.net.Uri
+import android.provider.DocumentsContract
+import androidx.documentfile.provider.DocumentFile
+import com.github.axet.lamejni.MetadataIndex
+import java.io.Closeable
+import java.io.File
+import java.nio.ByteBuffer
+import java.security.MessageDigest
+
+// Tags of a track as Id3Reader found them, before the album art is decoded
+data class TrackTags(
+    val title: String? = null,
+    val artist: String? = null,
+    val album: String? = null,
+    val track: String? = null,
+    val pictureOffset: Long = -1,   // -1 if the picture is not stored as is
+    val pictureBytes: Long = 0,
+    val durationMs: Long = -1       // -1 until read
+)
+
+// DirectorySummary with the album art as the file and offset it is at
+data class IndexedSummary(
+    val album: String?,
+    val artist: String?,
+    val pictureDocumentId: String?,
+    val pictureOffset: Long,
+    val pictureBytes: Long,
+    val trackCount: Int,
+    val durationMs: Long,
+    val otherAlbumCount: Int,
+    val otherArtistCount: Int
+)
+
+// What was read from the drive behind treeUri, kept in a MetadataIndex file
+// so reopening the drive does not read every file again. Records are keyed
+// by document id and used while the size and mtime the provider reports
+// for the document are unchanged. A folder summary goes by a digest of the
+// names, sizes and mtimes of the folder's children: on FAT and exFAT the
+// folder's own mtime often stays put when a host replaces a file in it.
+class MetadataStore(context: Context, val treeUri: Uri) : Closeable {
+    private data class Stamp(val size: Long, val mtime: Long)
+
+    private val contentResolver = context.contentResolver
+    private val index = MetadataIndex()
+    private val stamps = HashMap<String, Stamp>()
+    private val childDigests = HashMap<String, Stamp>()   // per folder, see loadStamps
+
+    init {
+        val directory = File(context.filesDir, INDEX_DIRECTORY).apply { mkdirs() }
+        index.open(File(directory, indexFileName(treeUri)).path)
+    }
+
+    // Sizes and mtimes of the children of directory, and the digest of
+    // them the folder summary is stamped with; one provider query
+    fun loadStamps(directory: DocumentFile) {
+        val directoryId = documentId(directory)
+        val childrenUri = DocumentsContract.buildChildDocumentsUriUsingTree(treeUri, directoryId)
+        val projection = arrayOf(
+            DocumentsContract.Document.COLUMN_DOCUMENT_ID,
+            DocumentsContract.Document.COLUMN_SIZE,
+            DocumentsContract.Document.COLUMN_LAST_MODIFIED,
+            DocumentsContract.Document.COLUMN_DISPLAY_NAME
+        )
+        val loaded = HashMap<String, Stamp>()
+        val lines = ArrayList<String>()
+        val listed = runCatching {
+            contentResolver.query(childrenUri, projection, null, null, null)?.use { cursor ->
+                while (cursor.moveToNext()) {
+                    val documentId = cursor.getString(0) ?: continue
+                    val size = if (cursor.isNull(1)) 0L else cursor.getLong(1)
+                    val mtime = if (cursor.isNull(2)) 0L else cursor.getLong(2)
+                    loaded[documentId] = Stamp(size, mtime)
+                    lines.add("$documentId/${cursor.getString(3)}/$size/$mtime")
+                }
+            } != null
+        }.getOrDefault(false)
+        synchronized(stamps) {
+            stamps.putAll(loaded)
+            if (listed) childDigests[directoryId] = digestOf(lines) else childDigests.remove(directoryId)
+        }
+    }
+
+    fun findTags(file: DocumentFile): TrackTags? {
+        val stamp = stampOf(file)
+        if (stamp.mtime <= 0) return null
+        val values = LongArray(MetadataIndex.VALUES)
+        val strings = arrayOfNulls<String>(MetadataIndex.STRINGS)
+        if (!index.find(documentId(file), stamp.size, stamp.mtime, values, strings)) return null
+        return TrackTags(
+            title = strings[TRACK_TITLE],
+            artist = strings[TRACK_ARTIST],
+            album = strings[TRACK_ALBUM],
+            track = strings[TRACK_NUMBER],
+            pictureOffset = values[TRACK_PICTURE_OFFSET],
+            pictureBytes = values[TRACK_PICTURE_BYTES],
+            durationMs = values[TRACK_DURATION_MS]
+        )
+    }
+
+    // Lists directory (one provider query) unless loadStamps already did
+    fun findSummary(directory: DocumentFile): IndexedSummary? {
+        val stamp = childDigestOf(directory) ?: return null
+        val values = LongArray(MetadataIndex.VALUES)
+        val strings = arrayOfNulls<String>(MetadataIndex.STRINGS)
+        if (!index.find(documentId(directory), stamp.size, stamp.mtime, values, strings)) return null
+        // the picture offset only holds for the file as it was
+        strings[SUMMARY_PICTURE_DOCUMENT]?.let { pictureId ->
+            val pictureStamp = synchronized(stamps) { stamps[pictureId] }
+            if (pictureStamp != Stamp(values[SUMMARY_PICTURE_SIZE], values[SUMMARY_PICTURE_MTIME])) return null
+        }
+        return IndexedSummary(
+            album = strings[SUMMARY_ALBUM],
+            artist = strings[SUMMARY_ARTIST],
+            pictureDocumentId = strings[SUMMARY_PICTURE_DOCUMENT],
+            pictureOffset = values[SUMMARY_PICTURE_OFFSET],
+            pictureBytes = values[SUMMARY_PICTURE_BYTES],
+            trackCount = values[SUMMARY_TRACK_COUNT].toInt(),
+            durationMs = values[SUMMARY_DURATION_MS],
+            otherAlbumCount = values[SUMMARY_OTHER_ALBUMS].toInt(),
+            otherArtistCount = values[SUMMARY_OTHER_ARTISTS].toInt()
+        )
+    }
+
+    // Replaces the track records of directory
+    fun putTracks(directory: DocumentFile, tracks: List<Pair<DocumentFile, TrackTags>>) {
+        val records = tracks.mapNotNull { (file, tags) ->
+            val stamp = stampOf(file)
+            if (stamp.mtime <= 0) return@mapNotNull null
+            val values = LongArray(MetadataIndex.VALUES).apply {
+                set(TRACK_PICTURE_OFFSET, tags.pictureOffset)
+                set(TRACK_PICTURE_BYTES, tags.pictureBytes)
+                set(TRACK_DURATION_MS, tags.durationMs)
+            }
+            Record(
+                documentId(file),
+                stamp,
+                values,
+                arrayOf(tags.title, tags.artist, tags.album, tags.track)
+            )
+        }
+        put(documentId(directory), records)
+    }
+
+    fun putSummary(directory: DocumentFile, summary: IndexedSummary) {
+        val stamp = childDigestOf(directory) ?: return
+        val pictureStamp = summary.pictureDocumentId?.let { pictureId ->
+            synchronized(stamps) { stamps[pictureId] } ?: return
+        }
+        val values = LongArray(MetadataIndex.VALUES).apply {
+            set(SUMMARY_PICTURE_OFFSET, summary.pictureOffset)
+            set(SUMMARY_PICTURE_BYTES, summary.pictureBytes)
+            set(SUMMARY_TRACK_COUNT, summary.trackCount.toLong())
+            set(SUMMARY_DURATION_MS, summary.durationMs)
+            set(SUMMARY_OTHER_ALBUMS, summary.otherAlbumCount.toLong())
+            set(SUMMARY_OTHER_ARTISTS, summary.otherArtistCount.toLong())
+            set(SUMMARY_PICTURE_SIZE, pictureStamp?.size ?: 0)
+            set(SUMMARY_PICTURE_MTIME, pictureStamp?.mtime ?: 0)
+        }
+        val record = Record(
+            documentId(directory),
+            stamp,
+            values,
+            arrayOf(summary.album, summary.artist, summary.pictureDocumentId, null)
+        )
+        put(summaryParent(directory), listOf(record))
+    }
+
+    // Drops what is known about directory, after the app changed it
+    fun invalidate(directory: DocumentFile) {
+        val documentId = documentId(directory)
+        synchronized(stamps) {
+            stamps.remove(documentId)
+            childDigests.remove(documentId)
+        }
+        put(documentId, emptyList())
+        put(summaryParent(directory), emptyList())
+    }
+
+    fun commit() {
+        index.commit()
+    }
+
+    fun documentUri(documentId: String): Uri =
+        DocumentsContract.buildDocumentUriUsingTree(treeUri, documentId)
+
+    override fun close() {
+        index.close()
+    }
+
+    private class Record(
+        val key: String,
+        val stamp: Stamp,
+        val values: LongArray,
+        val strings: Array<String?>
+    )
+
+    private fun put(parent: String, records: List<Record>) {
+        val keys = Array(records.size) { records[it].key }
+        val stampValues = LongArray(records.size * MetadataIndex.STAMP_LENGTH)
+        val values = LongArray(records.size * MetadataIndex.VALUES)
+        val strings = arrayOfNulls<String>(records.size * MetadataIndex.STRINGS)
+        records.forEachIndexed { i, record ->
+            stampValues[i * MetadataIndex.STAMP_LENGTH + MetadataIndex.STAMP_SIZE] = record.stamp.size
+            stampValues[i * MetadataIndex.STAMP_LENGTH + MetadataIndex.STAMP_MTIME] = record.stamp.mtime
+            record.values.copyInto(values, i * MetadataIndex.VALUES)
+            record.strings.copyInto(strings, i * MetadataIndex.STRINGS)
+        }
+        index.put(parent, keys, stampValues, values, strings)
+    }
+
+    private fun stampOf(document: DocumentFile): Stamp {
+        val documentId = documentId(document)
+        synchronized(stamps) { stamps[documentId] }?.let { return it }
+        return Stamp(document.length(), document.lastModified())
+    }
+
+    // The digest of directory's children, as a stamp
+    private fun childDigestOf(directory: DocumentFile): Stamp? {
+        val directoryId = documentId(directory)
+        synchronized(stamps) { childDigests[directoryId] }?.let { return it }
+        loadStamps(directory)
+        return synchronized(stamps) { childDigests[directoryId] }
+    }
+
+    private fun documentId(document: DocumentFile): String =
+        DocumentsContract.getDocumentId(document.uri)
+
+    // Summaries are a parent of their own, so listing a folder's tracks
+    // does not replace its summary
+    private fun summaryParent(directory: DocumentFile): String = documentId(directory) + SUMMARY_SUFFIX
+
+    private companion object {
+        const val INDEX_DIRECTORY = "metadata"
+        const val SUMMARY_SUFFIX = "#summary"
+
+        // track record layout
+        const val TRACK_TITLE = 0
+        const val TRACK_ARTIST = 1
+        const val TRACK_ALBUM = 2
+        const val TRACK_NUMBER = 3
+        const val TRACK_PICTURE_OFFSET = 0
+        const val TRACK_PICTURE_BYTES = 1
+        const val TRACK_DURATION_MS = 2
+
+        // summary record layout
+        const val SUMMARY_ALBUM = 0
+        const val SUMMARY_ARTIST = 1
+        const val SUMMARY_PICTURE_DOCUMENT = 2
+        const val SUMMARY_PICTURE_OFFSET = 0
+        const val SUMMARY_PICTURE_BYTES = 1
+        const val SUMMARY_TRACK_COUNT = 2
+        const val SUMMARY_DURATION_MS = 3
+        const val SUMMARY_OTHER_ALBUMS = 4
+        const val SUMMARY_OTHER_ARTISTS = 5
+        const val SUMMARY_PICTURE_SIZE = 6     // stamp of the picture's document
+        const val SUMMARY_PICTURE_MTIME = 7
+
+        // First 128 bits of the SHA-1 of the lines in order, as size and mtime
+        private fun digestOf(lines: List<String>): Stamp {
+            val sha = MessageDigest.getInstance("SHA-1")
+            for (line in lines.sorted()) {
+                sha.update(line.toByteArray())
+                sha.update(0.toByte())
+            }
+            val digest = ByteBuffer.wrap(sha.digest())
+            return Stamp(digest.long, digest.long)
+        }
+
+        fun indexFileName(treeUri: Uri): String {
+            val digest = MessageDigest.getInstance("SHA-1").digest(treeUri.toString().toByteArray())
+            return digest.joinToString("") { "%02x".format(it) } + ".idx"
+        }
+    }
+}
@@ -1,5 +1,6 @@
 package com.example.tonuinoaudiomanager
 
+import android.text.format.DateUtils
 import android.view.LayoutInflater
 import android.view.MotionEvent
 import android.view.ViewGroup
@@ -22,6 +23,7 @@ data class DirectorySummary(
     val artist: String? = null,
     val albumArt: Bitmap? = null,
     val trackCount: Int = 0,
+    val durationMs: Long = 0,
     val otherAlbumCount: Int = 0,
     val otherArtistCount: Int = 0
 )
@@ -122,11 +124,20 @@ class UsbFileAdapter(
                         baseArtist
                     }
                     val trackCount = summary.trackCount
-                    val trackCountText = binding.root.resources.getQuantityString(
+                    val trackCountOnly = binding.root.resources.getQuantityString(
                         R.plurals.folder_track_count,
                         trackCount,
                         trackCount
                     )
+                    val trackCountText = if (summary.durationMs > 0) {
+                        binding.root.context.getString(
+                            R.string.folder_track_count_duration,
+                            trackCountOnly,
+                            DateUtils.formatElapsedTime(summary.durationMs / 1000)
+                        )
+                    } else {
+                        trackCountOnly
+                    }
                     val isEmpty = trackCount == 0
                     val titleText = if (isEmpty) {
                         binding.root.context.getString(R.string.folder_empty_label)
@@ -0,0 +1,47 @@
+package com.github.axet.lamejni;
+
+import java.nio.ByteBuffer;
+
+// Writes a file on a native thread: write() copies into a ring of chunks
+// and returns, the thread writes them out in large aligned blocks. See
+// async_writer.h.
+public class AsyncWriter {
+    private long handle;
+
+    public AsyncWriter() {
+    }
+
+    // Takes fd (a detached one; it is closed by finish() or close(), also if
+    // this fails). 0, or -errno.
+    public synchronized native int open(int fd);
+
+    // 0, or -errno of an earlier failed write (the bytes are dropped then).
+    public synchronized native int write(byte[] data, int offset, int length);
+
+    // Queues an ID3v2.3 tag as Id3Writer.write() builds it. Returns the tag
+    // size, or -errno.
+    public synchronized native long writeId3Tag(String[] ids, String[] texts, String pictureMime,
+                                                int pictureFd, long[] picture, ByteBuffer pictureData);
+
+    // Preallocates bytes past what was written so far, so the file gets
+    // contiguous clusters; finish() cuts it back. 0, or -errno if the fd or
+    // filesystem cannot (nothing is wrong then).
+    public synchronized native int reserve(long bytes);
+
+    // Has data written at offset once all writes are, by finish(); for
+    // headers written as placeholders. 0, or -errno.
+    public synchronized native int patch(long offset, byte[] data);
+
+    // Waits for what is queued, fsyncs if sync and closes the fd. Returns
+    // the bytes written, or -errno of the first error.
+    public synchronized native long finish(boolean sync);
+
+    // Frees the writer; without finish() first, queued bytes are dropped.
+    public synchronized native void close();
+
+    static {
+        if (Config.natives) {
+            System.loadLibrary("lamejni");
+        }
+    }
+}
@@ -0,0 +1,33 @@
+package com.github.axet.lamejni;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+// Copies one fd to another in native code: copy_file_range or sendfile where
+// the kernel takes it, else reads and writes overlapped on two threads. See
+// file_copy.h.
+public class FileCopy {
+    // fdatasync every chunk, so PROGRESS_COPIED counts bytes on the device
+    public static final int SYNC = 1;
+
+    // progress buffer layout, longs; PROGRESS_CANCEL is written by the caller
+    public static final int PROGRESS_COPIED = 0;
+    public static final int PROGRESS_TOTAL = 1;        // -1 if unknown
+    public static final int PROGRESS_CANCEL = 2;
+    public static final int PROGRESS_LENGTH = 3;
+
+    // For copy(); read it with getLong(PROGRESS_* * 8) while the copy runs.
+    public static ByteBuffer newProgress() {
+        return ByteBuffer.allocateDirect(PROGRESS_LENGTH * 8).order(ByteOrder.nativeOrder());
+    }
+
+    // Copies inFd from its start to outFd; blocks until done. Returns the
+    // bytes copied, or -errno (-ECANCELED once PROGRESS_CANCEL is set).
+    public static native long copy(int inFd, int outFd, ByteBuffer progress, int flags);
+
+    static {
+        if (Config.natives) {
+            System.loadLibrary("lamejni");
+        }
+    }
+}
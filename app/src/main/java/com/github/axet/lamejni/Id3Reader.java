@@ -0,0 +1,31 @@
+package com.github.axet.lamejni;
+
+// Title, artist, album, track and the embedded picture of MP3 files, from
+// their ID3v2 tag with ID3v1 filling in. Reads the tag and frame headers
+// only; the picture is located in the file, not copied. See id3_reader.h.
+public class Id3Reader {
+    // read() result, TEXT_LENGTH values per file, null where missing
+    public static final int TEXT_TITLE = 0;
+    public static final int TEXT_ARTIST = 1;
+    public static final int TEXT_ALBUM = 2;
+    public static final int TEXT_TRACK = 3;             // as tagged, "3" or "3/12"
+    public static final int TEXT_PICTURE_MIME = 4;
+    public static final int TEXT_LENGTH = 5;
+
+    // pictures layout, PICTURE_LENGTH values per file
+    public static final int PICTURE_OFFSET = 0;         // of the image data, -1 if none or not stored as is
+    public static final int PICTURE_BYTES = 1;
+    public static final int PICTURE_TYPE = 2;           // APIC type, 3 is the front cover; -1 if none
+    public static final int PICTURE_LENGTH = 3;
+
+    // Reads the tags of all fds in one call; pictures must hold
+    // fds.length * PICTURE_LENGTH values. A file that cannot be read
+    // gets nulls and no picture. null if the arrays do not fit.
+    public static native String[] read(int[] fds, long[] pictures);
+
+    static {
+        if (Config.natives) {
+            System.loadLibrary("lamejni");
+        }
+    }
+}
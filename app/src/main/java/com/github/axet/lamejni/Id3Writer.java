@@ -0,0 +1,26 @@
+package com.github.axet.lamejni;
+
+import java.nio.ByteBuffer;
+
+// Writes an ID3v2.3 tag: one APIC frame, then UTF-16 text frames, no
+// padding; the last text frame ends the tag. The picture is streamed from a range of another file (as
+// Id3Reader located it) or taken from a direct buffer, never copied into
+// the Java heap. See id3_writer.h.
+public class Id3Writer {
+    public static final int MAX_FRAMES = 16;
+
+    // Writes the picture to fd if pictureMime is not null: from pictureFd,
+    // or from pictureData if pictureFd is -1, at the offset and with the
+    // bytes and type that picture holds in the Id3Reader.PICTURE_* layout.
+    // Then frames ids[i] ("TIT2", ...) with texts[i] (left out if null or
+    // empty), in order. Returns the tag size (0 if nothing was written), or
+    // -errno.
+    public static native long write(int fd, String[] ids, String[] texts, String pictureMime,
+                                    int pictureFd, long[] picture, ByteBuffer pictureData);
+
+    static {
+        if (Config.natives) {
+            System.loadLibrary("lamejni");
+        }
+    }
+}
@@ -1,6 +1,25 @@
 package com.github.axet.lamejni;
 
 public class Lame {
+    // getStats() layout: nanoseconds per encoder stage (0 unless tracing was
+    // on at open()), then counters and the encoder's memory
+    public static final int STAT_PSYMODEL_NS = 0;
+    public static final int STAT_ATH_NS = 1;
+    public static final int STAT_MDCT_NS = 2;
+    public static final int STAT_MS_NS = 3;
+    public static final int STAT_ITERATION_NS = 4;
+    public static final int STAT_BITSTREAM_NS = 5;
+    public static final int STAT_FRAMES = 6;
+    public static final int STAT_GRANULES = 7;
+    public static final int STAT_SHORT_BLOCKS = 8;
+    public static final int STAT_SILENT_FRAMES = 9;
+    public static final int STAT_BIN_SEARCH_PROBES = 10;
+    public static final int STAT_OUTER_LOOPS = 11;
+    public static final int STAT_OUTER_LOOP_TRIALS = 12;
+    public static final int STAT_MEMORY_BYTES = 13;         // held by the encoder now
+    public static final int STAT_MEMORY_PEAK_BYTES = 14;
+    public static final int STATS_LENGTH = 15;
+
     private long handle;
 
     public Lame() {
@@ -16,8 +35,34 @@ public class Lame {
 
     public native byte[] encodeInterleavedMonoFloat(float[] buffer, int offset, int length, int channels);
 
+    // Totals since open(), STATS_LENGTH values indexed by STAT_*; null if not open.
+    // close() drops them, so read them before.
+    public native long[] getStats();
+
+    // Encodes what is buffered and returns the last frames. The encoder
+    // stays open for getLametagFrame(); close() returns nothing more then.
+    public native byte[] flush();
+
+    // After flush(): the Info frame with the frame count, seek table and
+    // music CRC, to overwrite the placeholder the stream started with.
+    // null if the encoder writes none.
+    public native byte[] getLametagFrame();
+
     public native byte[] close();
 
+    // Bytes of the CBR stream open() and the encode calls would produce for
+    // samples samples per channel, Info frame included; exact unless LAME
+    // resamples. -1 if it cannot tell.
+    public static native long predictSize(int channels, int sampleRate, int bitRate, long samples);
+
+    // Opt-in tracing of the encoder stages and of these calls, per thread:
+    // ATrace sections (Perfetto) while enabled, and a ring buffer that
+    // dumpTrace() writes out as Chrome trace JSON. The encoder stages, and
+    // their times in getStats(), only of encoders opened while enabled.
+    public static native void setTracing(boolean enabled);
+
+    public static native boolean dumpTrace(String path);
+
     static {
         if (Config.natives) {
             System.loadLibrary("lamejni");
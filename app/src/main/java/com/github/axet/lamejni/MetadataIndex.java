@@ -0,0 +1,43 @@
+package com.github.axet.lamejni;
+
+// Records of what was read from the files of a drive, kept in a file across
+// app starts: per document id, VALUES numbers and STRINGS strings that mean
+// what the caller puts there. A record is found only while the file still
+// has the size and mtime it was put with. Puts replace the records of a
+// parent (directory) at a time and are written out by commit(). See
+// metadata_index.h.
+public class MetadataIndex {
+    public static final int VALUES = 8;     // per record
+    public static final int STRINGS = 4;
+
+    // put() stamps layout, STAMP_LENGTH values per record
+    public static final int STAMP_SIZE = 0;
+    public static final int STAMP_MTIME = 1;
+    public static final int STAMP_LENGTH = 2;
+
+    private long handle;
+
+    public MetadataIndex() {
+    }
+
+    // Maps the index at path; a missing or damaged file is an empty index.
+    public synchronized native boolean open(String path);
+
+    // Fills values[VALUES] and strings[STRINGS] (null where missing);
+    // false if key is not there with this size and mtime.
+    public synchronized native boolean find(String key, long size, long mtime, long[] values, String[] strings);
+
+    // Replaces the records of parent; keys.length records, laid out as above.
+    public synchronized native boolean put(String parent, String[] keys, long[] stamps, long[] values, String[] strings);
+
+    // Writes the index out if puts changed it.
+    public synchronized native boolean commit();
+
+    public synchronized native void close();
+
+    static {
+        if (Config.natives) {
+            System.loadLibrary("lamejni");
+        }
+    }
+}
@@ -0,0 +1,82 @@
+package com.github.axet.lamejni;
+
+// MP3 files as they come: validation against the player's constraints, a
+// clean frame-by-frame copy and gain changes, without decoding. See
+// mp3_stream.h.
+public class Mp3Stream {
+    // scan() layout
+    public static final int INFO_VERSION = 0;           // 1, 2 or 25 (MPEG-2.5); 0 if no frame
+    public static final int INFO_SAMPLE_RATE = 1;
+    public static final int INFO_CHANNEL_MODES = 2;     // MODE_* of all frames
+    public static final int INFO_MIN_BITRATE = 3;       // kbps
+    public static final int INFO_MAX_BITRATE = 4;
+    public static final int INFO_FRAMES = 5;
+    public static final int INFO_SAMPLES = 6;
+    public static final int INFO_AUDIO_BYTES = 7;
+    public static final int INFO_DROPPED_FRAMES = 8;
+    public static final int INFO_SKIPPED_BYTES = 9;     // tags, junk, dropped frames
+    public static final int INFO_TAG = 10;              // TAG_*
+    public static final int INFO_ENC_DELAY = 11;        // -1 if unknown
+    public static final int INFO_ENC_PADDING = 12;
+    public static final int INFO_PROBLEMS = 13;         // PROBLEM_*, 0 if the stream conforms
+    public static final int INFO_LENGTH = 14;
+
+    // index() layout
+    public static final int INDEX_VERSION = 0;
+    public static final int INDEX_SAMPLE_RATE = 1;
+    public static final int INDEX_VBR = 2;              // 1 for VBR
+    public static final int INDEX_BITRATE = 3;          // kbps, the average for VBR
+    public static final int INDEX_FRAMES = 4;
+    public static final int INDEX_SAMPLES = 5;          // less encoder delay and padding if known
+    public static final int INDEX_DURATION_MS = 6;
+    public static final int INDEX_ENC_DELAY = 7;        // -1 if unknown
+    public static final int INDEX_ENC_PADDING = 8;
+    public static final int INDEX_FROM_TAG = 9;         // 1 if counted by the Xing/Info frame
+    public static final int INDEX_LENGTH = 10;
+
+    public static final int MODE_STEREO = 1;
+    public static final int MODE_JOINT_STEREO = 2;
+    public static final int MODE_DUAL_CHANNEL = 4;
+    public static final int MODE_MONO = 8;
+
+    public static final int TAG_NONE = 0;
+    public static final int TAG_XING = 1;
+    public static final int TAG_INFO = 2;
+
+    public static final int PROBLEM_NO_AUDIO = 1;
+    public static final int PROBLEM_NOT_CBR = 2;
+    public static final int PROBLEM_SAMPLE_RATE = 4;
+    public static final int PROBLEM_CHANNEL_MODE = 8;
+    public static final int PROBLEM_BITRATE = 16;
+    public static final int PROBLEM_DAMAGED = 32;
+
+    // Reads the whole file at fd (from offset 0) and checks it; limits of 0
+    // are left out, for maxDroppedPermille -1 is. INFO_LENGTH values indexed
+    // by INFO_*, null on a read error.
+    public static native long[] scan(int fd, boolean cbr, int minSampleRate, int maxSampleRate,
+                                     int channelModes, int maxBitrate, int maxDroppedPermille);
+
+    // Duration and layout of the MP3 at fd. Trusts a Xing/Info frame count
+    // and reads only the first block then; without one a CBR stream is
+    // counted from its size, only VBR streams have all frames walked.
+    // INDEX_LENGTH values indexed by INDEX_*, null on a read error.
+    public static native long[] index(int fd);
+
+    // Writes tag (may be null) and then the frames of inFd to outFd, without
+    // the other tags, junk and broken frames. droppedFrames: INFO_DROPPED_FRAMES
+    // of a scan of inFd already done, -1 to scan it first. Bytes written, -1
+    // on error, also if inFd could not be read to its end.
+    public static native long remux(int inFd, int outFd, long droppedFrames, byte[] tag);
+
+    // Makes the MP3 at fd (open for reading and writing) louder or quieter
+    // by steps of 1.5 dB, in place and losslessly, by shifting the
+    // global_gain of every frame; a LAME Info frame is kept valid. Frames
+    // edited, -1 on error or if steps is outside -255..255.
+    public static native long gain(int fd, int steps);
+
+    static {
+        if (Config.natives) {
+            System.loadLibrary("lamejni");
+        }
+    }
+}